@@ -70,6 +70,8 @@ ATTR *atr_sub_branch(ATTR *branch);
 ATTR *atr_sub_branch_prev(ATTR *branch);
 void atr_new_add(dbref thing, char const *RESTRICT atr, char const *RESTRICT s,
                  dbref player, uint32_t flags, uint8_t derefs, bool makeroots);
+void atr_append(dbref thing, char const *RESTRICT atr, char const *RESTRICT s,
+                dbref player, uint32_t flags, uint8_t derefs);
 atr_err atr_add(dbref thing, char const *RESTRICT atr, char const *RESTRICT s,
                 dbref player, uint32_t flags);
 atr_err atr_clr(dbref thing, char const *atr, dbref player);
@@ -97,6 +99,7 @@ char const *convert_atr(int oldatr);
 int atr_single_match_r(ATTR *ptr, int flag_mask, int end, const char *input,
                        char *args[], char *match_space, int match_space_len,
                        char cmd_buff[], PE_REGS *pe_regs);
+void atr_comm_index_reset(void);
 int atr_comm_match(dbref thing, dbref player, int type, int end,
                    char const *str, int just_match, int check_locks,
                    char *atrname, char **abp, int show_child, dbref *errobj,
@@ -122,6 +125,8 @@ bool can_edit_attr(dbref player, dbref thing, const char *attrname);
 const char *atr_get_compressed_data(ATTR *atr);
 char *atr_value(ATTR *atr);
 char *safe_atr_value(ATTR *atr, char *check) __attribute_malloc__;
+void atr_cache_forget(chunk_reference_t ref);
+void atr_cache_stats(dbref player);
 
 void unanchored_regexp_attr_check(dbref thing, ATTR *atr, dbref player);
 
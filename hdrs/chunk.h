@@ -12,6 +12,8 @@ typedef uintptr_t chunk_reference_t;
 #define NULL_CHUNK_REFERENCE 0
 
 chunk_reference_t chunk_create(char const *data, uint16_t len, uint8_t derefs);
+void chunk_bulk_begin(void);
+void chunk_bulk_end(void);
 void chunk_delete(chunk_reference_t reference);
 uint16_t chunk_fetch(chunk_reference_t reference, char *buffer,
                      uint16_t buffer_len);
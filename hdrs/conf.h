@@ -163,6 +163,8 @@ struct options_table {
   int use_ws;                   /**< True to enable websockets */
   char ws_url[FILE_PATH_LEN];   /**< path to recognize as websocket one in HTTP
                                    requests. */
+  int ws_deflate;          /**< Should we offer permessage-deflate? */
+  int ws_deflate_takeover; /**< Keep deflate context between messages? */
   char input_db[FILE_PATH_LEN]; /**< Name of the input database file */
   char output_db[FILE_PATH_LEN]; /**< Name of the output database file */
   char crash_db[FILE_PATH_LEN];  /**< Name of the panic database file */
@@ -196,11 +198,15 @@ struct options_table {
   int starting_money; /**< Number of pennies for newly created players */
   int starting_quota; /**< Object quota for newly created players */
   int player_queue_limit; /**< Maximum commands a player can queue at once */
-  int queue_chunk;   /**< Number of commands run from queue when no input from
-                        sockets is waiting */
-  int func_nest_lim; /**< Maximum function recursion depth */
-  int func_invk_lim; /**< Maximum number of function invocations */
-  int call_lim;      /**< Maximum parser calls allowed in a queue cycle */
+  int queue_chunk;      /**< Number of commands run from queue when no input
+                           from sockets is waiting */
+  int queue_chunk_time; /**< Milliseconds queue_chunk commands may take */
+  int func_nest_lim;    /**< Maximum function recursion depth */
+  int func_invk_lim;    /**< Maximum number of function invocations */
+  int call_lim;         /**< Maximum parser calls allowed in a queue cycle */
+  int regexp_cache_memory; /**< Bytes of compiled regexps to keep cached */
+  int attribute_cache_memory; /**< Bytes of uncompressed attribute values to
+                                 keep cached */
   char log_wipe_passwd[256];  /**< Password for logwipe command */
   char money_singular[32];    /**< Currency unit name, singular */
   char money_plural[32];      /**< Currency unit name, plural */
@@ -255,6 +261,7 @@ struct options_table {
   dbref base_room;    /**< Room which floating checks consider as the base */
   dbref default_home; /**< Home for the homeless */
   int use_dns;        /**< Should we use DNS lookups? */
+  int mccp;           /**< Should we offer MCCP compression? */
   int safer_ufun;     /**< Should we require security for ufun calls? */
   char dump_warning_1min[256]; /**< 1 minute nonforking dump warning message */
   char dump_warning_5min[256]; /**< 5 minute nonforking dump warning message */
@@ -289,12 +296,14 @@ struct options_table {
     zone_control; /**< Are only ZMPs allowed to determine zone-based control? */
   int link_to_object; /**< Can exits be linked to objects? */
   int owner_queues;   /**< Are queues tracked by owner or individual object? */
+  int queue_sql_mirror; /**< Copy queue counts into the sqlite objects table? */
   int wiz_noaenter;   /**< Do DARK wizards trigger aenters? */
   char ip_addr[64];   /**< What ip address should the server bind to? */
   char ssl_ip_addr[64];   /**< What ip address should the server bind to? */
   int player_name_spaces; /**< Can players have multiword names? */
   int max_aliases;        /**< Maximum allowed aliases per player */
   int forking_dump;       /**< Should we fork to dump? */
+  int binary_dump;        /**< Save binary snapshots instead of text? */
   int restrict_building;  /**< Is the builder power required to build? */
   int free_objects; /**< If builder power is required, can you create without
                        it? */
@@ -341,6 +350,7 @@ struct options_table {
   int chunk_cache_memory;     /**< Memory to use for the attribute cache */
   int chunk_migrate_amount;   /**< Number of attrs to migrate each second */
   char attr_compression[256]; /**< How to compress attribute text in-memory */
+  char zstd_dictionary[FILE_PATH_LEN]; /**< Where to keep the zstd dictionary */
   int read_remote_desc; /**< Can players read DESCRIBE attribute remotely? */
   char ssl_private_key_file[FILE_PATH_LEN]; /**< File to load the server's key
                                                from */
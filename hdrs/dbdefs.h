@@ -57,6 +57,10 @@ extern dbref first_free; /* pointer to free list */
 
 #define Pennies(thing) (db[thing].penn)
 
+/* Number of queue entries charged to an object. Kept in its own array
+ * rather than struct object so the queue code touches less memory. */
+#define QueueCount(x) (db_queue[(x)])
+
 #define Parent(x) (db[(x)].parent)
 #define Powers(x) (db[(x)].powers)
 
@@ -239,6 +243,12 @@ extern dbref first_free; /* pointer to free list */
  * Other db stuff
  */
 
+/** A slot of transient per-object data. See set_objdata(). */
+struct objdata_slot {
+  int key;    /**< Interned key id */
+  void *data; /**< The data */
+};
+
 /** An object in the database.
  *
  */
@@ -269,13 +279,15 @@ struct object {
    * For other objects, the time/date of last modification to its attributes.
    */
   time_t modification_time;
-  int attrcount;           /**< Number of attribs on the object */
-  int attrcap;             /**< Size of the attribute array */
-  int type;                /**< Object's type */
-  object_flag_type flags;  /**< Pointer to flag bit array */
-  object_flag_type powers; /**< Pointer to power bit array */
-  struct lock_list *locks; /**< list of locks set on the object */
-  ALIST *list;             /**< list of attributes on the object */
+  int attrcount;                /**< Number of attribs on the object */
+  int attrcap;                  /**< Size of the attribute array */
+  int type;                     /**< Object's type */
+  object_flag_type flags;       /**< Pointer to flag bit array */
+  object_flag_type powers;      /**< Pointer to power bit array */
+  struct lock_list *locks;      /**< list of locks set on the object */
+  ALIST *list;                  /**< list of attributes on the object */
+  struct objdata_slot *objdata; /**< Transient data set by set_objdata() */
+  int objdatacount;             /**< Number of objdata slots in use */
 };
 
 /** A structure to hold database statistics.
@@ -292,6 +304,7 @@ struct db_stat_info {
 };
 
 extern struct object *db;
+extern int *db_queue;
 extern dbref db_top;
 
 void init_sqlite_db();
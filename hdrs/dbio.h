@@ -19,23 +19,37 @@
 
 extern jmp_buf db_err;
 
+struct mapped_file;
+
+/** A database file being read from memory, usually a mapped file. */
+struct pennfile_mem {
+  const char *data;       /**< Contents of the file */
+  size_t len;             /**< Length of the contents */
+  size_t pos;             /**< Offset of the next character to read */
+  struct mapped_file *map; /**< The mapping to undo on close, or NULL */
+};
+
 typedef struct pennfile {
-  enum { PFT_FILE, PFT_PIPE, PFT_GZFILE } type;
+  enum { PFT_FILE, PFT_PIPE, PFT_GZFILE, PFT_MEMORY } type;
   union {
     FILE *f;
 #ifdef HAVE_LIBZ
     gzFile g;
 #endif
+    struct pennfile_mem m;
   } handle;
 } PENNFILE;
 
 PENNFILE *penn_fopen(const char *, const char *);
+PENNFILE *penn_mapopen(const char *);
 void penn_fclose(PENNFILE *);
 
 int penn_fgetc(PENNFILE *);
 char *penn_fgets(char *, int, PENNFILE *);
+size_t penn_fread(void *, size_t, PENNFILE *);
 int penn_fputc(int, PENNFILE *);
 int penn_fputs(const char *, PENNFILE *);
+void penn_fwrite(const void *, size_t, PENNFILE *);
 int penn_fprintf(PENNFILE *, const char *fmt, ...)
   __attribute__((__format__(__printf__, 2, 3)));
 int penn_ungetc(int, PENNFILE *);
@@ -53,6 +67,7 @@ void db_write_labeld_uint32(PENNFILE *, char const *, uint32_t);
 void db_write_labeled_dbref(PENNFILE *f, char const *label, dbref value);
 
 dbref db_write(PENNFILE *f, int flag);
+dbref db_write_snapshot(PENNFILE *f);
 int db_paranoid_write(PENNFILE *f, int flag);
 
 /* Input functions */
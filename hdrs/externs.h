@@ -33,6 +33,7 @@ const char *sockset(DESC *d, char *name, char *val);
 const char *sockset_show(DESC *d, char *nl);
 
 DESC *player_desc(dbref player);   /* find descriptors */
+DESC *player_descs(dbref player);  /* find descriptors */
 DESC *inactive_desc(dbref player); /* find descriptors */
 DESC *port_desc(int port);         /* find descriptors */
 void WIN32_CDECL flag_broadcast(const char *flag1, const char *flag2,
@@ -70,6 +71,7 @@ dbref guest_to_connect(dbref player);
 void dump_reboot_db(void);
 void close_ssl_connections(void);
 DESC *least_idle_desc(dbref player, int priv);
+void desc_update_poll(DESC *d);
 int least_idle_time(dbref player);
 int least_idle_time_priv(dbref player);
 int most_conn_time(dbref player);
@@ -86,20 +88,23 @@ void send_oob(DESC *d, char *package, cJSON *data);
 
 /* sql.c */
 void sql_shutdown(void);
+int sql_async_fd(void);
+void sql_async_ready(void);
 
 /* From command.c */
 void generic_command_failure(dbref executor, dbref enactor, char *string,
                              MQUE *queue_entry);
 
 /* From compress.c */
-/* Define this to get some statistics on the attribute compression
- * in @stats/tables. Only for word-based compression (COMPRESSION_TYPE 3 or 4)
+/* Define this to get more statistics on word-based attribute
+ * compression in @stats/tables.
  */
 /* #define COMP_STATS /* */
 
 bool init_compress(PENNFILE *);
 char *safe_uncompress(char const *) __attribute_malloc__;
 char *text_uncompress(char const *);
+void compress_stats(dbref player);
 char *text_compress(char const *) __attribute_malloc__;
 #define compress text_compress
 #define uncompress text_uncompress
@@ -209,6 +214,7 @@ void run_http_command(dbref player, int port, char *method,
 void dequeue_semaphores(dbref thing, char const *aname, int count, int all,
                         int drain);
 void shutdown_queues(void);
+void free_owner_queue(dbref owner);
 
 /* From create.c */
 dbref do_dig(dbref player, const char *name, char **argv, int tport,
@@ -313,7 +319,7 @@ bool is_good_number(NVAL val);
 /* From plyrlist.c */
 void clear_players(void);
 void add_player(dbref player);
-void add_player_alias(dbref player, const char *alias, bool intransaction);
+void add_player_alias(dbref player, const char *alias);
 void delete_player(dbref player);
 void reset_player_list(dbref player, const char *name, const char *alias);
 
@@ -442,6 +448,7 @@ const char *accented_name(dbref thing);
 /* From utils.c */
 void parse_attrib(dbref player, char *str, dbref *thing, ATTR **attrib);
 uint64_t now_msecs(); /* current milliseconds */
+uint64_t mono_usecs(void); /* monotonic microseconds */
 #define SECS_TO_MSECS(x) ((x) *1000UL)
 #ifdef WIN32
 void penn_gettimeofday(struct timeval *now); /* For platform agnosticism */
@@ -542,6 +549,7 @@ bool quick_regexp_match(const char *restrict s, const char *restrict d, bool cs,
                         const char **report_err);
 bool qcomp_regexp_match(const pcre2_code *re, pcre2_match_data *md,
                         const char *s, PCRE2_SIZE);
+void re_cache_stats(dbref player);
 /** Default (case-insensitive) local wildcard match */
 #define local_wild_match(s, d, p) local_wild_match_case(s, d, 0, p)
 
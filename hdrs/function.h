@@ -101,6 +101,7 @@ void do_userfn(char *buff, char **bp, dbref obj, ATTR *attrib, int nargs,
                NEW_PE_INFO *pe_info, int extra_flags);
 
 FUN *func_hash_lookup(const char *name);
+FUN *func_hash_lookup_upper(const char *name);
 FUN *builtin_func_hash_lookup(const char *name);
 int check_func(dbref player, FUN *fp);
 int restrict_function(const char *name, const char *restriction);
@@ -257,6 +257,7 @@ void sq_cancel(struct squeue *sq);
 bool sq_run_one(void);
 bool sq_run_all(void);
 uint64_t sq_msecs_till_next(void);
+void sq_stats(dbref player);
 void init_sys_events(void);
 #define sq_register_in(n, f, d, ev)                                            \
   sq_register_in_msec(SECS_TO_MSECS(n), f, d, ev)
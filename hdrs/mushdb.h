@@ -193,5 +193,7 @@ bool unfindable(dbref);
 #define RDBF_SLAVE_FD 0x80
 #define RDBF_WEBSOCKET_FRAME 0x100
 #define RDBF_CONNLOG_ID 0x200
+#define RDBF_MCCP 0x400
+#define RDBF_WS_DEFLATE 0x800
 
 #endif /* __DB_H */
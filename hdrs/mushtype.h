@@ -124,6 +124,10 @@ typedef struct _pe_regs_ {
   int qcount;             /**< Q-register count, including inherited
                            * registers. */
   PE_REG_VAL *vals;       /**< The register values */
+  int valtypes;           /**< Types of the values set since the last clear */
+  PE_REG_VAL **index;     /**< Hash index of vals, built for big levels */
+  int index_size;         /**< Number of slots in index, a power of 2 */
+  int index_used;         /**< Number of vals in index */
   const char *name;       /**< For debugging */
 } PE_REGS;
 
@@ -166,15 +170,19 @@ struct mque {
 
   PE_REGS *regvals; /**< Queue-specific PE_REGS for inplace queues. */
 
-  MQUE *inplace; /**< Queue entry to run, either via \@include or \@break,
-                    \@foo/inplace, etc */
-  MQUE *next;    /**< The next queue entry in the linked list */
+  MQUE *inplace;  /**< Queue entry to run, either via \@include or \@break,
+                     \@foo/inplace, etc */
+  MQUE *next;     /**< The next queue entry in the linked list */
+  MQUE *sem_prev; /**< The previous entry on the semaphore queue */
 
   char
     *action_list; /**< The action list of commands to run in this queue entry */
-  time_t
-    wait_until; /**< Time (epoch in seconds) this \@wait'd queue entry runs */
-  uint32_t pid; /**< This queue's process id */
+  uint64_t wait_until; /**< Time (epoch in milliseconds) this \@wait'd queue
+                          entry runs */
+  uint64_t wait_seq;   /**< Tie-breaker for entries with the same wait_until */
+  int wait_slot;       /**< Index in the wait or semaphore timeout heap, or -1 */
+  uint64_t queued_at;  /**< Monotonic usecs when put on the run queue */
+  uint32_t pid;        /**< This queue's process id */
 
   int queue_type; /**< The type of queue entry, bitwise QUEUE_* values */
   int port; /**< The port/descriptor the command came from, or 0 for queue entry
@@ -187,13 +195,24 @@ struct mque {
 typedef struct attr ATTR;
 typedef ATTR ALIST;
 
+/** Rendered output text shared by the queues of every descriptor it
+ * was sent to. It's never changed once made, and is freed when the
+ * last reference goes.
+ */
+struct text_share {
+  int refcount; /**< Number of references to the text */
+  int len;      /**< Length of the text */
+  char *text;   /**< The text */
+};
+
 /** A text block
  */
 struct text_block {
-  int nchars;             /**< Number of characters in the block */
-  struct text_block *nxt; /**< Pointer to next block in queue */
-  char *start;            /**< Start of text */
-  char *buf;              /**< Current position in text */
+  int nchars;               /**< Number of characters in the block */
+  struct text_block *nxt;   /**< Pointer to next block in queue */
+  char *start;              /**< Start of text */
+  char *buf;                /**< Text owned by the block, or NULL if shared */
+  struct text_share *share; /**< Shared text start points into, or NULL */
 };
 /** A queue of text blocks.
  */
@@ -259,6 +278,11 @@ struct text_queue {
 /* Socket ignores command input quota */
 #define CONN_NOQUOTA   0x100000
 
+/** Output is compressed with MCCP2 */
+#define CONN_MCCP2 0x200000
+/** Input is compressed with MCCP3 */
+#define CONN_MCCP3 0x400000
+
 /* Flag for WebSocket client. */
 #define CONN_WEBSOCKETS_REQUEST 0x10000000
 #define CONN_WEBSOCKETS 0x20000000
@@ -289,11 +313,12 @@ typedef enum conn_status {
 typedef bool (*sq_func)(void *);
 /** System queue event */
 struct squeue {
-  sq_func fun;         /** Function to run */
-  void *data;          /** Data to pass to function, or NULL */
-  uint64_t when;       /** When to run the function, in milliseconds. */
-  char *event;         /** Softcode Event name to trigger, or NULL if none */
-  struct squeue *next; /** Pointer to next squeue event in linked list */
+  sq_func fun;   /** Function to run */
+  void *data;    /** Data to pass to function, or NULL */
+  uint64_t when; /** When to run the function, in milliseconds. */
+  uint64_t seq;  /** Order of registration, to break ties in when */
+  char *event;   /** Softcode Event name to trigger, or NULL if none */
+  int slot;      /** Position in the system queue heap */
 };
 
 /**< Have we used too much CPU? */
@@ -349,6 +374,7 @@ struct descriptor_data {
   int hide;       /**< Hide status */
   uint32_t conn_flags; /**< Flags of connection (telnet status, etc.) */
   struct descriptor_data *next; /**< Next descriptor in linked list */
+  struct descriptor_data *next_for_player; /**< Next DESC of same player */
   unsigned long input_chars;    /**< Characters received */
   unsigned long output_chars;   /**< Characters sent */
   int width;                    /**< Screen width */
@@ -363,6 +389,9 @@ struct descriptor_data {
   const char *close_reason; /**< Why is this socket being closed? */
   dbref closer;             /**< Who closed this socket? */
   struct http_request *http_request;
+  int poll_events; /**< Events the socket is registered for with epoll */
+  struct mccp_state *mccp; /**< Compression streams, or NULL */
+  struct ws_deflate *ws_deflate; /**< permessage-deflate streams, or NULL */
 };
 
 enum json_type {
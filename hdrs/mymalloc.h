@@ -72,6 +72,8 @@ struct slab_stats {
   int under75;
   int under50;
   int under25;
+  unsigned long served;     /**< Objects handed out since creation */
+  unsigned long pages_made; /**< Calls to malloc() since creation */
 };
 void slab_describe(const slab *sl, struct slab_stats *stats);
 
@@ -18,4 +18,21 @@ extern pcre2_compile_context *re_compile_ctx;
 extern pcre2_match_context *re_match_ctx;
 extern pcre2_convert_context *glob_convert_ctx;
 
+struct re_cache_entry;
+
+/** A compiled regexp borrowed from the regexp cache.
+ * Give it back with re_cache_release() when done matching.
+ */
+struct re_cache_ref {
+  pcre2_code *re;               /**< The compiled regexp */
+  pcre2_match_data *md;         /**< Match data for re */
+  struct re_cache_entry *entry; /**< Cache entry re belongs to */
+};
+
+bool re_cache_get(struct re_cache_ref *ref, const char *pattern,
+                  uint32_t flags, int *errcode);
+bool re_cache_get_glob(struct re_cache_ref *ref, const char *glob,
+                       uint32_t flags, int *errcode);
+void re_cache_release(struct re_cache_ref *ref);
+
 #endif /* End of mypcre.h */
@@ -115,5 +115,7 @@ extern BOOL GetErrorMessage(const DWORD dwError, LPTSTR lpszError,
 #define TN_GMCP                                                                \
   201 /**< Generic MUD Communication Protocol; see                             \
          http://www.gammon.com.au/gmcp */
+#define TN_MCCP2 86 /**< Compress output (MUD Client Compression Protocol v2) */
+#define TN_MCCP3 87 /**< Client compresses input (MCCP v3) */
 
 #endif /* MYSOCKET_H */
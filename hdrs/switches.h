@@ -8,190 +8,191 @@
 #define SWITCH_ALL 5
 #define SWITCH_ALLOCATIONS 6
 #define SWITCH_ANY 7
-#define SWITCH_ATTRIBS 8
-#define SWITCH_BAN 9
-#define SWITCH_BEFORE 10
-#define SWITCH_BRIEF 11
-#define SWITCH_BUFFER 12
-#define SWITCH_BUILTIN 13
-#define SWITCH_CHECK 14
-#define SWITCH_CHOWN 15
-#define SWITCH_CHUNKS 16
-#define SWITCH_CLEAR 17
-#define SWITCH_CLEARREGS 18
-#define SWITCH_CLONE 19
-#define SWITCH_CMD 20
-#define SWITCH_COLNAMES 21
-#define SWITCH_COMBINE 22
-#define SWITCH_COMMANDS 23
-#define SWITCH_CONN 24
-#define SWITCH_CONNECT 25
-#define SWITCH_CONNECTED 26
-#define SWITCH_CONTENTS 27
-#define SWITCH_COUNT 28
-#define SWITCH_CREATE 29
-#define SWITCH_CSTATS 30
-#define SWITCH_DB 31
-#define SWITCH_DEBUG 32
-#define SWITCH_DECOMPILE 33
-#define SWITCH_DELETE 34
-#define SWITCH_DELIMIT 35
-#define SWITCH_DESCRIBE 36
-#define SWITCH_DESTROY 37
-#define SWITCH_DISABLE 38
-#define SWITCH_DOWN 39
-#define SWITCH_DSTATS 40
-#define SWITCH_EMIT 41
-#define SWITCH_ENABLE 42
-#define SWITCH_ENUM 43
-#define SWITCH_EQSPLIT 44
-#define SWITCH_ERR 45
-#define SWITCH_EXITS 46
-#define SWITCH_EXTEND 47
-#define SWITCH_FILE 48
-#define SWITCH_FIRST 49
-#define SWITCH_FLAGS 50
-#define SWITCH_FOLDERS 51
-#define SWITCH_FORWARD 52
-#define SWITCH_FREESPACE 53
-#define SWITCH_FSTATS 54
-#define SWITCH_FULL 55
-#define SWITCH_FUNCTIONS 56
-#define SWITCH_FWD 57
-#define SWITCH_GAG 58
-#define SWITCH_GENERATE 59
-#define SWITCH_GLOBALS 60
-#define SWITCH_HEADER 61
-#define SWITCH_HERE 62
-#define SWITCH_HIDE 63
-#define SWITCH_IFELSE 64
-#define SWITCH_IGNORE 65
-#define SWITCH_IGSWITCH 66
-#define SWITCH_ILIST 67
-#define SWITCH_INLINE 68
-#define SWITCH_INPLACE 69
-#define SWITCH_INSIDE 70
-#define SWITCH_INVENTORY 71
-#define SWITCH_IPRINT 72
-#define SWITCH_JOIN 73
-#define SWITCH_JSON 74
-#define SWITCH_LEAVE 75
-#define SWITCH_LETTER 76
-#define SWITCH_LIMIT 77
-#define SWITCH_LIST 78
-#define SWITCH_LOCAL 79
-#define SWITCH_LOCALIZE 80
-#define SWITCH_LOCKS 81
-#define SWITCH_LOWERCASE 82
-#define SWITCH_LSARGS 83
-#define SWITCH_MATCH 84
-#define SWITCH_ME 85
-#define SWITCH_MEMBERS 86
-#define SWITCH_MOD 87
-#define SWITCH_MOGRIFIER 88
-#define SWITCH_MORTAL 89
-#define SWITCH_MOTD 90
-#define SWITCH_MUTE 91
-#define SWITCH_NAME 92
-#define SWITCH_NO 93
-#define SWITCH_NOBREAK 94
-#define SWITCH_NOCASE 95
-#define SWITCH_NOEVAL 96
-#define SWITCH_NOFLAGCOPY 97
-#define SWITCH_NOFORK 98
-#define SWITCH_NOISY 99
-#define SWITCH_NOPARSE 100
-#define SWITCH_NOSIG 101
-#define SWITCH_NOSPACE 102
-#define SWITCH_NOSPOOF 103
-#define SWITCH_NOTIFY 104
-#define SWITCH_NUKE 105
-#define SWITCH_OEMIT 106
-#define SWITCH_OFF 107
-#define SWITCH_ON 108
-#define SWITCH_OPAQUE 109
-#define SWITCH_OUTSIDE 110
-#define SWITCH_OVERRIDE 111
-#define SWITCH_PAGING 112
-#define SWITCH_PANIC 113
-#define SWITCH_PARANOID 114
-#define SWITCH_PARENT 115
-#define SWITCH_PLAYER 116
-#define SWITCH_PLAYERS 117
-#define SWITCH_PORT 118
-#define SWITCH_POST 119
-#define SWITCH_POWERS 120
-#define SWITCH_PREFIX 121
-#define SWITCH_PRESERVE 122
-#define SWITCH_PRINT 123
-#define SWITCH_PRIVS 124
-#define SWITCH_PURGE 125
-#define SWITCH_PUT 126
-#define SWITCH_QUERY 127
-#define SWITCH_QUEUED 128
-#define SWITCH_QUICK 129
-#define SWITCH_QUIET 130
-#define SWITCH_READ 131
-#define SWITCH_REBOOT 132
-#define SWITCH_RECALL 133
-#define SWITCH_REGEXP 134
-#define SWITCH_REGIONS 135
-#define SWITCH_REGISTER 136
-#define SWITCH_REMIT 137
-#define SWITCH_REMOVE 138
-#define SWITCH_RENAME 139
-#define SWITCH_RESTART 140
-#define SWITCH_RESTORE 141
-#define SWITCH_RESTRICT 142
-#define SWITCH_RETRACT 143
-#define SWITCH_RETROACTIVE 144
-#define SWITCH_REVIEW 145
-#define SWITCH_ROOM 146
-#define SWITCH_ROOMS 147
-#define SWITCH_ROTATE 148
-#define SWITCH_RSARGS 149
-#define SWITCH_RSNOPARSE 150
-#define SWITCH_SAVE 151
-#define SWITCH_SEARCH 152
-#define SWITCH_SEE 153
-#define SWITCH_SEEFLAG 154
-#define SWITCH_SELF 155
-#define SWITCH_SEND 156
-#define SWITCH_SET 157
-#define SWITCH_SETQ 158
-#define SWITCH_SILENT 159
-#define SWITCH_SKIPDEFAULTS 160
-#define SWITCH_SPEAK 161
-#define SWITCH_SPOOF 162
-#define SWITCH_STATS 163
-#define SWITCH_STATUS 164
-#define SWITCH_SUMMARY 165
-#define SWITCH_TABLES 166
-#define SWITCH_TAG 167
-#define SWITCH_TELEPORT 168
-#define SWITCH_TF 169
-#define SWITCH_THINGS 170
-#define SWITCH_TITLE 171
-#define SWITCH_TRACE 172
-#define SWITCH_TRIM 173
-#define SWITCH_TYPE 174
-#define SWITCH_UNCLEAR 175
-#define SWITCH_UNCOMBINE 176
-#define SWITCH_UNFOLDER 177
-#define SWITCH_UNGAG 178
-#define SWITCH_UNHIDE 179
-#define SWITCH_UNMUTE 180
-#define SWITCH_UNREAD 181
-#define SWITCH_UNTAG 182
-#define SWITCH_UNTIL 183
-#define SWITCH_URGENT 184
-#define SWITCH_USEFLAG 185
-#define SWITCH_WHAT 186
-#define SWITCH_WHO 187
-#define SWITCH_WILD 188
-#define SWITCH_WIPE 189
-#define SWITCH_WIZ 190
-#define SWITCH_WIZARD 191
-#define SWITCH_YES 192
-#define SWITCH_ZONE 193
+#define SWITCH_ASYNC 8
+#define SWITCH_ATTRIBS 9
+#define SWITCH_BAN 10
+#define SWITCH_BEFORE 11
+#define SWITCH_BRIEF 12
+#define SWITCH_BUFFER 13
+#define SWITCH_BUILTIN 14
+#define SWITCH_CHECK 15
+#define SWITCH_CHOWN 16
+#define SWITCH_CHUNKS 17
+#define SWITCH_CLEAR 18
+#define SWITCH_CLEARREGS 19
+#define SWITCH_CLONE 20
+#define SWITCH_CMD 21
+#define SWITCH_COLNAMES 22
+#define SWITCH_COMBINE 23
+#define SWITCH_COMMANDS 24
+#define SWITCH_CONN 25
+#define SWITCH_CONNECT 26
+#define SWITCH_CONNECTED 27
+#define SWITCH_CONTENTS 28
+#define SWITCH_COUNT 29
+#define SWITCH_CREATE 30
+#define SWITCH_CSTATS 31
+#define SWITCH_DB 32
+#define SWITCH_DEBUG 33
+#define SWITCH_DECOMPILE 34
+#define SWITCH_DELETE 35
+#define SWITCH_DELIMIT 36
+#define SWITCH_DESCRIBE 37
+#define SWITCH_DESTROY 38
+#define SWITCH_DISABLE 39
+#define SWITCH_DOWN 40
+#define SWITCH_DSTATS 41
+#define SWITCH_EMIT 42
+#define SWITCH_ENABLE 43
+#define SWITCH_ENUM 44
+#define SWITCH_EQSPLIT 45
+#define SWITCH_ERR 46
+#define SWITCH_EXITS 47
+#define SWITCH_EXTEND 48
+#define SWITCH_FILE 49
+#define SWITCH_FIRST 50
+#define SWITCH_FLAGS 51
+#define SWITCH_FOLDERS 52
+#define SWITCH_FORWARD 53
+#define SWITCH_FREESPACE 54
+#define SWITCH_FSTATS 55
+#define SWITCH_FULL 56
+#define SWITCH_FUNCTIONS 57
+#define SWITCH_FWD 58
+#define SWITCH_GAG 59
+#define SWITCH_GENERATE 60
+#define SWITCH_GLOBALS 61
+#define SWITCH_HEADER 62
+#define SWITCH_HERE 63
+#define SWITCH_HIDE 64
+#define SWITCH_IFELSE 65
+#define SWITCH_IGNORE 66
+#define SWITCH_IGSWITCH 67
+#define SWITCH_ILIST 68
+#define SWITCH_INLINE 69
+#define SWITCH_INPLACE 70
+#define SWITCH_INSIDE 71
+#define SWITCH_INVENTORY 72
+#define SWITCH_IPRINT 73
+#define SWITCH_JOIN 74
+#define SWITCH_JSON 75
+#define SWITCH_LEAVE 76
+#define SWITCH_LETTER 77
+#define SWITCH_LIMIT 78
+#define SWITCH_LIST 79
+#define SWITCH_LOCAL 80
+#define SWITCH_LOCALIZE 81
+#define SWITCH_LOCKS 82
+#define SWITCH_LOWERCASE 83
+#define SWITCH_LSARGS 84
+#define SWITCH_MATCH 85
+#define SWITCH_ME 86
+#define SWITCH_MEMBERS 87
+#define SWITCH_MOD 88
+#define SWITCH_MOGRIFIER 89
+#define SWITCH_MORTAL 90
+#define SWITCH_MOTD 91
+#define SWITCH_MUTE 92
+#define SWITCH_NAME 93
+#define SWITCH_NO 94
+#define SWITCH_NOBREAK 95
+#define SWITCH_NOCASE 96
+#define SWITCH_NOEVAL 97
+#define SWITCH_NOFLAGCOPY 98
+#define SWITCH_NOFORK 99
+#define SWITCH_NOISY 100
+#define SWITCH_NOPARSE 101
+#define SWITCH_NOSIG 102
+#define SWITCH_NOSPACE 103
+#define SWITCH_NOSPOOF 104
+#define SWITCH_NOTIFY 105
+#define SWITCH_NUKE 106
+#define SWITCH_OEMIT 107
+#define SWITCH_OFF 108
+#define SWITCH_ON 109
+#define SWITCH_OPAQUE 110
+#define SWITCH_OUTSIDE 111
+#define SWITCH_OVERRIDE 112
+#define SWITCH_PAGING 113
+#define SWITCH_PANIC 114
+#define SWITCH_PARANOID 115
+#define SWITCH_PARENT 116
+#define SWITCH_PLAYER 117
+#define SWITCH_PLAYERS 118
+#define SWITCH_PORT 119
+#define SWITCH_POST 120
+#define SWITCH_POWERS 121
+#define SWITCH_PREFIX 122
+#define SWITCH_PRESERVE 123
+#define SWITCH_PRINT 124
+#define SWITCH_PRIVS 125
+#define SWITCH_PURGE 126
+#define SWITCH_PUT 127
+#define SWITCH_QUERY 128
+#define SWITCH_QUEUED 129
+#define SWITCH_QUICK 130
+#define SWITCH_QUIET 131
+#define SWITCH_READ 132
+#define SWITCH_REBOOT 133
+#define SWITCH_RECALL 134
+#define SWITCH_REGEXP 135
+#define SWITCH_REGIONS 136
+#define SWITCH_REGISTER 137
+#define SWITCH_REMIT 138
+#define SWITCH_REMOVE 139
+#define SWITCH_RENAME 140
+#define SWITCH_RESTART 141
+#define SWITCH_RESTORE 142
+#define SWITCH_RESTRICT 143
+#define SWITCH_RETRACT 144
+#define SWITCH_RETROACTIVE 145
+#define SWITCH_REVIEW 146
+#define SWITCH_ROOM 147
+#define SWITCH_ROOMS 148
+#define SWITCH_ROTATE 149
+#define SWITCH_RSARGS 150
+#define SWITCH_RSNOPARSE 151
+#define SWITCH_SAVE 152
+#define SWITCH_SEARCH 153
+#define SWITCH_SEE 154
+#define SWITCH_SEEFLAG 155
+#define SWITCH_SELF 156
+#define SWITCH_SEND 157
+#define SWITCH_SET 158
+#define SWITCH_SETQ 159
+#define SWITCH_SILENT 160
+#define SWITCH_SKIPDEFAULTS 161
+#define SWITCH_SPEAK 162
+#define SWITCH_SPOOF 163
+#define SWITCH_STATS 164
+#define SWITCH_STATUS 165
+#define SWITCH_SUMMARY 166
+#define SWITCH_TABLES 167
+#define SWITCH_TAG 168
+#define SWITCH_TELEPORT 169
+#define SWITCH_TF 170
+#define SWITCH_THINGS 171
+#define SWITCH_TITLE 172
+#define SWITCH_TRACE 173
+#define SWITCH_TRIM 174
+#define SWITCH_TYPE 175
+#define SWITCH_UNCLEAR 176
+#define SWITCH_UNCOMBINE 177
+#define SWITCH_UNFOLDER 178
+#define SWITCH_UNGAG 179
+#define SWITCH_UNHIDE 180
+#define SWITCH_UNMUTE 181
+#define SWITCH_UNREAD 182
+#define SWITCH_UNTAG 183
+#define SWITCH_UNTIL 184
+#define SWITCH_URGENT 185
+#define SWITCH_USEFLAG 186
+#define SWITCH_WHAT 187
+#define SWITCH_WHO 188
+#define SWITCH_WILD 189
+#define SWITCH_WIPE 190
+#define SWITCH_WIZ 191
+#define SWITCH_WIZARD 192
+#define SWITCH_YES 193
+#define SWITCH_ZONE 194
 #endif /* SWITCHES_H */
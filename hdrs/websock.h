@@ -6,6 +6,7 @@
 #define MUSH_WEBSOCK_H
 #include "copyrite.h"
 #include "function.h"
+#include "dbio.h"
 
 #define IsWebSocket(d) ((d)->conn_flags & CONN_WEBSOCKETS)
 
@@ -24,8 +25,13 @@ int process_output(DESC *d);
 /* websock.c */
 int is_websocket(const char *command);
 int process_websocket_request(DESC *d, const char *command);
-int process_websocket_frame(DESC *d, char *tbuf1, int got);
-void to_websocket_frame(const char **bp, int *np, char channel);
+int process_websocket_frame(DESC *d, char **bufp, int got);
+void websocket_input_done(DESC *d);
+void to_websocket_frame(DESC *d, const char **bp, int *np, char channel);
+long websocket_deflate_saved(DESC *d);
+void free_websocket_deflate(DESC *d);
+void save_websocket_deflate(PENNFILE *f, DESC *d);
+int load_websocket_deflate(PENNFILE *f, DESC *d);
 
 int markup_websocket(char *buff, char **bp, char *data, int datalen, char *alt,
                      int altlen, char channel);
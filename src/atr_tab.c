@@ -506,11 +506,7 @@ check_attr_value(dbref player, const char *name, const char *value)
   /* Check for attribute limits and enums. */
   ATTR *ap;
   char *attrval;
-  pcre2_code *re;
-  pcre2_match_data *md;
   int subpatterns;
-  int errcode;
-  PCRE2_SIZE erroffset;
   char *ptr, *ptr2;
   char delim;
   int len;
@@ -537,18 +533,16 @@ check_attr_value(dbref player, const char *name, const char *value)
   }
 
   if (ap->flags & AF_RLIMIT) {
-    re = pcre2_compile((const PCRE2_UCHAR *) remove_markup(attrval, NULL),
-                       PCRE2_ZERO_TERMINATED, re_compile_flags | PCRE2_CASELESS,
-                       &errcode, &erroffset, re_compile_ctx);
-    if (!re) {
+    struct re_cache_ref rx;
+
+    if (!re_cache_get(&rx, remove_markup(attrval, NULL),
+                      re_compile_flags | PCRE2_CASELESS, NULL)) {
       return value;
     }
 
-    md = pcre2_match_data_create_from_pattern(re, NULL);
-    subpatterns = pcre2_match(re, (const PCRE2_UCHAR *) value, strlen(value), 0,
-                              re_match_flags, md, re_match_ctx);
-    pcre2_code_free(re);
-    pcre2_match_data_free(md);
+    subpatterns = pcre2_match(rx.re, (const PCRE2_UCHAR *) value, strlen(value),
+                              0, re_match_flags, rx.md, re_match_ctx);
+    re_cache_release(&rx);
 
     if (subpatterns >= 0) {
       return value;
@@ -11,7 +11,10 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <inttypes.h>
 
+#include "ansi.h"
+#include "case.h"
 #include "chunk.h"
 #include "conf.h"
 #include "dbdefs.h"
@@ -30,6 +33,7 @@
 #include "sort.h"
 #include "strtree.h"
 #include "strutil.h"
+#include "tests.h"
 
 #ifdef WIN32
 #pragma warning(disable : 4761) /* disable warning re conversion */
@@ -48,6 +52,98 @@ extern PRIV attr_privs_view[];
  */
 static char missing_name[ATTRIBUTE_NAME_LIMIT + 1];
 
+/** An uncompressed attribute value in the attribute value cache.
+ * Entries are kept in a hash table keyed on the chunk reference of the
+ * compressed value, and on a list ordered from most to least recently
+ * used. A chunk reference is forgotten when its chunk is deleted or
+ * migrated.
+ */
+struct atr_cache_entry {
+  chunk_reference_t ref;        /**< Chunk holding the compressed value */
+  size_t len;                   /**< Length of val */
+  struct atr_cache_entry *prev; /**< More recently used entry */
+  struct atr_cache_entry *next; /**< Less recently used entry */
+  char key[24];                 /**< Hash table key */
+  char val[];                   /**< Uncompressed value */
+};
+
+static HASHTAB htab_atr_values;
+static bool atr_cache_initialized = 0;
+static struct atr_cache_entry *atr_lru_head = NULL, *atr_lru_tail = NULL;
+static size_t atr_cache_bytes = 0;
+static struct {
+  uint64_t hits;      /**< Reads answered from the cache */
+  uint64_t misses;    /**< Reads that had to uncompress */
+  uint64_t evictions; /**< Entries dropped to make room */
+  uint64_t forgotten; /**< Entries dropped because their chunk went away */
+} atr_cache_stat;
+
+static void atr_cache_unlink(struct atr_cache_entry *e);
+static void atr_cache_free_entry(void *e);
+static void atr_cache_trim(void);
+static struct atr_cache_entry *atr_cache_find(chunk_reference_t ref);
+static void atr_cache_add(chunk_reference_t ref, const char *val);
+
+/** The $-command patterns on one object, for atr_comm_match() to rule
+ * the object out without looking at its attributes. Each pattern is
+ * reduced to its literal prefix, the part before any wildcard, upcased
+ * and cut to CMD_PREFIX_LEN bytes, so a command can only match an
+ * attribute if it starts with one of them. Prefixes are sorted and no
+ * prefix starts with another, so at most one can be a prefix of the
+ * command, and it's the greatest one not after it.
+ *
+ * Only the object's own attributes are summarized; atr_comm_match()
+ * checks each object in the parent chain, so parent changes and moves
+ * don't have to touch the index. Summaries are rebuilt when they're
+ * older than cmd_index_gen, which goes up whenever any $-command
+ * attribute is added, changed or removed.
+ */
+struct cmd_index {
+  uint32_t gen;     /**< cmd_index_gen when built, 0 if never */
+  bool any;         /**< A pattern could match anything */
+  int count;        /**< Number of prefixes */
+  char **prefixes;  /**< Sorted literal prefixes */
+};
+
+#define CMD_PREFIX_LEN 32 /**< Longest literal prefix kept */
+
+static struct cmd_index *cmd_index = NULL;
+static int cmd_index_size = 0;
+static uint32_t cmd_index_gen = 1;
+
+/** An attribute name met while atr_comm_match() walks up a parent
+ * chain. Names are interned in atr_names, so they're hashed and
+ * compared by address.
+ */
+struct walk_entry {
+  const char *name; /**< Interned attribute name */
+  uint32_t gen;     /**< walk_set gen when added; stale entries are empty */
+  int private_level; /**< Parent level where it's no_inherit, 0 if none */
+  uint8_t flags;     /**< WALK_SEEN, WALK_NOCMD */
+};
+
+#define WALK_SEEN 0x1  /**< Visible on an earlier object in the chain */
+#define WALK_NOCMD 0x2 /**< Masked by a no_command attribute */
+
+/** The attribute names met on one atr_comm_match() walk, in an open
+ * addressed hash table that's kept from one walk to the next. Bumping
+ * gen empties it. A lock or an inplace queue entry can call
+ * atr_comm_match() again in the middle of a walk, so each nesting
+ * depth has its own.
+ */
+struct walk_set {
+  struct walk_entry *slots; /**< Hash table */
+  uint32_t size;            /**< Number of slots, a power of two */
+  uint32_t used;            /**< Slots in use this walk */
+  uint32_t gen;             /**< Current walk */
+};
+
+#define WALK_SET_MIN 64 /**< Initial number of slots */
+
+static struct walk_set **walk_sets = NULL;
+static int walk_sets_size = 0;
+static int walk_depth = 0;
+
 /*======================================================================*/
 
 static int real_atr_clr(dbref thinking, char const *atr, dbref player,
@@ -62,7 +158,13 @@ static ATTR *atr_get_with_parent(dbref obj, char const *atrname, dbref *parent,
 static bool can_debug(dbref player, dbref victim);
 static int atr_count_helper(dbref player, dbref thing, dbref parent,
                             char const *pattern, ATTR *atr, void *args);
-static void set_cmd_flags(ATTR *a);
+static void set_cmd_flags(ATTR *a, const char *s);
+static struct walk_set *walk_set_begin(void);
+static struct walk_entry *walk_set_find(struct walk_set *ws, const char *name);
+static struct walk_entry *walk_set_add(struct walk_set *ws, const char *name);
+static void walk_set_mark(struct walk_set *ws, ATTR *ptr, bool self,
+                          uint8_t flags, int private_level);
+static NEW_PE_INFO *atr_comm_pe_info(const char *str, MQUE *from_queue);
 
 /*======================================================================*/
 
@@ -772,6 +874,8 @@ atr_new_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
     /* Duplicate, probably because of an added root attribute.  This
        happens when reading a database written with a different sort
        order than this server is using. */
+    if (AF_Command(ptr))
+      atr_comm_index_reset();
     AL_FLAGS(ptr) |= flags;
     AL_FLAGS(ptr) &= ~AF_COMMAND & ~AF_LISTEN;
     AL_CREATOR(ptr) = player;
@@ -791,7 +895,7 @@ atr_new_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
 
       ptr->data = chunk_create(t, strlen(t), derefs);
       free(t);
-      set_cmd_flags(ptr);
+      set_cmd_flags(ptr, s);
     }
     return;
   }
@@ -832,14 +936,73 @@ atr_new_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
 
     ptr->data = chunk_create(t, strlen(t), derefs);
     free(t);
-    set_cmd_flags(ptr);
+    set_cmd_flags(ptr, s);
   }
 }
 
+/** Add an attribute to the end of an object's attribute list.
+ * This is atr_new_add() for loading attributes that are already in
+ * sorted order, as in a database snapshot: one that sorts after every
+ * attribute the object has goes straight onto the end of the array,
+ * without looking for duplicates, a place to put it, or its root.
+ * Anything else, including any branch attribute, is passed on to
+ * atr_new_add(). Call attr_reserve() first to size the array. The
+ * name isn't checked with good_atr_name().
+ * \param thing object to set the attribute on.
+ * \param atr name of the attribute to set.
+ * \param s value of the attribute to set.
+ * \param player the attribute creator.
+ * \param flags bitmask of attribute flags for this attribute.
+ * \param derefs the initial deref count to use for the attribute value.
+ */
+void
+atr_append(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
+           dbref player, uint32_t flags, uint8_t derefs)
+{
+  ATTR *ptr;
+  char const *name;
+
+  if (!EMPTY_ATTRS && !*s && !(flags & AF_ROOT))
+    return;
+
+  if (strchr(atr, '`') ||
+      (AttrCount(thing) &&
+       strcmp(atr, AL_NAME(List(thing) + AttrCount(thing) - 1)) <= 0)) {
+    atr_new_add(thing, atr, s, player, flags, derefs, 1);
+    return;
+  }
+
+  if (!atr_check_capacity(thing))
+    return;
+  name = st_insert(atr, &atr_names);
+  if (!name)
+    return;
+
+  ptr = List(thing) + AttrCount(thing);
+  AL_NAME(ptr) = name;
+  AL_FLAGS(ptr) = flags & ~AF_COMMAND & ~AF_LISTEN;
+  AL_CREATOR(ptr) = player;
+  ptr->data = NULL_CHUNK_REFERENCE;
+  AttrCount(thing)++;
+
+  if (*s) {
+    char *t = compress(s);
+    if (!t)
+      return;
+
+    ptr->data = chunk_create(t, strlen(t), derefs);
+    free(t);
+    set_cmd_flags(ptr, s);
+  }
+}
+
+/* Set AF_COMMAND or AF_LISTEN on an attribute if its new value, s,
+ * is a $-command or ^-listen. Looks at the uncompressed text being
+ * stored rather than fetching it back out of the chunk. */
 static void
-set_cmd_flags(ATTR *a)
+set_cmd_flags(ATTR *a, const char *s)
 {
-  char *p = atr_value(a);
+  const char *p = s;
   int flag = AF_COMMAND;
 
   switch (*p) {
@@ -852,6 +1015,8 @@ set_cmd_flags(ATTR *a)
         p++;
       } else if (*p == ':') {
         AL_FLAGS(a) |= flag;
+        if (flag == AF_COMMAND)
+          atr_comm_index_reset();
         break;
       }
     }
@@ -994,6 +1159,8 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
   /* change owner */
   AL_CREATOR(ptr) = Owner(player);
 
+  if (AF_Command(ptr))
+    atr_comm_index_reset();
   AL_FLAGS(ptr) &= ~AF_COMMAND & ~AF_LISTEN;
 
   /* replace string with new string */
@@ -1009,7 +1176,7 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
     }
     ptr->data = chunk_create(t, strlen(t), 0);
     free(t);
-    set_cmd_flags(ptr);
+    set_cmd_flags(ptr, s);
     if (AF_Command(ptr) && AF_Regexp(ptr)) {
       unanchored_regexp_attr_check(thing, ptr, player);
     }
@@ -1356,44 +1523,26 @@ atr_iter_get(dbref player, dbref thing, const char *name, unsigned flags,
                                      : Can_Read_Attr(player, thing, ptr)))
       result = func(player, thing, NOTHING, name, ptr, args);
   } else if (AttrCount(thing)) {
-    pcre2_code *re = NULL;
-    pcre2_match_data *md = NULL;
-    int errcode;
-    PCRE2_SIZE erroffset;
+    struct re_cache_ref rx;
+    pcre2_code *re;
+    pcre2_match_data *md;
 
     if (flags & AIG_REGEX) {
-      re = pcre2_compile((const PCRE2_UCHAR *) name, len,
-                         re_compile_flags | PCRE2_CASELESS, &errcode,
-                         &erroffset, re_compile_ctx);
-      if (!re) {
+      if (!re_cache_get(&rx, name, re_compile_flags | PCRE2_CASELESS, NULL)) {
         return 0;
       }
-    } else {
+    } else if (name[len - 1] == '`') {
       /* Compile wildcard to regexp */
-      PCRE2_UCHAR *as_re = NULL;
-      PCRE2_SIZE rlen;
-      char *glob;
-
-      if (name[len - 1] == '`') {
-        glob = sqlite3_mprintf("%s*", name);
-        len += 1;
-      } else {
-        glob = sqlite3_mprintf("%s", name);
-      }
-
-      if (pcre2_pattern_convert((const PCRE2_UCHAR *) glob, len,
-                                PCRE2_CONVERT_GLOB, &as_re, &rlen,
-                                glob_convert_ctx) == 0) {
-        re = pcre2_compile(as_re, rlen, re_compile_flags | PCRE2_CASELESS,
-                           &errcode, &erroffset, re_compile_ctx);
-        pcre2_converted_pattern_free(as_re);
-      }
+      char *glob = sqlite3_mprintf("%s*", name);
+      re_cache_get_glob(&rx, glob, re_compile_flags | PCRE2_CASELESS, NULL);
       sqlite3_free(glob);
+    } else {
+      re_cache_get_glob(&rx, name, re_compile_flags | PCRE2_CASELESS, NULL);
     }
+    re = rx.re;
+    md = rx.md;
     if (re) {
       flags |= AIG_REGEX;
-      pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
-      md = pcre2_match_data_create_from_pattern(re, NULL);
     }
 
     ATTR_FOR_EACH (thing, ptr) {
@@ -1434,12 +1583,7 @@ atr_iter_get(dbref player, dbref thing, const char *name, unsigned flags,
         ptr = prev;
       }
     }
-    if (re) {
-      pcre2_code_free(re);
-    }
-    if (md) {
-      pcre2_match_data_free(md);
-    }
+    re_cache_release(&rx);
   }
 
   return result;
@@ -1530,44 +1674,26 @@ atr_iter_get_parent(dbref player, dbref thing, const char *name, unsigned flags,
   } else {
     StrTree seen;
     int parent_depth;
-    pcre2_code *re = NULL;
-    pcre2_match_data *md = NULL;
-    int errcode;
-    PCRE2_SIZE erroffset;
+    struct re_cache_ref rx;
+    pcre2_code *re;
+    pcre2_match_data *md;
 
     if (flags & AIG_REGEX) {
-      re = pcre2_compile((const PCRE2_UCHAR *) name, len,
-                         re_compile_flags | PCRE2_CASELESS, &errcode,
-                         &erroffset, re_compile_ctx);
-      if (!re) {
+      if (!re_cache_get(&rx, name, re_compile_flags | PCRE2_CASELESS, NULL)) {
         return 0;
       }
-    } else {
+    } else if (name[len - 1] == '`') {
       /* Compile wildcard to regexp */
-      PCRE2_UCHAR *as_re = NULL;
-      PCRE2_SIZE rlen;
-      char *glob;
-
-      if (name[len - 1] == '`') {
-        glob = sqlite3_mprintf("%s*", name);
-        len += 1;
-      } else {
-        glob = sqlite3_mprintf("%s", name);
-      }
-
-      if (pcre2_pattern_convert((const PCRE2_UCHAR *) glob, len,
-                                PCRE2_CONVERT_GLOB, &as_re, &rlen,
-                                glob_convert_ctx) == 0) {
-        re = pcre2_compile(as_re, rlen, re_compile_flags | PCRE2_CASELESS,
-                           &errcode, &erroffset, re_compile_ctx);
-        pcre2_converted_pattern_free(as_re);
-      }
+      char *glob = sqlite3_mprintf("%s*", name);
+      re_cache_get_glob(&rx, glob, re_compile_flags | PCRE2_CASELESS, NULL);
       sqlite3_free(glob);
+    } else {
+      re_cache_get_glob(&rx, name, re_compile_flags | PCRE2_CASELESS, NULL);
     }
+    re = rx.re;
+    md = rx.md;
     if (re) {
       flags |= AIG_REGEX;
-      pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
-      md = pcre2_match_data_create_from_pattern(re, NULL);
     }
 
     st_init(&seen, "AttrsSeenTree");
@@ -1638,12 +1764,7 @@ atr_iter_get_parent(dbref player, dbref thing, const char *name, unsigned flags,
         }
       }
     }
-    if (re) {
-      pcre2_code_free(re);
-    }
-    if (md) {
-      pcre2_match_data_free(md);
-    }
+    re_cache_release(&rx);
     st_flush(&seen);
   }
 
@@ -1671,6 +1792,8 @@ atr_free_all(dbref thing)
   }
 
   ATTR_FOR_EACH (thing, ptr) {
+    if (AF_Command(ptr))
+      atr_comm_index_reset();
     if (ptr->data)
       chunk_delete(ptr->data);
     st_delete(AL_NAME(ptr), &atr_names);
@@ -1807,7 +1930,7 @@ atr_single_match_r(ATTR *ptr, int flag_mask, int end, const char *input,
   i++;
 
   if (cmd_buff) {
-    strncpy(cmd_buff, atrval + i, BUFFER_LEN);
+    mush_strncpy(cmd_buff, atrval + i, BUFFER_LEN);
   }
 
   if (AF_Regexp(ptr)) {
@@ -1825,6 +1948,345 @@ atr_single_match_r(ATTR *ptr, int flag_mask, int end, const char *input,
   return match_found;
 }
 
+/** Note that a $-command attribute has been added, changed or removed,
+ * so the $-command index has to be rebuilt.
+ */
+void
+atr_comm_index_reset(void)
+{
+  if (++cmd_index_gen == 0)
+    cmd_index_gen = 1;
+}
+
+/* Copy the literal prefix of a glob pattern, upcased, into buf. */
+static void
+cmd_pattern_prefix(const char *pat, char *buf)
+{
+  int n = 0;
+
+  for (; *pat && *pat != '*' && *pat != '?' && n < CMD_PREFIX_LEN; pat++) {
+    if (*pat == '\\') {
+      if (!pat[1])
+        break;
+      pat++;
+    }
+    buf[n++] = UPCASE(*pat);
+  }
+  buf[n] = '\0';
+}
+
+static int
+cmd_prefix_cmp(const void *a, const void *b)
+{
+  return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* Build the $-command summary of one object's own attributes. */
+static void
+cmd_index_build(dbref thing, struct cmd_index *ci)
+{
+  ATTR *ptr;
+  char pat[BUFFER_LEN], prefix[CMD_PREFIX_LEN + 1];
+  const char *val;
+  int i, j;
+
+  for (i = 0; i < ci->count; i++)
+    mush_free(ci->prefixes[i], "cmd_index.prefix");
+  ci->count = 0;
+  ci->any = 0;
+
+  ATTR_FOR_EACH (thing, ptr) {
+    if (!AF_Command(ptr))
+      continue;
+    if (AF_Regexp(ptr)) {
+      ci->any = 1;
+      break;
+    }
+    /* Unescape \: the way atr_single_match_r() does. */
+    val = atr_value(ptr);
+    for (i = 1, j = 0; val[i] && val[i] != ':'; i++) {
+      if (val[i] == '\\' && val[i + 1]) {
+        if (val[i + 1] != ':')
+          pat[j++] = val[i];
+        i++;
+      }
+      pat[j++] = val[i];
+    }
+    pat[j] = '\0';
+    if (has_markup(pat)) {
+      ci->any = 1;
+      break;
+    }
+    cmd_pattern_prefix(pat, prefix);
+    if (!*prefix) {
+      ci->any = 1;
+      break;
+    }
+    if (!ci->prefixes || ci->count % 8 == 0)
+      ci->prefixes =
+        mush_realloc(ci->prefixes, (ci->count + 8) * sizeof *ci->prefixes,
+                     "cmd_index.prefixes");
+    ci->prefixes[ci->count++] = mush_strdup(prefix, "cmd_index.prefix");
+  }
+
+  if (ci->any) {
+    for (i = 0; i < ci->count; i++)
+      mush_free(ci->prefixes[i], "cmd_index.prefix");
+    ci->count = 0;
+  } else if (ci->count > 1) {
+    /* Sort, and drop any prefix that starts with the one before it. */
+    qsort(ci->prefixes, ci->count, sizeof *ci->prefixes, cmd_prefix_cmp);
+    for (i = 0, j = 1; j < ci->count; j++) {
+      if (strncmp(ci->prefixes[j], ci->prefixes[i],
+                  strlen(ci->prefixes[i])) == 0)
+        mush_free(ci->prefixes[j], "cmd_index.prefix");
+      else
+        ci->prefixes[++i] = ci->prefixes[j];
+    }
+    ci->count = i + 1;
+  }
+  ci->gen = cmd_index_gen;
+}
+
+/* Could str match one of the $-commands on thing itself? cmd is str
+ * upcased and cut like the prefixes are. */
+static bool
+cmd_index_check(dbref thing, const char *cmd)
+{
+  struct cmd_index *ci;
+  int lo, hi, mid;
+
+  if (thing >= cmd_index_size) {
+    int size = db_top > thing ? db_top : thing + 1;
+    cmd_index = mush_realloc(cmd_index, size * sizeof *cmd_index, "cmd_index");
+    memset(cmd_index + cmd_index_size, 0,
+           (size - cmd_index_size) * sizeof *cmd_index);
+    cmd_index_size = size;
+  }
+  ci = cmd_index + thing;
+  if (ci->gen != cmd_index_gen)
+    cmd_index_build(thing, ci);
+  if (ci->any)
+    return 1;
+
+  /* Find the greatest prefix that's not after cmd. */
+  lo = 0;
+  hi = ci->count - 1;
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    if (strcmp(ci->prefixes[mid], cmd) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return hi >= 0 &&
+         strncmp(cmd, ci->prefixes[hi], strlen(ci->prefixes[hi])) == 0;
+}
+
+/* Could str match a $-command on thing or its parents? */
+static bool
+atr_comm_may_match(dbref thing, const char *str)
+{
+  char cmd[CMD_PREFIX_LEN + 1];
+  dbref current = thing;
+  int n, parent_count = 0;
+
+  if (has_markup(str))
+    return 1;
+  for (n = 0; str[n] && n < CMD_PREFIX_LEN; n++)
+    cmd[n] = UPCASE(str[n]);
+  cmd[n] = '\0';
+
+  do {
+    if (cmd_index_check(current, cmd))
+      return 1;
+  } while ((current = next_parent(thing, current, &parent_count, NULL)) !=
+           NOTHING);
+  return 0;
+}
+
+TEST_GROUP(cmd_pattern_prefix)
+{
+  char buf[CMD_PREFIX_LEN + 1];
+
+  cmd_pattern_prefix("+who", buf);
+  TEST("cmd_pattern_prefix.1", strcmp(buf, "+WHO") == 0);
+  cmd_pattern_prefix("+finger *", buf);
+  TEST("cmd_pattern_prefix.2", strcmp(buf, "+FINGER ") == 0);
+  cmd_pattern_prefix("*foo", buf);
+  TEST("cmd_pattern_prefix.3", *buf == '\0');
+  cmd_pattern_prefix("wh?", buf);
+  TEST("cmd_pattern_prefix.4", strcmp(buf, "WH") == 0);
+  cmd_pattern_prefix("a\\*b*", buf);
+  TEST("cmd_pattern_prefix.5", strcmp(buf, "A*B") == 0);
+  cmd_pattern_prefix("x\\", buf);
+  TEST("cmd_pattern_prefix.6", strcmp(buf, "X") == 0);
+  cmd_pattern_prefix("abcdefghijklmnopqrstuvwxyz0123456789 *", buf);
+  TEST("cmd_pattern_prefix.7", strlen(buf) == CMD_PREFIX_LEN);
+}
+
+/* Start a walk with an empty set, at the next nesting depth. Every
+ * call must be matched with a walk_depth-- when the walk is done. */
+static struct walk_set *
+walk_set_begin(void)
+{
+  struct walk_set *ws;
+
+  if (walk_depth == walk_sets_size) {
+    walk_sets = mush_realloc(walk_sets,
+                             (walk_sets_size + 1) * sizeof *walk_sets,
+                             "attr_walk");
+    walk_sets[walk_sets_size++] =
+      mush_calloc(1, sizeof(struct walk_set), "attr_walk");
+  }
+  ws = walk_sets[walk_depth++];
+  if (++ws->gen == 0) {
+    if (ws->slots)
+      memset(ws->slots, 0, ws->size * sizeof *ws->slots);
+    ws->gen = 1;
+  }
+  ws->used = 0;
+  return ws;
+}
+
+static inline uint32_t
+walk_hash(const char *name)
+{
+  return (uint32_t) (((uintptr_t) name >> 3) * 2654435761U);
+}
+
+/* Look up a name met earlier in this walk. */
+static struct walk_entry *
+walk_set_find(struct walk_set *ws, const char *name)
+{
+  uint32_t i, mask;
+
+  if (!ws->used)
+    return NULL;
+  mask = ws->size - 1;
+  for (i = walk_hash(name) & mask; ws->slots[i].gen == ws->gen;
+       i = (i + 1) & mask) {
+    if (ws->slots[i].name == name)
+      return &ws->slots[i];
+  }
+  return NULL;
+}
+
+/* Look up a name, adding it with no flags if it's new. Adding can move
+ * other entries, so pointers from earlier lookups don't survive it. */
+static struct walk_entry *
+walk_set_add(struct walk_set *ws, const char *name)
+{
+  struct walk_entry *e;
+  uint32_t i, mask;
+
+  if ((ws->used + 1) * 2 > ws->size) {
+    struct walk_entry *old = ws->slots;
+    uint32_t n, oldsize = ws->size;
+
+    ws->size = oldsize ? oldsize * 2 : WALK_SET_MIN;
+    ws->slots = mush_calloc(ws->size, sizeof *ws->slots, "attr_walk");
+    mask = ws->size - 1;
+    for (n = 0; n < oldsize; n++) {
+      if (old[n].gen != ws->gen)
+        continue;
+      for (i = walk_hash(old[n].name) & mask; ws->slots[i].gen == ws->gen;
+           i = (i + 1) & mask)
+        ;
+      ws->slots[i] = old[n];
+    }
+    if (old)
+      mush_free(old, "attr_walk");
+  }
+
+  mask = ws->size - 1;
+  for (i = walk_hash(name) & mask; ws->slots[i].gen == ws->gen;
+       i = (i + 1) & mask) {
+    if (ws->slots[i].name == name)
+      return &ws->slots[i];
+  }
+  e = &ws->slots[i];
+  e->name = name;
+  e->gen = ws->gen;
+  e->private_level = 0;
+  e->flags = 0;
+  ws->used++;
+  return e;
+}
+
+/* Set flags, and the no_inherit level if private_level isn't 0, on the
+ * attributes below ptr in its tree, and on ptr itself if self is true.
+ * The branches follow their root in the sorted attribute list. */
+static void
+walk_set_mark(struct walk_set *ws, ATTR *ptr, bool self, uint8_t flags,
+              int private_level)
+{
+  struct walk_entry *e;
+  ATTR *p2;
+
+  if (self) {
+    e = walk_set_add(ws, AL_NAME(ptr));
+    e->flags |= flags;
+    if (private_level)
+      e->private_level = private_level;
+  }
+  if (!AF_Root(ptr) || !(p2 = atr_sub_branch(ptr)))
+    return;
+  for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2)); p2++) {
+    e = walk_set_add(ws, AL_NAME(p2));
+    e->flags |= flags;
+    if (private_level)
+      e->private_level = private_level;
+  }
+}
+
+TEST_GROUP(walk_set)
+{
+  static char names[WALK_SET_MIN * 2];
+  struct walk_set *ws;
+  int n;
+  bool ok = 1;
+
+  ws = walk_set_begin();
+  walk_set_add(ws, names)->flags |= WALK_SEEN;
+  TEST("walk_set.1", walk_set_find(ws, names) != NULL);
+  TEST("walk_set.2", walk_set_find(ws, names + 1) == NULL);
+  walk_set_add(ws, names);
+  TEST("walk_set.3", ws->used == 1);
+  /* Enough names to grow the table. All of them have to survive it. */
+  for (n = 1; n < WALK_SET_MIN * 2; n++)
+    walk_set_add(ws, names + n);
+  for (n = 1; n < WALK_SET_MIN * 2; n++)
+    ok = ok && walk_set_find(ws, names + n) != NULL;
+  TEST("walk_set.4", ok && walk_set_find(ws, names)->flags == WALK_SEEN);
+  walk_depth--;
+  ws = walk_set_begin();
+  TEST("walk_set.5", walk_set_find(ws, names) == NULL);
+  walk_depth--;
+}
+
+/* The pe_info for checking locks on an object that has a match. */
+static NEW_PE_INFO *
+atr_comm_pe_info(const char *str, MQUE *from_queue)
+{
+  NEW_PE_INFO *pe_info;
+
+  pe_info = make_pe_info("pe_info-atr_comm_match");
+  if (from_queue && from_queue->pe_info && *from_queue->pe_info->cmd_raw) {
+    pe_info->cmd_raw = mush_strdup(from_queue->pe_info->cmd_raw, "string");
+  } else {
+    pe_info->cmd_raw = mush_strdup(str, "string");
+  }
+
+  if (from_queue && from_queue->pe_info && *from_queue->pe_info->cmd_evaled) {
+    pe_info->cmd_evaled =
+      mush_strdup(from_queue->pe_info->cmd_evaled, "string");
+  } else {
+    pe_info->cmd_evaled = mush_strdup(str, "string");
+  }
+  return pe_info;
+}
+
 /** Match input against a $command or ^listen attribute.
  * This function attempts to match a string against either the $commands
  * or ^listens on an object. Matches may be glob or regex matches,
@@ -1863,7 +2325,7 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
   ATTR *ptr;
   int parent_depth;
   char *args[MAX_STACK_ARGS];
-  PE_REGS *pe_regs = NULL;
+  PE_REGS *pe_regs;
   char cmd_buff[BUFFER_LEN];
   int match, match_found;
   int lock_checked = !check_locks;
@@ -1871,8 +2333,9 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
   ssize_t match_space_len = BUFFER_LEN * 2;
   NEW_PE_INFO *pe_info;
   dbref current = thing, next = NOTHING;
-  int parent_count = 0;
-  StrTree seen, nocmd_roots, private_attrs;
+  int parent_count = 0, level = 0;
+  struct walk_set *ws;
+  struct walk_entry *e;
 
   /* check for lots of easy ways out */
   if (type != '$' && type != '^')
@@ -1881,125 +2344,71 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
                       (type == '$' && NoCommand(thing))))
     return 0;
 
+  if (type == '$' && end == ':' && GoodObject(thing) &&
+      !atr_comm_may_match(thing, str))
+    return 0;
+
   if (type == '$') {
     flag_mask = AF_COMMAND;
     parent_depth = GoodObject(Parent(thing));
   } else {
     flag_mask = AF_LISTEN;
-    if (has_flag_by_name(thing, "LISTEN_PARENT",
-                         TYPE_PLAYER | TYPE_THING | TYPE_ROOM)) {
-      parent_depth = GoodObject(Parent(thing));
-    } else {
-      parent_depth = 0;
-    }
+    /* Most objects have no parent, so don't look up the flag for them. */
+    parent_depth = GoodObject(Parent(thing)) &&
+                   has_flag_by_name(thing, "LISTEN_PARENT",
+                                    TYPE_PLAYER | TYPE_THING | TYPE_ROOM);
   }
   match = 0;
 
-  pe_info = make_pe_info("pe_info-atr_comm_match");
-  if (from_queue && from_queue->pe_info && *from_queue->pe_info->cmd_raw) {
-    pe_info->cmd_raw = mush_strdup(from_queue->pe_info->cmd_raw, "string");
-  } else {
-    pe_info->cmd_raw = mush_strdup(str, "string");
-  }
-
-  if (from_queue && from_queue->pe_info && *from_queue->pe_info->cmd_evaled) {
-    pe_info->cmd_evaled =
-      mush_strdup(from_queue->pe_info->cmd_evaled, "string");
-  } else {
-    pe_info->cmd_evaled = mush_strdup(str, "string");
-  }
-
-  if (!just_match) {
-    pe_regs = pe_regs_create(PE_REGS_ARG, "atr_comm_match");
-    pe_regs_copystack(pe_regs, pe_regs_parent, PE_REGS_ARG, 1);
-  }
-
-  st_init(&seen, "AttrsSeenTree");
-  st_init(&nocmd_roots, "AttrsSeenTree");
-  st_init(&private_attrs, "AttrsSeenTree");
+  ws = walk_set_begin();
 
   do {
     next =
       parent_depth ? next_parent(thing, current, &parent_count, NULL) : NOTHING;
 
-    st_flush(&private_attrs);
-
     ATTR_FOR_EACH (current, ptr) {
       if (cpu_time_limit_hit)
         break;
+      e = walk_set_find(ws, AL_NAME(ptr));
       if (current == thing) {
-        if (st_find(AL_NAME(ptr), &nocmd_roots)) {
+        if (e && (e->flags & WALK_NOCMD)) {
           continue;
         }
-        st_insert(AL_NAME(ptr), &seen);
+        /* Only the parents need to know what the child has. */
+        if (parent_depth)
+          walk_set_add(ws, AL_NAME(ptr))->flags |= WALK_SEEN;
         if (AF_Noprog(ptr)) {
           /* No-command. This, and later trees with this path its root
              are skipped. */
-          st_insert(AL_NAME(ptr), &nocmd_roots);
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &nocmd_roots);
-              }
-            }
-          }
+          walk_set_mark(ws, ptr, 1, WALK_NOCMD, 0);
           continue;
         }
       } else {
-        if (st_find(AL_NAME(ptr), &private_attrs)) {
+        if (e && e->private_level == level) {
           /* Already decided to skip this attribute */
           continue;
         }
-        if (st_find(AL_NAME(ptr), &nocmd_roots)) {
+        if (e && (e->flags & WALK_NOCMD)) {
           /* Skip attributes that are masked by an earlier nocommand */
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &nocmd_roots);
-                st_insert(AL_NAME(p2), &private_attrs);
-              }
-            }
-          }
+          walk_set_mark(ws, ptr, 0, WALK_NOCMD, level);
           continue;
         }
         if (AF_Private(ptr)) {
           /* No-inherit. This attribute is not visible, but later ones
              with the same name can be */
-          st_insert(AL_NAME(ptr), &private_attrs);
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &private_attrs);
-              }
-            }
-          }
+          walk_set_mark(ws, ptr, 1, 0, level);
           continue;
         }
         if (AF_Noprog(ptr)) {
           /* No-command. This, and later trees with this path its root
              are skipped. */
-          st_insert(AL_NAME(ptr), &nocmd_roots);
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &nocmd_roots);
-              }
-            }
-          }
+          walk_set_mark(ws, ptr, 1, WALK_NOCMD, 0);
           continue;
         }
-        if (st_find(AL_NAME(ptr), &seen)) {
+        if (e && (e->flags & WALK_SEEN)) {
           continue;
         } else {
-          st_insert(AL_NAME(ptr), &seen);
+          walk_set_add(ws, AL_NAME(ptr))->flags |= WALK_SEEN;
         }
       }
 
@@ -2015,7 +2424,7 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
 
       match_found =
         atr_single_match_r(ptr, flag_mask, end, str, args, match_space,
-                           match_space_len, cmd_buff, pe_regs);
+                           match_space_len, cmd_buff, NULL);
       if (match_found)
         match++;
 
@@ -2027,12 +2436,16 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
          * the child, even when the attr is inherited.
          */
         if (!lock_checked) {
+          int passed;
+
           lock_checked = 1;
-          if ((type == '$' &&
-               !eval_lock_with(player, thing, Command_Lock, pe_info)) ||
-              (type == '^' &&
-               !eval_lock_with(player, thing, Listen_Lock, pe_info)) ||
-              !eval_lock_with(player, thing, Use_Lock, pe_info)) {
+          pe_info = atr_comm_pe_info(str, from_queue);
+          passed = (type == '$'
+                      ? eval_lock_with(player, thing, Command_Lock, pe_info)
+                      : eval_lock_with(player, thing, Listen_Lock, pe_info)) &&
+                   eval_lock_with(player, thing, Use_Lock, pe_info);
+          free_pe_info(pe_info);
+          if (!passed) {
             match--;
             if (errobj)
               *errobj = thing;
@@ -2053,6 +2466,12 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
         if (!just_match) {
           char tmp[BUFFER_LEN];
 
+          /* Match again, to capture the arguments for the queue entry. */
+          pe_regs = pe_regs_create(PE_REGS_ARG, "atr_comm_match");
+          pe_regs_copystack(pe_regs, pe_regs_parent, PE_REGS_ARG, 1);
+          atr_single_match_r(ptr, flag_mask, end, str, args, match_space,
+                             match_space_len, cmd_buff, pe_regs);
+
           if (from_queue &&
               (queue_type & ~QUEUE_DEBUG_PRIVS) != QUEUE_DEFAULT) {
             int pe_flags = PE_INFO_DEFAULT;
@@ -2094,20 +2513,13 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
               (queue_type & QUEUE_DEBUG_PRIVS ? can_debug(player, thing) : 0));
           }
           pe_regs_free(pe_regs);
-          pe_regs = pe_regs_create(PE_REGS_ARG, "atr_comm_match");
-          pe_regs_copystack(pe_regs, pe_regs_parent, PE_REGS_ARG, 1);
         }
       }
     }
+    level++;
   } while ((current = next) != NOTHING && !cpu_time_limit_hit);
 
-  st_flush(&seen);
-  st_flush(&nocmd_roots);
-  st_flush(&private_attrs);
-
-  if (pe_regs)
-    pe_regs_free(pe_regs);
-  free_pe_info(pe_info);
+  walk_depth--;
   return match;
 }
 
@@ -2634,6 +3046,8 @@ atr_free_one(dbref thing, ATTR *a)
 
   if (!a)
     return;
+  if (AF_Command(a))
+    atr_comm_index_reset();
   st_delete(AL_NAME(a), &atr_names);
   if (a->data)
     chunk_delete(a->data);
@@ -2663,16 +3077,177 @@ atr_get_compressed_data(ATTR *atr)
   return buffer;
 }
 
+static void
+atr_cache_unlink(struct atr_cache_entry *e)
+{
+  if (e->prev) {
+    e->prev->next = e->next;
+  } else {
+    atr_lru_head = e->next;
+  }
+  if (e->next) {
+    e->next->prev = e->prev;
+  } else {
+    atr_lru_tail = e->prev;
+  }
+  e->prev = e->next = NULL;
+}
+
+static void
+atr_cache_free_entry(void *data)
+{
+  struct atr_cache_entry *e = data;
+
+  atr_cache_bytes -= sizeof *e + e->len + 1;
+  mush_free(e, "attribute.cache");
+}
+
+/* Evict least recently used entries until the cache fits in
+ * attribute_cache_memory. */
+static void
+atr_cache_trim(void)
+{
+  struct atr_cache_entry *e, *prev;
+
+  for (e = atr_lru_tail;
+       e && atr_cache_bytes > (size_t) options.attribute_cache_memory;
+       e = prev) {
+    prev = e->prev;
+    atr_cache_unlink(e);
+    atr_cache_stat.evictions++;
+    hashdelete(e->key, &htab_atr_values); /* Frees e */
+  }
+}
+
+static struct atr_cache_entry *
+atr_cache_find(chunk_reference_t ref)
+{
+  char key[24];
+  struct atr_cache_entry *e;
+
+  if (!atr_cache_initialized) {
+    return NULL;
+  }
+  snprintf(key, sizeof key, "%" PRIxPTR, ref);
+  e = hashfind(key, &htab_atr_values);
+  if (e && e != atr_lru_head) {
+    atr_cache_unlink(e);
+    e->next = atr_lru_head;
+    atr_lru_head->prev = e;
+    atr_lru_head = e;
+  }
+  return e;
+}
+
+static void
+atr_cache_add(chunk_reference_t ref, const char *val)
+{
+  struct atr_cache_entry *e;
+  size_t len = strlen(val);
+
+  if (sizeof *e + len + 1 > (size_t) options.attribute_cache_memory) {
+    return;
+  }
+  if (!atr_cache_initialized) {
+    hash_init(&htab_atr_values, 1024, atr_cache_free_entry);
+    atr_cache_initialized = 1;
+  }
+
+  e = mush_malloc(sizeof *e + len + 1, "attribute.cache");
+  if (!e) {
+    mush_panic("Unable to allocate memory in atr_cache_add()");
+  }
+  e->ref = ref;
+  e->len = len;
+  snprintf(e->key, sizeof e->key, "%" PRIxPTR, ref);
+  memcpy(e->val, val, len + 1);
+  hashadd(e->key, e, &htab_atr_values);
+  e->prev = NULL;
+  e->next = atr_lru_head;
+  if (atr_lru_head) {
+    atr_lru_head->prev = e;
+  } else {
+    atr_lru_tail = e;
+  }
+  atr_lru_head = e;
+  atr_cache_bytes += sizeof *e + len + 1;
+  atr_cache_trim();
+}
+
+/** Drop a chunk's uncompressed value from the attribute value cache.
+ * Called whenever a chunk is deleted or about to be migrated, since its
+ * reference may be reused for other data.
+ * \param ref the chunk reference.
+ */
+void
+atr_cache_forget(chunk_reference_t ref)
+{
+  char key[24];
+  struct atr_cache_entry *e;
+
+  if (!atr_cache_initialized || !htab_atr_values.entries) {
+    return;
+  }
+  snprintf(key, sizeof key, "%" PRIxPTR, ref);
+  e = hashfind(key, &htab_atr_values);
+  if (e) {
+    atr_cache_unlink(e);
+    atr_cache_stat.forgotten++;
+    hashdelete(key, &htab_atr_values); /* Frees e */
+  }
+}
+
+/** Report attribute value cache statistics for \@stats/tables.
+ * \param player the player to notify.
+ */
+void
+atr_cache_stats(dbref player)
+{
+  uint64_t lookups = atr_cache_stat.hits + atr_cache_stat.misses;
+
+  notify(player, "Attribute Value Cache:");
+  notify_format(player,
+                " %d values using %zu of %d bytes, %" PRIu64
+                " evicted, %" PRIu64 " invalidated.",
+                atr_cache_initialized ? htab_atr_values.entries : 0,
+                atr_cache_bytes, options.attribute_cache_memory,
+                atr_cache_stat.evictions, atr_cache_stat.forgotten);
+  notify_format(player,
+                " %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate).",
+                atr_cache_stat.hits, atr_cache_stat.misses,
+                lookups ? 100.0 * atr_cache_stat.hits / lookups : 0.0);
+}
+
 /** Return the uncompressed data for an attribute in a static buffer.
  * This is a wrapper function, to centralize the use of compression/
- * decompression on attributes.
+ * decompression on attributes. Recently read values are kept
+ * uncompressed in the attribute value cache.
  * \param atr the attribute struct from which to get the data reference.
  * \return a pointer to the uncompressed data, in a static buffer.
  */
 char *
 atr_value(ATTR *atr)
 {
-  return uncompress(atr_get_compressed_data(atr));
+  static char buff[BUFFER_LEN];
+  struct atr_cache_entry *e;
+  char *val;
+
+  if (!atr->data || options.attribute_cache_memory <= 0) {
+    if (atr_cache_bytes) {
+      atr_cache_trim();
+    }
+    return uncompress(atr_get_compressed_data(atr));
+  }
+  e = atr_cache_find(atr->data);
+  if (e) {
+    atr_cache_stat.hits++;
+    memcpy(buff, e->val, e->len + 1);
+    return buff;
+  }
+  atr_cache_stat.misses++;
+  val = uncompress(atr_get_compressed_data(atr));
+  atr_cache_add(atr->data, val);
+  return val;
 }
 
 /** Return the uncompressed data for an attribute in a dynamic buffer.
@@ -2685,6 +3260,41 @@ atr_value(ATTR *atr)
 char *
 safe_atr_value(ATTR *atr, char *check)
 {
+  struct atr_cache_entry *e;
+
   add_check(check);
-  return safe_uncompress(atr_get_compressed_data(atr));
+  if (!atr->data || options.attribute_cache_memory <= 0) {
+    return safe_uncompress(atr_get_compressed_data(atr));
+  }
+  e = atr_cache_find(atr->data);
+  if (e) {
+    atr_cache_stat.hits++;
+    return strdup(e->val);
+  }
+  return strdup(atr_value(atr));
+}
+
+TEST_GROUP(atr_cache)
+{
+  ATTR *a;
+  uint64_t hits;
+  char *val;
+
+  atr_add(GOD, "ATR_CACHE_TEST", "first value", GOD, 0);
+  a = atr_get_noparent(GOD, "ATR_CACHE_TEST");
+  TEST("atr_cache.1", a && strcmp(atr_value(a), "first value") == 0);
+  hits = atr_cache_stat.hits;
+  TEST("atr_cache.2", a && strcmp(atr_value(a), "first value") == 0);
+  TEST("atr_cache.3", options.attribute_cache_memory <= 0 ||
+                        atr_cache_stat.hits == hits + 1);
+  atr_add(GOD, "ATR_CACHE_TEST", "second value", GOD, 0);
+  a = atr_get_noparent(GOD, "ATR_CACHE_TEST");
+  TEST("atr_cache.4", a && strcmp(atr_value(a), "second value") == 0);
+  val = a ? safe_atr_value(a, "atr_cache.test") : NULL;
+  TEST("atr_cache.5", val && strcmp(val, "second value") == 0);
+  if (val) {
+    mush_free(val, "atr_cache.test");
+  }
+  atr_clr(GOD, "ATR_CACHE_TEST", GOD);
+  TEST("atr_cache.6", atr_get_noparent(GOD, "ATR_CACHE_TEST") == NULL);
 }
@@ -73,6 +73,10 @@
 #ifdef HAVE_POLL_H
 #include <poll.h>
 #endif
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+#include <sys/epoll.h>
+#define USE_EPOLL
+#endif
 #ifdef HAVE_LIBCURL
 #include <curl/curl.h>
 #endif
@@ -227,6 +231,54 @@ bool welcome_user_wrapper(void *data);
 static int handle_telnet(DESC *d, char **q, char *qend);
 static void set_ttype(DESC *d, char *value);
 bool http_finished_wrapper(void *data);
+#ifdef HAVE_LIBZ
+static void mccp_start_output(DESC *d);
+static void mccp_end_output(DESC *d);
+static void mccp_start_input(DESC *d, int window_bits);
+static void mccp_input(DESC *d, char *buf, int len);
+static long mccp_saved(DESC *d);
+static void mccp_free(DESC *d);
+#endif
+static void mccp_save(PENNFILE *f, DESC *d);
+static void mccp_load(PENNFILE *f, DESC *d);
+
+#ifdef HAVE_LIBZ
+/* MCCP, the MUD Client Compression Protocol, compresses a connection
+ * with zlib. With version 2, everything the MUSH sends after IAC SB
+ * MCCP2 IAC SE is one deflate stream; with version 3, everything the
+ * client sends after IAC SB MCCP3 IAC SE is.
+ *
+ * The output queue still holds plain text, so flushing it when it
+ * grows too big and sharing blocks between descriptors work as they
+ * do for any other connection. Queued text is only compressed when
+ * the socket can take more, into a buffer of bytes ready for the
+ * wire, and each batch ends with a sync flush so the client can
+ * display everything it has been sent.
+ */
+
+/** Compression state of a connection using MCCP */
+struct mccp_state {
+  z_stream out;          /**< Output stream, while CONN_MCCP2 is set */
+  z_stream in;           /**< Input stream, while CONN_MCCP3 is set */
+  bool in_raw;           /**< Was the input stream resumed without a header? */
+  bool in_synced;        /**< Did the last input read end at a flush point? */
+  unsigned char *wire;   /**< Compressed bytes waiting to be sent */
+  int wire_pos;          /**< Offset of the first unsent byte */
+  int wire_len;          /**< Offset just past the last unsent byte */
+  int wire_size;         /**< Allocated size of wire */
+  unsigned long raw_out; /**< Output bytes before compression */
+  unsigned long zip_out; /**< Output bytes after compression */
+  unsigned long raw_in;  /**< Input bytes after decompression */
+  unsigned long zip_in;  /**< Input bytes before decompression */
+};
+
+/** Does output to this descriptor have to go through mccp_send()? */
+#define MCCP_OUTPUT(d)                                                         \
+  ((d)->mccp && (((d)->conn_flags & CONN_MCCP2) ||                            \
+                 (d)->mccp->wire_pos < (d)->mccp->wire_len))
+/** Room to make in the wire buffer before each call to deflate() */
+#define MCCP_CHUNK 4096
+#endif
 
 typedef void (*telnet_handler)(DESC *d, char *cmd, int len);
 #define TELNET_HANDLER(x)                                                      \
@@ -262,6 +314,11 @@ struct gmcp_handler *gmcp_handlers = NULL;
 
 #define DESC_ITER(d) for (d = descriptor_list; (d); d = (d)->next)
 
+/** Iterate through the connected descriptors of a single player. */
+#define DESC_ITER_PLAYER(p, d)                                                 \
+  for (d = player_descs(p); (d); d = (d)->next_for_player)                     \
+    if ((d)->connected)
+
 /** Is a descriptor hidden? */
 #define Hidden(d) ((d->hide == 1))
 
@@ -302,6 +359,7 @@ dummy_msgs()
 
 DESC *descriptor_list = NULL; /**< The linked list of descriptors */
 intmap *descs_by_fd = NULL;   /**< Map of ports to DESC* objects */
+intmap *descs_by_player = NULL; /**< Map of player dbrefs to their DESC lists */
 
 struct http_request *active_http_request = NULL; /**< Active HTTP Request */
 /* To roughly average HTTP_SECOND_LIMIT per second, we actually define
@@ -398,6 +456,11 @@ static void shutdownsock(DESC *d, const char *reason, dbref executor,
                          int flags);
 static void disconnect_desc(DESC *d);
 static void cleanup_desc(DESC *d);
+static void desc_ready(DESC *d, bool input_ready, bool output_ready,
+                       bool errors, bool hangup);
+#ifdef USE_EPOLL
+static void check_epoll_descs(void);
+#endif
 DESC *initializesock(int s, char *addr, char *ip, conn_source source);
 int process_output(DESC *d);
 /* Notify.c */
@@ -821,6 +884,7 @@ main(int argc, char **argv)
 #endif
 
   descs_by_fd = im_new();
+  descs_by_player = im_new();
 
   if (restarting) {
     /* go do it */
@@ -972,11 +1036,16 @@ msec_diff(struct timeval now, struct timeval then)
   return msecs;
 }
 
+/** Milliseconds until the first throttled connection can run a
+ * command, as of the last update_quotas(). */
+static uint32_t throttle_msecs = UINT32_MAX;
+
 /** Update each descriptor's allowed rate of issuing commands.
  * Players are rate-limited; they may only perform up to a certain
  * number of commands per time slice. This function is run periodically
  * to refresh each descriptor's available command quota based on how
- * many slices have passed since it was last updated.
+ * many slices have passed since it was last updated, and notes how
+ * long it will be until the first throttled one can run a command.
  * \param last pointer to timeval struct of last time quota was updated.
  * \param current pointer to timeval struct of current time.
  */
@@ -996,6 +1065,7 @@ update_quotas(struct timeval current)
   msecs = msec_diff(current, last);
   last = current;
 
+  throttle_msecs = UINT32_MAX;
   DESC_ITER (d) {
     if (d->conn_flags & CONN_NOQUOTA)
       d->quota = QUOTA_MAX;
@@ -1003,6 +1073,9 @@ update_quotas(struct timeval current)
       d->quota += COMMANDS_PER_SECOND * msecs;
     if (d->quota > QUOTA_MAX)
       d->quota = QUOTA_MAX;
+    if (d->input.head && d->quota < MS_PER_SEC &&
+        (uint32_t) (MS_PER_SEC - d->quota) < throttle_msecs)
+      throttle_msecs = MS_PER_SEC - d->quota;
   }
 
   /* And the HTTP quota */
@@ -1385,6 +1458,80 @@ static nfds_t fd_size = 0, fds_used = 0;
 #define PENN_POLLOUT POLLOUT
 #endif
 
+#ifdef USE_EPOLL
+/* Connections are kept registered in an epoll set instead of being
+ * added to the fds array every time through the loop, and only the
+ * epoll fd goes into the array next to the listening sockets. That way
+ * it works the same whether curl or plain poll() does the waiting. A
+ * connection's registration is updated by desc_update_poll() where
+ * output is queued or sent and where input is saved or run, and only
+ * costs a system call when it starts or stops being throttled or
+ * having output pending. If epoll_create1() fails, connections go in
+ * the fds array like before. */
+static int epoll_fd = -1;
+#define EPOLL_BATCH 256 /**< Most events handled per epoll_wait() */
+static struct epoll_event epoll_events[EPOLL_BATCH];
+
+/* Change the events a connection's socket is registered for. */
+static void
+desc_poll_events(DESC *d, int events)
+{
+  struct epoll_event ev;
+  int op;
+
+  if (epoll_fd < 0 || d->poll_events == events)
+    return;
+  if (!events)
+    op = EPOLL_CTL_DEL;
+  else if (!d->poll_events)
+    op = EPOLL_CTL_ADD;
+  else
+    op = EPOLL_CTL_MOD;
+  memset(&ev, 0, sizeof ev);
+  ev.events = events;
+  ev.data.fd = d->descriptor;
+  if (epoll_ctl(epoll_fd, op, d->descriptor, &ev) < 0)
+    penn_perror("epoll_ctl");
+  d->poll_events = events;
+}
+#endif
+
+/* Does a connection have output waiting to be sent? */
+static bool
+desc_output_pending(DESC *d)
+{
+  if (d->output.head)
+    return 1;
+#ifdef HAVE_LIBZ
+  if (d->mccp && d->mccp->wire_pos < d->mccp->wire_len)
+    return 1;
+#endif
+  return 0;
+}
+
+/** Update the events a connection is watched for. It's watched for
+ * input unless it has commands waiting to run (it's throttled), and
+ * for writability while it has output waiting.
+ * \param d the descriptor.
+ */
+void
+desc_update_poll(DESC *d)
+{
+#ifdef USE_EPOLL
+  int events = 0;
+
+  if (epoll_fd < 0)
+    return;
+  if (!d->input.head)
+    events |= EPOLLIN;
+  if (desc_output_pending(d))
+    events |= EPOLLOUT;
+  desc_poll_events(d, events);
+#else
+  (void) d;
+#endif
+}
+
 void
 ext_startup()
 {
@@ -1408,6 +1555,19 @@ ext_startup()
   do_rawlog(LT_ERR, "RESTART FINISHED.");
 
   notify_fd = file_watch_init();
+
+#ifdef USE_EPOLL
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0)
+    penn_perror("epoll_create1");
+  else {
+    /* Connections kept over a @shutdown/reboot */
+    DESC *d;
+    DESC_ITER (d) {
+      desc_update_poll(d);
+    }
+  }
+#endif
 }
 
 void
@@ -1415,6 +1575,12 @@ ext_shutdown()
 {
   if (fds)
     mush_free(fds, "pollfds");
+#ifdef USE_EPOLL
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+    epoll_fd = -1;
+  }
+#endif
 
 #ifdef HAVE_LIBCURL
   curl_multi_cleanup(curl_handle);
@@ -1439,9 +1605,10 @@ check_sockets(uint32_t msec_timeout)
   time_t now;
 #endif
   int found;
+  int sql_fd;
   DESC *d;
 
-  if (((int) fd_size) < ((int) im_count(descs_by_fd) + 6)) {
+  if (((int) fd_size) < ((int) im_count(descs_by_fd) + 7)) {
     fd_size = im_count(descs_by_fd) + 16;
     fds = mush_realloc(fds, sizeof *fds * fd_size, "pollfds");
   }
@@ -1488,31 +1655,42 @@ check_sockets(uint32_t msec_timeout)
   }
 #endif
 
-  /** Now add all the active descriptors */
-  DESC_ITER (d) {
-    /* If d->input.head is non-null, the descriptor is being throttled.
-     * If d->output.head is non-null, the descriptor is choked on send,
-     * we want to watch for POLLOUT event to write some more.
-     * */
-    int events = 0;
-
-    if (d->input.head) {
-      /* They're throttled, be nice and reduce timeout to when we think
-       * they'll be unthrottled. */
-      uint64_t curr = MS_PER_SEC - d->quota;
-      if (msec_timeout > curr)
-        msec_timeout = curr;
-    } else {
-      events |= PENN_POLLIN;
-    }
+  /* Results of a @mapsql/async query */
+  sql_fd = sql_async_fd();
+  if (sql_fd >= 0) {
+    fds[fds_used].fd = sql_fd;
+    fds[fds_used++].events = PENN_POLLIN;
+  }
 
-    if (d->output.head) {
-      events |= PENN_POLLOUT;
-    }
+  /* If anyone's throttled, wake up when we think they'll be
+   * unthrottled. */
+  if (msec_timeout > throttle_msecs)
+    msec_timeout = throttle_msecs;
 
-    if (events) {
-      fds[fds_used].events = events;
-      fds[fds_used++].fd = d->descriptor;
+#ifdef USE_EPOLL
+  if (epoll_fd >= 0) {
+    fds[fds_used].fd = epoll_fd;
+    fds[fds_used++].events = PENN_POLLIN;
+  } else
+#endif
+  {
+    /** Now add all the active descriptors */
+    DESC_ITER (d) {
+      /* If d->input.head is non-null, the descriptor is being throttled.
+       * If output is pending, the descriptor is choked on send, and
+       * we want to watch for POLLOUT event to write some more.
+       * */
+      int events = 0;
+
+      if (!d->input.head)
+        events |= PENN_POLLIN;
+      if (desc_output_pending(d))
+        events |= PENN_POLLOUT;
+
+      if (events) {
+        fds[fds_used].events = events;
+        fds[fds_used++].fd = d->descriptor;
+      }
     }
   }
 
@@ -1634,6 +1812,19 @@ check_sockets(uint32_t msec_timeout)
     }
 #endif
 
+    if (found > 0 && sql_fd >= 0 && fds[fds_used++].revents & PENN_POLLIN) {
+      found -= 1;
+      sql_async_ready();
+    }
+
+#ifdef USE_EPOLL
+    if (epoll_fd >= 0) {
+      if (found > 0 && fds[fds_used++].revents & PENN_POLLIN)
+        check_epoll_descs();
+      return 1;
+    }
+#endif
+
     /* Check all the users for input */
     DESC_ITER (d) {
       unsigned int input_ready, output_ready, errors, full_events;
@@ -1653,30 +1844,65 @@ check_sockets(uint32_t msec_timeout)
       output_ready = fds[fds_used++].revents & PENN_POLLOUT;
       if (input_ready || errors || output_ready)
         found -= 1;
-      if (errors) {
-        /* Socket error; kill this connection. */
-        shutdownsock(d, "socket error", d->player >= 0 ? d->player : GOD,
-                     CONN_NOWRITE);
-      } else {
-        if (input_ready) {
-          if (!process_input(d, output_ready)) {
-            shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
-            continue;
-          }
-        }
-        if (output_ready) {
-          if (!process_output(d)) {
-            shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
-          }
-        }
+      desc_ready(d, input_ready, output_ready, errors, full_events & POLLHUP);
+    }
+  }
+  return 1;
+}
+
+/* Handle network activity on a single connection. */
+static void
+desc_ready(DESC *d, bool input_ready, bool output_ready, bool errors,
+           bool hangup)
+{
+  if (errors) {
+    /* Socket error; kill this connection. */
+    shutdownsock(d, "socket error", d->player >= 0 ? d->player : GOD,
+                 CONN_NOWRITE);
+  } else {
+    if (input_ready) {
+      if (!process_input(d, output_ready)) {
+        shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
+        return;
       }
-      if (full_events & POLLHUP) {
-        http_command_ready(d);
+    }
+    if (output_ready) {
+      if (!process_output(d)) {
+        shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
       }
     }
   }
-  return 1;
+  if (hangup) {
+    http_command_ready(d);
+  }
+}
+
+#ifdef USE_EPOLL
+/* Handle the connections the epoll set says are ready. */
+static void
+check_epoll_descs(void)
+{
+  int found, i;
+  DESC *d;
+
+  found = epoll_wait(epoll_fd, epoll_events, EPOLL_BATCH, 0);
+  if (found < 0) {
+    if (errno != EINTR)
+      penn_perror("epoll_wait");
+    return;
+  }
+
+  for (i = 0; i < found; i++) {
+    uint32_t revents = epoll_events[i].events;
+
+    d = im_find(descs_by_fd, epoll_events[i].data.fd);
+    if (!d)
+      continue;
+    desc_ready(d, revents & EPOLLIN, revents & EPOLLOUT, revents & EPOLLERR,
+               revents & EPOLLHUP);
+  }
 }
+#endif
 
 static void
 gameloop()
@@ -2218,6 +2444,62 @@ disconnect_player(DESC *d, enum disconn_reason reason)
   }
 }
 
+/** Change the player a descriptor is attached to, keeping the
+ * per-player descriptor lists in descs_by_player up to date.
+ * Each player's list is kept in the same order as descriptor_list, so
+ * code that walks it sees descriptors in the order it always has.
+ * \param d descriptor.
+ * \param player new player, or NOTHING to detach.
+ */
+static void
+desc_set_player(DESC *d, dbref player)
+{
+  DESC *head, *prev, *later;
+
+  if (d->player == player)
+    return;
+  if (GoodObject(d->player)) {
+    head = im_find(descs_by_player, d->player);
+    if (head == d) {
+      im_delete(descs_by_player, d->player);
+      if (d->next_for_player)
+        im_insert(descs_by_player, d->player, d->next_for_player);
+    } else {
+      for (prev = head; prev; prev = prev->next_for_player) {
+        if (prev->next_for_player == d) {
+          prev->next_for_player = d->next_for_player;
+          break;
+        }
+      }
+    }
+  }
+  d->next_for_player = NULL;
+  d->player = player;
+  if (!GoodObject(player))
+    return;
+
+  /* Find the first of the player's descriptors that follows d in
+   * descriptor_list, and go in front of it. */
+  for (later = d->next; later; later = later->next)
+    if (later->player == player)
+      break;
+
+  head = im_find(descs_by_player, player);
+  if (!head) {
+    im_insert(descs_by_player, player, d);
+  } else if (head == later) {
+    d->next_for_player = head;
+    im_delete(descs_by_player, player);
+    im_insert(descs_by_player, player, d);
+  } else {
+    for (prev = head; prev->next_for_player != later;
+         prev = prev->next_for_player)
+      ;
+    d->next_for_player = later;
+    prev->next_for_player = d;
+  }
+}
+
 /** Logout a descriptor from the player it's connected to,
  * without dropping the connection. Run when a player uses LOGOUT
  * \param d descriptor
@@ -2239,7 +2521,7 @@ logout_sock(DESC *d)
   d->output_prefix = 0;
   d->output_suffix = 0;
   d->output_size = 0;
-  d->player = NOTHING;
+  desc_set_player(d, NOTHING);
   init_text_queue(&d->input);
   init_text_queue(&d->output);
   d->raw_input = 0;
@@ -2275,6 +2557,9 @@ disconnect_desc(DESC *d)
   if (d->conn_flags & CONN_GMCP) {
     send_oob(d, "Core.Goodbye", NULL);
   }
+#ifdef HAVE_LIBZ
+  mccp_end_output(d);
+#endif
   process_output(d);
   clearstrings(d);
   if (d->conn_timer) {
@@ -2294,10 +2579,14 @@ disconnect_desc(DESC *d)
 static void
 cleanup_desc(DESC *d)
 {
+#ifdef USE_EPOLL
+  desc_poll_events(d, 0);
+#endif
   shutdown(d->descriptor, 2);
   closesocket(d->descriptor);
 
   im_delete(descs_by_fd, d->descriptor);
+  desc_set_player(d, NOTHING);
 
   if (sslsock && d->ssl) {
     ssl_close_connection(d->ssl);
@@ -2309,6 +2598,10 @@ cleanup_desc(DESC *d)
   }
 
   {
+#ifdef HAVE_LIBZ
+    mccp_free(d);
+#endif
+    free_websocket_deflate(d);
     freeqs(d);
     if (d->ttype && d->ttype != default_ttype)
       mush_free(d->ttype, "terminal description");
@@ -2331,6 +2624,9 @@ initializesock(int s, char *addr, char *ip, conn_source source)
   d->closer = NOTHING;
   d->close_reason = "unknown";
   d->http_request = NULL;
+  d->poll_events = 0;
+  d->mccp = NULL;
+  d->ws_deflate = NULL;
   d->connected = CONN_SCREEN;
   d->conn_timer = NULL;
   d->connected_at = mudtime;
@@ -2341,6 +2637,7 @@ initializesock(int s, char *addr, char *ip, conn_source source)
   init_text_queue(&d->input);
   init_text_queue(&d->output);
   d->player = NOTHING;
+  d->next_for_player = NULL;
   d->raw_input = 0;
   d->raw_input_at = 0;
   d->quota = QUOTA_MAX;
@@ -2373,17 +2670,401 @@ initializesock(int s, char *addr, char *ip, conn_source source)
     }
   }
   im_insert(descs_by_fd, d->descriptor, d);
+  desc_update_poll(d);
   d->connlog_id = connlog_connection(ip, addr, is_ssl_desc(d));
   d->conn_timer = sq_register_in(1, test_telnet_wrapper, (void *) d, NULL);
   queue_event(SYSEVENT, "SOCKET`CONNECT", "%d,%s", d->descriptor, d->ip);
   return d;
 }
 
+#ifdef HAVE_LIBZ
+/* Get a descriptor's compression state, creating it if needed. */
+static struct mccp_state *
+mccp_state(DESC *d)
+{
+  if (!d->mccp) {
+    d->mccp = mush_malloc(sizeof(struct mccp_state), "mccp_state");
+    if (!d->mccp)
+      mush_panic("Out of memory.");
+    memset(d->mccp, 0, sizeof(struct mccp_state));
+  }
+  return d->mccp;
+}
+
+/* Make room for at least n more bytes at the end of the wire buffer. */
+static void
+mccp_wire_reserve(struct mccp_state *m, int n)
+{
+  if (m->wire_pos > 0) {
+    memmove(m->wire, m->wire + m->wire_pos, m->wire_len - m->wire_pos);
+    m->wire_len -= m->wire_pos;
+    m->wire_pos = 0;
+  }
+  if (m->wire_len + n > m->wire_size) {
+    int size = m->wire_size ? m->wire_size : MCCP_CHUNK;
+    unsigned char *wire;
+
+    while (size < m->wire_len + n)
+      size *= 2;
+    wire = mush_realloc(m->wire, size, "mccp_wire");
+    if (!wire)
+      mush_panic("Out of memory.");
+    m->wire = wire;
+    m->wire_size = size;
+  }
+}
+
+/* Add bytes to the wire buffer as they are. */
+static void
+mccp_wire_add(struct mccp_state *m, const char *s, int n)
+{
+  mccp_wire_reserve(m, n);
+  memcpy(m->wire + m->wire_len, s, n);
+  m->wire_len += n;
+}
+
+/* Compress n bytes of s onto the end of the wire buffer. */
+static void
+mccp_deflate(struct mccp_state *m, char *s, int n, int flush)
+{
+  m->out.next_in = (Bytef *) s;
+  m->out.avail_in = n;
+  do {
+    int room;
+
+    mccp_wire_reserve(m, MCCP_CHUNK);
+    room = m->wire_size - m->wire_len;
+    m->out.next_out = m->wire + m->wire_len;
+    m->out.avail_out = room;
+    deflate(&m->out, flush);
+    m->wire_len += room - m->out.avail_out;
+    m->zip_out += room - m->out.avail_out;
+  } while (m->out.avail_out == 0);
+  m->raw_out += n;
+}
+
+/* Move everything in the output queue onto the wire buffer,
+ * compressed, and end with the given flush. */
+static void
+mccp_compress_queue(DESC *d, int flush)
+{
+  struct text_block *cur;
+
+  while ((cur = d->output.head) != NULL) {
+    mccp_deflate(d->mccp, cur->start, cur->nchars, Z_NO_FLUSH);
+    d->output_size -= cur->nchars;
+    d->output.head = cur->nxt;
+    free_text_block(cur);
+  }
+  d->output.tail = NULL;
+  mccp_deflate(d->mccp, NULL, 0, flush);
+}
+
+/* Send as much of the wire buffer as the socket will take, refilling
+ * it from the output queue while compression is on. Returns 0 if the
+ * connection should be closed. */
+static int
+mccp_send(DESC *d, int input_ready)
+{
+  struct mccp_state *m = d->mccp;
+  int written = 0;
+  bool failed = 0;
+
+  for (;;) {
+    char *buf;
+    int cnt = 0, len;
+
+    if (m->wire_pos == m->wire_len) {
+      m->wire_pos = m->wire_len = 0;
+      if (!(d->conn_flags & CONN_MCCP2) || !d->output.head)
+        break;
+      mccp_compress_queue(d, Z_SYNC_FLUSH);
+    }
+    buf = (char *) m->wire + m->wire_pos;
+    len = m->wire_len - m->wire_pos;
+    if (d->ssl) {
+      d->ssl_state =
+        ssl_write(d->ssl, d->ssl_state, input_ready, 1, buf, len, &cnt);
+      if (d->ssl_state < 0) {
+        /* Fatal error; the SSL object is freed with the descriptor */
+        d->ssl_state = 0;
+        shutdownsock(d, "ssl error", NOTHING, CONN_NOWRITE);
+        failed = 1;
+        break;
+      }
+      if (ssl_want_write(d->ssl_state))
+        break;
+    } else {
+      cnt = send(d->descriptor, buf, len, 0);
+      if (cnt < 0) {
+        if (is_blocking_err(errno))
+          break;
+        shutdownsock(d, "socket error", NOTHING, CONN_NOWRITE);
+        return 0;
+      }
+    }
+    written += cnt;
+    m->wire_pos += cnt;
+    if (cnt < len)
+      break;
+  }
+  d->output_chars += written;
+  if (failed)
+    return 0;
+  return written ? written : 1;
+}
+
+/* Start compressing output. Whatever is already queued goes out
+ * uncompressed, followed by the marker that starts the stream. */
+static void
+mccp_start_output(DESC *d)
+{
+  static const char marker[5] = {IAC, SB, TN_MCCP2, IAC, SE};
+  struct mccp_state *m = mccp_state(d);
+  struct text_block *cur;
+
+  memset(&m->out, 0, sizeof m->out);
+  if (deflateInit(&m->out, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    do_rawlog_lvl(LT_CONN, MLOG_ERR, "[%d/%s/%s] Unable to start MCCP2: %s",
+                  d->descriptor, d->addr, d->ip,
+                  m->out.msg ? m->out.msg : "out of memory");
+    return;
+  }
+  while ((cur = d->output.head) != NULL) {
+    mccp_wire_add(m, cur->start, cur->nchars);
+    d->output_size -= cur->nchars;
+    d->output.head = cur->nxt;
+    free_text_block(cur);
+  }
+  d->output.tail = NULL;
+  mccp_wire_add(m, marker, sizeof marker);
+  d->conn_flags |= CONN_MCCP2;
+  do_rawlog_lvl(LT_CONN, MLOG_DEBUG, "[%d/%s/%s] Compressing output (MCCP2).",
+                d->descriptor, d->addr, d->ip);
+  process_output(d);
+}
+
+/* Finish the output stream, which puts the client back to reading
+ * plain text, and send as much of the rest as the socket will take. */
+static void
+mccp_end_output(DESC *d)
+{
+  if (!(d->conn_flags & CONN_MCCP2))
+    return;
+  mccp_compress_queue(d, Z_FINISH);
+  deflateEnd(&d->mccp->out);
+  d->conn_flags &= ~CONN_MCCP2;
+  process_output(d);
+}
+
+/* Start decompressing input. A negative window_bits resumes a stream
+ * whose zlib header was read before a reboot. */
+static void
+mccp_start_input(DESC *d, int window_bits)
+{
+  struct mccp_state *m = mccp_state(d);
+
+  memset(&m->in, 0, sizeof m->in);
+  if (inflateInit2(&m->in, window_bits) != Z_OK) {
+    do_rawlog_lvl(LT_CONN, MLOG_ERR, "[%d/%s/%s] Unable to start MCCP3: %s",
+                  d->descriptor, d->addr, d->ip,
+                  m->in.msg ? m->in.msg : "out of memory");
+    return;
+  }
+  m->in_raw = window_bits < 0;
+  m->in_synced = 1;
+  d->conn_flags |= CONN_MCCP3;
+  do_rawlog_lvl(LT_CONN, MLOG_DEBUG,
+                "[%d/%s/%s] Decompressing input (MCCP3).", d->descriptor,
+                d->addr, d->ip);
+}
+
+/* Stop decompressing input. */
+static void
+mccp_end_input(DESC *d)
+{
+  if (!(d->conn_flags & CONN_MCCP3))
+    return;
+  inflateEnd(&d->mccp->in);
+  d->conn_flags &= ~CONN_MCCP3;
+}
+
+/* Decompress input from a client using MCCP3 and process it. */
+static void
+mccp_input(DESC *d, char *buf, int len)
+{
+  static const char flush_point[4] = {0, 0, '\xff', '\xff'};
+  struct mccp_state *m = d->mccp;
+  char out[BUFFER_LEN];
+  int r;
+
+  m->zip_in += len;
+  m->in_synced = len >= 4 && !memcmp(buf + len - 4, flush_point, 4);
+  m->in.next_in = (Bytef *) buf;
+  m->in.avail_in = len;
+  do {
+    int got;
+
+    m->in.next_out = (Bytef *) out;
+    m->in.avail_out = sizeof out;
+    r = inflate(&m->in, Z_SYNC_FLUSH);
+    got = sizeof out - m->in.avail_out;
+    m->raw_in += got;
+    if (r == Z_STREAM_END) {
+      /* The client stopped compressing, so the rest is plain. A
+       * stream resumed after a reboot still ends with the checksum
+       * from its zlib trailer, which isn't ours to check. */
+      char *rest = (char *) m->in.next_in;
+      int left = m->in.avail_in;
+
+      if (m->in_raw) {
+        int skip = left < 4 ? left : 4;
+        rest += skip;
+        left -= skip;
+      }
+      mccp_end_input(d);
+      if (got)
+        process_input_helper(d, out, got);
+      if (left)
+        process_input_helper(d, rest, left);
+      return;
+    } else if (r != Z_OK && r != Z_BUF_ERROR) {
+      do_rawlog_lvl(LT_CONN, MLOG_ERR, "[%d/%s/%s] Bad MCCP3 input: %s",
+                    d->descriptor, d->addr, d->ip,
+                    m->in.msg ? m->in.msg : "unknown error");
+      mccp_end_input(d);
+      shutdownsock(d, "compression error", NOTHING, 0);
+      return;
+    }
+    if (got)
+      process_input_helper(d, out, got);
+  } while (r == Z_OK && (m->in.avail_in > 0 || m->in.avail_out == 0));
+}
+
+/* Bytes saved so far by compression on a descriptor. */
+static long
+mccp_saved(DESC *d)
+{
+  if (!d->mccp)
+    return 0;
+  return (long) (d->mccp->raw_out - d->mccp->zip_out) +
+         (long) (d->mccp->raw_in - d->mccp->zip_in);
+}
+
+/* Log how much compression saved on a descriptor, and free its state. */
+static void
+mccp_free(DESC *d)
+{
+  struct mccp_state *m = d->mccp;
+
+  if (!m)
+    return;
+  if (d->conn_flags & CONN_MCCP2)
+    deflateEnd(&m->out);
+  mccp_end_input(d);
+  d->conn_flags &= ~CONN_MCCP2;
+  do_rawlog_lvl(LT_CONN, MLOG_INFO,
+                "[%d/%s/%s] MCCP sent %lu bytes as %lu, received %lu as %lu.",
+                d->descriptor, d->addr, d->ip, m->raw_out, m->zip_out,
+                m->raw_in, m->zip_in);
+  if (m->wire)
+    mush_free(m->wire, "mccp_wire");
+  mush_free(m, "mccp_state");
+  d->mccp = NULL;
+}
+#endif /* HAVE_LIBZ */
+
+/* A reboot keeps a descriptor's compression going by saving the
+ * compressed output that hasn't been sent yet, and, for MCCP3, the
+ * last 32K of decompressed input. The input stream can only be picked
+ * up again where the client last flushed it, after which it needs
+ * nothing from before but that window; the output stream is finished
+ * before the reboot and restarted afterwards instead. */
+#define MCCP_WINDOW (1 << 15)
+
+/* Save a descriptor's compression state to the reboot db. */
+static void
+mccp_save(PENNFILE *f, DESC *d)
+{
+#ifdef HAVE_LIBZ
+  struct mccp_state *m = d->mccp;
+
+  if (m) {
+    putref(f, m->wire_len - m->wire_pos);
+    penn_fwrite(m->wire + m->wire_pos, m->wire_len - m->wire_pos, f);
+  } else {
+    putref(f, 0);
+  }
+  if (d->conn_flags & CONN_MCCP3) {
+    unsigned char window[MCCP_WINDOW];
+    uInt len = 0;
+
+#if ZLIB_VERNUM >= 0x1280
+    if (m->in_synced &&
+        inflateGetDictionary(&m->in, window, &len) == Z_OK) {
+      putref(f, len);
+      penn_fwrite(window, len, f);
+      return;
+    }
+#endif
+    putref(f, -1);
+  }
+#else
+  putref(f, 0);
+#endif
+}
+
+/* Load a descriptor's compression state from the reboot db. The
+ * descriptor's conn_flags say which streams it was using. */
+static void
+mccp_load(PENNFILE *f, DESC *d)
+{
+  unsigned char window[MCCP_WINDOW];
+  uint32_t streams = d->conn_flags & (CONN_MCCP2 | CONN_MCCP3);
+  int len;
+
+  d->conn_flags &= ~(CONN_MCCP2 | CONN_MCCP3);
+  len = getref(f);
+  while (len > 0) {
+    int n = len > MCCP_WINDOW ? MCCP_WINDOW : len;
+
+    if (penn_fread(window, n, f) != (size_t) n)
+      longjmp(db_err, 1);
+#ifdef HAVE_LIBZ
+    mccp_wire_add(mccp_state(d), (char *) window, n);
+#endif
+    len -= n;
+  }
+  if (streams & CONN_MCCP3) {
+    len = getref(f);
+    if (len > MCCP_WINDOW ||
+        (len > 0 && penn_fread(window, len, f) != (size_t) len))
+      longjmp(db_err, 1);
+#ifdef HAVE_LIBZ
+    if (len >= 0) {
+      mccp_start_input(d, -MAX_WBITS);
+      if ((d->conn_flags & CONN_MCCP3) &&
+          inflateSetDictionary(&d->mccp->in, window, len) != Z_OK)
+        mccp_end_input(d);
+    }
+#endif
+    if (!(d->conn_flags & CONN_MCCP3)) {
+      /* There's no making sense of anything else the client sends. */
+      shutdownsock(d, "compression lost", NOTHING, 0);
+    }
+  }
+#ifdef HAVE_LIBZ
+  if ((streams & CONN_MCCP2) && options.mccp &&
+      !(d->conn_flags & CONN_CLOSE_READY))
+    mccp_start_output(d);
+#endif
+}
+
 static int
 network_send_ssl(DESC *d)
 {
   int input_ready, written = 0;
-  bool need_write = 0;
+  bool need_write = 0, failed = 0;
   struct text_block *cur;
 
   if (!d->ssl)
@@ -2449,11 +3130,23 @@ network_send_ssl(DESC *d)
     input_ready = 0;
   }
 
+#ifdef HAVE_LIBZ
+  if (MCCP_OUTPUT(d))
+    return mccp_send(d, input_ready);
+#endif
+
   while ((cur = d->output.head) != NULL) {
     int cnt = 0;
     need_write = 0;
     d->ssl_state = ssl_write(d->ssl, d->ssl_state, input_ready, 1, cur->start,
                              cur->nchars, &cnt);
+    if (d->ssl_state < 0) {
+      /* Fatal error; the SSL object is freed with the descriptor */
+      d->ssl_state = 0;
+      shutdownsock(d, "ssl error", NOTHING, CONN_NOWRITE);
+      failed = 1;
+      break;
+    }
     if (ssl_want_write(d->ssl_state)) {
       need_write = 1;
       break; /* Need to retry */
@@ -2475,6 +3168,8 @@ network_send_ssl(DESC *d)
   d->output_size -= written;
   d->output_chars += written;
 
+  if (failed)
+    return 0;
   return written + need_write;
 }
 
@@ -2537,6 +3232,11 @@ network_send(DESC *d)
   int written = 0;
   struct text_block *cur;
 
+#ifdef HAVE_LIBZ
+  if (d && MCCP_OUTPUT(d))
+    return mccp_send(d, 0);
+#endif
+
   if (!d || !d->output.head)
     return 1;
 
@@ -2589,10 +3289,14 @@ network_send(DESC *d)
 int
 process_output(DESC *d)
 {
+  int ret;
+
   if (d->ssl)
-    return network_send_ssl(d);
+    ret = network_send_ssl(d);
   else
-    return network_send(d);
+    ret = network_send(d);
+  desc_update_poll(d);
+  return ret;
 }
 
 /** A wrapper around test_telnet(), which is called via the
@@ -2675,6 +3379,7 @@ save_command(DESC *d, char *command)
     }
     add_to_queue(&d->input, command, strlen(command) + 1);
   }
+  desc_update_poll(d);
 }
 
 /** Send a telnet command to a descriptor to test for telnet support.
@@ -2936,6 +3641,32 @@ TELNET_HANDLER(telnet_mssp)
   process_output(d);
 }
 
+#ifdef HAVE_LIBZ
+/* DO MCCP2 or DO MCCP3, in reply to our offer. */
+TELNET_HANDLER(telnet_mccp)
+{
+  if (*cmd != DO)
+    return;
+  if (!options.mccp) {
+    char reply[3] = {IAC, WONT, 0};
+    reply[2] = *(cmd + 1);
+    queue_newwrite(d, reply, 3);
+    process_output(d);
+  } else if (*(cmd + 1) == TN_MCCP2 && !(d->conn_flags & CONN_MCCP2)) {
+    mccp_start_output(d);
+  }
+  /* With MCCP3, the client starts compressing when it's ready */
+}
+
+/* IAC SB MCCP3 IAC SE: Everything the client sends after this is
+ * compressed. */
+TELNET_HANDLER(telnet_mccp3_sb)
+{
+  if (options.mccp && !(d->conn_flags & CONN_MCCP3))
+    mccp_start_input(d, MAX_WBITS);
+}
+#endif
+
 TELNET_HANDLER(telnet_gmcp) { d->conn_flags |= CONN_GMCP; }
 
 TELNET_HANDLER(telnet_gmcp_sb)
@@ -3188,9 +3919,7 @@ FUNCTION(fun_oob)
       continue;
     }
 
-    DESC_ITER_CONN (d) {
-      if (d->player != who)
-        continue;
+    DESC_ITER_PLAYER (who, d) {
       if (d->conn_flags & CONN_WEBSOCKETS) {
         send_websocket_object(d, args[1], json);
         i++;
@@ -3268,6 +3997,22 @@ init_telnet_opts(void)
   telopt->sb = telnet_gmcp_sb;
   telnet_options[i] = telopt;
 
+#ifdef HAVE_LIBZ
+  telopt = mush_malloc(sizeof(struct telnet_opt), "telopt");
+  telopt->optcode = i = TN_MCCP2;
+  telopt->offer = options.mccp ? WILL : 0;
+  telopt->handler = telnet_mccp;
+  telopt->sb = NULL;
+  telnet_options[i] = telopt;
+
+  telopt = mush_malloc(sizeof(struct telnet_opt), "telopt");
+  telopt->optcode = i = TN_MCCP3;
+  telopt->offer = options.mccp ? WILL : 0;
+  telopt->handler = telnet_mccp;
+  telopt->sb = telnet_mccp3_sb;
+  telnet_options[i] = telopt;
+#endif
+
   /* Store the telnet options we negotiate for new connections,
    * to avoid looking them up every time someone connects */
   len = 0;
@@ -3396,6 +4141,10 @@ process_input_helper(DESC *d, char *tbuf1, int got)
 {
   char *p, *pend, *q, *qend;
   int is_first;
+#ifdef HAVE_LIBZ
+  char *compressed = NULL;
+  uint32_t was_compressed = d->conn_flags & CONN_MCCP3;
+#endif
 
   is_first = d->conn_flags & CONN_AWAITING_FIRST_DATA;
 
@@ -3407,7 +4156,11 @@ process_input_helper(DESC *d, char *tbuf1, int got)
 
   if ((d->conn_flags & CONN_WEBSOCKETS)) {
     /* Process using WebSockets framing. */
-    got = process_websocket_frame(d, tbuf1, got);
+    got = process_websocket_frame(d, &tbuf1, got);
+    if (got < 0) {
+      shutdownsock(d, "compression error", NOTHING, 0);
+      return;
+    }
   }
 
   if (!d->raw_input) {
@@ -3459,6 +4212,13 @@ process_input_helper(DESC *d, char *tbuf1, int got)
         if (p < pend)
           *p++ = *q;
       }
+#ifdef HAVE_LIBZ
+      else if ((d->conn_flags & CONN_MCCP3) && !was_compressed) {
+        /* That was IAC SB MCCP3 IAC SE, and the rest is compressed */
+        compressed = q + 1;
+        break;
+      }
+#endif
     } else if (p < pend) {
       *p++ = *q;
     }
@@ -3472,6 +4232,14 @@ process_input_helper(DESC *d, char *tbuf1, int got)
   }
 
   d->conn_flags &= ~CONN_AWAITING_FIRST_DATA;
+
+  if (d->conn_flags & CONN_WEBSOCKETS)
+    websocket_input_done(d);
+
+#ifdef HAVE_LIBZ
+  if (compressed && compressed < qend)
+    mccp_input(d, compressed, qend - compressed);
+#endif
 }
 
 /* ARGSUSED */
@@ -3538,7 +4306,12 @@ process_input(DESC *d, int output_ready __attribute__((__unused__)))
     }
   }
 
-  process_input_helper(d, tbuf1, got);
+#ifdef HAVE_LIBZ
+  if (d->conn_flags & CONN_MCCP3)
+    mccp_input(d, tbuf1, got);
+  else
+#endif
+    process_input_helper(d, tbuf1, got);
 
   return 1;
 }
@@ -3614,8 +4387,10 @@ process_commands(void)
         /* Falls through - to free input buffer */
         case CRES_OK:
           cdesc->input.head = t->nxt;
-          if (!cdesc->input.head)
+          if (!cdesc->input.head) {
             cdesc->input.tail = NULL;
+            desc_update_poll(cdesc);
+          }
 #ifdef DEBUG
           do_rawlog_lvl(LT_TRACE, MLOG_DEBUG, "free_text_block(%p) at 5.",
                         (void *) t);
@@ -4041,7 +4816,7 @@ do_http_command(DESC *d)
   pe_regs_setenv(pe_info->regvals, 1, req->inbody);
 
   /* 'invisibly' connect. */
-  d->player = HTTP_HANDLER;
+  desc_set_player(d, HTTP_HANDLER);
   d->connected = CONN_PLAYER;
   d->connected_at = mudtime;
 
@@ -4052,7 +4827,7 @@ do_http_command(DESC *d)
   run_http_command(HTTP_HANDLER, d->descriptor, d->http_request->method,
                    pe_info);
 
-  d->player = NOTHING;
+  desc_set_player(d, NOTHING);
   d->connected = CONN_SCREEN;
 
   /* pe_info is freed by the parser */
@@ -4297,7 +5072,7 @@ dump_messages(DESC *d, dbref player, int isnew)
 
   d->connected = CONN_PLAYER;
   d->connected_at = mudtime;
-  d->player = player;
+  desc_set_player(d, player);
 
   connlog_login(d->connlog_id, player);
 
@@ -4337,10 +5112,8 @@ dump_messages(DESC *d, dbref player, int isnew)
   }
 
   /* check to see if this is a reconnect */
-  DESC_ITER_CONN (tmpd) {
-    if (tmpd->player == player) {
-      num++;
-    }
+  DESC_ITER_PLAYER (player, tmpd) {
+    num++;
   }
   /* give permanent text messages */
   if (isnew)
@@ -4434,7 +5207,7 @@ check_connect(DESC *d, const char *msg)
       d->connected = CONN_PLAYER;
       if (Can_Hide(player))
         d->hide = 1;
-      d->player = player;
+      desc_set_player(d, player);
       set_flag(player, player, "DARK", 0, 0, 0);
       if ((dump_messages(d, player, 0)) == 0) {
         d->connected = CONN_DENIED;
@@ -4456,7 +5229,7 @@ check_connect(DESC *d, const char *msg)
                     Name(Location(player)), Location(player));
       /* Set player !dark */
       d->connected = CONN_PLAYER;
-      d->player = player;
+      desc_set_player(d, player);
       set_flag(player, player, "DARK", 1, 0, 0);
       if ((dump_messages(d, player, 0)) == 0) {
         d->connected = CONN_DENIED;
@@ -4477,7 +5250,7 @@ check_connect(DESC *d, const char *msg)
                     Name(Location(player)), Location(player));
       /* Set player hidden */
       d->connected = CONN_PLAYER;
-      d->player = player;
+      desc_set_player(d, player);
       if (Can_Hide(player))
         d->hide = 1;
       if ((dump_messages(d, player, 0)) == 0) {
@@ -4672,6 +5445,14 @@ close_sockets(void)
 
   for (d = descriptor_list; d; d = dnext) {
     dnext = d->next;
+#ifdef HAVE_LIBZ
+    if (d->conn_flags & CONN_MCCP2) {
+      /* The message has to go in the compressed stream, before its end */
+      queue_newwrite(d, shutmsg, shutlen);
+      queue_newwrite(d, "\r\n", 2);
+      mccp_end_output(d);
+    } else
+#endif
     if (!d->ssl) {
 #ifdef HAVE_WRITEV
       struct iovec byebye[2];
@@ -4690,6 +5471,8 @@ close_sockets(void)
       ssl_write(d->ssl, d->ssl_state, 0, 1, shutmsg, shutlen, &offset);
       offset = 0;
       ssl_write(d->ssl, d->ssl_state, 0, 1, "\r\n", 2, &offset);
+    }
+    if (d->ssl) {
       ssl_close_connection(d->ssl);
       d->ssl = NULL;
       d->ssl_state = 0;
@@ -4733,13 +5516,12 @@ boot_player(dbref player, int idleonly, int silent, dbref booter)
   if (idleonly)
     ignore = least_idle_desc(player, 1);
 
-  DESC_ITER_CONN (d) {
+  DESC_ITER_PLAYER (player, d) {
     if (boot) {
       boot_desc(boot, "boot", booter);
       boot = NULL;
     }
-    if (d->player == player &&
-        (!ignore || (d != ignore && difftime(now, d->last_time) > 60.0))) {
+    if (!ignore || (d != ignore && difftime(now, d->last_time) > 60.0)) {
       if (!idleonly && !silent && !count)
         notify(player, T("You are politely shown to the door."));
       count++;
@@ -4854,6 +5636,21 @@ sockset_show(DESC *d, char *nl)
   safe_format(buff, &bp, "%-15s:  %s", "Telnet",
               (TELNET_ABLE(d) ? "Yes" : "No"));
   safe_strl(nl, nllen, buff, &bp);
+#ifdef HAVE_LIBZ
+  if (d->conn_flags & (CONN_MCCP2 | CONN_MCCP3))
+    safe_format(buff, &bp, "%-15s:  %s%s%s, %ld bytes saved", "Compression",
+                (d->conn_flags & CONN_MCCP2 ? "MCCP2" : ""),
+                ((d->conn_flags & CONN_MCCP2) && (d->conn_flags & CONN_MCCP3)
+                   ? " "
+                   : ""),
+                (d->conn_flags & CONN_MCCP3 ? "MCCP3" : ""), mccp_saved(d));
+  else if (d->ws_deflate)
+    safe_format(buff, &bp, "%-15s:  permessage-deflate, %ld bytes saved",
+                "Compression", websocket_deflate_saved(d));
+  else
+    safe_format(buff, &bp, "%-15s:  %s", "Compression", "No");
+  safe_strl(nl, nllen, buff, &bp);
+#endif
   safe_format(buff, &bp, "%-15s:  %d", "Width", d->width);
   safe_strl(nl, nllen, buff, &bp);
   safe_format(buff, &bp, "%-15s:  %d", "Height", d->height);
@@ -5065,14 +5862,27 @@ player_desc(dbref player)
 {
   DESC *d;
 
-  for (d = descriptor_list; d; d = d->next) {
-    if (d->connected && (d->player == player)) {
-      return d;
-    }
+  DESC_ITER_PLAYER (player, d) {
+    return d;
   }
   return (DESC *) NULL;
 }
 
+/** Given a player dbref, return the head of the list of descriptors
+ * attached to that player, linked through next_for_player. The list
+ * can include descriptors that are not (or no longer) connected, so
+ * callers should check d->connected.
+ * \param player dbref of player.
+ * \return pointer to the player's first descriptor, or NULL.
+ */
+DESC *
+player_descs(dbref player)
+{
+  if (!GoodObject(player))
+    return NULL;
+  return im_find(descs_by_player, player);
+}
+
 /** Pemit to a specified socket.
  * \param player the enactor.
  * \param pc string containing port number to send message to.
@@ -5220,12 +6030,10 @@ inactive_desc(dbref player)
   time_t now;
   int numd = 0;
   now = mudtime;
-  DESC_ITER_CONN (d) {
-    if (d->player == player) {
-      numd++;
-      if (difftime(now, d->last_time) > 60.0)
-        in = d;
-    }
+  DESC_ITER_PLAYER (player, d) {
+    numd++;
+    if (difftime(now, d->last_time) > 60.0)
+      in = d;
   }
   if (numd > 1)
     return in;
@@ -6025,14 +6833,10 @@ announce_disconnect(DESC *saved, const char *reason, dbref executor)
   if (!GoodObject(loc))
     return;
 
-  DESC_ITER_CONN (d) {
+  DESC_ITER_PLAYER (player, d) {
     /* Don't count this current DESC, we want number of _other_ DESCs for this
-     * player.
-     * In a QUIT, saved won't be in descriptor_list, but in a LOGOUT, it will
-     * be. */
-    if (d == saved)
-      continue;
-    if (d->player == player)
+     * player. */
+    if (d != saved)
       numleft += 1;
   }
 
@@ -6641,8 +7445,8 @@ lookup_desc(dbref executor, const char *name)
       return NULL;
     else {
       /* walk the descriptor list looking for a match of a dbref */
-      DESC_ITER_CONN (d) {
-        if ((d->player == target) && (!Hidden(d) || Priv_Who(executor)) &&
+      DESC_ITER_PLAYER (target, d) {
+        if ((!Hidden(d) || Priv_Who(executor)) &&
             (!match || (d->last_time > match->last_time)))
           match = d;
       }
@@ -6656,8 +7460,8 @@ can_see_connected(dbref player, dbref target)
 {
   DESC *d;
 
-  DESC_ITER_CONN (d) {
-    if ((d->player == target) && (!Hidden(d) || Priv_Who(player)))
+  DESC_ITER_PLAYER (target, d) {
+    if (!Hidden(d) || Priv_Who(player))
       return 1;
   }
   return 0;
@@ -6673,9 +7477,8 @@ DESC *
 least_idle_desc(dbref player, int priv)
 {
   DESC *d, *match = NULL;
-  DESC_ITER_CONN (d) {
-    if ((d->player == player) && (priv || !Hidden(d)) &&
-        (!match || (d->last_time > match->last_time)))
+  DESC_ITER_PLAYER (player, d) {
+    if ((priv || !Hidden(d)) && (!match || (d->last_time > match->last_time)))
       match = d;
   }
 
@@ -6691,9 +7494,8 @@ int
 most_conn_time(dbref player)
 {
   DESC *d, *match = NULL;
-  DESC_ITER_CONN (d) {
-    if ((d->player == player) && !Hidden(d) &&
-        (!match || (d->connected_at > match->connected_at)))
+  DESC_ITER_PLAYER (player, d) {
+    if (!Hidden(d) && (!match || (d->connected_at > match->connected_at)))
       match = d;
   }
   if (match) {
@@ -6712,9 +7514,8 @@ int
 most_conn_time_priv(dbref player)
 {
   DESC *d, *match = NULL;
-  DESC_ITER_CONN (d) {
-    if ((d->player == player) &&
-        (!match || (d->connected_at > match->connected_at)))
+  DESC_ITER_PLAYER (player, d) {
+    if (!match || (d->connected_at > match->connected_at))
       match = d;
   }
   if (match) {
@@ -7004,6 +7805,8 @@ FUNCTION(fun_terminfo)
         safe_str(" telnet", buff, bp);
       if (match->conn_flags & CONN_GMCP)
         safe_str(" gmcp", buff, bp);
+      if (match->conn_flags & CONN_MCCP2)
+        safe_str(" mccp", buff, bp);
       if (match->conn_flags & CONN_PROMPT_NEWLINES)
         safe_str(" prompt_newlines", buff, bp);
       if (is_ssl_desc(match))
@@ -7138,14 +7941,12 @@ FUNCTION(fun_ports)
   }
   /* Walk descriptor chain. */
   first = 1;
-  DESC_ITER_CONN (d) {
-    if (d->player == target) {
-      if (first)
-        first = 0;
-      else
-        safe_chr(' ', buff, bp);
-      safe_integer(d->descriptor, buff, bp);
-    }
+  DESC_ITER_PLAYER (target, d) {
+    if (first)
+      first = 0;
+    else
+      safe_chr(' ', buff, bp);
+    safe_integer(d->descriptor, buff, bp);
   }
 }
 
@@ -7214,17 +8015,16 @@ hide_player(dbref player, int hide, char *victim)
 
   if (hide == 2) {
     hide = 0;
-    DESC_ITER_CONN (d) {
-      if (d->player == thing && !d->hide) {
+    DESC_ITER_PLAYER (thing, d) {
+      if (!d->hide) {
         hide = 1;
         break;
       }
     }
   }
 
-  DESC_ITER_CONN (d) {
-    if (d->player == thing)
-      d->hide = hide;
+  DESC_ITER_PLAYER (thing, d) {
+    d->hide = hide;
   }
   if (hide) {
     if (player == thing)
@@ -7313,13 +8113,11 @@ hidden(dbref player)
 {
   DESC *d;
   int i = 0;
-  DESC_ITER_CONN (d) {
-    if (d->player == player) {
-      if (!Hidden(d))
-        return 0;
-      else
-        i++;
-    }
+  DESC_ITER_PLAYER (player, d) {
+    if (!Hidden(d))
+      return 0;
+    else
+      i++;
   }
   return (i > 0);
 }
@@ -7374,7 +8172,7 @@ dump_reboot_db(void)
   flags |= RDBF_SSL_SLAVE | RDBF_SLAVE_FD;
 #endif
 
-  flags |= RDBF_WEBSOCKET_FRAME;
+  flags |= RDBF_WEBSOCKET_FRAME | RDBF_MCCP | RDBF_WS_DEFLATE;
 
   if (setjmp(db_err)) {
     flag_broadcast(0, 0, T("GAME: Error writing reboot database!"));
@@ -7395,6 +8193,11 @@ dump_reboot_db(void)
 #endif
     putref(f, maxd);
     DESC_ITER (d) {
+      uint32_t conn_flags = d->conn_flags;
+#ifdef HAVE_LIBZ
+      /* Output compression gets restarted after the reboot. */
+      mccp_end_output(d);
+#endif
       putref(f, d->descriptor);
       putref(f, d->connected_at);
       putref(f, d->hide);
@@ -7414,7 +8217,7 @@ dump_reboot_db(void)
         putstring(f, REBOOT_DB_NOVALUE);
       putstring(f, d->addr);
       putstring(f, d->ip);
-      putref_u32(f, d->conn_flags);
+      putref_u32(f, conn_flags);
       putref(f, d->width);
       putref(f, d->height);
       if (d->ttype)
@@ -7425,6 +8228,8 @@ dump_reboot_db(void)
       putstring(f, d->checksum);
       putref_u64(f, d->ws_frame_len);
       putref_u64(f, d->connlog_id);
+      mccp_save(f, d);
+      save_websocket_deflate(f, d);
     } /* for loop */
 
     putref(f, 0);
@@ -7496,13 +8301,19 @@ load_reboot_db(void)
       d = mush_malloc(sizeof(DESC), "descriptor");
       d->descriptor = val;
       d->http_request = NULL;
+      d->poll_events = 0;
+      d->mccp = NULL;
+      d->ws_deflate = NULL;
       d->closer = NOTHING;
       d->close_reason = "unknown";
       d->connected_at = getref(f);
       d->conn_timer = NULL;
       d->hide = getref(f);
       d->cmds = getref(f);
-      d->player = getref(f);
+      d->player = NOTHING;
+      d->next = NULL;
+      d->next_for_player = NULL;
+      desc_set_player(d, getref(f));
       d->last_time = getref(f);
       d->connected = (GoodObject(d->player) && IsPlayer(d->player))
                        ? CONN_PLAYER
@@ -7565,6 +8376,15 @@ load_reboot_db(void)
       d->ssl_state = 0;
       d->next = NULL;
 
+      if (flags & RDBF_MCCP)
+        mccp_load(f, d);
+      else
+        d->conn_flags &= ~(CONN_MCCP2 | CONN_MCCP3);
+      if ((flags & RDBF_WS_DEFLATE) && !load_websocket_deflate(f, d)) {
+        /* There's no making sense of anything else the client sends. */
+        shutdownsock(d, "compression lost", NOTHING, 0);
+      }
+
       if (d->conn_flags & CONN_CLOSE_READY) {
         d->close_reason = "ssl shutdown";
         d->next = closed;
@@ -7582,7 +8402,7 @@ load_reboot_db(void)
         set_flag_internal(d->player, "CONNECTED");
       else if ((!d->player || !GoodObject(d->player)) && d->connected) {
         d->connected = CONN_SCREEN;
-        d->player = NOTHING;
+        desc_set_player(d, NOTHING);
       }
     } /* while loop */
 
@@ -239,6 +239,7 @@
 #include <sys/stat.h>
 #endif
 
+#include "attrib.h"
 #include "command.h"
 #include "conf.h"
 #include "dbdefs.h"
@@ -816,6 +817,13 @@ static int stat_delete;        /**< Number of chunk deletions */
 static int m_count;                      /**< The used length for the arrays. */
 static chunk_reference_t **m_references; /**< The passed-in references array. */
 
+/** Are we between chunk_bulk_begin() and chunk_bulk_end()? */
+static bool bulk_mode = 0;
+#ifdef CHUNK_PARANOID
+/** Regions changed by chunk_create() in bulk mode, a bit each */
+static uint8_t bulk_touched[(UINT16_MAX + 1) / 8];
+#endif
+
 #ifdef CHUNK_PARANOID
 /** Log of recent actions for debug purposes */
 static char rolling_log[ROLLING_LOG_SIZE][ROLLING_LOG_ENTRY_LEN];
@@ -868,6 +876,11 @@ debug_log(char const *format, ...)
 #ifdef CHUNK_PARANOID
   va_list args;
 
+  /* The log explains a failed region check, and bulk mode puts those
+   * off until there's nothing recent left to explain. */
+  if (bulk_mode && !noisy_log)
+    return;
+
   va_start(args, format);
   mush_vsnprintf(rolling_log[rolling_pos], ROLLING_LOG_ENTRY_LEN, format, args);
   va_end(args);
@@ -2365,7 +2378,9 @@ acc_chunk_create(char const *data, uint16_t len, uint8_t derefs)
   regions[region].total_derefs += derefs;
   touch_cache_region(regions[region].in_memory);
 #ifdef CHUNK_PARANOID
-  if (!region_is_valid(region))
+  if (bulk_mode)
+    bulk_touched[region / 8] |= 1 << (region % 8);
+  else if (!region_is_valid(region))
     mush_panic("Invalid region after chunk_create!");
 #endif
   stat_create++;
@@ -2802,12 +2817,45 @@ chunk_create(char const *data, uint16_t len, uint8_t derefs)
   return chunker->chunk_create(data, len, derefs);
 }
 
+/** Start storing a lot of data at once, as when loading the database.
+ * Checking a region after each chunk_create() means walking every
+ * chunk in it, so until chunk_bulk_end() the check is put off, and
+ * each region changed is checked once at the end instead. Nothing
+ * goes in the rolling debug log meanwhile, either.
+ */
+void
+chunk_bulk_begin(void)
+{
+  bulk_mode = 1;
+}
+
+/** Finish a chunk_bulk_begin(), checking the regions it changed. */
+void
+chunk_bulk_end(void)
+{
+#ifdef CHUNK_PARANOID
+  uint32_t region;
+
+  if (bulk_mode) {
+    for (region = 0; region < region_count; region++) {
+      if (!(bulk_touched[region / 8] & (1 << (region % 8))))
+        continue;
+      bulk_touched[region / 8] &= ~(1 << (region % 8));
+      if (!region_is_valid(region))
+        mush_panic("Invalid region after chunk_create!");
+    }
+  }
+#endif
+  bulk_mode = 0;
+}
+
 /** Deallocate a chunk of storage.
  * \param reference the reference to the chunk to be freed.
  */
 void
 chunk_delete(chunk_reference_t reference)
 {
+  atr_cache_forget(reference);
   chunker->chunk_delete(reference);
 }
 
@@ -2861,6 +2909,11 @@ chunk_derefs(chunk_reference_t reference)
 void
 chunk_migration(int count, chunk_reference_t **references)
 {
+  int n;
+
+  for (n = 0; n < count; n++) {
+    atr_cache_forget(*references[n]);
+  }
   chunker->migration(count, references);
 }
 
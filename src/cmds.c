@@ -765,6 +765,8 @@ extern slab *intmap_slab;
 extern slab *lock_slab;
 extern slab *mail_slab;
 extern slab *memcheck_slab;
+extern slab *mque_slab;
+extern slab *pe_info_slab;
 extern slab *pe_reg_slab;
 extern slab *pe_reg_val_slab;
 extern slab *text_block_slab;
@@ -787,10 +789,10 @@ do_list_allocations(dbref player)
        time. */
     bvm_asmnode_slab,
 #endif
-    chanlist_slab,    chanuser_slab, flag_slab,   function_slab,
-    huffman_slab,     lock_slab,     mail_slab,   memcheck_slab,
-    text_block_slab,  intmap_slab,   pe_reg_slab, pe_reg_val_slab,
-    flagbucket_slab};
+    chanlist_slab,    chanuser_slab, flag_slab,    function_slab,
+    huffman_slab,     lock_slab,     mail_slab,    memcheck_slab,
+    text_block_slab,  intmap_slab,   pe_reg_slab,  pe_reg_val_slab,
+    pe_info_slab,     mque_slab,     flagbucket_slab};
   size_t i;
 
   if (!Hasprivs(player)) {
@@ -814,6 +816,9 @@ do_list_allocations(dbref player)
     notify_format(player,
                   "     allocated objects: %-6d           free objects: %-6d",
                   stats.allocated, stats.freed);
+    notify_format(player,
+                  "   objects handed out: %-10lu  malloc calls saved: %lu",
+                  stats.served, stats.served - stats.pages_made);
     if (stats.allocated > 0) {
       double allocation_average = stats.allocated;
       allocation_average /= (stats.allocated + stats.freed);
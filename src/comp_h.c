@@ -29,6 +29,9 @@
 #endif
 
 
+#define LOOKUP_BITS     12      /**< bits decoded per table lookup */
+#define LOOKUP_SYMS     5       /**< max characters per table lookup */
+
 /** Type for a huffman code. It must be at least CODE_BITS+CHAR_BITS-1
  * bits long.
  */
@@ -41,15 +44,29 @@ typedef struct cnode {
   char c;               /**< character at this node. */
 } CNode;
 
+/** What the next LOOKUP_BITS bits of a compressed string decode to,
+ * starting from the top of the tree. Only whole codes are counted;
+ * an entry with no characters means the first code is longer than
+ * LOOKUP_BITS, and has to be walked a bit at a time.
+ */
+typedef struct dentry {
+  uint8_t bits;                 /**< Number of bits used by syms */
+  uint8_t nsyms;                /**< Number of characters in syms */
+  uint8_t eos;                  /**< Is the last of syms EOS? */
+  char syms[LOOKUP_SYMS];       /**< The decoded characters */
+} DEntry;
+
 static CNode *ctop;
 static CType ctable[TABLE_SIZE];
 static char ltable[TABLE_SIZE];
+static DEntry dtable[1 << LOOKUP_BITS];
 
 slab *huffman_slab = NULL;
 
 static int fix_tree_depth(CNode *node, int height, int zeros);
 static void add_ones(CNode *node);
 static void build_ctable(CNode *root, CType code, int numbits);
+static void build_dtable(void);
 
 /** Huffman-compress a string.
  * Compress a string: this is pretty easy. For each char in the string,
@@ -69,7 +86,7 @@ static void build_ctable(CNode *root, CType code, int numbits);
 static char *
 huff_text_compress(const char *s)
 {
-  CType stage;
+  uint64_t stage;
   int bits = 0;
   const char *p;
   char *b, *buf;
@@ -77,7 +94,7 @@ huff_text_compress(const char *s)
 
   /* Part 1 - how long will the compressed string be? */
   for (p = s; p && *p; p++)
-    bits += ltable[*p];
+    bits += ltable[(unsigned char) *p];
   bits += CHAR_BITS * 2 - 1;    /* add space for the ending \0 */
   needed_length = bits / CHAR_BITS;
 
@@ -87,15 +104,20 @@ huff_text_compress(const char *s)
   stage = 0;
   bits = 0;
 
+  /* Codes pile up on the stage until there's a full 32-bit word of
+   * them, which is written out all at once. */
   while (p && *p) {
     /* Put code on stage */
-    stage |= ctable[*p] << bits;
-    bits += ltable[*p];
-    /* Put any full bytes of stage into the compressed string */
-    while (bits >= CHAR_BITS) {
-      *b++ = stage & CHAR_MASK;
-      stage = stage >> CHAR_BITS;
-      bits -= CHAR_BITS;
+    stage |= (uint64_t) ctable[(unsigned char) *p] << bits;
+    bits += ltable[(unsigned char) *p];
+    if (bits >= 32) {
+      b[0] = stage & CHAR_MASK;
+      b[1] = (stage >> 8) & CHAR_MASK;
+      b[2] = (stage >> 16) & CHAR_MASK;
+      b[3] = (stage >> 24) & CHAR_MASK;
+      b += 4;
+      stage >>= 32;
+      bits -= 32;
     }
     p++;
   }
@@ -111,35 +133,19 @@ huff_text_compress(const char *s)
   return buf;
 }
 
-/** Walk the huffman tree.
- * This macro is used for walking the compression tree.
- * It is a macro for efficiency.
- */
-#define WALK_TREE(bitpos) \
-do { \
-  if (*p & (bitpos)) \
-    node = node->right; \
-  else \
-    node = node->left; \
-  if (!node->left && !node->right) { \
-    /* Got a char */ \
-    *b++ = node->c; \
-    if (!*p || ((long)(b - buf) >= (long)(sizeof(buf) - 1))) { \
-      *b++ = EOS; \
-      return buf; \
-    } \
-    if (node->c == EOS) \
-      return buf; \
-    node = ctop; \
-  } \
-} while (0)
-
 /** Huffman uncompress a string.
  * Uncompression is a snap, too. Go bit by bit, using the
  * bits to traverse the binary tree (0=left, 1=right) until reaching
  * a leaf node, which is the uncompressed character.
  * Stop when the leaf node turns out to be EOS.
  *
+ * Rather than really going bit by bit, the next LOOKUP_BITS bits are
+ * looked up in dtable, which gives all the characters whose codes fit
+ * in them. Codes that run into the terminating null, codes longer
+ * than LOOKUP_BITS and the last few characters before the buffer
+ * fills up are still walked a bit at a time, so the result is exactly
+ * what walking the whole tree would give.
+ *
  * To avoid generating memory problems, this function should be
  * used with something of the format
  * \verbatim
@@ -157,27 +163,92 @@ huff_text_uncompress(const char *s)
 {
 
   static char buf[BUFFER_LEN];
-  const char *p;
+  const unsigned char *p;
   char *b;
   CNode *node;
+  size_t pos, end;
+  unsigned int byte, look;
+  const DEntry *d;
 
   buf[0] = '\0';
   if (!s || !*s)
     return buf;
-  p = s;
+  p = (const unsigned char *) s;
   b = buf;
+  pos = 0;
+  end = strlen(s) * CHAR_BITS;
   /* Finally start decompressing the string... */
-  node = ctop;
   for (;;) {
-    WALK_TREE(1);
-    WALK_TREE(2);
-    WALK_TREE(4);
-    WALK_TREE(8);
-    WALK_TREE(16);
-    WALK_TREE(32);
-    WALK_TREE(64);
-    WALK_TREE(128);
-    p++;
+    if (pos + LOOKUP_BITS <= end
+        && b - buf < (long) sizeof(buf) - 1 - LOOKUP_SYMS) {
+      /* The lookup never reads past the terminating null */
+      look = p[pos / CHAR_BITS] | (p[pos / CHAR_BITS + 1] << 8)
+        | (p[pos / CHAR_BITS + 2] << 16);
+      d = &dtable[(look >> (pos % CHAR_BITS)) & ((1 << LOOKUP_BITS) - 1)];
+      if (d->nsyms) {
+        memcpy(b, d->syms, LOOKUP_SYMS);
+        b += d->nsyms;
+        pos += d->bits;
+        if (d->eos)
+          return buf;
+        continue;
+      }
+    }
+    /* Walk the tree for one character. */
+    node = ctop;
+    do {
+      byte = p[pos / CHAR_BITS];
+      if (byte & (1 << (pos % CHAR_BITS)))
+        node = node->right;
+      else
+        node = node->left;
+      pos++;
+      if (!node) {
+        /* Not something we compressed */
+        *b = EOS;
+        return buf;
+      }
+    } while (node->left || node->right);
+    /* Got a char */
+    *b++ = node->c;
+    if (!byte || ((long) (b - buf) >= (long) (sizeof(buf) - 1))) {
+      *b++ = EOS;
+      return buf;
+    }
+    if (node->c == EOS)
+      return buf;
+  }
+}
+
+/* Build dtable from the tree. */
+static void
+build_dtable(void)
+{
+  unsigned int look;
+  int n;
+  CNode *node;
+  DEntry *d;
+
+  for (look = 0; look < (1 << LOOKUP_BITS); look++) {
+    d = &dtable[look];
+    memset(d, 0, sizeof *d);
+    node = ctop;
+    for (n = 0; n < LOOKUP_BITS; n++) {
+      node = (look & (1 << n)) ? node->right : node->left;
+      if (!node)
+        break;
+      if (!node->left && !node->right) {
+        d->syms[d->nsyms++] = node->c;
+        d->bits = n + 1;
+        if (node->c == EOS) {
+          d->eos = 1;
+          break;
+        }
+        if (d->nsyms == LOOKUP_SYMS)
+          break;
+        node = ctop;
+      }
+    }
   }
 }
 
@@ -504,6 +575,7 @@ huff_init_compress(PENNFILE *f)
 
   ctop = table[1].node;
   build_ctable(ctop, 0, 0);
+  build_dtable();
 
 #ifdef STANDALONE
   printf("init_compress: Done\n");
@@ -519,6 +591,37 @@ struct compression_ops huffman_ops = {
   huff_text_uncompress
 };
 
+TEST_GROUP(huffman)
+{
+  char text[BUFFER_LEN], *comp;
+  int n;
+
+  /* Games that don't use huffman compression get a tree built with
+   * no sample text. */
+  if (!ctop)
+    huff_init_compress(NULL);
+
+  comp = huff_text_compress("");
+  TEST("huffman.1", strcmp(huff_text_uncompress(comp), "") == 0);
+  free(comp);
+  comp = huff_text_compress("think [add(1,2)]: %0 says, \"Hello!\"");
+  TEST("huffman.2", strcmp(huff_text_uncompress(comp),
+                           "think [add(1,2)]: %0 says, \"Hello!\"") == 0);
+  free(comp);
+  for (n = 0; n < BUFFER_LEN - 1; n++)
+    text[n] = 1 + (n * 7) % 255;
+  text[n] = '\0';
+  comp = huff_text_compress(text);
+  TEST("huffman.3", strcmp(huff_text_uncompress(comp), text) == 0);
+  free(comp);
+  for (n = 0; n < BUFFER_LEN - 1; n++)
+    text[n] = 'e';
+  text[n] = '\0';
+  comp = huff_text_compress(text);
+  TEST("huffman.4", strcmp(huff_text_uncompress(comp), text) == 0);
+  free(comp);
+}
+
 #ifdef STANDALONE
 void
 main(argc, argv)
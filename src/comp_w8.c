@@ -153,8 +153,7 @@ static char *b;
 
 static void output_previous_word(void);
 #ifdef COMP_STATS
-void compress_stats(long *entries, long *mem_used, long *total_uncompressed,
-                    long *total_compressed);
+static void word_compress_stats(dbref player);
 #endif
 static unsigned int hash_fn(const char *s, int hashtab_mask);
 
@@ -341,17 +340,28 @@ word_init_compress(PENNFILE *f __attribute__((__unused__)))
 }
 
 #ifdef COMP_STATS
-/** Return word-compression statistics.
+/** Report word-compression statistics.
+ * \param player the enactor.
  */
-void
-compress_stats(long *entries, long *mem_used, long *total_uncompressed,
-               long *total_compressed)
+static void
+word_compress_stats(dbref player)
 {
-
-  *entries = total_entries;
-  *mem_used = total_mallocs;
-  *total_uncompressed = total_uncomp;
-  *total_compressed = total_comp;
+  float percent;
+
+  notify_format(player,
+                " %ld compression table items used, taking %ld bytes.",
+                total_entries, total_mallocs);
+  notify_format(player, " %ld bytes in text before compression.",
+                total_uncomp);
+  notify_format(player, " %ld bytes in text AFTER compression.", total_comp);
+  percent = ((float) total_comp) / ((float) total_uncomp) * 100.0;
+  notify_format(player, " %.0f%% text compression ratio.", percent);
+  percent = ((float) (total_comp + total_mallocs + (32768L * sizeof(char *)))) /
+            ((float) total_uncomp) * 100.0;
+  notify_format(player,
+                " %.0f%% OVERALL compression ratio, including table items "
+                "and %ld bytes of word pointers.",
+                percent, (long) (32768 * sizeof(char *)));
 }
 #endif
 
@@ -0,0 +1,290 @@
+/**
+ * \file comp_zstd.c
+ *
+ * \brief Zstandard compression routines.
+ *
+ * Attribute text is compressed with zstd, using a dictionary trained
+ * on the database being loaded. Most attributes are far too short for
+ * zstd to find much to work with on its own, but they look a lot like
+ * each other, so a dictionary built from the whole database gets them
+ * well below what huffman manages.
+ *
+ * The dictionary is trained again at every startup, unless
+ * zstd_dictionary names a file. Then it's read from there, or trained
+ * and saved there if the file doesn't exist yet, so that it can be
+ * kept alongside the database and reused. Delete the file to retrain.
+ *
+ * Compressed attributes have to be ordinary strings, but zstd output
+ * can hold any byte. So the first byte says what follows: ZMARK_FRAME
+ * for a zstd frame with its nulls (and ZESC bytes) escaped, or
+ * ZMARK_RAW for text that didn't get any shorter by compressing it.
+ */
+
+#if defined(HAVE_LIBZSTD) && defined(HAVE_ZSTD_H) && defined(HAVE_ZDICT_H)
+
+#include <zstd.h>
+#include <zdict.h>
+
+#define ZSTD_DICT_SIZE (64 * 1024) /**< Largest dictionary to train */
+#define ZSTD_SAMPLE_BYTES (16 * 1024 * 1024) /**< Most text to train on */
+#define ZSTD_SAMPLE_MIN 8   /**< Shortest line to train on */
+#define ZSTD_LEVEL 6        /**< Compression level */
+#define ZSTD_FRAME_LEN ZSTD_COMPRESSBOUND(BUFFER_LEN)
+
+#define ZMARK_RAW 1   /**< Uncompressed text follows */
+#define ZMARK_FRAME 2 /**< Escaped zstd frame follows */
+#define ZESC 1        /**< In a frame, 0 is ZESC 2 and ZESC is ZESC 3 */
+
+static ZSTD_CCtx *zstd_cctx = NULL;
+static ZSTD_DCtx *zstd_dctx = NULL;
+static ZSTD_CDict *zstd_cdict = NULL;
+static ZSTD_DDict *zstd_ddict = NULL;
+static size_t zstd_dict_size = 0;
+
+static void *zstd_read_dict(const char *file, size_t *len);
+static void zstd_write_dict(const char *file, const void *dict, size_t len);
+static void *zstd_train_dict(PENNFILE *f, size_t *len);
+
+/* Read a saved dictionary. */
+static void *
+zstd_read_dict(const char *file, size_t *len)
+{
+  FILE *fp;
+  void *dict;
+
+  fp = fopen(file, "rb");
+  if (!fp)
+    return NULL;
+  dict = mush_malloc(ZSTD_DICT_SIZE, "zstd.dict");
+  *len = fread(dict, 1, ZSTD_DICT_SIZE, fp);
+  fclose(fp);
+  if (*len == 0) {
+    mush_free(dict, "zstd.dict");
+    return NULL;
+  }
+  return dict;
+}
+
+/* Save a trained dictionary. */
+static void
+zstd_write_dict(const char *file, const void *dict, size_t len)
+{
+  FILE *fp;
+
+  fp = fopen(file, "wb");
+  if (!fp) {
+    do_rawlog(LT_ERR, "Unable to save zstd dictionary to %s: %s", file,
+              strerror(errno));
+    return;
+  }
+  if (fwrite(dict, 1, len, fp) != len)
+    do_rawlog(LT_ERR, "Unable to save zstd dictionary to %s: %s", file,
+              strerror(errno));
+  fclose(fp);
+}
+
+/* Train a dictionary on the lines of a database file. */
+static void *
+zstd_train_dict(PENNFILE *f, size_t *len)
+{
+  char line[BUFFER_LEN * 2];
+  char *samples;
+  size_t *sizes;
+  size_t used = 0, n, max_samples = ZSTD_SAMPLE_BYTES / ZSTD_SAMPLE_MIN;
+  unsigned nsamples = 0;
+  void *dict;
+
+  samples = mush_malloc(ZSTD_SAMPLE_BYTES, "zstd.samples");
+  sizes = mush_calloc(max_samples, sizeof *sizes, "zstd.samples");
+  while (nsamples < max_samples && penn_fgets(line, sizeof line, f)) {
+    n = strcspn(line, "\r\n");
+    if (n < ZSTD_SAMPLE_MIN)
+      continue;
+    if (used + n > ZSTD_SAMPLE_BYTES)
+      break;
+    memcpy(samples + used, line, n);
+    used += n;
+    sizes[nsamples++] = n;
+  }
+
+  dict = mush_malloc(ZSTD_DICT_SIZE, "zstd.dict");
+  *len = ZDICT_trainFromBuffer(dict, ZSTD_DICT_SIZE, samples, sizes, nsamples);
+  mush_free(samples, "zstd.samples");
+  mush_free(sizes, "zstd.samples");
+  if (ZDICT_isError(*len)) {
+    do_rawlog(LT_ERR,
+              "Unable to train a zstd dictionary on %u lines (%s). "
+              "Compressing without one.",
+              nsamples, ZDICT_getErrorName(*len));
+    mush_free(dict, "zstd.dict");
+    return NULL;
+  }
+  do_rawlog(LT_ERR, "Trained a %lu byte zstd dictionary on %u lines.",
+            (unsigned long) *len, nsamples);
+  return dict;
+}
+
+/** Initialize zstd compression.
+ * Loads or trains the dictionary and sets up the (de)compression
+ * contexts.
+ * \param f filehandle of the database to train the dictionary on.
+ */
+static bool
+zstd_init_compress(PENNFILE *f)
+{
+  void *dict = NULL;
+  size_t len = 0;
+  bool trained = 0;
+
+  zstd_cctx = ZSTD_createCCtx();
+  zstd_dctx = ZSTD_createDCtx();
+  if (!zstd_cctx || !zstd_dctx) {
+    do_rawlog(LT_ERR, "Unable to create zstd contexts.");
+    return 0;
+  }
+
+  if (*options.zstd_dictionary) {
+    dict = zstd_read_dict(options.zstd_dictionary, &len);
+    if (dict)
+      do_rawlog(LT_ERR, "Read a %lu byte zstd dictionary from %s.",
+                (unsigned long) len, options.zstd_dictionary);
+  }
+  if (!dict && f) {
+    dict = zstd_train_dict(f, &len);
+    trained = 1;
+  }
+
+  if (dict) {
+    zstd_cdict = ZSTD_createCDict(dict, len, ZSTD_LEVEL);
+    zstd_ddict = ZSTD_createDDict(dict, len);
+    if (zstd_cdict && zstd_ddict) {
+      ZSTD_CCtx_refCDict(zstd_cctx, zstd_cdict);
+      zstd_dict_size = len;
+      if (trained && *options.zstd_dictionary)
+        zstd_write_dict(options.zstd_dictionary, dict, len);
+    } else {
+      do_rawlog(LT_ERR, "Unable to load the zstd dictionary.");
+      ZSTD_freeCDict(zstd_cdict);
+      ZSTD_freeDDict(zstd_ddict);
+      zstd_cdict = NULL;
+      zstd_ddict = NULL;
+    }
+    mush_free(dict, "zstd.dict");
+  }
+
+  /* Every byte counts on short attributes. */
+  ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_compressionLevel, ZSTD_LEVEL);
+  ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_contentSizeFlag, 0);
+  ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_checksumFlag, 0);
+  ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_dictIDFlag, 0);
+  return 1;
+}
+
+/** Zstd-compress a string.
+ * \param s string to be compressed.
+ * \return newly allocated compressed string, to be free()d by the caller.
+ */
+static char *
+zstd_text_compress(const char *s)
+{
+  static char frame[ZSTD_FRAME_LEN];
+  size_t len, flen, elen, n;
+  char *buf, *b;
+
+  len = strlen(s);
+  if (!len)
+    return strdup("");
+
+  flen = ZSTD_compress2(zstd_cctx, frame, sizeof frame, s, len);
+  if (!ZSTD_isError(flen)) {
+    for (elen = flen, n = 0; n < flen; n++)
+      if (frame[n] == 0 || frame[n] == ZESC)
+        elen++;
+    if (elen < len) {
+      b = buf = malloc(elen + 2);
+      *b++ = ZMARK_FRAME;
+      for (n = 0; n < flen; n++) {
+        if (frame[n] == 0 || frame[n] == ZESC) {
+          *b++ = ZESC;
+          *b++ = frame[n] + 2;
+        } else {
+          *b++ = frame[n];
+        }
+      }
+      *b = '\0';
+      return buf;
+    }
+  }
+
+  buf = malloc(len + 2);
+  buf[0] = ZMARK_RAW;
+  memcpy(buf + 1, s, len + 1);
+  return buf;
+}
+
+/** Zstd-uncompress a string.
+ * \param s a compressed string.
+ * \return a pointer to a static buffer containing the uncompressed string.
+ */
+static char *
+zstd_text_uncompress(const char *s)
+{
+  static char buf[BUFFER_LEN];
+  static char frame[ZSTD_FRAME_LEN];
+  const char *p;
+  size_t flen = 0, len;
+
+  buf[0] = '\0';
+  if (!s || !*s)
+    return buf;
+  if (*s == ZMARK_RAW) {
+    mush_strncpy(buf, s + 1, sizeof buf);
+    return buf;
+  }
+  if (*s != ZMARK_FRAME)
+    return buf;
+
+  for (p = s + 1; *p && flen < sizeof frame; p++) {
+    if (*p == ZESC && p[1]) {
+      p++;
+      frame[flen++] = *p - 2;
+    } else {
+      frame[flen++] = *p;
+    }
+  }
+  len = ZSTD_decompress_usingDDict(zstd_dctx, buf, sizeof buf - 1, frame, flen,
+                                   zstd_ddict);
+  if (ZSTD_isError(len))
+    len = 0;
+  buf[len] = '\0';
+  return buf;
+}
+
+struct compression_ops zstd_ops = {zstd_init_compress, zstd_text_compress,
+                                   zstd_text_uncompress};
+
+#endif /* HAVE_LIBZSTD && HAVE_ZSTD_H && HAVE_ZDICT_H */
+
+TEST_GROUP(zstd)
+{
+#if defined(HAVE_LIBZSTD) && defined(HAVE_ZSTD_H) && defined(HAVE_ZDICT_H)
+  static const char *const texts[] = {
+    "x", "think [add(1,2)]: %0 says, \"Hello!\"",
+    "$+who:@pemit %#=[iter(lwho(),name(##),,%r)]", ""};
+  char *comp;
+  size_t n;
+
+  if (!zstd_cctx)
+    zstd_init_compress(NULL);
+
+  for (n = 0; n < sizeof texts / sizeof texts[0]; n++) {
+    comp = zstd_text_compress(texts[n]);
+    TEST("zstd.1", strlen(comp) <= strlen(texts[n]) + 1);
+    TEST("zstd.2", strcmp(zstd_text_uncompress(comp), texts[n]) == 0);
+    free(comp);
+  }
+#else
+  /* Asking for zstd without it falls back to no compression. */
+  TEST("zstd.1", strcmp(options.attr_compression, "zstd") != 0);
+#endif
+}
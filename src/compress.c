@@ -3,8 +3,8 @@
  *
  * \brief Compression routine wrapper file for PennMUSH.
  *
- * This file does nothing but conditionally include the appropriate
- * attribute compression source code.
+ * This file conditionally includes the appropriate attribute
+ * compression source code, and reports on how well it's doing.
  *
  */
 
@@ -14,15 +14,21 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
 
+#include "attrib.h"
 #include "log.h"
 #include "mushtype.h"
+#include "dbdefs.h"
 #include "dbio.h"
 #include "conf.h"
 #include "externs.h"
 #include "mushdb.h"
 #include "mymalloc.h"
+#include "notify.h"
 #include "strutil.h"
+#include "tests.h"
 
 typedef bool (*init_fn)(PENNFILE *);
 typedef char *(*comp_fn)(char const *);
@@ -35,6 +41,7 @@ struct compression_ops {
 
 #include "comp_h.c"
 #include "comp_w8.c"
+#include "comp_zstd.c"
 
 static bool
 dummy_init(PENNFILE *f __attribute__((__unused__)))
@@ -72,6 +79,10 @@ init_compress(PENNFILE *f)
       comp_ops = &huffman_ops;
     else if (strcmp(options.attr_compression, "word") == 0)
       comp_ops = &word_ops;
+#if defined(HAVE_LIBZSTD) && defined(HAVE_ZSTD_H) && defined(HAVE_ZDICT_H)
+    else if (strcmp(options.attr_compression, "zstd") == 0)
+      comp_ops = &zstd_ops;
+#endif
     else {
       /* Unknown option! */
       do_rawlog(LT_ERR, "Unknown compression option '%s'. Defaulting to none.",
@@ -84,20 +95,117 @@ init_compress(PENNFILE *f)
   return comp_ops->init(f);
 }
 
+/* Running totals of what's gone through text_compress(), for
+ * compress_stats(). */
+static uint64_t comp_count = 0;
+static uint64_t comp_in_bytes = 0;
+static uint64_t comp_out_bytes = 0;
+
 __attribute_malloc__ char *
 text_compress(char const *s)
 {
-  return comp_ops->comp(s);
+  char *comp;
+
+  comp = comp_ops->comp(s);
+  if (comp) {
+    comp_count += 1;
+    comp_in_bytes += strlen(s);
+    comp_out_bytes += strlen(comp);
+  }
+  return comp;
 }
 
+/* One in this many calls to text_uncompress() is timed, for the
+ * decoding speed in compress_stats(). Must be a power of 2. */
+#define DECOMP_TIME_EVERY 64
+
+static uint64_t decomp_count = 0;
+static uint64_t decomp_timed_bytes = 0;
+static uint64_t decomp_timed_usecs = 0;
+
 char *
 text_uncompress(char const *s)
 {
-  return comp_ops->decomp(s);
+  uint64_t start;
+  char *text;
+
+  if (decomp_count++ & (DECOMP_TIME_EVERY - 1)) {
+    return comp_ops->decomp(s);
+  }
+  /* A single call is shorter than the clock's resolution, but the
+   * rounding evens out over many samples. */
+  start = mono_usecs();
+  text = comp_ops->decomp(s);
+  decomp_timed_usecs += mono_usecs() - start;
+  if (text) {
+    decomp_timed_bytes += strlen(text);
+  }
+  return text;
 }
 
 __attribute_malloc__ char *
 safe_uncompress(char const *s)
 {
-  return strdup(comp_ops->decomp(s));
+  return strdup(text_uncompress(s));
+}
+
+/** Report on attribute compression, for \@stats/tables.
+ * Reports how much the text compressed since startup, including the
+ * database load, has shrunk, and how fast a sample of the values
+ * decompressed since then were decoded.
+ * \param player the enactor.
+ */
+void
+compress_stats(dbref player)
+{
+  notify_format(player, "Attribute Compression (%s):",
+                options.attr_compression);
+  notify_format(player,
+                " %" PRIu64 " values, %" PRIu64 " bytes compressed to "
+                "%" PRIu64 " (%.1f%%).",
+                comp_count, comp_in_bytes, comp_out_bytes,
+                comp_in_bytes ? 100.0 * comp_out_bytes / comp_in_bytes
+                              : 100.0);
+  notify_format(player, " %" PRIu64 " values decoded, at %.1f MB/s.",
+                decomp_count,
+                decomp_timed_usecs
+                  ? (double) decomp_timed_bytes / decomp_timed_usecs
+                  : 0.0);
+#if defined(HAVE_LIBZSTD) && defined(HAVE_ZSTD_H) && defined(HAVE_ZDICT_H)
+  if (comp_ops == &zstd_ops) {
+    if (zstd_dict_size)
+      notify_format(player, " Using a %zu byte zstd dictionary.",
+                    zstd_dict_size);
+    else
+      notify(player, " Not using a zstd dictionary.");
+  }
+#endif
+#ifdef COMP_STATS
+  if (comp_ops == &word_ops)
+    word_compress_stats(player);
+#endif
+}
+
+TEST_GROUP(compress)
+{
+  static const char *const texts[] = {
+    "", "x", "think [add(1,2)]: %0 says, \"Hello!\"",
+    "$+who:@pemit %#=[iter(lwho(),name(##),,%r)]"};
+  char *comp;
+  size_t n;
+  uint64_t count, in, out, decoded;
+
+  for (n = 0; n < sizeof texts / sizeof texts[0]; n++) {
+    count = comp_count;
+    in = comp_in_bytes;
+    out = comp_out_bytes;
+    comp = text_compress(texts[n]);
+    decoded = decomp_count;
+    TEST("compress.1", strcmp(text_uncompress(comp), texts[n]) == 0);
+    TEST("compress.2", comp_count == count + 1 &&
+                         comp_in_bytes == in + strlen(texts[n]) &&
+                         comp_out_bytes == out + strlen(comp));
+    TEST("compress.3", decomp_count == decoded + 1);
+    free(comp);
+  }
 }
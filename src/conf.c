@@ -146,7 +146,10 @@ PENNCONF conftable[] = {
    "net"},
   {"use_ws", cf_bool, &options.use_ws, sizeof options.use_ws, 0, "net"},
   {"ws_url", cf_str, options.ws_url, sizeof options.ws_url, 0, "net"},
+  {"ws_deflate", cf_bool, &options.ws_deflate, 2, 0, "net"},
+  {"ws_deflate_takeover", cf_bool, &options.ws_deflate_takeover, 2, 0, "net"},
   {"use_dns", cf_bool, &options.use_dns, 2, 0, "net"},
+  {"mccp", cf_bool, &options.mccp, 2, 0, "net"},
   {"logins", cf_bool, &options.login_allow, 2, 0, "net"},
   {"player_creation", cf_bool, &options.create_allow, 2, 0, "net"},
   {"guests", cf_bool, &options.guest_allow, 2, 0, "net"},
@@ -161,6 +164,7 @@ PENNCONF conftable[] = {
   {"sql_database", cf_str, options.sql_database, sizeof options.sql_database,
    CP_GODONLY, "net"},
   {"forking_dump", cf_bool, &options.forking_dump, 2, 0, "dump"},
+  {"binary_dump", cf_bool, &options.binary_dump, 2, 0, "dump"},
   {"dump_message", cf_str, options.dump_message, sizeof options.dump_message,
    CP_OPTIONAL, "dump"},
   {"dump_complete", cf_str, options.dump_complete, sizeof options.dump_complete,
@@ -229,11 +233,17 @@ PENNCONF conftable[] = {
    "limits"},
   {"queue_loss", cf_int, &options.queue_loss, 10000, 0, "limits"},
   {"queue_chunk", cf_int, &options.queue_chunk, 100000, 0, "limits"},
+  {"queue_chunk_time", cf_int, &options.queue_chunk_time, 100000, 0,
+   "limits"},
   {"function_recursion_limit", cf_int, &options.func_nest_lim, 100000, 0,
    "limits"},
   {"function_invocation_limit", cf_int, &options.func_invk_lim, 100000, 0,
    "limits"},
   {"call_limit", cf_int, &options.call_lim, 1000000, 0, "limits"},
+  {"regexp_cache_memory", cf_int, &options.regexp_cache_memory, 100000000, 0,
+   "limits"},
+  {"attribute_cache_memory", cf_int, &options.attribute_cache_memory,
+   100000000, 0, "limits"},
   {"player_name_len", cf_int, &options.player_name_len, BUFFER_LEN - 1, 0,
    "limits"},
   {"queue_entry_cpu_time", cf_int, &options.queue_entry_cpu_time, 100000, 0,
@@ -278,6 +288,7 @@ PENNCONF conftable[] = {
   {"possessive_get_d", cf_bool, &options.possessive_get_d, 2, 0, "cmds"},
   {"link_to_object", cf_bool, &options.link_to_object, 2, 0, "cmds"},
   {"owner_queues", cf_bool, &options.owner_queues, 2, 0, "cmds"},
+  {"queue_sql_mirror", cf_bool, &options.queue_sql_mirror, 2, 0, "cmds"},
   {"full_invis", cf_bool, &options.full_invis, 2, 0, "cmds"},
   {"wiz_noaenter", cf_bool, &options.wiz_noaenter, 2, 0, "cmds"},
   {"really_safe", cf_bool, &options.really_safe, 2, 0, "cmds"},
@@ -322,6 +333,8 @@ PENNCONF conftable[] = {
 
   {"attr_compression", cf_str, options.attr_compression,
    sizeof options.attr_compression, 0, NULL},
+  {"zstd_dictionary", cf_str, options.zstd_dictionary,
+   sizeof options.zstd_dictionary, 0, NULL},
 
 #ifdef HAVE_SSL
   {"ssl_private_key_file", cf_str, options.ssl_private_key_file,
@@ -1171,6 +1184,8 @@ conf_default_set(void)
   strcpy(options.socket_file, "data/netmush.sock");
   options.use_ws = 1;
   strcpy(options.ws_url, "/wsclient");
+  options.ws_deflate = 1;
+  options.ws_deflate_takeover = 1;
   strcpy(options.input_db, "data/indb");
   strcpy(options.output_db, "data/outdb");
   strcpy(options.crash_db, "data/PANIC.db");
@@ -1212,6 +1227,7 @@ conf_default_set(void)
   options.starting_quota = 20;
   options.player_queue_limit = 100;
   options.queue_chunk = 3;
+  options.queue_chunk_time = 0;
   options.func_nest_lim = 50;
   options.func_invk_lim = 2500;
   options.call_lim = 0;
@@ -1259,6 +1275,7 @@ conf_default_set(void)
   strcpy(options.channel_flags, "");
   options.warn_interval = 3600;
   options.use_dns = 1;
+  options.mccp = 1;
   options.safer_ufun = 1;
   set_string_option(options.dump_warning_1min,
                     T("GAME: Database save in 1 minute."));
@@ -1290,12 +1307,14 @@ conf_default_set(void)
   options.zone_control = 1;
   options.link_to_object = 1;
   options.owner_queues = 0;
+  options.queue_sql_mirror = 0;
   options.wiz_noaenter = 0;
   strcpy(options.ip_addr, "");
   strcpy(options.ssl_ip_addr, "");
   options.player_name_spaces = 0;
   options.max_aliases = 3;
   options.forking_dump = 1;
+  options.binary_dump = 0;
   options.restrict_building = 0;
   options.free_objects = 1;
   options.flags_on_examine = 1;
@@ -1332,12 +1351,15 @@ conf_default_set(void)
   options.queue_entry_cpu_time = 1500;
   options.ascii_names = 1;
   options.call_lim = 10000;
+  options.regexp_cache_memory = 1000000;
+  options.attribute_cache_memory = 4000000;
   options.use_chunk = 1;
   strcpy(options.chunk_swap_file, "data/chunkswap");
   options.chunk_swap_initial = 2048;
   options.chunk_cache_memory = 1000000;
   options.chunk_migrate_amount = 50;
   strcpy(options.attr_compression, "none");
+  strcpy(options.zstd_dictionary, "");
   options.read_remote_desc = 0;
 #ifdef HAVE_SSL
   strcpy(options.ssl_private_key_file, "");
@@ -1813,6 +1835,8 @@ show_compile_options(dbref player)
     notify(player, T(" Attributes are Huffman compressed in memory."));
   } else if (strcmp(options.attr_compression, "word") == 0) {
     notify(player, T(" Attributes are word compressed in memory."));
+  } else if (strcmp(options.attr_compression, "zstd") == 0) {
+    notify(player, T(" Attributes are zstd compressed in memory."));
   } else {
     notify(player, T(" Attributes are not compressed in memory."));
   }
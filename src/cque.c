@@ -10,7 +10,9 @@
 
 #include <ctype.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <math.h>
 #include <signal.h>
 #include <string.h>
 #include <stdarg.h>
@@ -47,6 +49,7 @@
 #include "intmap.h"
 #include "log.h"
 #include "match.h"
+#include "memcheck.h"
 #include "mushdb.h"
 #include "mymalloc.h"
 #include "parse.h"
@@ -54,13 +57,45 @@
 #include "strtree.h"
 #include "strutil.h"
 #include "mushsql.h"
+#include "tests.h"
 
 intmap *queue_map = NULL; /**< Intmap for looking up queue entries by pid */
+slab *mque_slab = NULL;   /**< Slab for queue entries */
 static uint32_t top_pid = 1;
 #define MAX_PID (1U << 15)
 
-static MQUE *qfirst = NULL, *qlast = NULL, *qwait = NULL;
+/** A binary min-heap of queue entries, ordered by when they're due. */
+struct mque_heap {
+  MQUE **entries; /**< The heap array */
+  int count;      /**< Number of entries in the heap */
+  int size;       /**< Allocated size of entries */
+};
+
+/** Commands waiting to run for one owner. Owners with anything to run
+ * are kept in a ring that do_top() takes turns around, so one owner's
+ * runaway objects can't hold up everyone else's commands.
+ */
+struct owner_queue {
+  dbref owner;                   /**< Owner of the executors */
+  MQUE *first;                   /**< First command waiting to run */
+  MQUE *last;                    /**< Last command waiting to run */
+  int count;                     /**< Number of commands waiting */
+  bool active;                   /**< True if in the run ring */
+  bool orphaned;                 /**< Owner destroyed; free once empty */
+  struct owner_queue *ring_next; /**< Next owner in the run ring */
+  struct owner_queue *all_next;  /**< Next in the list of every owner */
+  uint64_t ran;                  /**< Commands run */
+  uint64_t wait_total;           /**< Total usecs commands spent queued */
+  uint64_t wait_max;             /**< Most usecs a command spent queued */
+};
+
+static intmap *owner_map = NULL; /**< Owner queues by dbref */
+static struct owner_queue *oq_all = NULL;
+static struct owner_queue *ring_first = NULL, *ring_last = NULL;
 static MQUE *qsemfirst = NULL, *qsemlast = NULL;
+static struct mque_heap qwait = {NULL, 0, 0};    /**< \@wait'd entries */
+static struct mque_heap qsemwait = {NULL, 0, 0}; /**< Semaphores w/ timeouts */
+static uint64_t qwait_seq = 0; /**< Heap insertion counter */
 
 static int add_to_generic(dbref player, int am, const char *name,
                           uint32_t flags);
@@ -69,17 +104,22 @@ static int add_to_sem(dbref player, int am, const char *name);
 static int queue_limit(dbref player);
 void free_qentry(MQUE *point);
 static int pay_queue(dbref player, const char *command);
-void wait_que(dbref executor, int waittill, char *command, dbref enactor,
+void wait_que(dbref executor, int64_t waittill, char *command, dbref enactor,
               dbref sem, const char *semattr, int until, MQUE *parent_queue);
 int que_next(void);
 
 static void show_queue(dbref player, dbref victim, int q_type, int q_quiet,
                        int q_all, MQUE *q_ptr, int *tot, int *self, int *del);
+static void show_queue_entry(dbref player, dbref victim, int q_type,
+                             int q_quiet, int q_all, MQUE *q, int *tot,
+                             int *self, int *del);
 static void show_queue_single(dbref player, MQUE *q, int q_type);
 static void show_queue_env(dbref player, MQUE *q);
+static void show_queue_latency(dbref player);
 static void do_raw_restart(dbref victim);
 static int waitable_attr(dbref thing, const char *atr);
 static void shutdown_a_queue(MQUE **head, MQUE **tail);
+static void shutdown_a_heap(struct mque_heap *h);
 static int do_entry(MQUE *entry, int include_recurses);
 static MQUE *new_queue_entry(NEW_PE_INFO *pe_info);
 void init_queue(void);
@@ -101,6 +141,243 @@ extern dbref report_dbref;
  */
 #define SEMAPHORE_FLAGS (AF_LOCKED | AF_PRIVATE | AF_NOCOPY | AF_NODUMP)
 
+/* The wait queue and the semaphore timeouts are kept in binary heaps
+ * keyed on wait_until, so adding an entry and expiring the k entries
+ * that are due are both O(log n) per entry. Ties go to whichever entry
+ * was added (or last had its time changed) first. */
+
+static inline bool
+mh_before(const MQUE *a, const MQUE *b)
+{
+  return a->wait_until < b->wait_until ||
+         (a->wait_until == b->wait_until && a->wait_seq < b->wait_seq);
+}
+
+static inline void
+mh_place(struct mque_heap *h, MQUE *q, int slot)
+{
+  h->entries[slot] = q;
+  q->wait_slot = slot;
+}
+
+/* Move the entry in a slot up towards the root until it's in order. */
+static void
+mh_sift_up(struct mque_heap *h, int slot)
+{
+  MQUE *q = h->entries[slot];
+
+  while (slot > 0) {
+    int parent = (slot - 1) / 2;
+    if (!mh_before(q, h->entries[parent]))
+      break;
+    mh_place(h, h->entries[parent], slot);
+    slot = parent;
+  }
+  mh_place(h, q, slot);
+}
+
+/* Move the entry in a slot down towards the leaves until it's in order. */
+static void
+mh_sift_down(struct mque_heap *h, int slot)
+{
+  MQUE *q = h->entries[slot];
+
+  for (;;) {
+    int child = slot * 2 + 1;
+    if (child >= h->count)
+      break;
+    if (child + 1 < h->count &&
+        mh_before(h->entries[child + 1], h->entries[child]))
+      child += 1;
+    if (!mh_before(h->entries[child], q))
+      break;
+    mh_place(h, h->entries[child], slot);
+    slot = child;
+  }
+  mh_place(h, q, slot);
+}
+
+/* Add an entry to a heap. */
+static void
+mh_insert(struct mque_heap *h, MQUE *q)
+{
+  if (h->count == h->size) {
+    h->size = h->size ? h->size * 2 : 64;
+    h->entries =
+      mush_realloc(h->entries, sizeof *h->entries * h->size, "mque.heap");
+  }
+  q->wait_seq = qwait_seq++;
+  mh_place(h, q, h->count++);
+  mh_sift_up(h, q->wait_slot);
+}
+
+/* Take an entry out of a heap. */
+static void
+mh_remove(struct mque_heap *h, MQUE *q)
+{
+  int slot = q->wait_slot;
+
+  h->count -= 1;
+  if (slot != h->count) {
+    mh_place(h, h->entries[h->count], slot);
+    if (slot > 0 && mh_before(h->entries[slot], h->entries[(slot - 1) / 2]))
+      mh_sift_up(h, slot);
+    else
+      mh_sift_down(h, slot);
+  }
+  q->wait_slot = -1;
+}
+
+/* Put an entry back in order after its wait_until changed. */
+static void
+mh_update(struct mque_heap *h, MQUE *q)
+{
+  int slot = q->wait_slot;
+
+  q->wait_seq = qwait_seq++;
+  if (slot > 0 && mh_before(q, h->entries[(slot - 1) / 2]))
+    mh_sift_up(h, slot);
+  else
+    mh_sift_down(h, slot);
+}
+
+/* Restore heap order after entries were dropped from the array. */
+static void
+mh_heapify(struct mque_heap *h)
+{
+  int slot;
+
+  for (slot = h->count / 2 - 1; slot >= 0; slot--)
+    mh_sift_down(h, slot);
+}
+
+static int
+mh_cmp(const void *a, const void *b)
+{
+  const MQUE *qa = *(MQUE *const *) a;
+  const MQUE *qb = *(MQUE *const *) b;
+
+  if (mh_before(qa, qb))
+    return -1;
+  return mh_before(qb, qa);
+}
+
+/* Sort a heap into due order for listing. A sorted array is still a
+ * valid heap, so nothing else has to be fixed up afterwards. */
+static void
+mh_sort(struct mque_heap *h)
+{
+  int slot;
+
+  qsort(h->entries, h->count, sizeof *h->entries, mh_cmp);
+  for (slot = 0; slot < h->count; slot++)
+    h->entries[slot]->wait_slot = slot;
+}
+
+/* Milliseconds until the first entry of a heap is due, at most limit. */
+static uint64_t
+mh_msecs_till(const struct mque_heap *h, uint64_t now, uint64_t limit)
+{
+  uint64_t when;
+
+  if (!h->count)
+    return limit;
+  when = h->entries[0]->wait_until;
+  if (when <= now)
+    return 0;
+  return (when - now < limit) ? when - now : limit;
+}
+
+/* Add an entry to the end of the semaphore queue, and to the timeout
+ * heap if it has a timeout. */
+static void
+sem_append(MQUE *q)
+{
+  q->next = NULL;
+  q->sem_prev = qsemlast;
+  if (qsemlast)
+    qsemlast->next = q;
+  else
+    qsemfirst = q;
+  qsemlast = q;
+  if (q->wait_until)
+    mh_insert(&qsemwait, q);
+}
+
+/* Take an entry off the semaphore queue and the timeout heap. */
+static void
+sem_unlink(MQUE *q)
+{
+  if (q->sem_prev)
+    q->sem_prev->next = q->next;
+  else
+    qsemfirst = q->next;
+  if (q->next)
+    q->next->sem_prev = q->sem_prev;
+  else
+    qsemlast = q->sem_prev;
+  q->next = q->sem_prev = NULL;
+  if (q->wait_slot >= 0)
+    mh_remove(&qsemwait, q);
+}
+
+/* Seconds until a waiting entry is due, rounded to the nearest second. */
+static long
+wait_secs_left(const MQUE *q)
+{
+  uint64_t now = now_msecs();
+
+  if (q->wait_until <= now)
+    return 0;
+  return (long) ((q->wait_until - now + 500) / 1000);
+}
+
+/* Parse a wait time in (possibly fractional) seconds into milliseconds. */
+static bool
+parse_wait_msecs(const char *str, int64_t *msecs)
+{
+  NVAL secs;
+
+  if (!is_strict_number(str))
+    return false;
+  secs = parse_number(str);
+  if (isnan(secs))
+    return false;
+  if (secs > INT_MAX)
+    secs = INT_MAX;
+  else if (secs < -INT_MAX)
+    secs = -INT_MAX;
+  *msecs = (int64_t) floor(secs * 1000.0 + 0.5);
+  return true;
+}
+
+TEST_GROUP(mque_heap)
+{
+  struct mque_heap h = {NULL, 0, 0};
+  MQUE q[5];
+  uint64_t when[5] = {50, 10, 40, 10, 30};
+  int n;
+
+  for (n = 0; n < 5; n++) {
+    q[n].wait_until = when[n];
+    mh_insert(&h, &q[n]);
+  }
+  TEST("mque_heap.1", h.count == 5 && h.entries[0] == &q[1]);
+  mh_remove(&h, &q[1]);
+  TEST("mque_heap.2", h.entries[0] == &q[3]);
+  q[0].wait_until = 5;
+  mh_update(&h, &q[0]);
+  TEST("mque_heap.3", h.entries[0] == &q[0]);
+  mh_sort(&h);
+  TEST("mque_heap.4", h.entries[0] == &q[0] && h.entries[1] == &q[3] &&
+                        h.entries[2] == &q[4] && h.entries[3] == &q[2]);
+  for (n = 0; n < h.count; n++)
+    TEST("mque_heap.5", h.entries[n]->wait_slot == n);
+  TEST("mque_heap.6", mh_msecs_till(&h, 3, 1000) == 2);
+  TEST("mque_heap.7", mh_msecs_till(&h, 8, 1000) == 0);
+  mush_free(h.entries, "mque.heap");
+}
+
 /** Queue initializtion function. Must be called before anything
  * is added to the queue.
  */
@@ -108,6 +385,146 @@ void
 init_queue(void)
 {
   queue_map = im_new();
+  owner_map = im_new();
+}
+
+/* Find or make the run queue for an owner. */
+static struct owner_queue *
+owner_queue(dbref owner)
+{
+  struct owner_queue *oq;
+
+  oq = im_find(owner_map, owner);
+  if (!oq) {
+    oq = mush_malloc(sizeof *oq, "mque.owner");
+    memset(oq, 0, sizeof *oq);
+    oq->owner = owner;
+    oq->all_next = oq_all;
+    oq_all = oq;
+    im_insert(owner_map, owner, oq);
+  }
+  return oq;
+}
+
+/* Unlink an owner's run queue from the list of every owner and free it. */
+static void
+owner_queue_free(struct owner_queue *oq)
+{
+  struct owner_queue **op;
+
+  for (op = &oq_all; *op; op = &(*op)->all_next) {
+    if (*op == oq) {
+      *op = oq->all_next;
+      break;
+    }
+  }
+  mush_free(oq, "mque.owner");
+}
+
+/** Forget a destroyed owner's run queue, so that whoever gets the
+ * dbref next starts with a fresh one instead of inheriting its stats
+ * and place in the ring. Commands already waiting in it still run,
+ * and it's freed once they have.
+ * \param owner dbref of the destroyed object.
+ */
+void
+free_owner_queue(dbref owner)
+{
+  struct owner_queue *oq;
+
+  oq = im_find(owner_map, owner);
+  if (!oq)
+    return;
+  im_delete(owner_map, owner);
+  if (oq->active)
+    oq->orphaned = true;
+  else
+    owner_queue_free(oq);
+}
+
+TEST_GROUP(owner_queue)
+{
+  struct owner_queue *oq;
+  dbref who = 99999; /* Never a real object in the test db */
+
+  oq = owner_queue(who);
+  oq->ran = 5;
+  oq->wait_max = 100;
+  free_owner_queue(who);
+  TEST("owner_queue.1", !im_exists(owner_map, who));
+  oq = owner_queue(who);
+  TEST("owner_queue.2", oq->ran == 0 && oq->wait_max == 0 && !oq->active);
+  free_owner_queue(who);
+  for (oq = oq_all; oq; oq = oq->all_next)
+    if (oq->owner == who)
+      break;
+  TEST("owner_queue.3", oq == NULL);
+}
+
+static void
+ring_append(struct owner_queue *oq)
+{
+  oq->ring_next = NULL;
+  oq->active = true;
+  if (ring_last)
+    ring_last->ring_next = oq;
+  else
+    ring_first = oq;
+  ring_last = oq;
+}
+
+/* Put an entry at the end of its owner's run queue. */
+static void
+run_queue_append(MQUE *entry)
+{
+  struct owner_queue *oq;
+
+  oq = owner_queue(GoodObject(entry->executor) ? Owner(entry->executor) : GOD);
+  entry->next = NULL;
+  entry->queued_at = mono_usecs();
+  if (oq->last)
+    oq->last->next = entry;
+  else
+    oq->first = entry;
+  oq->last = entry;
+  oq->count += 1;
+  if (!oq->active)
+    ring_append(oq);
+}
+
+/* Take the next entry to run, from the owner whose turn it is. That
+ * owner then goes to the back of the ring if they have more. */
+static MQUE *
+run_queue_pop(void)
+{
+  struct owner_queue *oq = ring_first;
+  MQUE *entry;
+  uint64_t waited;
+
+  if (!oq)
+    return NULL;
+  if (!(ring_first = oq->ring_next))
+    ring_last = NULL;
+
+  entry = oq->first;
+  if (!(oq->first = entry->next))
+    oq->last = NULL;
+  entry->next = NULL;
+  oq->count -= 1;
+
+  waited = mono_usecs() - entry->queued_at;
+  oq->ran += 1;
+  oq->wait_total += waited;
+  if (waited > oq->wait_max)
+    oq->wait_max = waited;
+
+  if (oq->first)
+    ring_append(oq);
+  else if (oq->orphaned)
+    owner_queue_free(oq);
+  else
+    oq->active = false;
+  return entry;
 }
 
 /** Returns true if the attribute on thing can be used as a semaphore.
@@ -168,40 +585,47 @@ add_to_generic(dbref player, int am, const char *name, uint32_t flags)
   return num;
 }
 
-/** Wrapper for add_to_generic() to incremement a player's QUEUE attribute.
- * \param player object whose QUEUE should be incremented
- * \param am amount to increment the QUEUE by
- * \retval new value of QUEUE
+/** Adjust the number of queue entries charged to an object.
+ * Counts live in the in-memory db_queue array; with the
+ * queue_sql_mirror option on they are also copied into the shared
+ * sqlite objects table, which costs a query per entry.
+ * \param player object whose queue count should be incremented
+ * \param am amount to increment the count by
+ * \retval new queue count
  */
 static int
 add_to(dbref player, int am)
 {
-  sqlite3 *sqldb;
-  sqlite3_stmt *adder;
-  int status;
-  sqlite3_int64 newam;
+  int newam;
 
   if (QUEUE_PER_OWNER) {
     player = Owner(player);
   }
 
-  sqldb = get_shared_db();
-  adder = prepare_statement(
-    sqldb, "UPDATE objects SET queue = remember(queue + ?, ?) WHERE dbref = ?",
-    "queue.add");
-  sqlite3_bind_int(adder, 1, am);
-  sqlite3_bind_pointer(adder, 2, &newam, "carray", NULL);
-  sqlite3_bind_int(adder, 3, player);
+  newam = (QueueCount(player) += am);
+
+  if (options.queue_sql_mirror) {
+    sqlite3 *sqldb;
+    sqlite3_stmt *mirror;
+    int status;
+
+    sqldb = get_shared_db();
+    mirror = prepare_statement(
+      sqldb, "UPDATE objects SET queue = ? WHERE dbref = ?", "queue.mirror");
+    if (mirror) {
+      sqlite3_bind_int(mirror, 1, newam);
+      sqlite3_bind_int(mirror, 2, player);
+      do {
+        status = sqlite3_step(mirror);
+      } while (is_busy_status(status));
+      if (status != SQLITE_DONE) {
+        do_rawlog(LT_ERR, "Unable to mirror queue count for #%d: %s", player,
+                  sqlite3_errstr(status));
+      }
+      sqlite3_reset(mirror);
+    }
+  }
 
-  do {
-    status = sqlite3_step(adder);
-  } while (is_busy_status(status));
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to update queue for #%d: %s", player,
-              sqlite3_errstr(status));
-    newam = -1;
-  }
-  sqlite3_reset(adder);
   return newam;
 }
 
@@ -281,7 +705,8 @@ free_qentry(MQUE *entry)
     pe_regs_free(entry->regvals);
   }
 
-  mush_free(entry, "mque");
+  slab_free(mque_slab, entry);
+  DEL_CHECK("mque_slab");
 }
 
 static int
@@ -348,9 +773,12 @@ new_queue_entry(NEW_PE_INFO *pe_info)
 {
   MQUE *entry;
 
-  entry = mush_malloc(sizeof *entry, "mque");
+  if (!mque_slab)
+    mque_slab = slab_create("MQUE", sizeof(MQUE));
+  entry = slab_malloc(mque_slab, NULL);
   if (!entry)
     mush_panic("Unable to allocate memory in new_queue_entry");
+  ADD_CHECK("mque_slab");
   entry->executor = NOTHING;
   entry->enactor = NOTHING;
   entry->caller = NOTHING;
@@ -362,10 +790,13 @@ new_queue_entry(NEW_PE_INFO *pe_info)
 
   entry->inplace = NULL;
   entry->next = NULL;
+  entry->sem_prev = NULL;
 
   entry->semaphore_obj = NOTHING;
   entry->semaphore_attr = NULL;
   entry->wait_until = 0;
+  entry->wait_seq = 0;
+  entry->wait_slot = -1;
   entry->pid = 0;
   entry->action_list = NULL;
   entry->queue_type = QUEUE_DEFAULT;
@@ -505,12 +936,7 @@ queue_event(dbref enactor, const char *event, const char *fmt, ...)
   /* Hmm, should events queue ahead of anything else?
    * For now, yes, but leaving code here anyway.
    */
-  if (qlast) {
-    qlast->next = tmp;
-    qlast = tmp;
-  } else {
-    qlast = qfirst = tmp;
-  }
+  run_queue_append(tmp);
 
   /* All good! */
   im_insert(queue_map, tmp->pid, tmp);
@@ -563,12 +989,7 @@ insert_que(MQUE *queue_entry, MQUE *parent_queue)
     (queue_entry->queue_type & (QUEUE_PLAYER | QUEUE_OBJECT | QUEUE_INPLACE))) {
   case QUEUE_PLAYER:
   case QUEUE_OBJECT:
-    if (qlast) {
-      qlast->next = queue_entry;
-      qlast = queue_entry;
-    } else {
-      qlast = qfirst = queue_entry;
-    }
+    run_queue_append(queue_entry);
     break;
   case QUEUE_INPLACE:
     if (parent_queue->inplace) {
@@ -874,11 +1295,13 @@ queue_attribute_useatr(dbref executor, ATTR *a, dbref enactor, PE_REGS *pe_regs,
 
 /** Queue an entry on the wait or semaphore queues.
  * This function creates and adds a queue entry to the wait queue
- * or the semaphore queue. Wait queue entries are sorted by when
- * they're due to expire; semaphore queue entries are just added
- * to the back of the queue.
+ * or the semaphore queue. Wait queue entries are kept in a heap
+ * ordered by when they're due to expire; semaphore queue entries are
+ * just added to the back of the queue (and to the timeout heap if they
+ * have a timeout).
  * \param executor the enqueuing object.
- * \param waittill time to wait, or 0.
+ * \param waittill milliseconds to wait (or epoch milliseconds to wait
+ *  until), 0 to run now, or negative for a semaphore without a timeout.
  * \param command command to enqueue.
  * \param enactor object that caused command to be enqueued.
  * \param sem object to serve as a semaphore, or NOTHING.
@@ -887,8 +1310,8 @@ queue_attribute_useatr(dbref executor, ATTR *a, dbref enactor, PE_REGS *pe_regs,
  * \param parent_queue the queue entry the \@wait command was executed in
  */
 void
-wait_que(dbref executor, int waittill, char *command, dbref enactor, dbref sem,
-         const char *semattr, int until, MQUE *parent_queue)
+wait_que(dbref executor, int64_t waittill, char *command, dbref enactor,
+         dbref sem, const char *semattr, int until, MQUE *parent_queue)
 {
   MQUE *tmp;
   NEW_PE_INFO *pe_info;
@@ -922,39 +1345,21 @@ wait_que(dbref executor, int waittill, char *command, dbref enactor, dbref sem,
   tmp->caller = enactor;
   tmp->queue_type |= queue_type;
 
-  if (until) {
-    tmp->wait_until = (time_t) waittill;
-  } else {
-    if (waittill >= 0)
-      tmp->wait_until = mudtime + waittill;
-    else
-      tmp->wait_until = 0; /* semaphore wait without a timeout */
-  }
+  if (waittill < 0)
+    tmp->wait_until = 0; /* semaphore wait without a timeout */
+  else if (until)
+    tmp->wait_until = waittill;
+  else
+    tmp->wait_until = now_msecs() + waittill;
   tmp->semaphore_obj = sem;
   if (sem == NOTHING) {
-    /* No semaphore, put on normal wait queue, sorted by time */
-    MQUE *point, *trail = NULL;
-
-    for (point = qwait; point && (point->wait_until <= tmp->wait_until);
-         point = point->next)
-      trail = point;
-
-    tmp->next = point;
-    if (trail != NULL)
-      trail->next = tmp;
-    else
-      qwait = tmp;
+    /* No semaphore, put on normal wait queue */
+    mh_insert(&qwait, tmp);
   } else {
-
     /* Put it on the end of the semaphore queue */
     tmp->semaphore_attr =
       mush_strdup(semattr ? semattr : "SEMAPHORE", "mque.semaphore_attr");
-    if (qsemlast != NULL) {
-      qsemlast->next = tmp;
-      qsemlast = tmp;
-    } else {
-      qsemfirst = qsemlast = tmp;
-    }
+    sem_append(tmp);
   }
   im_insert(queue_map, tmp->pid, tmp);
 }
@@ -999,56 +1404,34 @@ update_queue_load()
 void
 queue_update(void)
 {
-  static time_t last_mudtime = 0;
-  MQUE *trail = NULL, *point, *next;
-
-  if (mudtime == last_mudtime) {
-    /* Only run once per second at most. */
-    return;
-  }
-  last_mudtime = mudtime;
+  uint64_t now = now_msecs();
+  MQUE *point;
 
   /* check regular @wait queue */
-  while (qwait && qwait->wait_until <= mudtime) {
-    point = qwait;
-    qwait = point->next;
+  while (qwait.count && qwait.entries[0]->wait_until <= now) {
+    point = qwait.entries[0];
+    mh_remove(&qwait, point);
     point->next = NULL;
     point->wait_until = 0;
-    if (qlast) {
-      qlast->next = point;
-      qlast = point;
-    } else {
-      qlast = qfirst = point;
-    }
+    run_queue_append(point);
   }
 
   /* check for semaphore Zwait timeouts */
-  for (point = qsemfirst, trail = NULL; point; point = next) {
-    if (point->wait_until == 0 || point->wait_until > mudtime) {
-      next = (trail = point)->next;
-      continue; /* skip non-timed and those that haven't gone off yet */
-    }
-    if (trail != NULL)
-      trail->next = next = point->next;
-    else
-      qsemfirst = next = point->next;
-    if (point == qsemlast)
-      qsemlast = trail;
+  while (qsemwait.count && qsemwait.entries[0]->wait_until <= now) {
+    point = qsemwait.entries[0];
+    sem_unlink(point);
     add_to_sem(point->semaphore_obj, -1, point->semaphore_attr);
     point->semaphore_obj = NOTHING;
-    point->next = NULL;
-    if (qlast) {
-      qlast->next = point;
-      qlast = point;
-    } else {
-      qlast = qfirst = point;
-    }
+    point->wait_until = 0;
+    run_queue_append(point);
   }
 }
 
 /** Execute some commands from the top of the queue.
  * This function dequeues and executes commands on the normal
- * priority (player) queue.
+ * priority (player) queue, taking one from each owner in turn. It
+ * stops early if the queue_chunk_time option is set and that many
+ * milliseconds have gone by.
  * \param ncom number of commands to execute.
  * \return number of commands executed.
  */
@@ -1057,17 +1440,22 @@ do_top(int ncom)
 {
   int i;
   MQUE *entry;
+  uint64_t budget = 0, start = 0;
+
+  if (options.queue_chunk_time > 0) {
+    budget = options.queue_chunk_time * 1000ULL;
+    start = mono_usecs();
+  }
 
   for (i = 0; i < ncom; i++) {
-    if (!qfirst)
+    if (budget && i > 0 && mono_usecs() - start >= budget)
       return i;
 
     /* We must dequeue before execution, so that things like
      * queued @kick or @ps get a sane queue image.
      */
-    entry = qfirst;
-    if (!(qfirst = entry->next))
-      qlast = NULL;
+    if (!(entry = run_queue_pop()))
+      return i;
     do_entry(entry, 0);
     free_qentry(entry);
   }
@@ -1257,45 +1645,27 @@ do_entry(MQUE *entry, int include_recurses)
  * This function returns the number of milliseconds we expect to wait
  * before it's time to run a queued command.
  * If there are commands in the player queue, that's 0.
- * If there are commands in the object queue, that's 1000.
  * Otherwise, we check wait and semaphore queues to see what's next.
- * \return seconds left before a queue entry will be ready.
+ * \return milliseconds left before a queue entry will be ready.
  */
 uint64_t
 queue_msecs_till_next(void)
 {
-  uint64_t min, curr;
-  MQUE *point;
+  uint64_t min, now;
   /* If there are commands in the player queue, they should be run
    * immediately.
    */
-  if (qfirst != NULL)
+  if (ring_first != NULL)
     return 0;
 
   /* Arbitrarily high wait */
   min = SECS_TO_MSECS(500);
 
-  /* Check out the wait and semaphore queues, looking for the smallest
-   * wait value. Return that - 1, since commands get moved to the player
-   * queue when they have one second to go.
-   */
-
-  /* Wait queue is in sorted order so we only have to look at the first
-     item on it. Anything else is wasted time. */
-  if (qwait) {
-    curr = SECS_TO_MSECS(difftime(qwait->wait_until, mudtime));
-    if (curr < min)
-      min = curr;
-  }
-
-  for (point = qsemfirst; point; point = point->next) {
-    if (point->wait_until == 0) /* no timeout */
-      continue;
-    curr = SECS_TO_MSECS(difftime(point->wait_until, mudtime));
-    if (curr < min) {
-      min = curr;
-    }
-  }
+  /* Both the wait queue and the semaphore timeouts keep their soonest
+     entry on top of a heap, so only those have to be looked at. */
+  now = now_msecs();
+  min = mh_msecs_till(&qwait, now, min);
+  min = mh_msecs_till(&qsemwait, now, min);
 
   return min;
 }
@@ -1323,28 +1693,16 @@ drain_helper(dbref player __attribute__((__unused__)), dbref thing,
 int
 execute_one_semaphore(dbref thing, char const *aname, PE_REGS *pe_regs)
 {
-  MQUE **point;
   MQUE *entry;
 
   /* Go through the semaphore queue and do it */
-  point = &qsemfirst;
-  while (*point) {
-    entry = *point;
+  for (entry = qsemfirst; entry; entry = entry->next) {
     if (entry->semaphore_obj != thing ||
-        (aname && strcmp(entry->semaphore_attr, aname))) {
-      point = &(entry->next);
+        (aname && strcmp(entry->semaphore_attr, aname)))
       continue;
-    }
 
     /* Remove the queue entry from the semaphore list */
-    *point = entry->next;
-    entry->next = NULL;
-    if (qsemlast == entry) {
-      qsemlast = qsemfirst;
-      if (qsemlast)
-        while (qsemlast->next)
-          qsemlast = qsemlast->next;
-    }
+    sem_unlink(entry);
 
     /* Update bookkeeping */
     add_to_sem(entry->semaphore_obj, -1, entry->semaphore_attr);
@@ -1357,12 +1715,7 @@ execute_one_semaphore(dbref thing, char const *aname, PE_REGS *pe_regs)
     }
 
     /* And enqueue */
-    if (qlast) {
-      qlast->next = entry;
-      qlast = entry;
-    } else {
-      qlast = qfirst = entry;
-    }
+    run_queue_append(entry);
     return 1;
   }
   return 0;
@@ -1382,31 +1735,20 @@ dequeue_semaphores(dbref thing, char const *aname, int count, int all,
                    int drain)
 {
 
-  MQUE **point;
-  MQUE *entry;
+  MQUE *entry, *next;
 
   if (all)
     count = INT_MAX;
 
   /* Go through the semaphore queue and do it */
-  point = &qsemfirst;
-  while (*point && count > 0) {
-    entry = *point;
+  for (entry = qsemfirst; entry && count > 0; entry = next) {
+    next = entry->next;
     if (entry->semaphore_obj != thing ||
-        (aname && strcmp(entry->semaphore_attr, aname))) {
-      point = &(entry->next);
+        (aname && strcmp(entry->semaphore_attr, aname)))
       continue;
-    }
 
     /* Remove the queue entry from the semaphore list */
-    *point = entry->next;
-    entry->next = NULL;
-    if (qsemlast == entry) {
-      qsemlast = qsemfirst;
-      if (qsemlast)
-        while (qsemlast->next)
-          qsemlast = qsemlast->next;
-    }
+    sem_unlink(entry);
 
     /* Update bookkeeping */
     count--;
@@ -1419,12 +1761,7 @@ dequeue_semaphores(dbref thing, char const *aname, int count, int all,
       add_to(entry->executor, -1);
       free_qentry(entry);
     } else {
-      if (qlast) {
-        qlast->next = entry;
-        qlast = entry;
-      } else {
-        qlast = qfirst = entry;
-      }
+      run_queue_append(entry);
     }
   }
 
@@ -1562,13 +1899,14 @@ do_wait(dbref executor, dbref enactor, char *arg1, const char *cmd, bool until,
 {
   dbref thing;
   char *tcount = NULL, *aname = NULL;
-  int waitfor, num;
+  int64_t waitfor;
+  int num;
   ATTR *a;
 
-  if (is_strict_integer(arg1)) {
+  if (parse_wait_msecs(arg1, &waitfor)) {
     /* normal wait */
-    wait_que(executor, parse_integer(arg1), (char *) cmd, enactor, NOTHING,
-             NULL, until, parent_queue);
+    wait_que(executor, waitfor, (char *) cmd, enactor, NOTHING, NULL, until,
+             parent_queue);
     return;
   }
   /* semaphore wait with optional timeout */
@@ -1590,7 +1928,7 @@ do_wait(dbref executor, dbref enactor, char *arg1, const char *cmd, bool until,
   if (aname) {
     tcount = strchr(aname, '/');
     if (!tcount) {
-      if (is_strict_integer(aname)) { /* Timeout */
+      if (is_strict_number(aname)) { /* Timeout */
         tcount = aname;
         aname = (char *) "SEMAPHORE";
       } else { /* Attribute */
@@ -1610,9 +1948,10 @@ do_wait(dbref executor, dbref enactor, char *arg1, const char *cmd, bool until,
     return;
   }
   /* get timeout, default of -1 */
-  if (tcount && *tcount)
-    waitfor = parse_integer(tcount);
-  else
+  if (tcount && *tcount) {
+    if (!parse_wait_msecs(tcount, &waitfor))
+      waitfor = 0;
+  } else
     waitfor = -1;
   add_to_sem(thing, 1, aname);
   a = atr_get_noparent(thing, aname);
@@ -1639,8 +1978,8 @@ void
 do_waitpid(dbref player, const char *pidstr, const char *timestr, bool until)
 {
   uint32_t pid;
-  MQUE *q, *tmp, *last;
-  bool found;
+  MQUE *q;
+  int64_t msecs, when;
 
   if (!is_strict_uinteger(pidstr)) {
     notify(player, T("That is not a valid pid!"));
@@ -1666,71 +2005,33 @@ do_waitpid(dbref player, const char *pidstr, const char *timestr, bool until)
     return;
   }
 
-  if (!is_strict_integer(timestr)) {
+  if (!parse_wait_msecs(timestr, &msecs)) {
     notify(player, T("That is not a valid timestamp."));
     return;
   }
 
   if (until) {
-    int when;
-
-    when = parse_integer(timestr);
-
-    if (when < 0)
-      when = 0;
-
-    q->wait_until = (time_t) when;
-
+    when = msecs;
   } else {
-    int offset = parse_integer(timestr);
-
     /* If timestr looks like +NNN or -NNN, add or subtract a number
        of seconds to the current timeout. Otherwise, change timeout.
      */
     if (timestr[0] == '+' || timestr[0] == '-')
-      q->wait_until += offset;
+      when = (int64_t) q->wait_until + msecs;
     else
-      q->wait_until = mudtime + offset;
-
-    if (q->wait_until < 0)
-      q->wait_until = 0;
+      when = (int64_t) now_msecs() + msecs;
   }
+  q->wait_until = (when < 0) ? 0 : when;
 
-  /* Now adjust it in the wait queue. Not a clever approach, but I
-     wrote it at 3 am and clever was not an option. */
-  found = false;
-  for (tmp = qwait, last = NULL; tmp; last = tmp, tmp = tmp->next) {
-    if (tmp == q) {
-      if (last)
-        last->next = q->next;
-      else
-        qwait = qwait->next;
-      found = true;
-      break;
-    }
-  }
-  if (found) {
-    found = false;
-    for (tmp = qwait, last = NULL; tmp; last = tmp, tmp = tmp->next) {
-      if (tmp->wait_until > q->wait_until) {
-        if (last) {
-          last->next = q;
-          q->next = tmp;
-        } else {
-          q->next = qwait;
-          qwait = q;
-        }
-        found = true;
-        break;
-      }
-    }
-    if (!found) {
-      if (last)
-        last->next = q;
-      else
-        qwait = q;
-      q->next = NULL;
-    }
+  /* Now adjust it in the wait queue or the semaphore timeouts. A
+     semaphore whose timeout drops to 0 waits forever, as usual. */
+  if (q->wait_slot >= 0) {
+    if (q->semaphore_obj == NOTHING)
+      mh_update(&qwait, q);
+    else if (q->wait_until)
+      mh_update(&qsemwait, q);
+    else
+      mh_remove(&qsemwait, q);
   }
 
   notify_format(player, T("Queue entry with pid %u updated."),
@@ -1796,7 +2097,7 @@ FUNCTION(fun_pidinfo)
       if (q->wait_until == 0)
         safe_integer(-1, buff, bp);
       else
-        safe_integer(difftime(q->wait_until, mudtime), buff, bp);
+        safe_integer(wait_secs_left(q), buff, bp);
     } else if (string_prefix("object", r)) {
       if (!first)
         safe_str(osep, buff, bp);
@@ -1828,7 +2129,7 @@ FUNCTION(fun_lpids)
 {
   /* Can be called as LPIDS or GETPIDS */
   MQUE *tmp;
-  int qmask = 0;
+  int qmask = 0, i;
   dbref thing = NOTHING;
   dbref player = NOTHING;
   char *attrib = NULL;
@@ -1894,7 +2195,9 @@ FUNCTION(fun_lpids)
     }
   }
   if (qmask & LPIDS_WAIT) {
-    for (tmp = qwait; tmp; tmp = tmp->next) {
+    mh_sort(&qwait);
+    for (i = 0; i < qwait.count; i++) {
+      tmp = qwait.entries[i];
       if (GoodObject(player) && GoodObject(tmp->executor) &&
           ((qmask & LPIDS_INDEPENDENT) ? (tmp->executor != player)
                                        : !Owns(tmp->executor, player))) {
@@ -1929,16 +2232,24 @@ show_queue(dbref player, dbref victim, int q_type, int q_quiet, int q_all,
            MQUE *q_ptr, int *tot, int *self, int *del)
 {
   MQUE *tmp;
-  for (tmp = q_ptr; tmp; tmp = tmp->next) {
-    (*tot)++;
-    if (!GoodObject(tmp->executor))
-      (*del)++;
-    else if (q_all || (Owner(tmp->executor) == victim)) {
-      if ((LookQueue(player) || Owns(tmp->executor, player))) {
-        (*self)++;
-        if (!q_quiet)
-          show_queue_single(player, tmp, q_type);
-      }
+  for (tmp = q_ptr; tmp; tmp = tmp->next)
+    show_queue_entry(player, victim, q_type, q_quiet, q_all, tmp, tot, self,
+                     del);
+}
+
+/* Count, and maybe show, one entry of a queue being listed */
+static void
+show_queue_entry(dbref player, dbref victim, int q_type, int q_quiet,
+                 int q_all, MQUE *q, int *tot, int *self, int *del)
+{
+  (*tot)++;
+  if (!GoodObject(q->executor))
+    (*del)++;
+  else if (q_all || (Owner(q->executor) == victim)) {
+    if ((LookQueue(player) || Owns(q->executor, player))) {
+      (*self)++;
+      if (!q_quiet)
+        show_queue_single(player, q, q_type);
     }
   }
 }
@@ -1950,7 +2261,7 @@ show_queue_single(dbref player, MQUE *q, int q_type)
   switch (q_type) {
   case 1: /* wait queue */
     notify_format(player, "(Pid: %u) [%ld]%s: %s", (unsigned int) q->pid,
-                  (long) difftime(q->wait_until, mudtime),
+                  wait_secs_left(q),
                   unparse_object(player, q->executor, AN_UNPARSE),
                   q->action_list);
     break;
@@ -1958,7 +2269,7 @@ show_queue_single(dbref player, MQUE *q, int q_type)
     if (q->wait_until != 0) {
       notify_format(player, "(Pid: %u) [#%d/%s/%ld]%s: %s",
                     (unsigned int) q->pid, q->semaphore_obj, q->semaphore_attr,
-                    (long) difftime(q->wait_until, mudtime),
+                    wait_secs_left(q),
                     unparse_object(player, q->executor, AN_UNPARSE),
                     q->action_list);
     } else {
@@ -1975,6 +2286,32 @@ show_queue_single(dbref player, MQUE *q, int q_type)
   }
 }
 
+/* @ps/all: how long each owner's commands wait before they run. */
+static void
+show_queue_latency(dbref player)
+{
+  struct owner_queue *oq;
+  bool header = false;
+
+  for (oq = oq_all; oq; oq = oq->all_next) {
+    if (oq->orphaned || (!oq->ran && !oq->count))
+      continue;
+    if (!LookQueue(player) && oq->owner != Owner(player))
+      continue;
+    if (!header) {
+      notify(player, T("Command queue wait by owner:"));
+      header = true;
+    }
+    notify_format(player,
+                  T("  %s: %" PRIu64 " run, %d waiting, average %.2fms, "
+                    "max %.2fms"),
+                  unparse_object(player, oq->owner, AN_UNPARSE), oq->ran,
+                  oq->count,
+                  oq->ran ? (double) oq->wait_total / oq->ran / 1000.0 : 0.0,
+                  (double) oq->wait_max / 1000.0);
+  }
+}
+
 /* @ps/debug dump */
 static void
 show_queue_env(dbref player, MQUE *q)
@@ -2062,6 +2399,8 @@ do_queue(dbref player, const char *what, enum queue_type flag)
   int dpq = 0, dwq = 0, dsq = 0;
   int pq = 0, wq = 0, sq = 0;
   int tpq = 0, twq = 0, tsq = 0;
+  int i;
+  struct owner_queue *oq;
   if (flag == QUEUE_SUMMARY || flag == QUEUE_QUICK)
     quick = 1;
   if (flag == QUEUE_ALL || flag == QUEUE_SUMMARY) {
@@ -2096,10 +2435,14 @@ do_queue(dbref player, const char *what, enum queue_type flag)
     victim = Owner(victim);
     if (!quick)
       notify(player, T("Command Queue:"));
-    show_queue(player, victim, 0, quick, all, qfirst, &tpq, &pq, &dpq);
+    for (oq = ring_first; oq; oq = oq->ring_next)
+      show_queue(player, victim, 0, quick, all, oq->first, &tpq, &pq, &dpq);
     if (!quick)
       notify(player, T("Wait Queue:"));
-    show_queue(player, victim, 1, quick, all, qwait, &twq, &wq, &dwq);
+    mh_sort(&qwait);
+    for (i = 0; i < qwait.count; i++)
+      show_queue_entry(player, victim, 1, quick, all, qwait.entries[i], &twq,
+                       &wq, &dwq);
     if (!quick)
       notify(player, T("Semaphore Queue:"));
     show_queue(player, victim, 2, quick, all, qsemfirst, &tsq, &sq, &dsq);
@@ -2113,6 +2456,8 @@ do_queue(dbref player, const char *what, enum queue_type flag)
                   average32(queue_load_record, 60),
                   average32(queue_load_record, 300),
                   average32(queue_load_record, 900));
+    if (flag == QUEUE_ALL)
+      show_queue_latency(player);
   }
 }
 
@@ -2168,8 +2513,9 @@ do_queue_single(dbref player, char *pidstr, bool debug)
 void
 do_halt(dbref owner, const char *ncom, dbref victim)
 {
-  MQUE *tmp, *trail = NULL, *point, *next;
-  int num = 0;
+  MQUE *tmp, *point, *next;
+  struct owner_queue *oq;
+  int num = 0, i, n;
   dbref player;
   if (victim == NOTHING)
     player = owner;
@@ -2178,45 +2524,43 @@ do_halt(dbref owner, const char *ncom, dbref victim)
   if (!Quiet(Owner(player)))
     notify_format(Owner(player), "%s: %s(#%d)", T("Halted"),
                   AName(player, AN_SYS, NULL), player);
-  for (tmp = qfirst; tmp; tmp = tmp->next) {
-    if (GoodObject(tmp->executor) &&
-        ((tmp->executor == player) || (Owner(tmp->executor) == player))) {
-      num--;
-      giveto(player, QUEUE_COST);
-      tmp->executor = NOTHING;
+  for (oq = ring_first; oq; oq = oq->ring_next) {
+    for (tmp = oq->first; tmp; tmp = tmp->next) {
+      if (GoodObject(tmp->executor) &&
+          ((tmp->executor == player) || (Owner(tmp->executor) == player))) {
+        num--;
+        giveto(player, QUEUE_COST);
+        tmp->executor = NOTHING;
+      }
     }
   }
-  /* remove wait q stuff */
-  for (point = qwait; point; point = next) {
+  /* remove wait q stuff, keeping the rest packed at the front of the
+     heap array, then put what's left back in heap order. */
+  for (i = n = 0; i < qwait.count; i++) {
+    point = qwait.entries[i];
     if (((point->executor == player) || (Owner(point->executor) == player))) {
       num--;
       giveto(player, QUEUE_COST);
-      if (trail)
-        trail->next = next = point->next;
-      else
-        qwait = next = point->next;
       free_qentry(point);
-    } else {
-      next = (trail = point)->next;
-    }
+    } else
+      mh_place(&qwait, point, n++);
+  }
+  if (n < qwait.count) {
+    qwait.count = n;
+    mh_heapify(&qwait);
   }
 
   /* clear semaphore queue */
 
-  for (point = qsemfirst, trail = NULL; point; point = next) {
+  for (point = qsemfirst; point; point = next) {
+    next = point->next;
     if (((point->executor == player) || (Owner(point->executor) == player))) {
       num--;
       giveto(player, QUEUE_COST);
-      if (trail)
-        trail->next = next = point->next;
-      else
-        qsemfirst = next = point->next;
-      if (point == qsemlast)
-        qsemlast = trail;
+      sem_unlink(point);
       add_to_sem(point->semaphore_obj, -1, point->semaphore_attr);
       free_qentry(point);
-    } else
-      next = (trail = point)->next;
+    }
   }
 
   add_to(player, num);
@@ -2315,20 +2659,8 @@ do_haltpid(dbref player, const char *arg1)
      turn comes up (Or show it in @ps, etc.).  Exception is for
      semaphores, which otherwise might wait forever. */
   q->executor = NOTHING;
-  if (q->semaphore_attr) {
-    MQUE *last = NULL, *tmp;
-    for (tmp = qsemfirst; tmp; last = tmp, tmp = tmp->next) {
-      if (tmp == q) {
-        if (last)
-          last->next = tmp->next;
-        else
-          qsemfirst = tmp->next;
-        if (qsemlast == tmp)
-          qsemlast = last;
-        break;
-      }
-    }
-
+  if (q->semaphore_obj != NOTHING) {
+    sem_unlink(q);
     giveto(victim, QUEUE_COST);
     add_to_sem(q->semaphore_obj, -1, q->semaphore_attr);
     free_qentry(q);
@@ -2458,9 +2790,33 @@ do_restart_com(dbref player, const char *arg1)
 void
 shutdown_queues(void)
 {
-  shutdown_a_queue(&qfirst, &qlast);
+  MQUE *entry;
+
+  while ((entry = run_queue_pop())) {
+    if (GoodObject(entry->executor) && !IsGarbage(entry->executor)) {
+      giveto(entry->executor, QUEUE_COST);
+      add_to(entry->executor, -1);
+    }
+    free_qentry(entry);
+  }
+  qsemwait.count = 0;
   shutdown_a_queue(&qsemfirst, &qsemlast);
-  shutdown_a_queue(&qwait, NULL);
+  shutdown_a_heap(&qwait);
+}
+
+static void
+shutdown_a_heap(struct mque_heap *h)
+{
+  MQUE *entry;
+  /* Drain out a heap */
+  while (h->count) {
+    entry = h->entries[--h->count];
+    if (GoodObject(entry->executor) && !IsGarbage(entry->executor)) {
+      giveto(entry->executor, QUEUE_COST);
+      add_to(entry->executor, -1);
+    }
+    free_qentry(entry);
+  }
 }
 
 static void
@@ -33,6 +33,7 @@
 
 #include "ansi.h"
 #include "attrib.h"
+#include "chunk.h"
 #include "conf.h"
 #include "dbdefs.h"
 #include "dbio.h"
@@ -44,6 +45,7 @@
 #include "htab.h"
 #include "lock.h"
 #include "log.h"
+#include "map_file.h"
 #include "memcheck.h"
 #include "mushdb.h"
 #include "mymalloc.h"
@@ -53,6 +55,7 @@
 #include "strutil.h"
 #include "mushsql.h"
 #include "charclass.h"
+#include "tests.h"
 
 #ifdef WIN32
 #pragma warning(disable : 4761) /* disable warning re conversion */
@@ -70,6 +73,7 @@ int loading_db = 0; /**< Are we loading the database? */
 char db_timestamp[100]; /**< Time the read database was saved. */
 
 struct object *db = NULL; /**< The object db array */
+int *db_queue = NULL;     /**< Per-object queue counts, sized like db */
 dbref db_top = 0;         /**< The number of objects in the db array */
 
 dbref errobj; /**< Dbref of object on which an error has occurred */
@@ -165,9 +169,15 @@ db_grow(dbref newtop)
         do_rawlog(LT_ERR, "ERROR: out of memory while creating database!");
         abort();
       }
+      if ((db_queue = (int *) calloc(db_size, sizeof(int))) == NULL) {
+        do_rawlog(LT_ERR, "ERROR: out of memory while creating database!");
+        abort();
+      }
     }
     /* maybe grow it */
     if (db_top > db_size) {
+      int *newqueue;
+      dbref oldsize = db_size;
       /* make sure it's big enough */
       while (db_top > db_size)
         db_size *= 2;
@@ -177,6 +187,13 @@ db_grow(dbref newtop)
         abort();
       }
       db = newdb;
+      if ((newqueue = (int *) realloc(db_queue, db_size * sizeof(int))) ==
+          NULL) {
+        do_rawlog(LT_ERR, "ERROR: out of memory while extending database!");
+        abort();
+      }
+      memset(newqueue + oldsize, 0, (db_size - oldsize) * sizeof(int));
+      db_queue = newqueue;
     }
     while (initialized < db_top) {
       o = db + initialized;
@@ -198,6 +215,9 @@ db_grow(dbref newtop)
       o->attrcount = 0;
       o->attrcap = 0;
       o->list = NULL;
+      o->objdata = NULL;
+      o->objdatacount = 0;
+      db_queue[initialized] = 0;
       initialized++;
     }
   }
@@ -237,6 +257,9 @@ new_object(void)
   o->warnings = 0;
   o->modification_time = o->creation_time = mudtime;
   o->attrcount = 0;
+  o->objdata = NULL;
+  o->objdatacount = 0;
+  QueueCount(newobj) = 0;
   /* Flags are set by the functions that call this */
   o->powers = new_flag_bitmask("POWER");
   if (current_state.garbage) {
@@ -705,6 +728,36 @@ db_write_object(PENNFILE *f, dbref i)
   return 0;
 }
 
+/* The DBF_* flags describing the databases that are written now. */
+static int
+db_current_flags(void)
+{
+  int dbflag = 0;
+
+  dbflag += DBF_NO_CHAT_SYSTEM;
+  dbflag += DBF_WARNINGS;
+  dbflag += DBF_CREATION_TIMES;
+  dbflag += DBF_SPIFFY_LOCKS;
+  dbflag += DBF_NEW_STRINGS;
+  dbflag += DBF_TYPE_GARBAGE;
+  dbflag += DBF_SPLIT_IMMORTAL;
+  dbflag += DBF_NO_TEMPLE;
+  dbflag += DBF_LESS_GARBAGE;
+  dbflag += DBF_AF_VISUAL;
+  dbflag += DBF_VALUE_IS_COST;
+  dbflag += DBF_LINK_ANYWHERE;
+  dbflag += DBF_NO_STARTUP_FLAG;
+  dbflag += DBF_AF_NODUMP;
+  dbflag += DBF_NEW_FLAGS;
+  dbflag += DBF_NEW_POWERS;
+  dbflag += DBF_POWERS_LOGGED;
+  dbflag += DBF_LABELS;
+  dbflag += DBF_SPIFFY_AF_ANSI;
+  dbflag += DBF_HEAR_CONNECT;
+  dbflag += DBF_NEW_VERSIONS;
+  return dbflag;
+}
+
 /** Write out the object database to disk.
  * \verbatim
  * This function writes the databsae out to disk. The database
@@ -734,28 +787,7 @@ db_write(PENNFILE *f, int flag)
    * to deal with that. We need to use some extra flags as well, so
    * we may be adding to 5/6 as needed, using successive binary numbers.
    */
-  dbflag = 5 + flag;
-  dbflag += DBF_NO_CHAT_SYSTEM;
-  dbflag += DBF_WARNINGS;
-  dbflag += DBF_CREATION_TIMES;
-  dbflag += DBF_SPIFFY_LOCKS;
-  dbflag += DBF_NEW_STRINGS;
-  dbflag += DBF_TYPE_GARBAGE;
-  dbflag += DBF_SPLIT_IMMORTAL;
-  dbflag += DBF_NO_TEMPLE;
-  dbflag += DBF_LESS_GARBAGE;
-  dbflag += DBF_AF_VISUAL;
-  dbflag += DBF_VALUE_IS_COST;
-  dbflag += DBF_LINK_ANYWHERE;
-  dbflag += DBF_NO_STARTUP_FLAG;
-  dbflag += DBF_AF_NODUMP;
-  dbflag += DBF_NEW_FLAGS;
-  dbflag += DBF_NEW_POWERS;
-  dbflag += DBF_POWERS_LOGGED;
-  dbflag += DBF_LABELS;
-  dbflag += DBF_SPIFFY_AF_ANSI;
-  dbflag += DBF_HEAR_CONNECT;
-  dbflag += DBF_NEW_VERSIONS;
+  dbflag = 5 + flag + db_current_flags();
 
   penn_fprintf(f, "+V%d\n", dbflag * 256 + 2);
 
@@ -800,6 +832,284 @@ db_write_attrs(PENNFILE *f)
   attr_write_all(f);
 }
 
+/* Binary database snapshots.
+ *
+ * A snapshot starts out like a text database, with a +B<version> line
+ * instead of +V, and the same dbversion, savedtime, flag, power and
+ * attribute table sections, up to the ~<db_top> line. After that it's
+ * binary, in the byte order of the machine that wrote it:
+ *
+ * A struct snapshot_header.
+ * A string table of header.strings NUL-terminated strings: every
+ * different flag list, power list and attribute name, each once.
+ * An array of header.count fixed-size struct snapshot_object records,
+ * which refer to their flags and powers by string table index.
+ * header.count variable-length records, one for each of those objects
+ * and in the same order. Each is a uint32_t length and then:
+ *   The name, as a NUL-terminated string.
+ *   The number of locks, then for each its type, creator, flags,
+ *   derefs and key.
+ * An array of header.attrs fixed-size struct snapshot_attr records,
+ * the attributes of each object in turn, in the order they're kept.
+ * The value of each of those attributes as a NUL-terminated string.
+ * The text end of dump marker.
+ *
+ * Numbers are uint32_t or int32_t. Attribute values are stored
+ * uncompressed. Flags and powers are stored by name as in text dumps,
+ * since their bit positions can change when the flag table is read
+ * back, but each different set is only turned into bits once. Lock
+ * and attribute flags are stored as their raw bits, so any change to
+ * the AF_ or LF_ values needs a new SNAPSHOT_VERSION.
+ *
+ * Snapshots are meant to be read from a memory map, a section at a
+ * time, with each object's attribute array filled in one go by
+ * atr_append(). db_write() and db_read() are still the reference
+ * format; either one can be read at startup, so changing the
+ * binary_dump option and saving converts between them.
+ */
+
+#define SNAPSHOT_VERSION 2 /**< Version of the snapshot format */
+#define SNAPSHOT_BYTE_ORDER 0x01020304U /**< To catch foreign snapshots */
+
+/** Start of the binary part of a snapshot. */
+struct snapshot_header {
+  char magic[4];       /**< "PSNP" */
+  uint32_t byte_order; /**< SNAPSHOT_BYTE_ORDER */
+  uint32_t objsize;    /**< sizeof(struct snapshot_object) */
+  uint32_t attrsize;   /**< sizeof(struct snapshot_attr) */
+  uint32_t count;      /**< Number of objects */
+  uint32_t strings;    /**< Number of strings in the string table */
+  uint32_t attrs;      /**< Number of attributes */
+  uint32_t unused;     /**< Padding, written as 0 */
+};
+
+/** The fixed-size fields of an object in a snapshot. */
+struct snapshot_object {
+  int64_t created;   /**< Creation time */
+  int64_t modified;  /**< Modification time */
+  int32_t dbref;     /**< The object */
+  int32_t location;  /**< Location */
+  int32_t contents;  /**< First content */
+  int32_t exits;     /**< First exit */
+  int32_t next;      /**< Next in the contents or exits list */
+  int32_t parent;    /**< Parent */
+  int32_t owner;     /**< Owner */
+  int32_t zone;      /**< Zone */
+  int32_t pennies;   /**< Pennies */
+  int32_t type;      /**< TYPE_* */
+  uint32_t warnings; /**< Warnings */
+  uint32_t flags;    /**< String table index of the flag list */
+  uint32_t powers;   /**< String table index of the power list */
+  uint32_t attrs;    /**< Number of attributes */
+};
+
+/** An attribute in a snapshot. Its value is stored separately. */
+struct snapshot_attr {
+  uint32_t name;   /**< String table index of the name */
+  int32_t creator; /**< Owner of the attribute */
+  uint32_t flags;  /**< AF_* flags */
+  uint32_t derefs; /**< Deref count of the value */
+};
+
+static void
+snapshot_put(sqlite3_str *rec, const void *data, size_t len)
+{
+  sqlite3_str_append(rec, data, (int) len);
+}
+
+static void
+snapshot_put_u32(sqlite3_str *rec, uint32_t n)
+{
+  snapshot_put(rec, &n, sizeof n);
+}
+
+static void
+snapshot_put_string(sqlite3_str *rec, const char *str)
+{
+  snapshot_put(rec, str, strlen(str) + 1);
+}
+
+/* Find a string in the snapshot string table, adding it if it's new.
+ * Table entries hold their index plus one. */
+static uint32_t
+snapshot_string(HASHTAB *table, sqlite3_str *strings, uint32_t *count,
+                const char *str)
+{
+  intptr_t n = (intptr_t) hashfind(str, table);
+
+  if (!n) {
+    n = ++*count;
+    hashadd(str, (void *) n, table);
+    snapshot_put_string(strings, str);
+  }
+  return n - 1;
+}
+
+/* Fill in the fixed-size part of an object, adding its flags, powers
+ * and attribute names to the string table if they're not there. */
+static void
+snapshot_fill_object(struct snapshot_object *so, dbref i, HASHTAB *table,
+                     sqlite3_str *strings, uint32_t *count)
+{
+  ALIST *list;
+
+  so->created = CreTime(i);
+  so->modified = ModTime(i);
+  so->dbref = i;
+  so->location = db[i].location;
+  so->contents = db[i].contents;
+  so->exits = db[i].exits;
+  so->next = db[i].next;
+  so->parent = db[i].parent;
+  so->owner = db[i].owner;
+  so->zone = db[i].zone;
+  so->pennies = Pennies(i);
+  so->type = Typeof(i);
+  so->warnings = db[i].warnings;
+  so->flags = snapshot_string(table, strings, count,
+                              bits_to_string("FLAG", Flags(i), GOD, NOTHING));
+  so->powers = snapshot_string(
+    table, strings, count, bits_to_string("POWER", Powers(i), GOD, NOTHING));
+  so->attrs = 0;
+  ATTR_FOR_EACH (i, list) {
+    if (AF_Nodump(list))
+      continue;
+    snapshot_string(table, strings, count, AL_NAME(list));
+    so->attrs++;
+  }
+}
+
+/* Build the variable-length record of an object. */
+static void
+snapshot_write_record(sqlite3_str *rec, dbref i)
+{
+  lock_list *ll;
+  uint32_t count;
+
+  snapshot_put_string(rec, Name(i));
+
+  for (count = 0, ll = Locks(i); ll; ll = ll->next)
+    count++;
+  snapshot_put_u32(rec, count);
+  for (ll = Locks(i); ll; ll = ll->next) {
+    snapshot_put_string(rec, ll->type);
+    snapshot_put_u32(rec, L_CREATOR(ll));
+    snapshot_put_u32(rec, L_FLAGS(ll));
+    snapshot_put_u32(rec, chunk_derefs(L_KEY(ll)));
+    snapshot_put_string(rec, unparse_boolexp(GOD, ll->key, UB_DBREF));
+  }
+}
+
+/* Write out a finished part of a snapshot, and start over. */
+static void
+snapshot_flush(PENNFILE *f, sqlite3_str *buf)
+{
+  if (sqlite3_str_errcode(buf) != SQLITE_OK) {
+    sqlite3_free(sqlite3_str_finish(buf));
+    longjmp(db_err, 1);
+  }
+  penn_fwrite(sqlite3_str_value(buf), sqlite3_str_length(buf), f);
+  sqlite3_str_reset(buf);
+}
+
+/** Write out the object database to disk as a binary snapshot.
+ * See the comments above for the format.
+ * \param f file pointer to write to.
+ * \return the number of objects in the database (db_top)
+ */
+dbref
+db_write_snapshot(PENNFILE *f)
+{
+  struct snapshot_header header;
+  struct snapshot_object so;
+  struct snapshot_attr sa;
+  HASHTAB table;
+  sqlite3_str *buf;
+  ALIST *list;
+  uint32_t len;
+  dbref i;
+
+  penn_fprintf(f, "+B%d\n", SNAPSHOT_VERSION);
+  db_write_labeled_int(f, "dbversion", NDBF_VERSION);
+  db_write_labeled_string(f, "savedtime", show_time(mudtime, 1));
+  db_write_flags(f);
+  db_write_attrs(f);
+  penn_fprintf(f, "~%d\n", db_top);
+
+  memset(&header, 0, sizeof header);
+  memcpy(header.magic, "PSNP", 4);
+  header.byte_order = SNAPSHOT_BYTE_ORDER;
+  header.objsize = sizeof so;
+  header.attrsize = sizeof sa;
+
+  /* The string table has to be written before the objects that use
+   * it, so the first pass builds it and counts everything. The second
+   * finds all the strings already there. */
+  hashinit(&table, 256);
+  buf = sqlite3_str_new(NULL);
+  memset(&so, 0, sizeof so);
+  for (i = 0; i < db_top; i++) {
+    if (IsGarbage(i))
+      continue;
+    snapshot_fill_object(&so, i, &table, buf, &header.strings);
+    header.count++;
+    header.attrs += so.attrs;
+  }
+  penn_fwrite(&header, sizeof header, f);
+  snapshot_flush(f, buf);
+
+  for (i = 0; i < db_top; i++) {
+    if (IsGarbage(i))
+      continue;
+    snapshot_fill_object(&so, i, &table, buf, &header.strings);
+    penn_fwrite(&so, sizeof so, f);
+  }
+
+  for (i = 0; i < db_top; i++) {
+#ifdef WIN32SERVICES
+    /* Keep the service manager happy */
+    if (shutdown_flag && (i & 0xFF) == 0)
+      shutdown_checkpoint();
+#endif
+    if (IsGarbage(i))
+      continue;
+    snapshot_write_record(buf, i);
+    len = sqlite3_str_length(buf);
+    penn_fwrite(&len, sizeof len, f);
+    snapshot_flush(f, buf);
+  }
+
+  memset(&sa, 0, sizeof sa);
+  for (i = 0; i < db_top; i++) {
+    if (IsGarbage(i))
+      continue;
+    ATTR_FOR_EACH (i, list) {
+      if (AF_Nodump(list))
+        continue;
+      sa.name = (intptr_t) hashfind(AL_NAME(list), &table) - 1;
+      sa.creator = Owner(AL_CREATOR(list));
+      sa.flags = AL_FLAGS(list);
+      sa.derefs = AL_DEREFS(list);
+      penn_fwrite(&sa, sizeof sa, f);
+    }
+  }
+
+  for (i = 0; i < db_top; i++) {
+    if (IsGarbage(i))
+      continue;
+    ATTR_FOR_EACH (i, list) {
+      if (!AF_Nodump(list))
+        snapshot_put_string(buf, atr_value(list));
+    }
+    snapshot_flush(f, buf);
+  }
+  sqlite3_free(sqlite3_str_finish(buf));
+  hashfree(&table);
+
+  penn_fputs(EOD, f);
+  return db_top;
+}
+
 /** Write out an object, in paranoid fashion.
  * This function writes a single object out to a file in paranoid
  * mode, which warns about several potential types of corruption,
@@ -908,6 +1218,8 @@ db_paranoid_write_object(PENNFILE *f, dbref i, int flag)
         char *t = compress(tbuf1);
         if (!t)
           return 0;
+        if (AF_Command(list))
+          atr_comm_index_reset();
 
         chunk_delete(list->data);
         list->data = chunk_create(t, strlen(t), 0);
@@ -955,28 +1267,7 @@ db_paranoid_write(PENNFILE *f, int flag)
   /* print a header line to make a later conversion to 2.0 easier to do.
    * the odd choice of numbers is based on 256*x + 2 offset
    */
-  dbflag = 5;
-  dbflag += DBF_NO_CHAT_SYSTEM;
-  dbflag += DBF_WARNINGS;
-  dbflag += DBF_CREATION_TIMES;
-  dbflag += DBF_SPIFFY_LOCKS;
-  dbflag += DBF_NEW_STRINGS;
-  dbflag += DBF_TYPE_GARBAGE;
-  dbflag += DBF_SPLIT_IMMORTAL;
-  dbflag += DBF_NO_TEMPLE;
-  dbflag += DBF_LESS_GARBAGE;
-  dbflag += DBF_AF_VISUAL;
-  dbflag += DBF_VALUE_IS_COST;
-  dbflag += DBF_LINK_ANYWHERE;
-  dbflag += DBF_NO_STARTUP_FLAG;
-  dbflag += DBF_AF_NODUMP;
-  dbflag += DBF_NEW_FLAGS;
-  dbflag += DBF_NEW_POWERS;
-  dbflag += DBF_POWERS_LOGGED;
-  dbflag += DBF_LABELS;
-  dbflag += DBF_SPIFFY_AF_ANSI;
-  dbflag += DBF_HEAR_CONNECT;
-  dbflag += DBF_NEW_VERSIONS;
+  dbflag = 5 + db_current_flags();
 
   do_rawlog(LT_CHECK, "PARANOID WRITE BEGINNING...\n");
 
@@ -1211,10 +1502,13 @@ db_free(void)
       set_name(i, NULL);
       atr_free_all(i);
       free_locks(Locks(i));
+      clear_objdata(i);
     }
 
     free((char *) db);
     db = NULL;
+    free(db_queue);
+    db_queue = NULL;
     db_init = db_top = 0;
   }
 }
@@ -1588,6 +1882,7 @@ db_read_oldstyle(PENNFILE *f)
         /** In newdb_version 4+, HAVEN defaults to PLAYER only, not PLAYER |
          * ROOM. */
         set_flag_type_by_name("FLAG", "HAVEN", TYPE_PLAYER);
+        chunk_bulk_end();
         do_rawlog(LT_ERR, "READING: done");
         loading_db = 0;
         fix_free_list();
@@ -1603,9 +1898,338 @@ db_read_oldstyle(PENNFILE *f)
   }
 }
 
+/* Finish setting up an object read from the database. */
+static void
+db_read_object_done(dbref i, sqlite3_stmt *adder)
+{
+  struct object *o = db + i;
+  int status;
+
+  sqlite3_bind_int(adder, 1, i);
+  do {
+    status = sqlite3_step(adder);
+  } while (is_busy_status(status));
+  if (status != SQLITE_DONE) {
+    do_rawlog(LT_ERR, "Unable to add #%d to objects table: %s", i,
+              sqlite3_errstr(status));
+  }
+  sqlite3_reset(adder);
+
+  if (IsPlayer(i) && (strlen(o->name) > (size_t) PLAYER_NAME_LIMIT)) {
+    char buff[BUFFER_LEN]; /* The name plus a NUL */
+    mush_strncpy(buff, o->name, PLAYER_NAME_LIMIT);
+    set_name(i, buff);
+    do_rawlog(LT_CHECK,
+              " * Name of #%d is longer than the maximum, truncating.\n", i);
+  } else if (!IsPlayer(i) && (strlen(o->name) > OBJECT_NAME_LIMIT)) {
+    char buff[OBJECT_NAME_LIMIT + 1]; /* The name plus a NUL */
+    mush_strncpy(buff, o->name, OBJECT_NAME_LIMIT);
+    set_name(i, buff);
+    do_rawlog(LT_CHECK,
+              " * Name of #%d is longer than the maximum, truncating.\n", i);
+  }
+  if (IsPlayer(i)) {
+    add_player(i);
+    clear_flag_internal(i, "CONNECTED");
+    /* If it has the MONITOR flag and the db predates HEAR_CONNECT, swap
+     * them over */
+    if (!(globals.indb_flags & DBF_HEAR_CONNECT) &&
+        has_flag_by_name(i, "MONITOR", NOTYPE)) {
+      clear_flag_internal(i, "MONITOR");
+      set_flag_internal(i, "HEAR_CONNECT");
+    }
+  }
+
+  if (globals.new_indb_version < 4 && IsRoom(i) &&
+      has_flag_by_name(i, "HAVEN", TYPE_ROOM)) {
+    /* HAVEN flag is no longer settable on rooms. */
+    clear_flag_internal(i, "HAVEN");
+  }
+}
+
+/* Count an object of a newly read type in the database statistics. */
+static void
+db_read_count_type(dbref i)
+{
+  switch (Typeof(i)) {
+  case TYPE_PLAYER:
+    current_state.players++;
+    current_state.garbage--;
+    break;
+  case TYPE_THING:
+    current_state.things++;
+    current_state.garbage--;
+    break;
+  case TYPE_EXIT:
+    current_state.exits++;
+    current_state.garbage--;
+    break;
+  case TYPE_ROOM:
+    current_state.rooms++;
+    current_state.garbage--;
+    break;
+  }
+}
+
+/* Wrap up after reading the end of dump marker. */
+static dbref
+db_read_finish(sqlite3 *sqldb)
+{
+  if (globals.new_indb_version < 4) {
+    /** In newdb_version 4+, HAVEN defaults to PLAYER only, not PLAYER |
+     * ROOM. */
+    set_flag_type_by_name("FLAG", "HAVEN", TYPE_PLAYER);
+  }
+  chunk_bulk_end();
+  do_rawlog(LT_ERR, "READING: done");
+  sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, NULL);
+  loading_db = 0;
+  fix_free_list();
+  dbck();
+  log_mem_check();
+  return db_top;
+}
+
+/* Where a snapshot is being read from. */
+struct snapshot_reader {
+  const char *p;   /**< Next byte to read */
+  const char *end; /**< End of the data */
+};
+
+static void
+snapshot_need(struct snapshot_reader *r, size_t len)
+{
+  if ((size_t) (r->end - r->p) < len) {
+    do_rawlog(LT_ERR, "ERROR: Database snapshot is truncated.");
+    longjmp(db_err, 1);
+  }
+}
+
+static uint32_t
+snapshot_get_u32(struct snapshot_reader *r)
+{
+  uint32_t n;
+
+  snapshot_need(r, sizeof n);
+  memcpy(&n, r->p, sizeof n);
+  r->p += sizeof n;
+  return n;
+}
+
+static const char *
+snapshot_get_string(struct snapshot_reader *r)
+{
+  const char *s = r->p, *nul;
+
+  nul = memchr(s, '\0', r->end - s);
+  if (!nul) {
+    do_rawlog(LT_ERR, "ERROR: Database snapshot is truncated.");
+    longjmp(db_err, 1);
+  }
+  r->p = nul + 1;
+  return s;
+}
+
+/* Read the name and locks of an object in a snapshot. */
+static void
+snapshot_read_record(struct snapshot_reader *r, dbref i)
+{
+  const char *type, *key;
+  dbref creator;
+  privbits flags;
+  uint32_t count, derefs;
+  boolexp b;
+
+  set_name(i, snapshot_get_string(r));
+
+  for (count = snapshot_get_u32(r); count > 0; count--) {
+    type = snapshot_get_string(r);
+    creator = snapshot_get_u32(r);
+    flags = snapshot_get_u32(r);
+    derefs = snapshot_get_u32(r);
+    key = snapshot_get_string(r);
+    b = parse_boolexp_d(GOD, key, type, derefs);
+    if (b == TRUE_BOOLEXP)
+      do_rawlog(LT_ERR, "WARNING: Invalid lock key '%s' for lock #%d/%s!", key,
+                i, type);
+    else
+      add_lock_raw(creator, i, type, b, flags);
+  }
+}
+
+/* Turn a flag or power list from the string table into bits, the first
+ * time it's used. */
+static object_flag_type
+snapshot_bits(const char *ns, object_flag_type *sets, const char **strings,
+              uint32_t n)
+{
+  object_flag_type bits;
+  FLAG *f;
+
+  if (!sets[n]) {
+    bits = string_to_bits(ns, strings[n]);
+    if (strcmp(ns, "FLAG") == 0) {
+      /* Clear the GOING flags, as when reading a text database. */
+      if ((f = match_flag("GOING")))
+        bits = clear_flag_bitmask(ns, bits, f->bitpos);
+      if ((f = match_flag("GOING_TWICE")))
+        bits = clear_flag_bitmask(ns, bits, f->bitpos);
+    }
+    sets[n] = bits;
+  }
+  return clone_flag_bitmask(ns, sets[n]);
+}
+
+/* Read the binary part of a snapshot, after the ~<db_top> line. */
+static int
+db_read_snapshot(PENNFILE *f, dbref top, sqlite3_stmt *adder)
+{
+  struct snapshot_reader r, rec;
+  struct snapshot_header header;
+  struct snapshot_object so;
+  struct snapshot_attr sa;
+  const char *objs, *attrs, *value, **strings = NULL;
+  object_flag_type *flagsets = NULL, *powersets = NULL;
+  char *buf = NULL;
+  struct object *o;
+  uint32_t n, k, len, attr;
+  size_t eodlen = strlen(EOD);
+  int result = -1;
+
+  if (f->type == PFT_MEMORY) {
+    r.p = f->handle.m.data + f->handle.m.pos;
+    r.end = f->handle.m.data + f->handle.m.len;
+  } else {
+    /* A compressed snapshot can't be mapped, so read it all in. */
+    size_t size = 0, cap = 1024 * 1024, got;
+
+    buf = mush_malloc(cap, "snapshot");
+    while ((got = penn_fread(buf + size, cap - size, f)) > 0) {
+      size += got;
+      if (size == cap) {
+        cap *= 2;
+        buf = mush_realloc(buf, cap, "snapshot");
+      }
+    }
+    r.p = buf;
+    r.end = buf + size;
+  }
+
+  snapshot_need(&r, sizeof header);
+  memcpy(&header, r.p, sizeof header);
+  r.p += sizeof header;
+  if (memcmp(header.magic, "PSNP", 4) != 0 ||
+      header.byte_order != SNAPSHOT_BYTE_ORDER ||
+      header.objsize != sizeof so || header.attrsize != sizeof sa ||
+      header.strings > (size_t) (r.end - r.p)) {
+    do_rawlog(LT_ERR, "ERROR: Database snapshot was written by an "
+                      "incompatible server. Load a text dump instead.");
+    goto done;
+  }
+
+  strings = mush_calloc(header.strings + 1, sizeof *strings, "snapshot");
+  flagsets = mush_calloc(header.strings + 1, sizeof *flagsets, "snapshot");
+  powersets = mush_calloc(header.strings + 1, sizeof *powersets, "snapshot");
+  for (n = 0; n < header.strings; n++)
+    strings[n] = snapshot_get_string(&r);
+
+  db_grow(top);
+
+  /* The fixed-size part of every object, in one pass. */
+  snapshot_need(&r, (size_t) header.count * sizeof so);
+  objs = r.p;
+  r.p += (size_t) header.count * sizeof so;
+  for (n = 0, attr = 0; n < header.count; n++) {
+    memcpy(&so, objs + (size_t) n * sizeof so, sizeof so);
+    if (so.dbref < 0 || so.dbref >= top || so.flags >= header.strings ||
+        so.powers >= header.strings || so.attrs > header.attrs - attr) {
+      do_rawlog(LT_ERR, "ERROR: Bad object #%d in database snapshot.",
+                so.dbref);
+      goto done;
+    }
+    attr += so.attrs;
+    o = db + so.dbref;
+    o->location = so.location;
+    o->contents = so.contents;
+    o->exits = so.exits;
+    o->next = so.next;
+    o->parent = so.parent;
+    o->owner = so.owner;
+    o->zone = so.zone;
+    o->penn = so.pennies;
+    o->type = so.type;
+    o->warnings = so.warnings;
+    o->creation_time = (time_t) so.created;
+    o->modification_time = (time_t) so.modified;
+    Flags(so.dbref) = snapshot_bits("FLAG", flagsets, strings, so.flags);
+    Powers(so.dbref) = snapshot_bits("POWER", powersets, strings, so.powers);
+    db_read_count_type(so.dbref);
+  }
+
+  /* Names and locks. */
+  for (n = 0; n < header.count; n++) {
+    memcpy(&so, objs + (size_t) n * sizeof so, sizeof so);
+    len = snapshot_get_u32(&r);
+    snapshot_need(&r, len);
+    rec.p = r.p;
+    rec.end = r.p + len;
+    r.p += len;
+    snapshot_read_record(&rec, so.dbref);
+  }
+
+  /* Attributes, with their values coming from a second array right
+   * after theirs. */
+  snapshot_need(&r, (size_t) header.attrs * sizeof sa);
+  attrs = r.p;
+  r.p += (size_t) header.attrs * sizeof sa;
+  for (n = 0, attr = 0; n < header.count; n++) {
+    memcpy(&so, objs + (size_t) n * sizeof so, sizeof so);
+    attr_reserve(so.dbref, so.attrs);
+    for (k = 0; k < so.attrs; k++, attr++) {
+      memcpy(&sa, attrs + (size_t) attr * sizeof sa, sizeof sa);
+      if (sa.name >= header.strings) {
+        do_rawlog(LT_ERR, "ERROR: Bad attribute name on #%d in database "
+                          "snapshot.",
+                  so.dbref);
+        goto done;
+      }
+      value = snapshot_get_string(&r);
+      atr_append(so.dbref, strings[sa.name], value, sa.creator, sa.flags,
+                 sa.derefs);
+    }
+    db_read_object_done(so.dbref, adder);
+  }
+
+  if ((size_t) (r.end - r.p) < eodlen || memcmp(r.p, EOD, eodlen) != 0) {
+    do_rawlog(LT_ERR, "ERROR: No end of dump after database snapshot.");
+    goto done;
+  }
+  r.p += eodlen;
+  if (!buf)
+    f->handle.m.pos = r.p - f->handle.m.data;
+  result = 0;
+
+done:
+  if (strings) {
+    for (n = 0; n < header.strings; n++) {
+      if (flagsets[n])
+        destroy_flag_bitmask("FLAG", flagsets[n]);
+      if (powersets[n])
+        destroy_flag_bitmask("POWER", powersets[n]);
+    }
+    mush_free(strings, "snapshot");
+    mush_free(flagsets, "snapshot");
+    mush_free(powersets, "snapshot");
+  }
+  if (buf)
+    mush_free(buf, "snapshot");
+  return result;
+}
+
 /** Read the object database from a file.
  * This function reads the entire database from a file. See db_write()
- * for some notes about the expected format.
+ * for some notes about the expected format, and db_write_snapshot()
+ * for binary snapshots.
  * \param f file pointer to read from.
  * \return number of objects in the database.
  */
@@ -1614,17 +2238,20 @@ db_read(PENNFILE *f)
 {
   sqlite3 *sqldb;
   sqlite3_stmt *adder;
-  int status;
   int c;
   dbref i = 0;
   char *tmp;
   struct object *o;
+  bool snapshot = 0;
   int minimum_flags = DBF_NEW_STRINGS | DBF_TYPE_GARBAGE | DBF_SPLIT_IMMORTAL |
                       DBF_NO_TEMPLE | DBF_SPIFFY_LOCKS;
 
   log_mem_check();
 
   loading_db = 1;
+  /* Every attribute value is stored, so check the chunk regions once
+   * at the end instead of after each one. */
+  chunk_bulk_begin();
 
   sqldb = get_shared_db();
   init_objdata();
@@ -1638,11 +2265,21 @@ db_read(PENNFILE *f)
     return -1;
   }
   c = penn_fgetc(f);
-  if (c != 'V') {
+  if (c == 'B') {
+    long version = getref(f);
+    if (version != SNAPSHOT_VERSION) {
+      do_rawlog(LT_ERR, "ERROR: Unknown database snapshot version %ld.",
+                version);
+      return -1;
+    }
+    snapshot = 1;
+    globals.indb_flags = db_current_flags();
+  } else if (c != 'V') {
     do_rawlog(LT_ERR, "Database does not start with a version string");
     return -1;
+  } else {
+    globals.indb_flags = ((getref(f) - 2) / 256) - 5;
   }
-  globals.indb_flags = ((getref(f) - 2) / 256) - 5;
   /* if you want to read in an old-style database, use an earlier
    * patchlevel to upgrade.
    */
@@ -1698,7 +2335,15 @@ db_read(PENNFILE *f)
       }
       break;
     case '~':
-      db_init = (getref(f) * 3) / 2;
+      i = getref(f);
+      db_init = (i * 3) / 2;
+      if (snapshot) {
+        if (db_read_snapshot(f, i, adder) < 0) {
+          sqlite3_exec(sqldb, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+          return -1;
+        }
+        return db_read_finish(sqldb);
+      }
       break;
     case '!':
       /* Read an object */
@@ -1806,24 +2451,7 @@ db_read(PENNFILE *f)
             break;
           case LBL_TYPE:
             o->type = parse_integer(value);
-            switch (Typeof(i)) {
-            case TYPE_PLAYER:
-              current_state.players++;
-              current_state.garbage--;
-              break;
-            case TYPE_THING:
-              current_state.things++;
-              current_state.garbage--;
-              break;
-            case TYPE_EXIT:
-              current_state.exits++;
-              current_state.garbage--;
-              break;
-            case TYPE_ROOM:
-              current_state.rooms++;
-              current_state.garbage--;
-              break;
-            }
+            db_read_count_type(i);
             break;
           case LBL_FLAGS:
             o->flags = string_to_bits("FLAG", value);
@@ -1857,48 +2485,7 @@ db_read(PENNFILE *f)
             return -1;
           }
         }
-        sqlite3_bind_int(adder, 1, i);
-        do {
-          status = sqlite3_step(adder);
-        } while (is_busy_status(status));
-        if (status != SQLITE_DONE) {
-          do_rawlog(LT_ERR, "Unable to add #%d to objects table: %s", i,
-                    sqlite3_errstr(status));
-        }
-        sqlite3_reset(adder);
-
-        if (IsPlayer(i) && (strlen(o->name) > (size_t) PLAYER_NAME_LIMIT)) {
-          char buff[BUFFER_LEN]; /* The name plus a NUL */
-          mush_strncpy(buff, o->name, PLAYER_NAME_LIMIT);
-          set_name(i, buff);
-          do_rawlog(LT_CHECK,
-                    " * Name of #%d is longer than the maximum, truncating.\n",
-                    i);
-        } else if (!IsPlayer(i) && (strlen(o->name) > OBJECT_NAME_LIMIT)) {
-          char buff[OBJECT_NAME_LIMIT + 1]; /* The name plus a NUL */
-          mush_strncpy(buff, o->name, OBJECT_NAME_LIMIT);
-          set_name(i, buff);
-          do_rawlog(LT_CHECK,
-                    " * Name of #%d is longer than the maximum, truncating.\n",
-                    i);
-        }
-        if (IsPlayer(i)) {
-          add_player(i);
-          clear_flag_internal(i, "CONNECTED");
-          /* If it has the MONITOR flag and the db predates HEAR_CONNECT, swap
-           * them over */
-          if (!(globals.indb_flags & DBF_HEAR_CONNECT) &&
-              has_flag_by_name(i, "MONITOR", NOTYPE)) {
-            clear_flag_internal(i, "MONITOR");
-            set_flag_internal(i, "HEAR_CONNECT");
-          }
-        }
-
-        if (globals.new_indb_version < 4 && IsRoom(i) &&
-            has_flag_by_name(i, "HAVEN", TYPE_ROOM)) {
-          /* HAVEN flag is no longer settable on rooms. */
-          clear_flag_internal(i, "HAVEN");
-        }
+        db_read_object_done(i, adder);
       }
       break;
     case '*': {
@@ -1910,18 +2497,7 @@ db_read(PENNFILE *f)
         sqlite3_exec(sqldb, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
         return -1;
       } else {
-        if (globals.new_indb_version < 4) {
-          /** In newdb_version 4+, HAVEN defaults to PLAYER only, not PLAYER |
-           * ROOM. */
-          set_flag_type_by_name("FLAG", "HAVEN", TYPE_PLAYER);
-        }
-        do_rawlog(LT_ERR, "READING: done");
-        sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, NULL);
-        loading_db = 0;
-        fix_free_list();
-        dbck();
-        log_mem_check();
-        return db_top;
+        return db_read_finish(sqldb);
       }
     }
     default:
@@ -1971,8 +2547,7 @@ sqlite_logger(void *arg __attribute__((__unused__)), int errcode,
   if (!errmsg) {
     errmsg = "UNKNOWN ERROR";
   }
-  if (strstr(errmsg, "UNIQUE constraint failed: players.name") ||
-      strstr(errmsg, "malformed JSON")) {
+  if (strstr(errmsg, "malformed JSON")) {
     return;
   }
 
@@ -2591,26 +3166,73 @@ init_objdata()
 {
   const char *create_query =
     "CREATE TABLE objects(dbref INTEGER NOT NULL PRIMARY KEY, queue INTEGER "
-    "NOT NULL DEFAULT 0);"
-    "CREATE TABLE objdata(dbref INTEGER NOT NULL, key TEXT NOT NULL, ptr "
-    "INTEGER, PRIMARY KEY (dbref, key), FOREIGN KEY(dbref) REFERENCES "
-    "objects(dbref) ON DELETE CASCADE) WITHOUT ROWID;";
+    "NOT NULL DEFAULT 0);";
   char *errmsg = NULL;
   sqlite3 *sqldb = get_shared_db();
 
   if (sqlite3_exec(sqldb, create_query, NULL, NULL, &errmsg) != SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to create objdata table: %s", errmsg);
+    do_rawlog(LT_ERR, "Unable to create objects table: %s", errmsg);
     sqlite3_free(errmsg);
     return;
   }
 }
 
-/** Add data to the object data hashtable.
- * This hash table is typically used to store transient object data
+/* Object data keys are interned; each object just stores small
+ * integer key ids. There are only ever a handful of distinct keys. */
+static char **objdata_keys = NULL;
+static int objdata_key_count = 0;
+
+/** Find the id of an object data key.
+ * \param keybase the key to look up.
+ * \param add true to intern the key if it isn't already known.
+ * \return the key's id, or -1 if not found.
+ */
+static int
+objdata_key(const char *keybase, bool add)
+{
+  int n;
+
+  for (n = 0; n < objdata_key_count; n++) {
+    if (strcmp(objdata_keys[n], keybase) == 0) {
+      return n;
+    }
+  }
+  if (!add) {
+    return -1;
+  }
+  objdata_keys = mush_realloc(objdata_keys, sizeof(char *) * (n + 1),
+                              "objdata.keys");
+  objdata_keys[n] = mush_strdup(keybase, "objdata.key");
+  objdata_key_count += 1;
+  return n;
+}
+
+/** Find an object's data slot for a key.
+ * \param thing the object.
+ * \param key the key id.
+ * \return pointer to the slot, or NULL.
+ */
+static struct objdata_slot *
+objdata_slot(dbref thing, int key)
+{
+  struct objdata_slot *slot;
+  int n;
+
+  for (n = 0, slot = db[thing].objdata; n < db[thing].objdatacount;
+       n++, slot++) {
+    if (slot->key == key) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/** Add data to the object data table.
+ * This table is typically used to store transient object data
  * that is built at database load and isn't saved to disk, but it
  * can be used for other purposes as well - it's a good general
  * tool for hackers who want to add their own data to objects.
- * This function adds data to the hashtable. NULL data cleared
+ * This function adds data to the table. NULL data cleared
  * that particular keybase/object entry. It does not free the
  * data pointer.
  * \param thing dbref of object to associate the data with.
@@ -2621,43 +3243,31 @@ init_objdata()
 void *
 set_objdata(dbref thing, const char *keybase, void *data)
 {
-  sqlite3_stmt *setter;
-  int status;
-  sqlite3 *sqldb;
+  struct objdata_slot *slot;
+  int key;
 
   if (data == NULL) {
     delete_objdata(thing, keybase);
     return NULL;
   }
 
-  sqldb = get_shared_db();
-  setter =
-    prepare_statement(sqldb,
-                      "INSERT INTO objdata(dbref, key, ptr) VALUES(?, ?, ?) ON "
-                      "CONFLICT (dbref, key) DO UPDATE SET ptr=excluded.ptr",
-                      "objdata.set");
-  if (!setter) {
-    return NULL;
+  key = objdata_key(keybase, 1);
+  slot = objdata_slot(thing, key);
+  if (!slot) {
+    struct object *o = db + thing;
+    o->objdata = mush_realloc(
+      o->objdata, sizeof(struct objdata_slot) * (o->objdatacount + 1),
+      "objdata");
+    slot = o->objdata + o->objdatacount;
+    slot->key = key;
+    o->objdatacount += 1;
   }
-
-  sqlite3_bind_int(setter, 1, thing);
-  sqlite3_bind_text(setter, 2, keybase, strlen(keybase), SQLITE_STATIC);
-  sqlite3_bind_int64(setter, 3, (intptr_t) data);
-
-  do {
-    status = sqlite3_step(setter);
-  } while (is_busy_status(status));
-
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to execute objdata set query for #%d/%s: %s",
-              thing, keybase, sqlite3_errmsg(sqldb));
-  }
-  sqlite3_reset(setter);
+  slot->data = data;
 
   return data;
 }
 
-/** Retrieve data from the object data hashtable.
+/** Retrieve data from the object data table.
  * \param thing dbref of object data is associated with.
  * \param keybase base string for type of data, in UTF-8.
  * \return data stored for that object and keybase, or NULL.
@@ -2665,31 +3275,18 @@ set_objdata(dbref thing, const char *keybase, void *data)
 void *
 get_objdata(dbref thing, const char *keybase)
 {
-  sqlite3_stmt *getter;
-  int status;
-  void *data = NULL;
-  sqlite3 *sqldb = get_shared_db();
+  struct objdata_slot *slot;
+  int key;
 
-  getter = prepare_statement(
-    sqldb, "SELECT ptr FROM objdata WHERE dbref = ? AND key = ?",
-    "objdata.get");
-  if (!getter) {
+  if (!db[thing].objdatacount) {
     return NULL;
   }
-
-  sqlite3_bind_int(getter, 1, thing);
-  sqlite3_bind_text(getter, 2, keybase, strlen(keybase), SQLITE_STATIC);
-  do {
-    status = sqlite3_step(getter);
-  } while (is_busy_status(status));
-  if (status == SQLITE_ROW) {
-    data = (void *) ((intptr_t) sqlite3_column_int64(getter, 0));
-  } else if (status != SQLITE_DONE) {
-    do_rawlog(LT_TRACE, "Unable to execute objdata get query for #%d/%s: %s",
-              thing, keybase, sqlite3_errmsg(sqldb));
+  key = objdata_key(keybase, 0);
+  if (key < 0) {
+    return NULL;
   }
-  sqlite3_reset(getter);
-  return data;
+  slot = objdata_slot(thing, key);
+  return slot ? slot->data : NULL;
 }
 
 /** Clear an object's data for a specific key.
@@ -2699,27 +3296,57 @@ get_objdata(dbref thing, const char *keybase)
 void
 delete_objdata(dbref thing, const char *keybase)
 {
-  sqlite3_stmt *deleter;
-  int status;
-  sqlite3 *sqldb = get_shared_db();
+  struct object *o = db + thing;
+  struct objdata_slot *slot;
+  int key;
 
-  deleter = prepare_statement(
-    sqldb, "DELETE FROM objdata WHERE dbref = ? AND key = ?", "objdata.delete");
-  if (!deleter) {
+  key = objdata_key(keybase, 0);
+  if (key < 0) {
     return;
   }
+  slot = objdata_slot(thing, key);
+  if (!slot) {
+    return;
+  }
+  o->objdatacount -= 1;
+  *slot = o->objdata[o->objdatacount];
+  if (!o->objdatacount) {
+    mush_free(o->objdata, "objdata");
+    o->objdata = NULL;
+  }
+}
 
-  sqlite3_bind_int(deleter, 1, thing);
-  sqlite3_bind_text(deleter, 2, keybase, strlen(keybase), SQLITE_STATIC);
-  do {
-    status = sqlite3_step(deleter);
-  } while (is_busy_status(status));
-
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to execute objdata delete query for #%d: %s",
-              thing, sqlite3_errmsg(sqldb));
+/** Clear all of an object's data. Does not free the data pointers.
+ * \param thing dbref of object whose data should be cleared.
+ */
+void
+clear_objdata(dbref thing)
+{
+  if (db[thing].objdata) {
+    mush_free(db[thing].objdata, "objdata");
   }
-  sqlite3_reset(deleter);
+  db[thing].objdata = NULL;
+  db[thing].objdatacount = 0;
+}
+
+TEST_GROUP(objdata)
+{
+  int a = 1, b = 2;
+  dbref thing = 0;
+
+  TEST("objdata.1", get_objdata(thing, "TEST.OBJDATA") == NULL);
+  TEST("objdata.2", set_objdata(thing, "TEST.OBJDATA", &a) == &a);
+  TEST("objdata.3", get_objdata(thing, "TEST.OBJDATA") == &a);
+  TEST("objdata.4", get_objdata(thing, "test.objdata") == NULL);
+  set_objdata(thing, "TEST.OBJDATA2", &b);
+  set_objdata(thing, "TEST.OBJDATA", &b);
+  TEST("objdata.5", get_objdata(thing, "TEST.OBJDATA") == &b);
+  TEST("objdata.6", get_objdata(thing, "TEST.OBJDATA2") == &b);
+  delete_objdata(thing, "TEST.OBJDATA");
+  TEST("objdata.7", get_objdata(thing, "TEST.OBJDATA") == NULL);
+  TEST("objdata.8", get_objdata(thing, "TEST.OBJDATA2") == &b);
+  set_objdata(thing, "TEST.OBJDATA2", NULL);
+  TEST("objdata.9", get_objdata(thing, "TEST.OBJDATA2") == NULL);
 }
 
 static void
@@ -2833,6 +3460,28 @@ penn_fopen(const char *filename, const char *mode)
   return pf;
 }
 
+/** Open an uncompressed file for reading through a memory map.
+ * \param filename the file to open.
+ * \return a PENNFILE reading from the mapped file, or NULL.
+ */
+PENNFILE *
+penn_mapopen(const char *filename)
+{
+  PENNFILE *pf;
+  MAPPED_FILE *map;
+
+  map = map_file(filename, 0);
+  if (!map)
+    return NULL;
+  pf = mush_malloc(sizeof *pf, "pennfile");
+  pf->type = PFT_MEMORY;
+  pf->handle.m.data = map->data;
+  pf->handle.m.len = map->len;
+  pf->handle.m.pos = 0;
+  pf->handle.m.map = map;
+  return pf;
+}
+
 /* Close a db file, which may really be a pipe */
 void
 penn_fclose(PENNFILE *pf)
@@ -2851,6 +3500,12 @@ penn_fclose(PENNFILE *pf)
     gzclose(pf->handle.g);
 #endif
     break;
+  case PFT_MEMORY:
+    if (pf->handle.m.map)
+      unmap_file(pf->handle.m.map);
+    else
+      mush_free((void *) pf->handle.m.data, "pennfile.data");
+    break;
   }
   mush_free(pf, "pennfile");
 }
@@ -2872,6 +3527,10 @@ penn_fgetc(PENNFILE *f)
     return gzgetc(f->handle.g);
 #endif
     break;
+  case PFT_MEMORY:
+    if (f->handle.m.pos >= f->handle.m.len)
+      return EOF;
+    return (unsigned char) f->handle.m.data[f->handle.m.pos++];
   }
   return 0;
 }
@@ -2892,10 +3551,58 @@ penn_fgets(char *buf, int len, PENNFILE *pf)
     return gzgets(pf->handle.g, buf, len);
 #endif
     break;
+  case PFT_MEMORY: {
+    struct pennfile_mem *m = &pf->handle.m;
+    size_t n = m->len - m->pos;
+    const char *nl;
+
+    if (len <= 0 || n == 0)
+      return NULL;
+    if (n > (size_t) len - 1)
+      n = len - 1;
+    nl = memchr(m->data + m->pos, '\n', n);
+    if (nl)
+      n = nl - (m->data + m->pos) + 1;
+    memcpy(buf, m->data + m->pos, n);
+    buf[n] = '\0';
+    m->pos += n;
+    return buf;
+  }
   }
   return NULL;
 }
 
+/** Read a block of bytes from a db file.
+ * \param buf where to put the bytes.
+ * \param len how many bytes to read.
+ * \param pf file to read from.
+ * \return the number of bytes read, less than len at the end of the file.
+ */
+size_t
+penn_fread(void *buf, size_t len, PENNFILE *pf)
+{
+  switch (pf->type) {
+  case PFT_FILE:
+  case PFT_PIPE:
+    return fread(buf, 1, len, pf->handle.f);
+  case PFT_GZFILE:
+#ifdef HAVE_LIBZ
+  {
+    int r = gzread(pf->handle.g, buf, len);
+    return r > 0 ? (size_t) r : 0;
+  }
+#endif
+    break;
+  case PFT_MEMORY:
+    if (len > pf->handle.m.len - pf->handle.m.pos)
+      len = pf->handle.m.len - pf->handle.m.pos;
+    memcpy(buf, pf->handle.m.data + pf->handle.m.pos, len);
+    pf->handle.m.pos += len;
+    return len;
+  }
+  return 0;
+}
+
 /* c should not be a negative value or it'll screw up gzputc return value
  * testing */
 int
@@ -2915,6 +3622,9 @@ penn_fputc(int c, PENNFILE *f)
     OUTPUT(gzputc(f->handle.g, c));
 #endif
     break;
+  case PFT_MEMORY:
+    OUTPUT(EOF);
+    break;
   }
   return 0;
 }
@@ -2936,10 +3646,38 @@ penn_fputs(const char *s, PENNFILE *f)
     OUTPUT(gzputs(f->handle.g, s));
 #endif
     break;
+  case PFT_MEMORY:
+    OUTPUT(EOF);
+    break;
   }
   return 0;
 }
 
+/** Write a block of bytes to a db file.
+ * \param data the bytes to write.
+ * \param len how many bytes to write.
+ * \param f file to write to.
+ */
+void
+penn_fwrite(const void *data, size_t len, PENNFILE *f)
+{
+  switch (f->type) {
+  case PFT_FILE:
+  case PFT_PIPE:
+    if (fwrite(data, 1, len, f->handle.f) != len)
+      longjmp(db_err, 1);
+    break;
+  case PFT_GZFILE:
+#ifdef HAVE_LIBZ
+    if (len && gzwrite(f->handle.g, data, len) <= 0)
+      longjmp(db_err, 1);
+#endif
+    break;
+  case PFT_MEMORY:
+    longjmp(db_err, 1);
+  }
+}
+
 int
 penn_fprintf(PENNFILE *f, const char *fmt, ...)
 {
@@ -2991,6 +3729,8 @@ penn_fprintf(PENNFILE *f, const char *fmt, ...)
 #endif
 #endif
     break;
+  case PFT_MEMORY:
+    longjmp(db_err, 1);
   }
   return r;
 }
@@ -3008,6 +3748,12 @@ penn_ungetc(int c, PENNFILE *f)
     OUTPUT(gzungetc(c, f->handle.g));
 #endif
     break;
+  case PFT_MEMORY:
+    /* Like ungetc(), pushing back EOF is an error. */
+    if (c == EOF || f->handle.m.pos == 0)
+      OUTPUT(EOF);
+    f->handle.m.pos--;
+    break;
   }
   return c;
 }
@@ -3024,6 +3770,29 @@ penn_feof(PENNFILE *pf)
     return gzeof(pf->handle.g);
 #endif
     break;
+  case PFT_MEMORY:
+    return pf->handle.m.pos >= pf->handle.m.len;
   }
   return 0;
 }
+
+TEST_GROUP(penn_memfile)
+{
+  static const char text[] = "+B1\nab\ncd";
+  struct pennfile_mem m = {text, sizeof text - 1, 0, NULL};
+  PENNFILE pf;
+  char buf[8];
+
+  pf.type = PFT_MEMORY;
+  pf.handle.m = m;
+  TEST("penn_memfile.1", penn_fgetc(&pf) == '+');
+  TEST("penn_memfile.2", penn_ungetc('+', &pf) == '+');
+  TEST("penn_memfile.3", penn_fgets(buf, sizeof buf, &pf) &&
+                           strcmp(buf, "+B1\n") == 0);
+  TEST("penn_memfile.4", penn_fgets(buf, 2, &pf) && strcmp(buf, "a") == 0);
+  TEST("penn_memfile.5", penn_fread(buf, sizeof buf, &pf) == 4 &&
+                           memcmp(buf, "b\ncd", 4) == 0);
+  TEST("penn_memfile.6", penn_feof(&pf));
+  TEST("penn_memfile.7", penn_fgetc(&pf) == EOF);
+  TEST("penn_memfile.8", penn_fgets(buf, sizeof buf, &pf) == NULL);
+}
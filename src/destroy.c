@@ -716,6 +716,8 @@ free_object(dbref thing)
   Parent(thing) = NOTHING;
   Zone(thing) = NOTHING;
   remove_all_obj_chan(thing);
+  if (IsPlayer(thing))
+    delete_player(thing);
 
   switch (Typeof(thing)) {
   /* Make absolutely sure we are removed from Location's content or
@@ -756,6 +758,8 @@ free_object(dbref thing)
   Exits(thing) = NOTHING;
   Home(thing) = NOTHING;
   CreTime(thing) = 0; /* Prevents it from matching objids */
+  clear_objdata(thing);
+  free_owner_queue(thing);
 
   {
     sqlite3 *sqldb;
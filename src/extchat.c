@@ -20,6 +20,7 @@
 
 #include "ansi.h"
 #include "attrib.h"
+#include "case.h"
 #include "command.h"
 #include "conf.h"
 #include "dbdefs.h"
@@ -56,6 +57,11 @@ static int load_labeled_channel(PENNFILE *fp, CHAN *ch, int dbflags,
 static int load_labeled_chanusers(PENNFILE *fp, CHAN *ch, bool restart);
 static void insert_channel(CHAN **ch);
 static void remove_channel(CHAN *ch);
+static void chan_index_add(CHAN *ch);
+static void chan_index_remove(CHAN *ch);
+static CHAN *chan_index_find(const char *name);
+static int chan_index_prefix(const char *prefix, int *first);
+static void chan_index_number(void);
 static void insert_obj_chan(dbref who, CHAN **ch);
 static void remove_obj_chan(dbref who, CHAN *ch);
 void remove_all_obj_chan(dbref thing);
@@ -111,6 +117,23 @@ int num_channels; /**< Number of channels defined */
 
 CHAN *channels; /**< Pointer to channel list */
 
+/** A channel in the name index. */
+struct chan_key {
+  char *key;  /**< Markup-stripped, lower-cased name */
+  int pos;    /**< Position in the channels list */
+  CHAN *chan; /**< The channel */
+};
+
+/* Every channel, sorted by key so that all the names starting with a
+ * given prefix are next to each other, plus a hash of keys for exact
+ * matches. Kept in step with the channels list by insert_channel() and
+ * remove_channel(). */
+static struct chan_key *chan_keys = NULL;
+static int chan_keys_count = 0;
+static int chan_keys_size = 0;
+static bool chan_keys_pos_stale = false;
+static HASHTAB htab_chan_keys;
+
 extern int rhs_present; /* from command.c */
 
 /* Player must come before Admin and Wizard, otherwise @chan/what
@@ -222,6 +245,7 @@ init_chatdb(void)
     slab_set_opt(chanuser_slab, SLAB_ALLOC_BEST_FIT, 1);
     slab_set_opt(chanlist_slab, SLAB_ALLOC_BEST_FIT, 1);
     channels = NULL;
+    hashinit(&htab_chan_keys, 256);
   }
 }
 
@@ -578,6 +602,8 @@ insert_channel(CHAN **ch)
   if (!ch || !*ch)
     return;
 
+  chan_index_add(*ch);
+
   /* If there's no channels on the list, or if the first channel is already
    * alphabetically greater, ch should be the first entry on the list */
   /* No channels? */
@@ -617,6 +643,7 @@ remove_channel(CHAN *ch)
     return;
   if (!channels)
     return;
+  chan_index_remove(ch);
   if (channels == ch) {
     /* First channel */
     channels = ch->next;
@@ -632,6 +659,144 @@ remove_channel(CHAN *ch)
   return;
 }
 
+/* Lower-case name into key, which holds BUFFER_LEN bytes */
+static void
+chan_fold_name(const char *name, char *key)
+{
+  char *kp = key;
+
+  for (; *name && kp < key + BUFFER_LEN - 1; name++)
+    *kp++ = DOWNCASE(*name);
+  *kp = '\0';
+}
+
+/* Find where key goes in chan_keys */
+static int
+chan_key_slot(const char *key)
+{
+  int lo = 0, hi = chan_keys_count;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (strcmp(chan_keys[mid].key, key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Add a channel to the name index */
+static void
+chan_index_add(CHAN *ch)
+{
+  char key[BUFFER_LEN];
+  int slot;
+
+  chan_fold_name(remove_markup(ChanName(ch), NULL), key);
+  if (chan_keys_count == chan_keys_size) {
+    chan_keys_size = chan_keys_size ? chan_keys_size * 2 : 64;
+    chan_keys =
+      mush_realloc(chan_keys, chan_keys_size * sizeof(struct chan_key),
+                   "channel.index");
+  }
+  /* After any others with the same name, like the channels list */
+  for (slot = chan_key_slot(key);
+       slot < chan_keys_count && !strcmp(chan_keys[slot].key, key); slot++)
+    ;
+  memmove(chan_keys + slot + 1, chan_keys + slot,
+          (chan_keys_count - slot) * sizeof(struct chan_key));
+  chan_keys[slot].key = mush_strdup(key, "channel.index.key");
+  chan_keys[slot].pos = 0;
+  chan_keys[slot].chan = ch;
+  chan_keys_count++;
+  chan_keys_pos_stale = true;
+  hashadd(key, ch, &htab_chan_keys);
+}
+
+/* Remove a channel from the name index */
+static void
+chan_index_remove(CHAN *ch)
+{
+  char key[BUFFER_LEN];
+  int slot;
+
+  chan_fold_name(remove_markup(ChanName(ch), NULL), key);
+  for (slot = chan_key_slot(key);
+       slot < chan_keys_count && !strcmp(chan_keys[slot].key, key); slot++) {
+    if (chan_keys[slot].chan != ch)
+      continue;
+    mush_free(chan_keys[slot].key, "channel.index.key");
+    chan_keys_count--;
+    chan_keys_pos_stale = true;
+    memmove(chan_keys + slot, chan_keys + slot + 1,
+            (chan_keys_count - slot) * sizeof(struct chan_key));
+    break;
+  }
+  if (hashfind(key, &htab_chan_keys) == ch) {
+    hashdelete(key, &htab_chan_keys);
+    /* Another channel with the same name, from a db that has one */
+    slot = chan_key_slot(key);
+    if (slot < chan_keys_count && !strcmp(chan_keys[slot].key, key))
+      hashadd(key, chan_keys[slot].chan, &htab_chan_keys);
+  }
+}
+
+/* Look up a channel by its markup-stripped name, ignoring case */
+static CHAN *
+chan_index_find(const char *name)
+{
+  char key[BUFFER_LEN];
+
+  chan_fold_name(name, key);
+  return hashfind(key, &htab_chan_keys);
+}
+
+/* Find the channels whose markup-stripped names start with prefix,
+ * ignoring case. Sets *first to the index in chan_keys of the first one
+ * and returns how many there are. */
+static int
+chan_index_prefix(const char *prefix, int *first)
+{
+  char key[BUFFER_LEN];
+  size_t len;
+  int slot;
+
+  if (chan_keys_pos_stale)
+    chan_index_number();
+  chan_fold_name(prefix, key);
+  len = strlen(key);
+  *first = chan_key_slot(key);
+  for (slot = *first;
+       slot < chan_keys_count && !strncmp(chan_keys[slot].key, key, len);
+       slot++)
+    ;
+  return slot - *first;
+}
+
+/* Record where each channel is in the channels list, so that picking the
+ * alphabetically first of several matches doesn't need strcasecoll() */
+static void
+chan_index_number(void)
+{
+  char key[BUFFER_LEN];
+  CHAN *p;
+  int pos = 0, slot;
+
+  for (p = channels; p; p = p->next, pos++) {
+    chan_fold_name(remove_markup(ChanName(p), NULL), key);
+    for (slot = chan_key_slot(key); slot < chan_keys_count; slot++)
+      if (chan_keys[slot].chan == p) {
+        chan_keys[slot].pos = pos;
+        break;
+      }
+  }
+  chan_keys_pos_stale = false;
+}
+
+/* True if chan_keys[a] comes before chan_keys[b] in the channels list */
+#define chan_key_before(a, b) (chan_keys[(a)].pos < chan_keys[(b)].pos)
+
 /* Insert the channel onto the list of channels on a given object,
  * sorted by name
  */
@@ -944,30 +1109,31 @@ find_channel(const char *name, CHAN **chan, dbref player)
 {
   CHAN *p;
   int count = 0;
+  int i, first, n, best = -1;
   char cleanname[BUFFER_LEN];
-  char cleanp[CHAN_NAME_LEN];
 
   *chan = NULL;
   if (!name || !*name)
     return CMATCH_NONE;
 
   strcpy(cleanname, normalize_channel_name(name));
-  for (p = channels; p; p = p->next) {
-    strcpy(cleanp, remove_markup(ChanName(p), NULL));
-    if (!strcasecmp(cleanname, cleanp)) {
-      *chan = p;
-      if (Chan_Can_See(*chan, player) || onchannel(player, *chan))
-        return CMATCH_EXACT;
-      else
-        return CMATCH_NONE;
-    }
-    if (string_prefix(cleanp, name)) {
-      /* Keep the alphabetically first channel if we've got one */
-      if (Chan_Can_See(p, player) || onchannel(player, p)) {
-        if (!*chan)
-          *chan = p;
-        count++;
+  if ((p = chan_index_find(cleanname))) {
+    *chan = p;
+    if (Chan_Can_See(*chan, player) || onchannel(player, *chan))
+      return CMATCH_EXACT;
+    else
+      return CMATCH_NONE;
+  }
+  n = chan_index_prefix(name, &first);
+  for (i = first; i < first + n; i++) {
+    p = chan_keys[i].chan;
+    /* Keep the alphabetically first channel if we've got one */
+    if (Chan_Can_See(p, player) || onchannel(player, p)) {
+      if (best < 0 || chan_key_before(i, best)) {
+        *chan = p;
+        best = i;
       }
+      count++;
     }
   }
   switch (count) {
@@ -998,30 +1164,35 @@ find_channel_partial(const char *name, CHAN **chan, dbref player)
 {
   CHAN *p;
   int count = 0;
+  int i, first, n, best = -1;
+  bool best_on = false, on;
   char cleanname[BUFFER_LEN];
-  char cleanp[CHAN_NAME_LEN];
 
   *chan = NULL;
   if (!name || !*name)
     return CMATCH_NONE;
   strcpy(cleanname, normalize_channel_name(name));
-  for (p = channels; p; p = p->next) {
-    if (!onchannel(player, p) && !Chan_Can_See(p, player))
+  p = chan_index_find(cleanname);
+  if (p && (onchannel(player, p) || Chan_Can_See(p, player))) {
+    *chan = p;
+    return CMATCH_EXACT;
+  }
+  n = chan_index_prefix(cleanname, &first);
+  for (i = first; i < first + n; i++) {
+    p = chan_keys[i].chan;
+    on = onchannel(player, p);
+    if (!on && !Chan_Can_See(p, player))
       continue;
-    strcpy(cleanp, remove_markup(ChanName(p), NULL));
-    if (!strcasecmp(cleanname, cleanp)) {
+    /* Prefer the alphabetically first channel the player is on, and
+     * otherwise the alphabetically first one.
+     */
+    if (best < 0 || (on && !best_on) ||
+        (on == best_on && chan_key_before(i, best))) {
       *chan = p;
-      return CMATCH_EXACT;
-    }
-    if (string_prefix(cleanp, cleanname)) {
-      /* If we've already found an ambiguous match that the
-       * player is on, keep using that one. Otherwise, this is
-       * our best candidate so far.
-       */
-      if (!*chan || (!onchannel(player, *chan) && onchannel(player, p)))
-        *chan = p;
-      count++;
+      best = i;
+      best_on = on;
     }
+    count++;
   }
   switch (count) {
   case 0:
@@ -1082,25 +1253,27 @@ find_channel_partial_on(const char *name, CHAN **chan, dbref player)
 {
   CHAN *p;
   int count = 0;
+  int i, first, n, best = -1;
   char cleanname[BUFFER_LEN];
-  char cleanp[CHAN_NAME_LEN];
 
   *chan = NULL;
   if (!name || !*name)
     return CMATCH_NONE;
   strcpy(cleanname, normalize_channel_name(name));
-  for (p = channels; p; p = p->next) {
+  p = chan_index_find(cleanname);
+  if (p && onchannel(player, p)) {
+    *chan = p;
+    return CMATCH_EXACT;
+  }
+  n = chan_index_prefix(cleanname, &first);
+  for (i = first; i < first + n; i++) {
+    p = chan_keys[i].chan;
     if (onchannel(player, p)) {
-      strcpy(cleanp, remove_markup(ChanName(p), NULL));
-      if (!strcasecmp(cleanname, cleanp)) {
+      if (best < 0 || chan_key_before(i, best)) {
         *chan = p;
-        return CMATCH_EXACT;
-      }
-      if (string_prefix(cleanp, cleanname) && onchannel(player, p)) {
-        if (!*chan)
-          *chan = p;
-        count++;
+        best = i;
       }
+      count++;
     }
   }
   switch (count) {
@@ -1131,26 +1304,28 @@ find_channel_partial_off(const char *name, CHAN **chan, dbref player)
 {
   CHAN *p;
   int count = 0;
+  int i, first, n, best = -1;
   char cleanname[BUFFER_LEN];
-  char cleanp[CHAN_NAME_LEN];
 
   *chan = NULL;
   if (!name || !*name)
     return CMATCH_NONE;
   strcpy(cleanname, normalize_channel_name(name));
-  for (p = channels; p; p = p->next) {
+  p = chan_index_find(cleanname);
+  if (p && !onchannel(player, p) && Chan_Can_See(p, player)) {
+    *chan = p;
+    return CMATCH_EXACT;
+  }
+  n = chan_index_prefix(cleanname, &first);
+  for (i = first; i < first + n; i++) {
+    p = chan_keys[i].chan;
     if (onchannel(player, p) || !Chan_Can_See(p, player))
       continue;
-    strcpy(cleanp, remove_markup(ChanName(p), NULL));
-    if (!strcasecmp(cleanname, cleanp)) {
+    if (best < 0 || chan_key_before(i, best)) {
       *chan = p;
-      return CMATCH_EXACT;
-    }
-    if (string_prefix(cleanp, cleanname)) {
-      if (!*chan)
-        *chan = p;
-      count++;
+      best = i;
     }
+    count++;
   }
 
   switch (count) {
@@ -1887,16 +2062,13 @@ ok_channel_name(const char *n, CHAN *unique)
   if (strlen(name) > CHAN_NAME_LEN - 1)
     return NAME_TOO_LONG;
 
-  for (check = channels; check; check = check->next) {
-    p = remove_markup(ChanName(check), NULL);
-    if (!strcasecmp(p, name)) {
-      if (unique == NULL)
-        return NAME_NOT_UNIQUE; /* Name already in use */
-      else if (check != unique)
-        return NAME_NOT_UNIQUE; /* Name already in use by another channel */
-      else
-        return NAME_OK; /* Renaming the channel to its current name is fine */
-    }
+  if ((check = chan_index_find(name))) {
+    if (unique == NULL)
+      return NAME_NOT_UNIQUE; /* Name already in use */
+    else if (check != unique)
+      return NAME_NOT_UNIQUE; /* Name already in use by another channel */
+    else
+      return NAME_OK; /* Renaming the channel to its current name is fine */
   }
 
   return NAME_OK; /* Name is valid and not in use */
@@ -3714,6 +3886,39 @@ mogrify(dbref mogrifier, const char *attrname, dbref player, int numargs,
   return buff;
 }
 
+/** What na_chanusers() needs to pick out the users who hear a broadcast. */
+struct na_chanusers_data {
+  CHANUSER *next; /**< Next user to consider */
+  dbref player;   /**< Message speaker */
+  int flags;      /**< CB_* flags of the broadcast */
+};
+
+/* notify_anything() iterator for the users of a channel who hear a
+ * broadcast. Telling them all with one notify_anything() call lets them
+ * share each rendering of the message. */
+static dbref
+na_chanusers(dbref current __attribute__((__unused__)), void *data)
+{
+  struct na_chanusers_data *nc = data;
+  CHANUSER *u;
+  dbref who;
+
+  while ((u = nc->next)) {
+    nc->next = u->next;
+    who = CUdbref(u);
+
+    if ((nc->flags & CB_NOCOMBINE) && Chanuser_Combine(u))
+      continue;
+    if ((nc->flags & CB_SEEALL) && !See_All(who) && (who != nc->player))
+      continue;
+    if (((nc->flags & CB_CHECKQUIET) && Chanuser_Quiet(u)) ||
+        Chanuser_Gag(u) || (IsPlayer(who) && !Connected(who)))
+      continue;
+    return who;
+  }
+  return NOTHING;
+}
+
 /** Broadcast a message to a channel, using @chatformat if it's
  *  available, and mogrifying.
  * \param channel pointer to channel to broadcast to.
@@ -3739,10 +3944,9 @@ channel_send(CHAN *channel, dbref player, int flags, const char *origmessage)
   static char buff[BUFFER_LEN];
   static char speechtext[BUFFER_LEN];
   struct format_msg format;
+  struct na_chanusers_data nc;
 
-  CHANUSER *u;
   CHANUSER *speaker;
-  dbref current;
   char *bp;
   const char *blockstr = "";
   int na_flags = NA_INTER_LOCK;
@@ -3949,21 +4153,11 @@ channel_send(CHAN *channel, dbref player, int flags, const char *origmessage)
     format.args[7] = "noisy";
   }
 
-  for (u = ChanUsers(channel); u; u = u->next) {
-    current = CUdbref(u);
-
-    if ((flags & CB_NOCOMBINE) && Chanuser_Combine(u)) {
-      continue;
-    }
-    if ((flags & CB_SEEALL) && !See_All(current) && (current != player))
-      continue;
-
-    if (!(((flags & CB_CHECKQUIET) && Chanuser_Quiet(u)) || Chanuser_Gag(u) ||
-          (IsPlayer(current) && !Connected(current)))) {
-      notify_anything(player, player, na_one, &current, NULL, na_flags, buff,
-                      NULL, AMBIGUOUS, (override_chatformat ? NULL : &format));
-    }
-  }
+  nc.next = ChanUsers(channel);
+  nc.player = player;
+  nc.flags = flags;
+  notify_anything(player, player, na_chanusers, &nc, NULL, na_flags, buff,
+                  NULL, AMBIGUOUS, (override_chatformat ? NULL : &format));
 
   if (ChanBufferQ(channel) && !skip_buffer)
     add_to_bufferq(ChanBufferQ(channel),
@@ -2581,11 +2581,11 @@ FUNCTION(fun_table)
  * with an ig version */
 FUNCTION(fun_regreplace)
 {
+  struct re_cache_ref rx;
   pcre2_code *re;
   pcre2_match_data *md;
   int errcode;
   int subpatterns;
-  PCRE2_SIZE erroffset;
   int flags = re_compile_flags, all = 0;
   PCRE2_SIZE match_offset = 0;
   PE_REGS *pe_regs = NULL;
@@ -2642,10 +2642,7 @@ FUNCTION(fun_regreplace)
     }
     *tbp = '\0';
 
-    if ((re =
-           pcre2_compile((const PCRE2_UCHAR *) remove_markup(tbuf, &searchlen),
-                         PCRE2_ZERO_TERMINATED, flags, &errcode, &erroffset,
-                         re_compile_ctx)) == NULL) {
+    if (!re_cache_get(&rx, remove_markup(tbuf, &searchlen), flags, &errcode)) {
       /* Matching error. */
       char errstr[120];
       pcre2_get_error_message(errcode, (PCRE2_UCHAR *) errstr, sizeof errstr);
@@ -2653,18 +2650,12 @@ FUNCTION(fun_regreplace)
       safe_str(errstr, buff, bp);
       goto exit_sequence;
     }
-    ADD_CHECK("pcre"); /* re */
+    re = rx.re;
+    md = rx.md;
     if (searchlen) {
       searchlen--;
     }
 
-    /* If we're doing a lot, jit the regexp to make it faster */
-    if (all) {
-      pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
-    }
-
-    md = pcre2_match_data_create_from_pattern(re, NULL);
-
     /* Do all the searches and replaces we can */
 
     start = prebuf;
@@ -2674,9 +2665,7 @@ FUNCTION(fun_regreplace)
     /* Match wasn't found... we're done */
     if (subpatterns < 0) {
       safe_str(prebuf, postbuf, &postp);
-      pcre2_code_free(re);
-      pcre2_match_data_free(md);
-      DEL_CHECK("pcre");
+      re_cache_release(&rx);
       continue;
     }
 
@@ -2699,9 +2688,7 @@ FUNCTION(fun_regreplace)
 
       if (process_expression(postbuf, &postp, &obp, executor, caller, enactor,
                              eflags | PE_DOLLAR, PT_DEFAULT, pe_info)) {
-        pcre2_code_free(re);
-        pcre2_match_data_free(md);
-        DEL_CHECK("pcre");
+        re_cache_release(&rx);
         goto exit_sequence;
       }
       if ((*bp == (buff + BUFFER_LEN - 1)) &&
@@ -2725,9 +2712,7 @@ FUNCTION(fun_regreplace)
     safe_str(start, postbuf, &postp);
     *postp = '\0';
 
-    pcre2_code_free(re);
-    pcre2_match_data_free(md);
-    DEL_CHECK("pcre");
+    re_cache_release(&rx);
   }
 
   /* We get to this point if there is ansi in an 'orig' string */
@@ -2748,10 +2733,8 @@ FUNCTION(fun_regreplace)
 
       *tbp = '\0';
 
-      if ((re = pcre2_compile(
-             (const PCRE2_UCHAR *) remove_markup(tbuf, &searchlen),
-             PCRE2_ZERO_TERMINATED, flags, &errcode, &erroffset,
-             re_compile_ctx)) == NULL) {
+      if (!re_cache_get(&rx, remove_markup(tbuf, &searchlen), flags,
+                        &errcode)) {
         /* Matching error. */
         char errstr[120];
         pcre2_get_error_message(errcode, (PCRE2_UCHAR *) errstr, sizeof errstr);
@@ -2759,16 +2742,12 @@ FUNCTION(fun_regreplace)
         safe_str(errstr, buff, bp);
         goto exit_sequence;
       }
-      ADD_CHECK("pcre"); /* re */
+      re = rx.re;
+      md = rx.md;
       if (searchlen) {
         searchlen--;
       }
 
-      if (all) {
-        pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
-      }
-      md = pcre2_match_data_create_from_pattern(re, NULL);
-
       search = 0;
       /* Do all the searches and replaces we can */
       do {
@@ -2784,9 +2763,7 @@ FUNCTION(fun_regreplace)
           tbp = tbuf;
           if (process_expression(tbuf, &tbp, &r, executor, caller, enactor,
                                  eflags | PE_DOLLAR, PT_DEFAULT, pe_info)) {
-            pcre2_code_free(re);
-            pcre2_match_data_free(md);
-            DEL_CHECK("pcre");
+            re_cache_release(&rx);
             goto exit_sequence;
           }
           *tbp = '\0';
@@ -2816,9 +2793,7 @@ FUNCTION(fun_regreplace)
           }
         }
       } while (subpatterns >= 0 && !cpu_time_limit_hit && all);
-      pcre2_code_free(re);
-      pcre2_match_data_free(md);
-      DEL_CHECK("pcre");
+      re_cache_release(&rx);
     }
     safe_ansi_string(orig, 0, orig->len, buff, bp);
     free_ansi_string(orig);
@@ -2848,10 +2823,10 @@ FUNCTION(fun_regmatch)
    */
   int i, nqregs;
   char *qregs[NUMQ], *holder[NUMQ];
+  struct re_cache_ref rx;
   pcre2_code *re;
   pcre2_match_data *md;
   int errcode;
-  PCRE2_SIZE erroffset;
   const char *errptr = NULL;
   int subpatterns;
   char lbuff[BUFFER_LEN], *lbp;
@@ -2881,8 +2856,7 @@ FUNCTION(fun_regmatch)
     return;
   }
 
-  if ((re = pcre2_compile(needle, PCRE2_ZERO_TERMINATED, flags, &errcode,
-                          &erroffset, re_compile_ctx)) == NULL) {
+  if (!re_cache_get(&rx, (const char *) needle, flags, &errcode)) {
     char errstr[120];
     /* Matching error. */
     pcre2_get_error_message(errcode, (PCRE2_UCHAR *) errstr, sizeof errstr);
@@ -2891,8 +2865,8 @@ FUNCTION(fun_regmatch)
     free_ansi_string(as);
     return;
   }
-  ADD_CHECK("pcre");
-  md = pcre2_match_data_create_from_pattern(re, NULL);
+  re = rx.re;
+  md = rx.md;
 
   subpatterns =
     pcre2_match(re, txt, as->len, 0, re_match_flags, md, re_match_ctx);
@@ -2963,9 +2937,7 @@ FUNCTION(fun_regmatch)
   for (i = 0; i < nqregs; i++) {
     mush_free(holder[i], "regmatch");
   }
-  pcre2_code_free(re);
-  pcre2_match_data_free(md);
-  DEL_CHECK("pcre");
+  re_cache_release(&rx);
   free_ansi_string(as);
 }
 
@@ -2976,10 +2948,8 @@ FUNCTION(fun_regrab)
 {
   char *r, *s, *b, sep;
   size_t rlen;
-  pcre2_code *re;
-  pcre2_match_data *md;
+  struct re_cache_ref rx;
   int errcode;
-  PCRE2_SIZE erroffset;
   int flags = re_compile_flags;
   char *osep, osepd[2] = {'\0', '\0'};
   char **ptrs;
@@ -3012,9 +2982,7 @@ FUNCTION(fun_regrab)
     pos = 1;
   }
 
-  if ((re = pcre2_compile((const PCRE2_UCHAR *) remove_markup(args[1], NULL),
-                          PCRE2_ZERO_TERMINATED, flags, &errcode, &erroffset,
-                          re_compile_ctx)) == NULL) {
+  if (!re_cache_get(&rx, remove_markup(args[1], NULL), flags, &errcode)) {
     /* Matching error. */
     char errstr[120];
     pcre2_get_error_message(errcode, (PCRE2_UCHAR *) errstr, sizeof errstr);
@@ -3022,9 +2990,6 @@ FUNCTION(fun_regrab)
     safe_str(errstr, buff, bp);
     return;
   }
-  ADD_CHECK("pcre");
-  md = pcre2_match_data_create_from_pattern(re, NULL);
-
   ptrs = mush_calloc(MAX_SORTSIZE, sizeof(char *), "ptrarray");
   if (!ptrs) {
     mush_panic("Unable to allocate memory in fun_regrab");
@@ -3032,8 +2997,8 @@ FUNCTION(fun_regrab)
   nptrs = list2arr_ansi(ptrs, MAX_SORTSIZE, s, sep, 1);
   for (i = 0; i < nptrs && !cpu_time_limit_hit; i++) {
     r = remove_markup(ptrs[i], &rlen);
-    if (pcre2_match(re, (const PCRE2_UCHAR *) r, rlen - 1, 0, re_match_flags,
-                    md, re_match_ctx) >= 0) {
+    if (pcre2_match(rx.re, (const PCRE2_UCHAR *) r, rlen - 1, 0,
+                    re_match_flags, rx.md, re_match_ctx) >= 0) {
       if (all && *bp != b) {
         safe_str(osep, buff, bp);
       }
@@ -3050,9 +3015,7 @@ FUNCTION(fun_regrab)
   freearr(ptrs, nptrs);
   mush_free(ptrs, "ptrarray");
 
-  pcre2_code_free(re);
-  pcre2_match_data_free(md);
-  DEL_CHECK("pcre");
+  re_cache_release(&rx);
 }
 
 FUNCTION(fun_isregexp)
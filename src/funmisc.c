@@ -998,14 +998,13 @@ FUNCTION(fun_reswitch)
   char *tbuf1;
   int first = 1, found = 0, flags = re_compile_flags;
   int search, subpatterns;
+  struct re_cache_ref rx;
   pcre2_code *re;
   pcre2_match_data *md;
   PE_REGS *pe_regs;
   ansi_string *mas = NULL;
   const PCRE2_UCHAR *haystack;
   int haystacklen;
-  int errcode;
-  PCRE2_SIZE erroffset;
 
   if (strstr(called_as, "ALL")) {
     first = 0;
@@ -1047,14 +1046,12 @@ FUNCTION(fun_reswitch)
     }
     *dp = '\0';
 
-    if ((re = pcre2_compile((const PCRE2_UCHAR *) remove_markup(pstr, NULL),
-                            PCRE2_ZERO_TERMINATED, flags, &errcode, &erroffset,
-                            re_compile_ctx)) == NULL) {
+    if (!re_cache_get(&rx, remove_markup(pstr, NULL), flags, NULL)) {
       /* Matching error. Ignore this one, move on. */
       continue;
     }
-    ADD_CHECK("pcre");
-    md = pcre2_match_data_create_from_pattern(re, NULL);
+    re = rx.re;
+    md = rx.md;
     search = 0;
     subpatterns = pcre2_match(re, haystack, haystacklen, search, re_match_flags,
                               md, re_match_ctx);
@@ -1077,9 +1074,7 @@ FUNCTION(fun_reswitch)
       mush_free(tbuf1, "replace_string.buff");
       found = 1;
     }
-    pcre2_code_free(re);
-    pcre2_match_data_free(md);
-    DEL_CHECK("pcre");
+    re_cache_release(&rx);
     if ((first && found) || per) {
       goto exit_sequence;
     }
@@ -128,11 +128,6 @@ extern void create_minimal_db(void); /* From db.c */
 dbref orator =
   NOTHING; /**< Last dbref to issue a speech command. DEPRECATED. DO NOT USE. */
 
-#ifdef COMP_STATS
-extern void compress_stats(long *entries, long *mem_used,
-                           long *total_uncompressed, long *total_compressed);
-#endif
-
 /* Set in do_entry(), used in report() */
 char report_cmd[BUFFER_LEN];
 dbref report_dbref = NOTHING;
@@ -326,6 +321,7 @@ dump_database_internal(void)
       switch (f->type) {
       case PFT_FILE:
       case PFT_PIPE:
+      case PFT_MEMORY:
         errmsg = strerror(errno);
         break;
       case PFT_GZFILE:
@@ -387,7 +383,10 @@ dump_database_internal(void)
 #ifdef ALWAYS_PARANOID
         db_paranoid_write(f, 0);
 #else
-        db_write(f, 0);
+        if (options.binary_dump)
+          db_write_snapshot(f);
+        else
+          db_write(f, 0);
 #endif
         break;
       case 1:
@@ -674,24 +673,21 @@ do_restart(void)
   ATTR *s;
   char buf[BUFFER_LEN];
   char *bp;
-  sqlite3 *sqldb = get_shared_db();
 
   /* Do stuff that needs to be done for players only: add stuff to the
    * alias table, and refund money from queued commands at shutdown.
    */
 
-  sqlite3_exec(sqldb, "BEGIN TRANSACTION", NULL, NULL, NULL);
   for (thing = 0; thing < db_top; thing++) {
     if (IsPlayer(thing)) {
       if ((s = atr_get_noparent(thing, "ALIAS")) != NULL) {
         bp = buf;
         safe_str(atr_value(s), buf, &bp);
         *bp = '\0';
-        add_player_alias(thing, buf, 1);
+        add_player_alias(thing, buf);
       }
     }
   }
-  sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, NULL);
 
   /* Once we load all that, then we can trigger the startups and
    * begin queueing commands. Also, let's make sure that we get
@@ -2416,6 +2412,8 @@ do_uptime(dbref player, int mortal)
   if (!Wizard(player) || mortal)
     return;
 
+  sq_stats(player);
+
 #if defined(linux)
   linux_uptime(player);
 #elif defined(WIN32)
@@ -2496,6 +2494,15 @@ db_open(const char *fname)
   } else
 #endif /* WIN32 */
   {
+    /* Uncompressed files are read straight out of a memory map. */
+    if (access(filename, R_OK) == 0) {
+      PENNFILE *mapped = penn_mapopen(filename);
+      if (mapped) {
+        sqlite3_free(filename);
+        mush_free(pf, "pennfile");
+        return mapped;
+      }
+    }
     pf->type = PFT_FILE;
     pf->handle.f = fopen(filename, FOPEN_READ);
     if (!pf->handle.f) {
@@ -2605,9 +2612,12 @@ db_open_write(const char *fname)
 
 extern HASHTAB htab_function;
 extern HASHTAB htab_user_function;
+extern HASHTAB htab_func_lookup;
 extern HASHTAB htab_reserved_aliases;
 extern HASHTAB help_files;
 extern HASHTAB htab_locks;
+extern HASHTAB htab_player_list;
+extern HASHTAB htab_colors;
 extern HASHTAB local_options;
 extern StrTree atr_names;
 extern StrTree lock_names;
@@ -2672,9 +2682,12 @@ do_list_memstats(dbref player)
   } hash_tables[] = {
     {&htab_function, "Functions"},
     {&htab_user_function, "@Functions"},
+    {&htab_func_lookup, "FunLookup"},
     {&htab_reserved_aliases, "Aliases"},
     {&help_files, "HelpFiles"},
     {&htab_locks, "@locks"},
+    {&htab_player_list, "Players"},
+    {&htab_colors, "Colors"},
     {&local_options, "ConfigOpts"},
   };
   unsigned int i;
@@ -2716,6 +2729,12 @@ do_list_memstats(dbref player)
   im_stats(player, watchtable, "Inotify");
 #endif
 
+  if (Wizard(player)) {
+    re_cache_stats(player);
+    atr_cache_stats(player);
+    compress_stats(player);
+  }
+
   notify(player, "Sqlite3 Databases:");
   sqlmem = sqlite3_memory_used();
   notify_format(player, " Using %ld megabytes and %ld kilobytes of memory.",
@@ -2729,39 +2748,6 @@ do_list_memstats(dbref player)
       list_sqlite3_stats(player, "connlog", connlog_db);
     }
   }
-
-#ifdef COMP_STATS
-  if (Wizard(player) && strcmp(options.attr_compression, "word") == 0) {
-    long items, used, total_comp, total_uncomp;
-    float percent;
-    compress_stats(&items, &used, &total_uncomp, &total_comp);
-    notify(player, "---------- Internal attribute compression  ----------");
-    notify_format(player,
-                  "%10ld compression table items used, "
-                  "taking %ld bytes.",
-                  items, used);
-    notify_format(player, "%10ld bytes in text before compression. ",
-                  total_uncomp);
-    notify_format(player, "%10ld bytes in text AFTER  compression. ",
-                  total_comp);
-    percent = ((float) (total_comp)) / ((float) total_uncomp) * 100.0;
-    notify_format(player,
-                  "%10.0f %% text    compression ratio (lower is better). ",
-                  percent);
-    percent = ((float) (total_comp + used + (32768L * sizeof(char *)))) /
-              ((float) total_uncomp) * 100.0;
-    notify_format(player,
-                  "%10.0f %% OVERALL compression ratio (lower is better). ",
-                  percent);
-    notify_format(player,
-                  "          (Includes table items, and table of words "
-                  "pointers of %ld bytes)",
-                  (long) (32768 * sizeof(char *)));
-    if (percent >= 100.0)
-      notify(player, "          "
-                     "(Compression ratio improves with larger database)");
-  }
-#endif
 }
 
 static char *
@@ -21,6 +21,8 @@
 #include "conf.h"
 #include "externs.h"
 #include "game.h"
+#include "htab.h"
+#include "intmap.h"
 #include "log.h"
 #include "mymalloc.h"
 #include "parse.h"
@@ -30,6 +32,7 @@
 #include "charconv.h"
 #include "map_file.h"
 #include "markup.h"
+#include "tests.h"
 
 #define ANSI_BEGIN "\x1B["
 #define ANSI_FINISH "m"
@@ -76,6 +79,36 @@ bool colorname_lookup(const char *name, int len, int *rgb, int *ansi,
                       int *xnum);
 bool rgb_lookup(int rgb, int *ansi, int *xnum);
 
+/** A color from the colors file, with its downgrades */
+struct color_info {
+  int rgb;   /**< RGB value */
+  int ansi;  /**< 16-color code, with 0x100 set for hilite */
+  int xterm; /**< 256-color code */
+};
+
+HASHTAB htab_colors;                 /**< Color names to color_info */
+static intmap *colors_by_rgb = NULL; /**< RGB values to color_info */
+
+/** The xterm colors, in the order they're searched for nearest matches */
+static struct {
+  uint32_t rgb; /**< RGB value */
+  int xterm;    /**< 256-color code */
+} xterm_palette[256];
+static int xterm_palette_len = 0;
+
+#define NEAREST_MEMO_SIZE 1024
+/** Remembered nearest xterm colors for RGB values without a name.
+ * Indexed by whether the 16 basic colors are skipped, then by a hash
+ * of the RGB value. xterm is the color code plus one, or 0 if unused. */
+static struct {
+  uint32_t rgb; /**< RGB value */
+  int xterm;    /**< 256-color code + 1 */
+} nearest_memo[2][NEAREST_MEMO_SIZE];
+
+static void free_color_info(void *ci);
+static void load_color_table(sqlite3 *sqldb);
+static int nearest_xterm(uint32_t hex, bool all);
+
 /** Info on a color from the 16-color ANSI palette */
 struct COLORMAP_16 {
   int id;         /**< Code for this color (0-7) */
@@ -124,6 +157,9 @@ build_rgb_map(void)
     ", json_extract(j.value, '$.xterm')"
     ", json_extract(j.value, '$.ansi') FROM json_each(?) AS j";
 
+  hash_init(&htab_colors, 1024, free_color_info);
+  colors_by_rgb = im_new();
+
   sqldb = get_shared_db();
 
   if (!sqldb) {
@@ -163,6 +199,102 @@ build_rgb_map(void)
   }
   sqlite3_finalize(creator);
   unmap_file(mf);
+
+  load_color_table(sqldb);
+}
+
+static void
+free_color_info(void *ci)
+{
+  mush_free(ci, "colors.entry");
+}
+
+/* Copy a color name into key with leading zeros dropped from each run
+ * of digits, so grey05 and grey5 find the same entry like they did
+ * under the colors table's UINT collation. key must hold len + 1
+ * bytes. */
+static void
+color_key(const char *name, int len, char *key)
+{
+  const char *end = name + len;
+
+  while (name < end) {
+    if (*name == '0' && name + 1 < end && isdigit(name[1])) {
+      name += 1;
+      continue;
+    }
+    if (isdigit(*name)) {
+      while (name < end && isdigit(*name)) {
+        *key++ = *name++;
+      }
+    } else {
+      *key++ = *name++;
+    }
+  }
+  *key = '\0';
+}
+
+/* Copy the colors table into memory for colorname_lookup(),
+ * rgb_lookup() and nearest_xterm(). The sqlite table is still used
+ * for listing colors. */
+static void
+load_color_table(sqlite3 *sqldb)
+{
+  sqlite3_stmt *lister;
+  int status;
+
+  /* Ordered the same way as the old rgb index lookup, so the first
+   * name with a given RGB value supplies its downgrades. */
+  lister = prepare_statement_cache(
+    sqldb, "SELECT name, rgb, ansi, xterm FROM colors ORDER BY rgb, name",
+    "colors.load", 0);
+  if (!lister) {
+    return;
+  }
+  do {
+    status = sqlite3_step(lister);
+    if (status == SQLITE_ROW) {
+      struct color_info *ci = mush_malloc(sizeof *ci, "colors.entry");
+      const char *name = (const char *) sqlite3_column_text(lister, 0);
+      int nlen = sqlite3_column_bytes(lister, 0);
+      char key[BUFFER_LEN];
+      if (!ci) {
+        mush_panic("Unable to allocate memory in load_color_table()");
+      }
+      ci->rgb = sqlite3_column_int(lister, 1);
+      ci->ansi = sqlite3_column_int(lister, 2);
+      ci->xterm = sqlite3_column_int(lister, 3);
+      if (nlen >= BUFFER_LEN) {
+        nlen = BUFFER_LEN - 1;
+      }
+      color_key(name, nlen, key);
+      if (!hashadd(key, ci, &htab_colors)) {
+        mush_free(ci, "colors.entry");
+        continue;
+      }
+      if (!im_exists(colors_by_rgb, ci->rgb)) {
+        im_insert(colors_by_rgb, ci->rgb, ci);
+      }
+    }
+  } while (status == SQLITE_ROW || is_busy_status(status));
+  sqlite3_finalize(lister);
+
+  lister = prepare_statement_cache(
+    sqldb, "SELECT rgb, xterm FROM colors WHERE name LIKE 'xterm%'",
+    "colors.load.xterm", 0);
+  if (!lister) {
+    return;
+  }
+  xterm_palette_len = 0;
+  do {
+    status = sqlite3_step(lister);
+    if (status == SQLITE_ROW && xterm_palette_len < 256) {
+      xterm_palette[xterm_palette_len].rgb = sqlite3_column_int(lister, 0);
+      xterm_palette[xterm_palette_len].xterm = sqlite3_column_int(lister, 1);
+      xterm_palette_len += 1;
+    }
+  } while (status == SQLITE_ROW || is_busy_status(status));
+  sqlite3_finalize(lister);
 }
 
 /* ARGSUSED */
@@ -818,76 +950,49 @@ nest_ansi_data(ansi_data *old, ansi_data *cur)
 bool
 colorname_lookup(const char *name, int len, int *rgb, int *ansi, int *xnum)
 {
-  sqlite3 *sqldb;
-  sqlite3_stmt *finder;
-  int status;
-  int ulen;
-  char *utf8;
+  char key[BUFFER_LEN];
+  struct color_info *ci;
 
-  sqldb = get_shared_db();
-  if (!sqldb) {
+  if (len < 0 || len >= BUFFER_LEN) {
     return 0;
   }
+  color_key(name, len, key);
 
-  finder = prepare_statement(
-    sqldb, "SELECT rgb, ansi, xterm FROM colors WHERE name = ?",
-    "colors.lookup.name");
-  if (!finder) {
+  ci = hashfind(key, &htab_colors);
+  if (!ci) {
     return 0;
   }
-
-  utf8 = latin1_to_utf8(name, len, &ulen, "string");
-  sqlite3_bind_text(finder, 1, utf8, ulen, free_string);
-  do {
-    status = sqlite3_step(finder);
-  } while (is_busy_status(status));
-  if (status == SQLITE_ROW) {
-    if (rgb) {
-      *rgb = sqlite3_column_int(finder, 0);
-    }
-    if (ansi) {
-      *ansi = sqlite3_column_int(finder, 1);
-    }
-    if (xnum) {
-      *xnum = sqlite3_column_int(finder, 2);
-    }
+  if (rgb) {
+    *rgb = ci->rgb;
+  }
+  if (ansi) {
+    *ansi = ci->ansi;
   }
-  sqlite3_reset(finder);
-  return status == SQLITE_ROW;
+  if (xnum) {
+    *xnum = ci->xterm;
+  }
+  return 1;
 }
 
 bool
 rgb_lookup(int rgb, int *ansi, int *xnum)
 {
-  sqlite3 *sqldb;
-  sqlite3_stmt *finder;
-  int status;
+  struct color_info *ci;
 
-  sqldb = get_shared_db();
-  if (!sqldb) {
+  if (!colors_by_rgb) {
     return 0;
   }
-
-  finder = prepare_statement(
-    sqldb, "SELECT ansi, xterm FROM colors WHERE rgb = ?", "colors.lookup.rgb");
-  if (!finder) {
+  ci = im_find(colors_by_rgb, rgb);
+  if (!ci) {
     return 0;
   }
-
-  sqlite3_bind_int(finder, 1, rgb);
-  do {
-    status = sqlite3_step(finder);
-  } while (is_busy_status(status));
-  if (status == SQLITE_ROW) {
-    if (ansi) {
-      *ansi = sqlite3_column_int(finder, 0);
-    }
-    if (xnum) {
-      *xnum = sqlite3_column_int(finder, 1);
-    }
+  if (ansi) {
+    *ansi = ci->ansi;
+  }
+  if (xnum) {
+    *xnum = ci->xterm;
   }
-  sqlite3_reset(finder);
-  return status == SQLITE_ROW;
+  return 1;
 }
 
 /** Return the hex code for a given ANSI color */
@@ -1038,16 +1143,52 @@ ansi_map_16(const char *name, bool bg, bool *hilite)
   }
 }
 
+/* Find the closest xterm color to an RGB value that isn't a named
+ * color. If all is true, the 16 basic colors are skipped. */
+static int
+nearest_xterm(uint32_t hex, bool all)
+{
+  uint32_t diff, cdiff;
+  int best = -1;
+  int i;
+  unsigned int slot =
+    (hex ^ (hex >> 10) ^ (hex >> 20)) & (NEAREST_MEMO_SIZE - 1);
+
+  if (nearest_memo[all][slot].xterm && nearest_memo[all][slot].rgb == hex) {
+    return nearest_memo[all][slot].xterm - 1;
+  }
+
+  diff = 0x0FFFFFFF;
+  for (i = 0; i < xterm_palette_len; i++) {
+    uint32_t rgb = xterm_palette[i].rgb;
+
+    if (all && xterm_palette[i].xterm < 16) {
+      continue;
+    }
+
+    if (hex == rgb) {
+      best = xterm_palette[i].xterm;
+      break;
+    }
+
+    cdiff = hex_difference(rgb, hex);
+    if (cdiff < diff) {
+      best = xterm_palette[i].xterm;
+      diff = cdiff;
+    }
+  }
+
+  nearest_memo[all][slot].rgb = hex;
+  nearest_memo[all][slot].xterm = best + 1;
+  return best;
+}
+
 /** Map a RGB hex color to the 256-color XTERM palette */
 int
 ansi_map_256(const char *name, bool hilite, bool all)
 {
-  uint32_t hex, diff, cdiff;
-  int best = -1;
+  uint32_t hex;
   int num = 0;
-  sqlite3 *sqldb;
-  sqlite3_stmt *finder;
-  int status;
 
   /* Is it an xterm color number? */
   if (strncasecmp(name, "+xterm", 6) == 0) {
@@ -1064,46 +1205,42 @@ ansi_map_256(const char *name, bool hilite, bool all)
     return num;
   }
 
-  diff = 0x0FFFFFFF;
   /* Now find the closest 256 color match. */
-
-  sqldb = get_shared_db();
-  if (!sqldb) {
-    return -1;
-  }
-
-  finder = prepare_statement(
-    sqldb, "SELECT rgb, xterm FROM colors WHERE name LIKE 'xterm%'",
-    "colors.list.xterm");
-  if (!finder) {
-    return -1;
-  }
-
-  do {
-    status = sqlite3_step(finder);
-    if (status == SQLITE_ROW) {
-      uint32_t rgb = sqlite3_column_int(finder, 0);
-      num = sqlite3_column_int(finder, 1);
-
-      if (all && num < 16) {
-        continue;
-      }
-
-      if (hex == rgb) {
-        best = num;
-        break;
-      }
-
-      cdiff = hex_difference(rgb, hex);
-      if (cdiff < diff) {
-        best = num;
-        diff = cdiff;
-      }
-    }
-  } while (status == SQLITE_ROW || is_busy_status(status));
-  sqlite3_reset(finder);
-
-  return best;
+  return nearest_xterm(hex, all);
+}
+
+TEST_GROUP(color_lookup)
+{
+  int rgb = 0, ansi = 0, xnum = 0;
+  unsigned int slot;
+
+  TEST("color_lookup.1", colorname_lookup("yellow", 6, &rgb, &ansi, &xnum) &&
+                           rgb == 0xffff00 && xnum == 226);
+  TEST("color_lookup.2",
+       !colorname_lookup("nosuchcolor", 11, NULL, NULL, NULL));
+  TEST("color_lookup.3", rgb_lookup(0x0000ee, NULL, &xnum) && xnum == 12);
+  TEST("color_lookup.4", ansi_map_256("+blue2", false, false) == 12);
+  /* Not a named color, so it's matched to the nearest xterm color */
+  TEST("color_lookup.5", ansi_map_256("#fffe00", false, true) == 226);
+  /* and remembered: a second lookup comes from the memo */
+  slot = (0xfffe00 ^ (0xfffe00 >> 10) ^ (0xfffe00 >> 20)) &
+         (NEAREST_MEMO_SIZE - 1);
+  TEST("color_lookup.6", nearest_memo[1][slot].rgb == 0xfffe00 &&
+                           nearest_memo[1][slot].xterm == 227);
+  nearest_memo[1][slot].xterm = 101;
+  TEST("color_lookup.7", ansi_map_256("#fffe00", false, true) == 100);
+  nearest_memo[1][slot].xterm = 0;
+  TEST("color_lookup.8", ansi_map_256("#fffe00", false, true) == 226);
+  /* Digit runs compare by value, as the old UINT collation did */
+  TEST("color_lookup.9", colorname_lookup("grey05", 6, &rgb, NULL, NULL) &&
+                           rgb == 0x0d0d0d);
+  TEST("color_lookup.10",
+       colorname_lookup("xterm009", 8, NULL, NULL, &xnum) && xnum == 9);
+  TEST("color_lookup.11", colorname_lookup("xterm9", 6, NULL, NULL, &xnum) &&
+                            xnum == 9);
+  TEST("color_lookup.12",
+       colorname_lookup("xterm0", 6, NULL, NULL, &xnum) && xnum == 0);
+  TEST("color_lookup.13", !colorname_lookup("xterm", 5, NULL, NULL, NULL));
 }
 
 typedef int (*writer_func)(ansi_data *old, ansi_data *cur, int ansi_format,
@@ -185,6 +185,8 @@ struct slab_page {
   int nfree;              /**< Number of objects on this page's free list */
   void *last_obj;         /**< Pointer to last object in page. */
   struct slab_page *next; /**< Pointer to next allocated page */
+  struct slab_page *prev; /**< Pointer to previous allocated page */
+  struct slab *owner;     /**< The slab this page belongs to */
   struct slab_page_list
     *freelist; /**< Pointer to list of unallocated objects */
 };
@@ -204,7 +206,11 @@ struct slab {
   int hintless_threshold;  /**< See documentation for
                               SLAB_HINTLESS_THRESHOLD option */
   struct slab_page *slabs; /**< Pointer to the head of the list of
-                              allocated pages. */
+                              allocated pages. With first-fit, pages
+                              with room come before full ones. */
+  struct slab_page *last_page; /**< Pointer to the tail of the list */
+  unsigned long served;    /**< Objects handed out since creation */
+  unsigned long pages_made; /**< Pages allocated since creation */
 };
 
 /** Create a new slab allocator.
@@ -230,6 +236,9 @@ slab_create(const char *name, size_t item_size)
   sl->keep_last_empty = 0;
   sl->hintless_threshold = 0;
   sl->slabs = NULL;
+  sl->last_page = NULL;
+  sl->served = 0;
+  sl->pages_made = 0;
   if (item_size < sizeof(void *))
     item_size = sizeof(void *);
   /* Align objects after the first with the size of a pointer */
@@ -299,15 +308,17 @@ slab_alloc_page(struct slab *sl)
      valloc() can't be passed to free(). Those same systems probably won't have
      posix_memalign. Deal.
    */
-  if (posix_memalign((void **) &page, pgsize, pgsize) < 0) {
+  n = posix_memalign((void **) &page, pgsize, pgsize);
+  if (n != 0) {
     do_rawlog(LT_ERR, "Unable to allocate %d bytes via posix_memalign: %s",
-              pgsize, strerror(errno));
+              pgsize, strerror(n));
     page = malloc(pgsize);
   }
 #else
   page = malloc(pgsize);
 #endif
   memset(page, 0, pgsize);
+  sl->pages_made += 1;
 
   sp = (struct slab_page *) page;
   sp->nfree = sl->items_per_page;
@@ -322,6 +333,8 @@ slab_alloc_page(struct slab *sl)
   }
   sp->last_obj = sp->freelist;
   sp->next = NULL;
+  sp->prev = NULL;
+  sp->owner = sl;
 #ifdef SLAB_DEBUG
   do_rawlog(LT_TRACE,
             "Allocating page starting at %p for slab(%s).\n\tFirst "
@@ -333,12 +346,88 @@ slab_alloc_page(struct slab *sl)
   return sp;
 }
 
+/** Take a page out of its allocator's list of pages.
+ * \param sl the allocator the page belongs to.
+ * \param page the page to unlink.
+ */
+static void
+slab_unlink_page(struct slab *sl, struct slab_page *page)
+{
+  if (page->prev)
+    page->prev->next = page->next;
+  else
+    sl->slabs = page->next;
+  if (page->next)
+    page->next->prev = page->prev;
+  else
+    sl->last_page = page->prev;
+  page->next = page->prev = NULL;
+}
+
+/** Put a page at the head of its allocator's list of pages.
+ * \param sl the allocator the page belongs to.
+ * \param page the page to link in.
+ */
+static void
+slab_push_page(struct slab *sl, struct slab_page *page)
+{
+  page->prev = NULL;
+  page->next = sl->slabs;
+  if (sl->slabs)
+    sl->slabs->prev = page;
+  else
+    sl->last_page = page;
+  sl->slabs = page;
+}
+
+/** Put a page at the tail of its allocator's list of pages.
+ * \param sl the allocator the page belongs to.
+ * \param page the page to link in.
+ */
+static void
+slab_append_page(struct slab *sl, struct slab_page *page)
+{
+  page->next = NULL;
+  page->prev = sl->last_page;
+  if (sl->last_page)
+    sl->last_page->next = page;
+  else
+    sl->slabs = page;
+  sl->last_page = page;
+}
+
+/** Find the page an object was allocated from.
+ * Pages from posix_memalign() start on a page boundary, so the page
+ * can be found directly from the object's address; otherwise, or if
+ * that isn't one of ours, the list of pages is searched.
+ * \param sl the allocator.
+ * \param obj the object.
+ * \return the page, or NULL if obj didn't come from this allocator.
+ */
+static struct slab_page *
+slab_find_page(struct slab *sl, const void *obj)
+{
+  struct slab_page *page;
+
+#ifdef HAVE_POSIX_MEMALIGN
+  page = (struct slab_page *) ((uintptr_t) obj &
+                               ~((uintptr_t) mush_getpagesize() - 1));
+  if (page->owner == sl && obj > (void *) page && obj <= page->last_obj)
+    return page;
+#endif
+  for (page = sl->slabs; page; page = page->next)
+    if (obj > (void *) page && obj <= page->last_obj)
+      return page;
+  return NULL;
+}
+
 /** Allocate a new object from a page
+ * \param sl the allocator the page belongs to.
  * \param where the page to allocate from.
  * \return pointer to object, or NULL if no room left on page
  */
 static void *
-slab_alloc_obj(struct slab_page *where)
+slab_alloc_obj(struct slab *sl, struct slab_page *where)
 {
   struct slab_page_list *obj;
 
@@ -346,10 +435,18 @@ slab_alloc_obj(struct slab_page *where)
   if (obj == NULL)
     return NULL;
 
+  sl->served += 1;
   where->freelist = obj->next;
   where->nalloced += 1;
   where->nfree -= 1;
 
+  /* Keep pages with room at the front for first-fit */
+  if (sl->fill_strategy && where->nfree <= sl->hintless_threshold &&
+      where != sl->last_page) {
+    slab_unlink_page(sl, where);
+    slab_append_page(sl, where);
+  }
+
   return obj;
 }
 
@@ -365,24 +462,30 @@ slab_malloc(slab *sl, const void *hint)
     return NULL;
 
   /* If objects are too big to fit in a single page, use plain malloc */
-  if (sl->items_per_page == 0)
+  if (sl->items_per_page == 0) {
+    sl->served += 1;
+    sl->pages_made += 1;
     return malloc(sl->item_size);
+  }
 
   /* If no pages have been allocated, make one and use it. */
   if (!sl->slabs) {
-    sl->slabs = slab_alloc_page(sl);
-    return slab_alloc_obj(sl->slabs);
+    slab_push_page(sl, slab_alloc_page(sl));
+    return slab_alloc_obj(sl, sl->slabs);
   }
 
-  if (!hint) {
-    /* Use first empty spot. */
-    struct slab_page *page, *last = NULL, *best = NULL;
+  if (!hint && sl->fill_strategy) {
+    /* First fit. Pages with room are kept ahead of full ones, so
+       only the first page has to be looked at. */
+    if (sl->slabs->nfree <= sl->hintless_threshold)
+      slab_push_page(sl, slab_alloc_page(sl));
+    return slab_alloc_obj(sl, sl->slabs);
+  } else if (!hint) {
+    /* Best fit. */
+    struct slab_page *page, *best = NULL;
     int best_free = INT_MAX;
     for (page = sl->slabs; page; page = page->next) {
-      if (page->nfree > sl->hintless_threshold && sl->fill_strategy)
-        /* First fit */
-        return slab_alloc_obj(page);
-      else if (page->nfree > sl->hintless_threshold) {
+      if (page->nfree > sl->hintless_threshold) {
         /* Best fit */
         if (page->nfree < best_free) {
           best_free = page->nfree;
@@ -391,45 +494,41 @@ slab_malloc(slab *sl, const void *hint)
             break;
         }
       }
-      last = page;
     }
 
     if (best)
-      return slab_alloc_obj(best);
+      return slab_alloc_obj(sl, best);
 
     /* All pages are full; allocate a new one */
-    last->next = slab_alloc_page(sl);
-    return slab_alloc_obj(last->next);
+    slab_append_page(sl, slab_alloc_page(sl));
+    return slab_alloc_obj(sl, sl->last_page);
   } else {
-    struct slab_page *page, *last = NULL;
+    struct slab_page *page;
     /* Okay. We have a hint for where to allocate the object. Find the
        page the hint is on. */
-    for (page = sl->slabs; page; page = page->next) {
-      if (hint > (void *) page && hint <= page->last_obj) {
-        /* If there's space, use this page, otherwise, if using
-           first-fit, use the first page with room if using best-fit,
-           see if the next or previous page has room, otherwise,
-           normal best-fit match */
-        if (page->nfree > 0)
-          return slab_alloc_obj(page);
-        if (sl->fill_strategy)
-          return slab_malloc(sl, NULL);
-        else if (page->next && page->next->nfree > 0)
-          return slab_alloc_obj(page->next);
-        else if (last && last->nfree > 0)
-          return slab_alloc_obj(last);
-        else
-          return slab_malloc(sl, NULL);
-      }
-      last = page;
+    page = slab_find_page(sl, hint);
+    if (page) {
+      /* If there's space, use this page, otherwise, if using
+         first-fit, use the first page with room if using best-fit,
+         see if the next or previous page has room, otherwise,
+         normal best-fit match */
+      if (page->nfree > 0)
+        return slab_alloc_obj(sl, page);
+      if (sl->fill_strategy)
+        return slab_malloc(sl, NULL);
+      else if (page->next && page->next->nfree > 0)
+        return slab_alloc_obj(sl, page->next);
+      else if (page->prev && page->prev->nfree > 0)
+        return slab_alloc_obj(sl, page->prev);
+      else
+        return slab_malloc(sl, NULL);
     }
 /* This should never be reached, but handle it anyways. */
 #ifdef SLAB_DEBUG
     do_rawlog(LT_TRACE, "page hint %p not found in slab(%s)", (void *) hint,
               sl->name);
 #endif
-    last->next = slab_alloc_page(sl);
-    return slab_alloc_obj(last->next);
+    return slab_malloc(sl, NULL);
   }
   return NULL;
 }
@@ -441,7 +540,7 @@ slab_malloc(slab *sl, const void *hint)
 void
 slab_free(slab *sl, void *obj)
 {
-  struct slab_page *page, *last;
+  struct slab_page *page;
 
   /* If objects are too big to fit in a single page, use plain free */
   if (sl->items_per_page == 0) {
@@ -450,48 +549,48 @@ slab_free(slab *sl, void *obj)
   }
 
   /* Find the page the object is on and push it into that page's free list */
-  last = NULL;
-  for (page = sl->slabs; page; page = page->next) {
-    if (obj > (void *) page && obj <= page->last_obj) {
-      struct slab_page_list *item = obj;
+  page = slab_find_page(sl, obj);
+  if (page) {
+    struct slab_page_list *item = obj;
 #ifdef SLAB_DEBUG
-      struct slab_page_list *scan;
-      for (scan = page->freelist; scan; scan = scan->next)
-        if (item == scan)
-          do_rawlog(
-            LT_TRACE,
-            "Attempt to free already free object %p from page %p of slab(%s)",
-            (void *) item, (void *) page, sl->name);
+    struct slab_page_list *scan;
+    for (scan = page->freelist; scan; scan = scan->next)
+      if (item == scan)
+        do_rawlog(
+          LT_TRACE,
+          "Attempt to free already free object %p from page %p of slab(%s)",
+          (void *) item, (void *) page, sl->name);
 #endif
-      item->next = page->freelist;
-      page->freelist = item;
-      page->nalloced -= 1;
-      page->nfree += 1;
+    item->next = page->freelist;
+    page->freelist = item;
+    page->nalloced -= 1;
+    page->nfree += 1;
 #ifdef SLAB_DEBUG
-      assert(page->nalloced >= 0 && page->nalloced <= sl->items_per_page);
-      assert(page->nfree >= 0 && page->nfree <= sl->items_per_page);
+    assert(page->nalloced >= 0 && page->nalloced <= sl->items_per_page);
+    assert(page->nfree >= 0 && page->nfree <= sl->items_per_page);
 #endif
-      if (page->nalloced == 0) {
-        /* Empty page. Free it. */
+    if (page->nalloced == 0) {
+      /* Empty page. Free it. */
 
-        /* Unless it's the only allocated page and we want to keep it */
-        if (sl->keep_last_empty && page == sl->slabs && !page->next)
-          return;
+      /* Unless it's the only allocated page and we want to keep it */
+      if (sl->keep_last_empty && page == sl->slabs && !page->next)
+        return;
 
-        if (last)
-          last->next = page->next;
-        else
-          sl->slabs = page->next;
+      slab_unlink_page(sl, page);
 
 #ifdef SLAB_DEBUG
-        do_rawlog(LT_TRACE, "Freeing empty page %p of slab(%s)", (void *) page,
-                  sl->name);
+      do_rawlog(LT_TRACE, "Freeing empty page %p of slab(%s)", (void *) page,
+                sl->name);
 #endif
-        free(page);
-      }
-      return;
+      free(page);
+    } else if (sl->fill_strategy &&
+               page->nfree == sl->hintless_threshold + 1 &&
+               page != sl->slabs) {
+      /* It has room again; move it up with the others that do. */
+      slab_unlink_page(sl, page);
+      slab_push_page(sl, page);
     }
-    last = page;
+    return;
   }
   /* Ooops. An object not allocated by this allocator! */
   do_rawlog(LT_TRACE, "Attempt to free object %p not allocated by slab(%s)",
@@ -532,6 +631,8 @@ slab_describe(const slab *sl, struct slab_stats *stats)
   stats->fill_strategy = sl->fill_strategy;
   stats->min_fill = INT_MAX;
   stats->max_fill = 0;
+  stats->served = sl->served;
+  stats->pages_made = sl->pages_made;
 
   for (page = sl->slabs; page; page = page->next) {
     double p;
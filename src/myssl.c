@@ -744,9 +744,13 @@ ssl_write(SSL *ssl, int state, int net_read_ready, int net_write_ready,
       ssl_debugdump("SSL_write wants read");
       state |= MYSSL_WBOR;
       break;
+    case SSL_ERROR_ZERO_RETURN:
+      /* The other end closed the connection */
+      return -1;
     default:
       /* Should never happen */
       ssl_errordump("Unknown ssl_write failure!");
+      return -1;
     }
   }
   return state;
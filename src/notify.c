@@ -111,14 +111,31 @@ extern CHAN *channels;
 
 static const char flushed_message[] = "\r\n<Output Flushed>\x1B[0m\r\n";
 
+/* Line endings and prompts. They're never freed, since nothing ever
+ * releases the reference they start with. */
+static struct text_share eol_crlf = {1, 2, "\r\n"};
+static struct text_share eol_lf = {1, 1, "\n"};
+static struct text_share eol_br = {1, 5, "<BR>\n"};
+static struct text_share telnet_ga = {1, 2, "\xFF\xF9"};
+
 extern DESC *descriptor_list;
 
 static struct text_block *make_text_block(const char *s, int n);
+static struct text_block *make_shared_text_block(struct text_share *ts,
+                                                 const char *s, int n);
+static struct text_share *make_text_share(const char *s, int n);
+static void release_text_share(struct text_share *ts);
 void free_text_block(struct text_block *t);
 void add_to_queue(struct text_queue *q, const char *b, int n);
+static void add_to_queue_shared(struct text_queue *q, struct text_share *ts,
+                                const char *b, int n);
 static int flush_queue(struct text_queue *q, int n);
 int queue_write(DESC *d, const char *b, int n);
 int queue_newwrite(DESC *d, const char *b, int n);
+static int queue_newwrite_real(DESC *d, const char *b, int n, char ch,
+                               struct text_share *ts);
+static int queue_newwrite_shared(DESC *d, const char *b, int n,
+                                 struct text_share *ts);
 int queue_string(DESC *d, const char *s);
 int WIN32_CDECL queue_string_eol(DESC *d, const char *s, ...)
   __attribute__((__format__(__printf__, 2, 3)));
@@ -272,9 +289,10 @@ static enum na_type msg_to_na(int output_type);
 
 /** A place to store a single rendering of a message. */
 struct notify_strings {
-  char const *message; /**< The message text. */
-  size_t len;          /**< Length of message. */
-  int made;            /**< True if message has been rendered. */
+  char const *message;      /**< The message text. */
+  size_t len;               /**< Length of message. */
+  int made;                 /**< True if message has been rendered. */
+  struct text_share *share; /**< Shared buffer holding a rendered message */
 };
 
 /** A message, in every possible rendering */
@@ -310,9 +328,12 @@ static char *make_nospoof(dbref speaker, int paranoid);
 static void make_prefix_str(dbref thing, dbref enactor, const char *msg,
                             char *tbuf1);
 
+static struct notify_strings *notify_render(struct notify_message *message,
+                                            int output_type);
 static const char *notify_makestring_real(struct notify_message *message,
                                           int output_type);
 static char *notify_makestring_nocache(const char *message, int output_type);
+static void free_notify_strings(struct notify_strings *strs);
 
 #define notify_makestring(msg, ot) notify_makestring_real(msg, ot)
 
@@ -583,14 +604,17 @@ init_notify_message_group(struct notify_message_group *real_message)
     real_message->messages.strs[i].message = NULL;
     real_message->messages.strs[i].made = 0;
     real_message->messages.strs[i].len = 0;
+    real_message->messages.strs[i].share = NULL;
 
     real_message->nospoofs.strs[i].message = NULL;
     real_message->nospoofs.strs[i].made = 0;
     real_message->nospoofs.strs[i].len = 0;
+    real_message->nospoofs.strs[i].share = NULL;
 
     real_message->paranoids.strs[i].message = NULL;
     real_message->paranoids.strs[i].made = 0;
     real_message->paranoids.strs[i].len = 0;
+    real_message->paranoids.strs[i].share = NULL;
   }
   real_message->messages.type = 0;
   real_message->nospoofs.type = 0;
@@ -933,36 +957,66 @@ render_string(const char *message, int output_type)
  * cache the result.
  * If we've already cached the string in the requested format, return that.
  * Otherwise, render it, cache and return the newly cached version. Calls
- * render_string() to actually do the rendering, and strdup()s the result.
+ * render_string() to actually do the rendering, and keeps the result in a
+ * text_share, so that output queues can hold on to it without copying.
  * \param message a notify_message structure, with the original message and
  * cached copies
  * \param output_type MSG_* flags of how to render the message
- * \return pointer to the cached, rendered string
+ * \return the cached rendering
  */
-static const char *
-notify_makestring_real(struct notify_message *message, int output_type)
+static struct notify_strings *
+notify_render(struct notify_message *message, int output_type)
 {
   enum na_type msgtype;
   const char *newstr;
+  struct notify_strings *strs;
 
   if (output_type & MSG_PLAYER)
     output_type = (output_type & (message->type | MSG_PLAYER));
 
   msgtype = msg_to_na(output_type);
+  strs = &message->strs[msgtype];
 
-  if (message->strs[msgtype].made) {
-    return message->strs[msgtype].message;
+  if (strs->made) {
+    return strs;
   }
 
   /* Render the message */
   newstr = render_string(message->strs[0].message, output_type);
 
   /* Save the new message */
-  message->strs[msgtype].made = 1;
-  message->strs[msgtype].message = mush_strdup(newstr, "notify_str");
-  message->strs[msgtype].len = strlen(newstr);
+  strs->made = 1;
+  strs->len = strlen(newstr);
+  strs->share = make_text_share(newstr, strs->len);
+  strs->message = strs->share->text;
+
+  return strs;
+}
+
+/** Return a rendered message, rendering it if needed.
+ * \param message a notify_message structure, with the original message and
+ * cached copies
+ * \param output_type MSG_* flags of how to render the message
+ * \return pointer to the cached, rendered string
+ */
+static const char *
+notify_makestring_real(struct notify_message *message, int output_type)
+{
+  return notify_render(message, output_type)->message;
+}
 
-  return message->strs[msgtype].message;
+/** Free a message rendering made by notify_render() or make_nospoof().
+ * \param strs the rendering to free.
+ */
+static void
+free_notify_strings(struct notify_strings *strs)
+{
+  if (!strs->made)
+    return;
+  if (strs->share)
+    release_text_share(strs->share);
+  else
+    mush_free((void *) strs->message, "notify_str");
 }
 
 /** Render a message in a given format and return the new message.
@@ -1061,12 +1115,10 @@ notify_anything(dbref executor, dbref speaker, na_lookup func, void *fdata,
     return;
   /* Cleanup */
   for (i = 0; i < MESSAGE_TYPES; i++) {
-    if (i && real_message.messages.strs[i].made)
-      mush_free((void *) real_message.messages.strs[i].message, "notify_str");
-    if (real_message.nospoofs.strs[i].made)
-      mush_free((void *) real_message.nospoofs.strs[i].message, "notify_str");
-    if (real_message.paranoids.strs[i].made)
-      mush_free((void *) real_message.paranoids.strs[i].message, "notify_str");
+    if (i)
+      free_notify_strings(&real_message.messages.strs[i]);
+    free_notify_strings(&real_message.nospoofs.strs[i]);
+    free_notify_strings(&real_message.paranoids.strs[i]);
   }
 }
 
@@ -1112,11 +1164,13 @@ notify_anything_sub(dbref executor, dbref speaker, na_lookup func, void *fdata,
     real_prefix->strs[0].message = prefix;
     real_prefix->strs[0].made = 1;
     real_prefix->strs[0].len = strlen(prefix);
+    real_prefix->strs[0].share = NULL;
     real_prefix->type = str_type(prefix);
     for (i = 1; i < MESSAGE_TYPES; i++) {
       real_prefix->strs[i].message = NULL;
       real_prefix->strs[i].made = 0;
       real_prefix->strs[i].len = 0;
+      real_prefix->strs[i].share = NULL;
     }
   }
   /* Tell everyone */
@@ -1138,10 +1192,8 @@ notify_anything_sub(dbref executor, dbref speaker, na_lookup func, void *fdata,
   if (real_prefix != NULL) {
     int i;
 
-    for (i = 1; i < MESSAGE_TYPES; i++) {
-      if (real_prefix->strs[i].made)
-        mush_free((void *) real_prefix->strs[i].message, "notify_str");
-    }
+    for (i = 1; i < MESSAGE_TYPES; i++)
+      free_notify_strings(&real_prefix->strs[i]);
     mush_free(real_prefix, "notify_message");
   }
 
@@ -1192,6 +1244,8 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
   int msglen = 0;            /**< Length of the rendered message */
   const char *prefixstr = NULL;
   int prefixlen = 0;
+  struct notify_strings *spoofs = NULL, *msgs = NULL,
+                        *prefixes = NULL; /**< Renderings being sent */
   static char buff[BUFFER_LEN],
     *bp; /**< Buffer used for processing the format attr */
   char *formatmsg =
@@ -1222,8 +1276,8 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
   if (message == NULL) {
     if (!(flags & NA_PROMPT) || !IsPlayer(target))
       return;
-    for (d = descriptor_list; d; d = d->next) {
-      if (!d->connected || d->player != target ||
+    for (d = player_descs(target); d; d = d->next_for_player) {
+      if (!d->connected ||
           !(d->conn_flags & (CONN_TELNET | CONN_WEBSOCKETS | CONN_HTTP_BUFFER)))
         continue;
 
@@ -1304,16 +1358,17 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
          (USABLE(HTTP_HANDLER) && target == HTTP_HANDLER)) &&
         (heard || (flags & NA_PROMPT))) {
       /* Send text to the player's descriptors */
-      for (d = descriptor_list; d; d = d->next) {
-        if (!d->connected || d->player != target)
+      for (d = player_descs(target); d; d = d->next_for_player) {
+        if (!d->connected)
           continue;
         output_type = notify_type(d);
 
         if (heard && prefix != NULL) {
           /* Figure out */
           if (!prefixstr || output_type != last_output_type) {
-            prefixstr = notify_makestring(prefix, output_type);
-            prefixlen = strlen(prefixstr);
+            prefixes = notify_render(prefix, output_type);
+            prefixstr = prefixes->message;
+            prefixlen = prefixes->len;
           }
         } else {
           prefixlen = 0;
@@ -1332,8 +1387,7 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
               message->paranoids.type =
                 str_type((const char *) message->paranoids.strs[0].message);
             }
-            spoofstr = notify_makestring(&message->paranoids, output_type);
-            spooflen = strlen(spoofstr);
+            spoofs = notify_render(&message->paranoids, output_type);
           } else {
             if (!message->nospoofs.strs[0].made) {
               message->nospoofs.strs[0].message = make_nospoof(speaker, 0);
@@ -1343,9 +1397,10 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
               message->nospoofs.type =
                 str_type((const char *) message->nospoofs.strs[0].message);
             }
-            spoofstr = notify_makestring(&message->nospoofs, output_type);
-            spooflen = strlen(spoofstr);
+            spoofs = notify_render(&message->nospoofs, output_type);
           }
+          spoofstr = spoofs->message;
+          spooflen = spoofs->len;
         } else {
           spooflen = 0;
         }
@@ -1358,7 +1413,8 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
         if (heard) {
           if (!msgstr || output_type != last_output_type) {
             if (cache) {
-              msgstr = notify_makestring(&message->messages, output_type);
+              msgs = notify_render(&message->messages, output_type);
+              msgstr = msgs->message;
             } else {
               if (formatmsg)
                 mush_free(formatmsg, "notify_str");
@@ -1370,20 +1426,25 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
 
           if (msglen) {
             if (prefixlen) /* send prefix */
-              queue_newwrite(d, prefixstr, prefixlen);
+              queue_newwrite_shared(d, prefixstr, prefixlen, prefixes->share);
             if (spooflen) /* send nospoof prefix */
-              queue_newwrite(d, spoofstr, spooflen);
+              queue_newwrite_shared(d, spoofstr, spooflen, spoofs->share);
 
             if (prompt) { /* send prompt */
               if (d->conn_flags & CONN_WEBSOCKETS) {
                 queue_newwrite_channel(d, msgstr, msglen,
                                        WEBSOCKET_CHANNEL_PROMPT);
               } else {
-                queue_newwrite(d, msgstr, msglen); /* send message */
-                queue_newwrite(d, "\xFF\xF9", 2);
+                /* send message */
+                queue_newwrite_shared(d, msgstr, msglen,
+                                      cache ? msgs->share : NULL);
+                queue_newwrite_shared(d, telnet_ga.text, telnet_ga.len,
+                                      &telnet_ga);
               }
             } else {
-              queue_newwrite(d, msgstr, msglen); /* send message */
+              /* send message */
+              queue_newwrite_shared(d, msgstr, msglen,
+                                    cache ? msgs->share : NULL);
             }
           }
         }
@@ -1393,11 +1454,11 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
           /* send lineending */
           if ((output_type & MSG_PUEBLO)) {
             if (flags & NA_NOPENTER)
-              queue_newwrite(d, "\n", 1);
+              queue_newwrite_shared(d, eol_lf.text, eol_lf.len, &eol_lf);
             else
-              queue_newwrite(d, "<BR>\n", 5);
+              queue_newwrite_shared(d, eol_br.text, eol_br.len, &eol_br);
           } else {
-            queue_newwrite(d, "\r\n", 2);
+            queue_newwrite_shared(d, eol_crlf.text, eol_crlf.len, &eol_crlf);
           }
         }
       } /* for loop */
@@ -1712,12 +1773,28 @@ flag_broadcast(const char *flag1, const char *flag2, const char *fmt, ...)
   va_list args;
   char tbuf1[BUFFER_LEN];
   DESC *d;
-  int ok;
+  int ok, i;
+  struct notify_message message;
+  struct notify_strings *strs;
 
   va_start(args, fmt);
   mush_vsnprintf(tbuf1, sizeof tbuf1, fmt, args);
   va_end(args);
 
+  /* Render the message once for each kind of connection, and let all
+   * the connections of that kind share it. */
+  message.strs[0].message = tbuf1;
+  message.strs[0].made = 1;
+  message.strs[0].len = strlen(tbuf1);
+  message.strs[0].share = NULL;
+  message.type = str_type(tbuf1);
+  for (i = 1; i < MESSAGE_TYPES; i++) {
+    message.strs[i].message = NULL;
+    message.strs[i].made = 0;
+    message.strs[i].len = 0;
+    message.strs[i].share = NULL;
+  }
+
   DESC_ITER_CONN (d) {
     ok = 1;
     if (flag1)
@@ -1725,10 +1802,15 @@ flag_broadcast(const char *flag1, const char *flag2, const char *fmt, ...)
     if (flag2)
       ok = ok && (flaglist_check_long("FLAG", GOD, d->player, flag2, 0) == 1);
     if (ok) {
-      queue_string_eol(d, "%s", tbuf1);
+      strs = notify_render(&message, notify_type(d));
+      queue_newwrite_shared(d, strs->message, strs->len, strs->share);
+      queue_eol(d);
       process_output(d);
     }
   }
+
+  for (i = 1; i < MESSAGE_TYPES; i++)
+    free_notify_strings(&message.strs[i]);
 }
 
 slab *text_block_slab = NULL; /**< Slab for 'struct text_block' allocations */
@@ -1746,17 +1828,35 @@ make_text_block(const char *s, int n)
   p = slab_malloc(text_block_slab, NULL);
   if (!p)
     mush_panic("Out of memory");
-  p->buf = mush_malloc(n, "text_block_buff");
-  if (!p->buf)
-    mush_panic("Out of memory");
-
-  memcpy(p->buf, s, n);
+  if (s) {
+    p->buf = mush_malloc(n, "text_block_buff");
+    if (!p->buf)
+      mush_panic("Out of memory");
+    memcpy(p->buf, s, n);
+  } else {
+    p->buf = NULL;
+  }
   p->nchars = n;
   p->start = p->buf;
+  p->share = NULL;
   p->nxt = NULL;
   return p;
 }
 
+/* Make a text block that points into shared text instead of copying it. */
+static struct text_block *
+make_shared_text_block(struct text_share *ts, const char *s, int n)
+{
+  struct text_block *p;
+
+  p = make_text_block(NULL, 0);
+  p->nchars = n;
+  p->start = (char *) s;
+  p->share = ts;
+  ts->refcount++;
+  return p;
+}
+
 /** Free a text_block structure.
  * \param t pointer to text_block to free.
  */
@@ -1766,10 +1866,37 @@ free_text_block(struct text_block *t)
   if (t) {
     if (t->buf)
       mush_free(t->buf, "text_block_buff");
+    if (t->share)
+      release_text_share(t->share);
     slab_free(text_block_slab, t);
   }
 }
 
+/* Copy text into a new text_share, with one reference for the caller. */
+static struct text_share *
+make_text_share(const char *s, int n)
+{
+  struct text_share *ts;
+
+  ts = mush_malloc(sizeof *ts + n + 1, "text_share");
+  if (!ts)
+    mush_panic("Out of memory");
+  ts->refcount = 1;
+  ts->len = n;
+  ts->text = (char *) (ts + 1);
+  memcpy(ts->text, s, n);
+  ts->text[n] = '\0';
+  return ts;
+}
+
+/* Drop a reference to a text_share, freeing it if it was the last. */
+static void
+release_text_share(struct text_share *ts)
+{
+  if (--ts->refcount == 0)
+    mush_free(ts, "text_share");
+}
+
 /** Initialize a text_queue structure.
  */
 void
@@ -1804,6 +1931,27 @@ add_to_queue(struct text_queue *q, const char *b, int n)
   }
 }
 
+/* Add a chunk of shared text to an output queue without copying it.
+ * b and n give the part of ts's text to add. */
+static void
+add_to_queue_shared(struct text_queue *q, struct text_share *ts, const char *b,
+                    int n)
+{
+  struct text_block *p;
+
+  if (n == 0 || !q)
+    return;
+
+  p = make_shared_text_block(ts, b, n);
+
+  if (!q->head) {
+    q->head = q->tail = p;
+  } else {
+    q->tail->nxt = p;
+    q->tail = p;
+  }
+}
+
 static int
 flush_queue(struct text_queue *q, int n)
 {
@@ -1915,6 +2063,22 @@ queue_newwrite(DESC *d, const char *b, int n)
 
 int
 queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
+{
+  return queue_newwrite_real(d, b, n, ch, NULL);
+}
+
+/* Add already-rendered text to a descriptor's queue. If ts isn't NULL,
+ * b is part of its text, and anything that has to wait in the queue
+ * shares it instead of being copied, as long as it goes out unchanged. */
+static int
+queue_newwrite_shared(DESC *d, const char *b, int n, struct text_share *ts)
+{
+  return queue_newwrite_real(d, b, n, WEBSOCKET_CHANNEL_AUTO, ts);
+}
+
+static int
+queue_newwrite_real(DESC *d, const char *b, int n, char ch,
+                    struct text_share *ts)
 {
 
   int space;
@@ -1936,6 +2100,7 @@ queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
                              "string");
     b = utf8;
     n = utf8bytes;
+    ts = NULL;
   }
 
   /*
@@ -1944,13 +2109,15 @@ queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
    */
   if ((d->conn_flags & CONN_WEBSOCKETS)) {
     /* TODO: Uses a static buffer; probably safe in this case. */
-    to_websocket_frame(&b, &n, ch);
+    to_websocket_frame(d, &b, &n, ch);
+    ts = NULL;
   }
 
-  if (d->source != CS_OPENSSL_SOCKET && !d->output.head) {
+  if (d->source != CS_OPENSSL_SOCKET && !d->output.head && !d->mccp) {
     /* If there's no data already buffered to write out, try writing
        directly to the socket. Add whatever's left to the buffer to
-       queue for later. */
+       queue for later. Compressed connections always go through
+       process_output(). */
     int written;
 
     if ((written = send(d->descriptor, b, n, 0)) > 0) {
@@ -2003,8 +2170,12 @@ queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
         d->output_size -= flush_queue(&d->output, -space);
     }
   }
-  add_to_queue(&d->output, b, n);
+  if (ts)
+    add_to_queue_shared(&d->output, ts, b, n);
+  else
+    add_to_queue(&d->output, b, n);
   d->output_size += n;
+  desc_update_poll(d);
   if (utf8)
     mush_free(utf8, "string");
   return n;
@@ -2018,9 +2189,9 @@ int
 queue_eol(DESC *d)
 {
   if ((d->conn_flags & CONN_HTML))
-    return queue_newwrite(d, "<BR>\n", 5);
+    return queue_newwrite_shared(d, eol_br.text, eol_br.len, &eol_br);
   else
-    return queue_newwrite(d, "\r\n", 2);
+    return queue_newwrite_shared(d, eol_crlf.text, eol_crlf.len, &eol_crlf);
 }
 
 /** Add a string and an end-of-line to a descriptor's text queue.
@@ -29,6 +29,7 @@
 #include "externs.h"
 #include "flags.h"
 #include "function.h"
+#include "hash_function.h"
 #include "log.h"
 #include "match.h"
 #include "memcheck.h"
@@ -849,9 +850,20 @@ parse_uint64(const char *s, char **end, int base)
 StrTree pe_reg_names;
 StrTree pe_reg_vals;
 
-/* Slabs for PE_REGS and PE_REG_VALs */
+/* Slabs for PE_REGS, PE_REG_VALs and NEW_PE_INFOs */
 slab *pe_reg_slab;
 slab *pe_reg_val_slab;
+slab *pe_info_slab;
+
+/* Levels with more values than this get a hash index */
+#define PE_REGS_INDEX_MIN 8
+
+static PE_REG_VAL *pe_regs_find(PE_REGS *pe_regs, const char *key, int type);
+static void pe_regs_link(PE_REGS *pe_regs, PE_REG_VAL *pval);
+static void pe_regs_index_build(PE_REGS *pe_regs, int nvals);
+static void pe_regs_index_drop(PE_REGS *pe_regs);
+static const char *pe_regs_get_key(PE_REGS *pe_regs, int type,
+                                   const char *key);
 
 /* Lame speed-up so we don't constantly call tprintf :D */
 static const char *envid[10] = {"0", "1", "2", "3", "4",
@@ -865,6 +877,7 @@ init_pe_regs_trees()
 
   pe_reg_slab = slab_create("PE_REGS", sizeof(PE_REGS));
   pe_reg_val_slab = slab_create("PE_REG_VAL", sizeof(PE_REG_VAL));
+  pe_info_slab = slab_create("NEW_PE_INFO", sizeof(NEW_PE_INFO));
 
   st_init(&pe_reg_names, "pe_reg_names");
   st_init(&pe_reg_vals, "pe_reg_vals");
@@ -954,6 +967,10 @@ pe_regs_create_real(int pr_flags, const char *name)
   pe_regs->count = 0;
   pe_regs->flags = pr_flags;
   pe_regs->vals = NULL;
+  pe_regs->valtypes = 0;
+  pe_regs->index = NULL;
+  pe_regs->index_size = 0;
+  pe_regs->index_used = 0;
   pe_regs->prev = NULL;
   return pe_regs;
 }
@@ -998,9 +1015,11 @@ pe_regs_clear(PE_REGS *pe_regs)
     pe_reg_val_free(val);
     val = next;
   }
+  pe_regs_index_drop(pe_regs);
   pe_regs->count = 0;
   pe_regs->qcount = 0;
   pe_regs->vals = NULL;
+  pe_regs->valtypes = 0;
 }
 
 /** Free all values of a specific type from a PE_REGS context.
@@ -1015,6 +1034,7 @@ pe_regs_clear_type(PE_REGS *pe_regs, int type)
   PE_REG_VAL *next;
   PE_REG_VAL *prev = NULL;
 
+  pe_regs_index_drop(pe_regs);
   while (val) {
     next = val->next;
     if (val->type & type) {
@@ -1071,15 +1091,106 @@ pe_regs_restore(NEW_PE_INFO *pe_info, PE_REGS *pe_regs)
   pe_info->regvals = pe_regs->prev;
 }
 
-#define FIND_PVAL(pval, key, type)                                             \
-  do {                                                                         \
-    if (!pval)                                                                 \
-      break;                                                                   \
-    if ((pval->type & type & PE_REGS_TYPE) && !strcmp(pval->name, key)) {      \
-      break;                                                                   \
-    }                                                                          \
-    pval = pval->next;                                                         \
-  } while (pval)
+#define PE_REG_HASH(key) city_hash((key), strlen(key), 0)
+
+/* Find the value of a given type in one PE_REGS level.
+ * key must already be upper-cased. */
+static PE_REG_VAL *
+pe_regs_find(PE_REGS *pe_regs, const char *key, int type)
+{
+  PE_REG_VAL *pval;
+  int n = 0;
+
+  type &= PE_REGS_TYPE;
+  if (!(pe_regs->valtypes & type)) {
+    return NULL;
+  }
+
+  if (pe_regs->index) {
+    uint32_t mask = pe_regs->index_size - 1;
+    uint32_t slot = PE_REG_HASH(key) & mask;
+
+    for (; (pval = pe_regs->index[slot]); slot = (slot + 1) & mask) {
+      if ((pval->type & type) && !strcmp(pval->name, key)) {
+        return pval;
+      }
+    }
+    return NULL;
+  }
+
+  for (pval = pe_regs->vals; pval; pval = pval->next, n++) {
+    if ((pval->type & type) && !strcmp(pval->name, key)) {
+      return pval;
+    }
+  }
+  if (n > PE_REGS_INDEX_MIN) {
+    pe_regs_index_build(pe_regs, n);
+  }
+  return NULL;
+}
+
+static void
+pe_regs_index_add(PE_REGS *pe_regs, PE_REG_VAL *pval)
+{
+  uint32_t mask = pe_regs->index_size - 1;
+  uint32_t slot = PE_REG_HASH(pval->name) & mask;
+
+  while (pe_regs->index[slot]) {
+    slot = (slot + 1) & mask;
+  }
+  pe_regs->index[slot] = pval;
+  pe_regs->index_used++;
+}
+
+/* (Re)build the open-addressed index of a level's values, keeping it
+ * at most half full. */
+static void
+pe_regs_index_build(PE_REGS *pe_regs, int nvals)
+{
+  PE_REG_VAL *pval;
+  int size = 16;
+
+  while (size < nvals * 2) {
+    size *= 2;
+  }
+  pe_regs_index_drop(pe_regs);
+  pe_regs->index = mush_calloc(size, sizeof(PE_REG_VAL *), "pe_regs.index");
+  if (!pe_regs->index) {
+    mush_panic("Out of memory");
+  }
+  pe_regs->index_size = size;
+  for (pval = pe_regs->vals; pval; pval = pval->next) {
+    pe_regs_index_add(pe_regs, pval);
+  }
+}
+
+/* Throw away a level's index. Done whenever values are removed; it's
+ * rebuilt the next time a lookup has to walk a long list. */
+static void
+pe_regs_index_drop(PE_REGS *pe_regs)
+{
+  if (pe_regs->index) {
+    mush_free(pe_regs->index, "pe_regs.index");
+    pe_regs->index = NULL;
+    pe_regs->index_size = 0;
+    pe_regs->index_used = 0;
+  }
+}
+
+/* Add a new value to the front of a level's list, and its index. */
+static void
+pe_regs_link(PE_REGS *pe_regs, PE_REG_VAL *pval)
+{
+  pval->next = pe_regs->vals;
+  pe_regs->vals = pval;
+  if (pe_regs->index) {
+    if ((pe_regs->index_used + 1) * 2 > pe_regs->index_size) {
+      pe_regs_index_build(pe_regs, pe_regs->index_used + 1);
+    } else {
+      pe_regs_index_add(pe_regs, pval);
+    }
+  }
+}
 
 /** Is the given key a named register (not A-Z or 0-9)?
  */
@@ -1117,11 +1228,11 @@ pe_regs_set_if(PE_REGS *pe_regs, int type, const char *lckey, const char *val,
 {
   /* pe_regs_set is authoritative: it ignores flags set on the PE_REGS,
    * it doesn't recurse up the chain, etc. */
-  PE_REG_VAL *pval = pe_regs->vals;
+  PE_REG_VAL *pval;
   char key[PE_KEY_LEN];
   static const char noval[] = "";
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  pval = pe_regs_find(pe_regs, key, type);
   if (!(type & PE_REGS_NOCOPY)) {
     if (!val || !val[0]) {
       val = noval;
@@ -1138,8 +1249,7 @@ pe_regs_set_if(PE_REGS *pe_regs, int type, const char *lckey, const char *val,
     ADD_CHECK("pe_reg_val_slab");
     pval->name = st_insert(key, &pe_reg_names);
     ADD_CHECK("pe_reg_val-name");
-    pval->next = pe_regs->vals;
-    pe_regs->vals = pval;
+    pe_regs_link(pe_regs, pval);
     pe_regs->count++;
     if (type & PE_REGS_Q) {
       if (is_named_register(key)) {
@@ -1147,6 +1257,7 @@ pe_regs_set_if(PE_REGS *pe_regs, int type, const char *lckey, const char *val,
       }
     }
   }
+  pe_regs->valtypes |= type & PE_REGS_TYPE;
   if (type & PE_REGS_NOCOPY) {
     pval->type = type | PE_REGS_STR;
     pval->val.sval = val;
@@ -1173,10 +1284,10 @@ void
 pe_regs_set_int_if(PE_REGS *pe_regs, int type, const char *lckey, int val,
                    int override)
 {
-  PE_REG_VAL *pval = pe_regs->vals;
+  PE_REG_VAL *pval;
   char key[PE_KEY_LEN];
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  pval = pe_regs_find(pe_regs, key, type);
   if (pval) {
     if (!override)
       return;
@@ -1186,8 +1297,7 @@ pe_regs_set_int_if(PE_REGS *pe_regs, int type, const char *lckey, int val,
     ADD_CHECK("pe_reg_val_slab");
     pval->name = st_insert(key, &pe_reg_names);
     ADD_CHECK("pe_reg_val-name");
-    pval->next = pe_regs->vals;
-    pe_regs->vals = pval;
+    pe_regs_link(pe_regs, pval);
     pe_regs->count++;
     if (type & PE_REGS_Q) {
       if (is_named_register(key)) {
@@ -1195,6 +1305,7 @@ pe_regs_set_int_if(PE_REGS *pe_regs, int type, const char *lckey, int val,
       }
     }
   }
+  pe_regs->valtypes |= type & PE_REGS_TYPE;
   pval->type = type | PE_REGS_INT;
   pval->val.ival = val;
 }
@@ -1202,10 +1313,16 @@ pe_regs_set_int_if(PE_REGS *pe_regs, int type, const char *lckey, int val,
 const char *
 pe_regs_get(PE_REGS *pe_regs, int type, const char *lckey)
 {
-  PE_REG_VAL *pval = pe_regs->vals;
   char key[PE_KEY_LEN];
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  return pe_regs_get_key(pe_regs, type, key);
+}
+
+/* pe_regs_get() for an already upper-cased key */
+static const char *
+pe_regs_get_key(PE_REGS *pe_regs, int type, const char *key)
+{
+  PE_REG_VAL *pval = pe_regs_find(pe_regs, key, type);
   if (!pval)
     return NULL;
   if (pval->type & PE_REGS_STR) {
@@ -1225,10 +1342,10 @@ pe_regs_get(PE_REGS *pe_regs, int type, const char *lckey)
 int
 pe_regs_get_int(PE_REGS *pe_regs, int type, const char *lckey)
 {
-  PE_REG_VAL *pval = pe_regs->vals;
+  PE_REG_VAL *pval;
   char key[PE_KEY_LEN];
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  pval = pe_regs_find(pe_regs, key, type);
   if (!pval)
     return 0;
   if (pval->type & PE_REGS_STR) {
@@ -1239,6 +1356,41 @@ pe_regs_get_int(PE_REGS *pe_regs, int type, const char *lckey)
   return 0;
 }
 
+TEST_GROUP(pe_regs_index)
+{
+  PE_REGS *pe_regs = pe_regs_create(PE_REGS_QUEUE, "test");
+  char name[PE_KEY_LEN];
+  int i;
+  bool ok = 1;
+
+  /* Enough values to get an index */
+  for (i = 0; i < 40; i++) {
+    snprintf(name, sizeof name, "test%d", i);
+    pe_regs_set(pe_regs, PE_REGS_Q, name, pe_regs_intname(i));
+  }
+  pe_regs_setenv(pe_regs, 0, "arg");
+  pe_regs_set(pe_regs, PE_REGS_Q, "0", "q");
+  for (i = 0; i < 40 && ok; i++) {
+    const char *val;
+    snprintf(name, sizeof name, "TeSt%d", i);
+    val = pe_regs_get(pe_regs, PE_REGS_Q, name);
+    ok = val && !strcmp(val, pe_regs_intname(i));
+  }
+  TEST("pe_regs_index.1", ok);
+  TEST("pe_regs_index.2", pe_regs->index != NULL);
+  TEST("pe_regs_index.3", pe_regs_get(pe_regs, PE_REGS_Q, "test40") == NULL);
+  TEST("pe_regs_index.4",
+       strcmp(pe_regs_get(pe_regs, PE_REGS_ARG, "0"), "arg") == 0 &&
+         strcmp(pe_regs_get(pe_regs, PE_REGS_Q, "0"), "q") == 0);
+  pe_regs_set(pe_regs, PE_REGS_Q, "test7", "seven");
+  TEST("pe_regs_index.5",
+       strcmp(pe_regs_get(pe_regs, PE_REGS_Q, "test7"), "seven") == 0);
+  pe_regs_clear_type(pe_regs, PE_REGS_Q);
+  TEST("pe_regs_index.6", pe_regs_get(pe_regs, PE_REGS_Q, "test7") == NULL &&
+                            pe_regs_get(pe_regs, PE_REGS_ARG, "0") != NULL);
+  pe_regs_free(pe_regs);
+}
+
 /** Copy Q-reg values to one PE_REGS from another.
  * \param dst The PE_REGS to copy to.
  * \param src The PE_REGS to copy from.
@@ -1282,6 +1434,7 @@ pe_regs_copystack(PE_REGS *new_regs, PE_REGS *pe_regs, int copytypes,
 
   if (override && (copytypes & PE_REGS_ARG) && (pe_regs->flags & PE_REGS_ARG)) {
     /* Look for all PE_REGS_ARG flags in new_regs, and delete them. */
+    pe_regs_index_drop(new_regs);
     for (val = new_regs->vals; val; val = next) {
       next = val->next;
       if (val->type & PE_REGS_ARG) {
@@ -1486,13 +1639,16 @@ pi_regs_setq(NEW_PE_INFO *pe_info, const char *key, const char *val)
 }
 
 const char *
-pi_regs_getq(NEW_PE_INFO *pe_info, const char *key)
+pi_regs_getq(NEW_PE_INFO *pe_info, const char *lckey)
 {
   const char *ret;
+  char key[PE_KEY_LEN];
   PE_REGS *pe_regs = pe_info->regvals;
+
+  strupper_r(lckey, key, sizeof key);
   while (pe_regs) {
     if (pe_regs->flags & PE_REGS_Q) {
-      ret = pe_regs_get(pe_regs, PE_REGS_Q, key);
+      ret = pe_regs_get_key(pe_regs, PE_REGS_Q, key);
       if (ret)
         return ret;
     }
@@ -1613,13 +1769,16 @@ pe_regs_set_rx_context_ansi(PE_REGS *pe_regs, int pe_reg_flags,
 
 /* Used by PE_Get_re, to get regexp values */
 const char *
-pi_regs_get_rx(NEW_PE_INFO *pe_info, const char *key)
+pi_regs_get_rx(NEW_PE_INFO *pe_info, const char *lckey)
 {
   const char *ret;
+  char key[PE_KEY_LEN];
   PE_REGS *pe_regs = pe_info->regvals;
+
+  strupper_r(lckey, key, sizeof key);
   while (pe_regs) {
     if (pe_regs->flags & PE_REGS_REGEXP) {
-      ret = pe_regs_get(pe_regs, PE_REGS_REGEXP, key);
+      ret = pe_regs_get_key(pe_regs, PE_REGS_REGEXP, key);
       if (ret)
         return ret;
       /* Only check the _first_ PE_REGS_REGEXP. */
@@ -1646,8 +1805,8 @@ pi_regs_get_itext(NEW_PE_INFO *pe_info, int type, int lev)
 
   while (pe_regs) {
     if (pe_regs->flags & type) {
-      snprintf(numbuff, 10, "t%d", lev);
-      ret = pe_regs_get(pe_regs, type, numbuff);
+      snprintf(numbuff, 10, "T%d", lev);
+      ret = pe_regs_get_key(pe_regs, type, numbuff);
       if (ret) {
         return ret;
       }
@@ -1760,12 +1919,14 @@ pi_regs_get_env(NEW_PE_INFO *pe_info, const char *name)
 {
   PE_REGS *pe_regs;
   const char *ret;
+  char key[PE_KEY_LEN];
 
+  strupper_r(name, key, sizeof key);
   pe_regs = pe_info->regvals;
 
   while (pe_regs) {
     if (pe_regs->flags & PE_REGS_ARG) {
-      ret = pe_regs_get(pe_regs, PE_REGS_ARG, name);
+      ret = pe_regs_get_key(pe_regs, PE_REGS_ARG, key);
       return ret;
     }
     /* NEWATTR without ARGPASS halts switch and itext. */
@@ -1853,11 +2014,8 @@ free_pe_info(NEW_PE_INFO *pe_info)
     mush_free(pe_info->attrname, "string");
   }
 
-#ifdef DEBUG
-  mush_free(pe_info, pe_info->name);
-#else
-  mush_free(pe_info, "new_pe_info");
-#endif
+  slab_free(pe_info_slab, pe_info);
+  DEL_CHECK("pe_info_slab");
 
   return;
 }
@@ -1870,13 +2028,10 @@ make_pe_info(char *name __attribute__((__unused__)))
 {
   NEW_PE_INFO *pe_info;
 
-#ifdef DEBUG
-  pe_info = mush_malloc(sizeof(NEW_PE_INFO), name);
-#else
-  pe_info = mush_malloc(sizeof(NEW_PE_INFO), "new_pe_info");
-#endif
+  pe_info = slab_malloc(pe_info_slab, NULL);
   if (!pe_info)
     mush_panic("Unable to allocate memory in make_pe_info");
+  ADD_CHECK("pe_info_slab");
 
   pe_info->fun_invocations = 0;
   pe_info->fun_recursions = 0;
@@ -1894,9 +2049,6 @@ make_pe_info(char *name __attribute__((__unused__)))
   pe_info->cmd_evaled = NULL;
 
   pe_info->refcount = 1;
-#ifdef DEBUG
-  strcpy(pe_info->name, name);
-#endif
 
   return pe_info;
 }
@@ -1995,6 +2147,37 @@ pe_info_from(NEW_PE_INFO *old_pe_info, int flags, PE_REGS *pe_regs)
   return pe_info;
 }
 
+/* Every function call evaluates its arguments into BUFFER_LEN sized
+ * buffers. Released ones are kept here and handed out again instead of
+ * going back to malloc (and zeroing a fresh one) for each argument. */
+#define PE_ARGBUF_KEEP 64
+static char *pe_argbufs[PE_ARGBUF_KEEP];
+static int pe_argbuf_count = 0;
+
+/** Get a buffer to evaluate a function argument into.
+ * \return a BUFFER_LEN + SSE_OFFSET byte buffer.
+ */
+static char *
+pe_argbuf_get(void)
+{
+  if (pe_argbuf_count > 0)
+    return pe_argbufs[--pe_argbuf_count];
+  return mush_malloc_zero(BUFFER_LEN + SSE_OFFSET,
+                          "process_expression.function_argument");
+}
+
+/** Give back a buffer from pe_argbuf_get().
+ * \param buf the buffer.
+ */
+static void
+pe_argbuf_release(char *buf)
+{
+  if (pe_argbuf_count < PE_ARGBUF_KEEP)
+    pe_argbufs[pe_argbuf_count++] = buf;
+  else
+    mush_free(buf, "process_expression.function_argument");
+}
+
 /** Function and other substitution evaluation.
  * This is the PennMUSH function/expression parser. Big stuff.
  *
@@ -2783,7 +2966,7 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
           safe_chr(UPCASE(*sp), name, &tp);
         *tp = '\0';
         fp = (eflags & PE_BUILTINONLY) ? builtin_func_hash_lookup(name)
-                                       : func_hash_lookup(name);
+                                       : func_hash_lookup_upper(name);
         eflags &= ~PE_BUILTINONLY; /* Only applies to the outermost call */
         if (!fp) {
           if (eflags & PE_FUNCTION_MANDATORY) {
@@ -2870,8 +3053,7 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
             ~(PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK);
         temp_tflags = PT_COMMA | PT_PAREN;
         nfargs = 0;
-        onearg = mush_malloc(BUFFER_LEN,
-                             "process_expression.single_function_argument");
+        onearg = pe_argbuf_get();
         do {
           char *argp;
           char *lca_safe_func_name = NULL;
@@ -2911,13 +3093,10 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
             arglens = narglens;
             args_alloced += 10;
           }
-          fargs[nfargs] = mush_malloc_zero(
-            BUFFER_LEN + SSE_OFFSET, "process_expression.function_argument");
           argp = onearg;
           if (process_expression(onearg, &argp, str, executor, caller, enactor,
                                  temp_eflags, temp_tflags, pe_info)) {
             retval = 1;
-            nfargs++;
             /* Part of r1628's deprecation of unescaped commas as the final arg
              * of a function,
              * added 17 Sep 2012. Remove when this behaviour is removed. */
@@ -2931,11 +3110,15 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
           }
           *argp = '\0';
           if (fp->flags & FN_STRIPANSI) {
+            fargs[nfargs] = pe_argbuf_get();
             strcpy(fargs[nfargs], remove_markup(onearg, NULL));
+            arglens[nfargs] = strlen(fargs[nfargs]);
           } else {
-            strcpy(fargs[nfargs], onearg);
+            /* Hand the evaluated buffer over instead of copying it */
+            fargs[nfargs] = onearg;
+            arglens[nfargs] = strlen(fargs[nfargs]);
+            onearg = pe_argbuf_get();
           }
-          arglens[nfargs] = strlen(fargs[nfargs]);
           /* Part of r1628's deprecation of unescaped commas as the final arg of
            * a function,
            * added 17 Sep 2012. Remove when this behaviour is removed. */
@@ -2972,7 +3155,7 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
            * Special case: zero args is recognized as one null arg.
            */
           if ((fp->minargs == 0) && (nfargs == 1) && !*fargs[0]) {
-            mush_free(fargs[0], "process_expression.function_argument");
+            pe_argbuf_release(fargs[0]);
             fargs[0] = NULL;
             arglens[0] = 0;
             nfargs = 0;
@@ -3079,13 +3262,13 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
       free_func_args:
         for (j = 0; j < nfargs; j++)
           if (fargs[j])
-            mush_free(fargs[j], "process_expression.function_argument");
+            pe_argbuf_release(fargs[j]);
         if (fargs != sargs)
           mush_free(fargs, "process_expression.function_arglist");
         if (arglens != sarglens)
           mush_free(arglens, "process_expression.function_arglens");
         if (onearg)
-          mush_free(onearg, "process_expression.single_function_argument");
+          pe_argbuf_release(onearg);
       }
       break;
     /* Space compression */
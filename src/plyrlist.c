@@ -3,7 +3,10 @@
  *
  * \brief Player list management for PennMUSH.
  *
- *
+ * Player names and aliases are kept in a hash table keyed by the
+ * upper-cased name. Each player's entries are also chained together
+ * and reachable by dbref, so that all of a player's names can be
+ * removed without knowing what they were.
  */
 
 #include "copyrite.h"
@@ -15,34 +18,42 @@
 #include "conf.h"
 #include "dbdefs.h"
 #include "externs.h"
+#include "htab.h"
+#include "intmap.h"
 #include "mushdb.h"
+#include "mymalloc.h"
 #include "parse.h"
 #include "strutil.h"
-#include "mushsql.h"
-#include "log.h"
-#include "charconv.h"
+#include "tests.h"
+
+/** A name or alias in the player list. */
+struct plyr_name {
+  dbref player;           /**< Player the name belongs to */
+  struct plyr_name *next; /**< Next name of the same player */
+  char key[];             /**< Upper-cased name */
+};
+
+HASHTAB htab_player_list; /**< Player names and aliases */
+static intmap *players_by_dbref = NULL; /**< Each player's first plyr_name */
 
 static int hft_initialized = 0;
 static void init_hft(void);
+static void free_player_name(void *pn);
+static void add_player_name(const char *name, dbref player);
+
+static void
+free_player_name(void *pn)
+{
+  mush_free(pn, "plyrlist.entry");
+}
 
 static void
 init_hft(void)
 {
   if (!hft_initialized) {
-    char *errmsg = NULL;
-    sqlite3 *sqldb = get_shared_db();
-
-    if (sqlite3_exec(sqldb,
-                     "CREATE TABLE players(name TEXT NOT NULL PRIMARY KEY, "
-                     "dbref INTEGER NOT NULL, FOREIGN KEY(dbref) REFERENCES "
-                     "objects(dbref) ON DELETE CASCADE) WITHOUT ROWID;"
-                     "CREATE INDEX plyr_dbref_idx ON players(dbref)",
-                     NULL, NULL, &errmsg) != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to create players table: %s", errmsg);
-      sqlite3_free(errmsg);
-    } else {
-      hft_initialized = 1;
-    }
+    hash_init(&htab_player_list, 256, free_player_name);
+    players_by_dbref = im_new();
+    hft_initialized = 1;
   }
 }
 
@@ -51,14 +62,9 @@ void
 clear_players(void)
 {
   if (hft_initialized) {
-    char *errmsg = NULL;
-    sqlite3 *sqldb = get_shared_db();
-
-    if (sqlite3_exec(sqldb, "DELETE FROM players", NULL, NULL, &errmsg) !=
-        SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to wipe players table: %s", errmsg);
-      sqlite3_free(errmsg);
-    }
+    hashflush(&htab_player_list, 256);
+    im_destroy(players_by_dbref);
+    players_by_dbref = im_new();
   } else {
     init_hft();
   }
@@ -66,36 +72,29 @@ clear_players(void)
 
 /* name is assumed to be latin-1 */
 static void
-add_player_name(sqlite3 *sqldb, const char *name, dbref player)
+add_player_name(const char *name, dbref player)
 {
-  sqlite3_stmt *adder;
-  int ulen;
-  char *utf8;
-  int status;
+  char key[BUFFER_LEN];
+  size_t klen;
+  struct plyr_name *pn;
 
   init_hft();
 
-  adder = prepare_statement(
-    sqldb, "INSERT INTO players(name, dbref) VALUES(upper(?), ?)",
-    "plyrlist.add");
-  if (!adder) {
-    return;
-  }
-
-  utf8 = latin1_to_utf8(name, strlen(name), &ulen, "string");
-  sqlite3_bind_text(adder, 1, utf8, ulen, free_string);
-  sqlite3_bind_int(adder, 2, player);
-
-  do {
-    status = sqlite3_step(adder);
-  } while (is_busy_status(status));
-
-  if (status != SQLITE_DONE && status != SQLITE_CONSTRAINT) {
-    do_rawlog(LT_ERR, "Unable to execute players add query for #%d/%s: %s (%d)",
-              player, name, sqlite3_errmsg(sqldb), status);
-  }
-
-  sqlite3_reset(adder);
+  strupper_r(name, key, sizeof key);
+  if (hashfind(key, &htab_player_list))
+    return; /* First one to claim a name keeps it */
+
+  klen = strlen(key) + 1;
+  pn = mush_malloc(sizeof *pn + klen, "plyrlist.entry");
+  if (!pn)
+    mush_panic("Unable to allocate memory in plyrlist!");
+  pn->player = player;
+  memcpy(pn->key, key, klen);
+  hashadd(key, pn, &htab_player_list);
+  pn->next = im_find(players_by_dbref, player);
+  if (pn->next)
+    im_delete(players_by_dbref, player);
+  im_insert(players_by_dbref, player, pn);
 }
 
 /** Add a player to the player list htab.
@@ -104,7 +103,7 @@ add_player_name(sqlite3 *sqldb, const char *name, dbref player)
 void
 add_player(dbref player)
 {
-  add_player_name(get_shared_db(), Name(player), player);
+  add_player_name(Name(player), player);
 }
 
 /** Add a player's alias list to the player list htab.
@@ -113,24 +112,9 @@ add_player(dbref player)
  * semicolon-separated.
  */
 void
-add_player_alias(dbref player, const char *alias, bool intransaction)
+add_player_alias(dbref player, const char *alias)
 {
   char tbuf1[BUFFER_LEN], *s, *sp;
-  int status;
-  char *errmsg;
-  sqlite3 *sqldb = get_shared_db();
-
-  init_hft();
-
-  if (!intransaction) {
-    status = sqlite3_exec(sqldb, "BEGIN TRANSACTION", NULL, NULL, &errmsg);
-    if (status != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to start players add alias transaction: %s",
-                errmsg);
-      sqlite3_free(errmsg);
-      return;
-    }
-  }
 
   mush_strncpy(tbuf1, alias, BUFFER_LEN);
   s = trim_space_sep(tbuf1, ALIAS_DELIMITER);
@@ -139,18 +123,7 @@ add_player_alias(dbref player, const char *alias, bool intransaction)
     while (sp && *sp && *sp == ' ')
       sp++;
     if (sp && *sp) {
-      add_player_name(sqldb, sp, player);
-    }
-  }
-
-  if (!intransaction) {
-    status = sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, &errmsg);
-    if (status != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to commit players add alias transaction: %s",
-                errmsg);
-      sqlite3_free(errmsg);
-      sqlite3_exec(sqldb, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
-      return;
+      add_player_name(sp, player);
     }
   }
 }
@@ -185,68 +158,38 @@ lookup_player(const char *name)
 dbref
 lookup_player_name(const char *name)
 {
-  sqlite3_stmt *looker;
-  dbref d = NOTHING;
-  char *utf8;
-  int ulen;
-  int status;
-  sqlite3 *sqldb = get_shared_db();
+  char key[BUFFER_LEN];
+  struct plyr_name *pn;
 
   if (!hft_initialized) {
     return NOTHING;
   }
 
-  looker =
-    prepare_statement(sqldb, "SELECT dbref FROM players WHERE name = upper(?)",
-                      "plyrlist.lookup");
-  if (!looker) {
-    return NOTHING;
-  }
-
-  utf8 = latin1_to_utf8(name, strlen(name), &ulen, "string");
-  sqlite3_bind_text(looker, 1, utf8, ulen, free_string);
-
-  do {
-    status = sqlite3_step(looker);
-  } while (is_busy_status(status));
-
-  if (status == SQLITE_ROW) {
-    d = sqlite3_column_int(looker, 0);
-  } else if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to run players lookup query for %s: %s", name,
-              sqlite3_errmsg(sqldb));
-  }
-  sqlite3_reset(looker);
-  return d;
+  strupper_r(name, key, sizeof key);
+  pn = hashfind(key, &htab_player_list);
+  return pn ? pn->player : NOTHING;
 }
 
-/** Remove a player from the player list htab.
+/** Remove a player's names and aliases from the player list htab.
  * \param player dbref of player to remove.
- * \param alias key to remove if given.
  */
 void
 delete_player(dbref player)
 {
-  sqlite3_stmt *deleter;
-  int status;
-  sqlite3 *sqldb = get_shared_db();
-
-  init_hft();
+  struct plyr_name *pn, *next;
 
-  deleter = prepare_statement(sqldb, "DELETE FROM players WHERE dbref = ?",
-                              "plyrlist.delete");
-  if (!deleter) {
+  if (!hft_initialized) {
     return;
   }
 
-  sqlite3_bind_int(deleter, 1, player);
-  status = sqlite3_step(deleter);
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR,
-              "Unable to execute query to delete players names for #%d: %s",
-              player, sqlite3_errmsg(sqldb));
+  pn = im_find(players_by_dbref, player);
+  if (!pn)
+    return;
+  im_delete(players_by_dbref, player);
+  for (; pn; pn = next) {
+    next = pn->next;
+    hashdelete(pn->key, &htab_player_list); /* Frees pn */
   }
-  sqlite3_reset(deleter);
 }
 
 /** Reset all of a player's player list entries (names/aliases).
@@ -260,11 +203,6 @@ void
 reset_player_list(dbref player, const char *name, const char *alias)
 {
   char tbuf[BUFFER_LEN];
-  int status;
-  char *errmsg;
-  sqlite3 *sqldb = get_shared_db();
-
-  init_hft();
 
   if (!name) {
     name = Name(player);
@@ -285,25 +223,34 @@ reset_player_list(dbref player, const char *name, const char *alias)
     }
   }
 
-  status = sqlite3_exec(sqldb, "BEGIN TRANSACTION", NULL, NULL, &errmsg);
-  if (status != SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to start players replace transaction: %s",
-              errmsg);
-    sqlite3_free(errmsg);
-    return;
-  }
-
   /* Delete all the old stuff */
   delete_player(player);
   /* Add in the new stuff */
-  add_player_name(sqldb, name, player);
-  add_player_alias(player, tbuf, 1);
+  add_player_name(name, player);
+  add_player_alias(player, tbuf);
+}
 
-  status = sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, &errmsg);
-  if (status != SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to commit players replace transaction: %s",
-              errmsg);
-    sqlite3_free(errmsg);
-    sqlite3_exec(sqldb, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
-  }
+TEST_GROUP(player_list)
+{
+  char name[BUFFER_LEN];
+  /* Not a real object, so the live database's entries are untouched */
+  dbref scratch = db_top;
+
+  TEST("player_list.1", lookup_player_name(Name(GOD)) == GOD);
+  strlower_r(Name(GOD), name, sizeof name);
+  TEST("player_list.2", lookup_player_name(name) == GOD);
+  strupper_r(Name(GOD), name, sizeof name);
+  TEST("player_list.3", lookup_player(name) == GOD);
+  TEST("player_list.4", lookup_player_name("PlyrListTest") == NOTHING);
+  add_player_name("PlyrListTest", scratch);
+  add_player_alias(scratch, "PlyrListTest2;PlyrListTest3");
+  TEST("player_list.5", lookup_player_name("plyrlisttest") == scratch);
+  TEST("player_list.6", lookup_player("*PlyrListTest2") == scratch);
+  TEST("player_list.7", lookup_player_name("PLYRLISTTEST3") == scratch);
+  add_player_name(Name(GOD), scratch);
+  TEST("player_list.8", lookup_player_name(Name(GOD)) == GOD);
+  delete_player(scratch);
+  TEST("player_list.9", lookup_player_name("PlyrListTest") == NOTHING);
+  TEST("player_list.10", lookup_player_name("PlyrListTest2") == NOTHING);
+  TEST("player_list.11", lookup_player_name(Name(GOD)) == GOD);
 }
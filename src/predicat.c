@@ -1533,17 +1533,15 @@ grep_util(dbref player, dbref thing, char *attrs, char *findstr, char *buff,
   if (flags & GREP_REGEXP) {
     /* regexp grep */
     struct regrep_data rgd;
+    struct re_cache_ref rx;
     int errcode;
-    PCRE2_SIZE erroffset;
     int reflags = re_compile_flags;
 
     if (flags & GREP_NOCASE) {
       reflags |= PCRE2_CASELESS;
     }
 
-    if ((rgd.re = pcre2_compile((const PCRE2_UCHAR *) cleanfind,
-                                PCRE2_ZERO_TERMINATED, reflags, &errcode,
-                                &erroffset, re_compile_ctx)) == NULL) {
+    if (!re_cache_get(&rx, cleanfind, reflags, &errcode)) {
       char errstr[120];
       pcre2_get_error_message(errcode, (PCRE2_UCHAR *) errstr, sizeof errstr);
       /* Matching error. */
@@ -1555,9 +1553,8 @@ grep_util(dbref player, dbref thing, char *attrs, char *findstr, char *buff,
       }
       return 0;
     }
-    ADD_CHECK("pcre");
-    pcre2_jit_compile(rgd.re, PCRE2_JIT_COMPLETE);
-    rgd.md = pcre2_match_data_create_from_pattern(rgd.re, NULL);
+    rgd.re = rx.re;
+    rgd.md = rx.md;
     rgd.buff = buff;
     rgd.bp = bp;
     rgd.count = 0;
@@ -1569,9 +1566,7 @@ grep_util(dbref player, dbref thing, char *attrs, char *findstr, char *buff,
       atr_iter_get(player, thing, attrs, AIG_NONE, regrep_helper,
                    (void *) &rgd);
     }
-    pcre2_code_free(rgd.re);
-    pcre2_match_data_free(rgd.md);
-    DEL_CHECK("pcre");
+    re_cache_release(&rx);
 
     return rgd.count;
   } else {
@@ -518,6 +518,9 @@ af_helper(dbref player, dbref thing, dbref parent __attribute__((__unused__)),
     return 0;
   }
 
+  if (AF_Command(atr) && ((af->clrf | af->setf) & AF_REGEXP))
+    atr_comm_index_reset();
+
   /* Clear flags first, then set flags */
   if (af->clrf) {
     AL_FLAGS(atr) &= ~af->clrf;
@@ -553,6 +556,8 @@ copy_attrib_flags(dbref player, dbref target, ATTR *atr, int flags)
     flags |= AF_ROOT;
   else
     flags &= ~AF_ROOT;
+  if (AF_Command(atr) || (flags & AF_COMMAND))
+    atr_comm_index_reset();
   AL_FLAGS(atr) = flags;
 }
 
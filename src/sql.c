@@ -124,6 +124,43 @@ static void penn_sqlite3_free_sql_query(sqlite3_stmt *);
 #endif
 static sqlplatform sql_platform(void);
 static char *sql_sanitize(const char *res);
+
+/** Where @mapsql should send each row of a result. */
+struct mapsql_target {
+  dbref executor;    /**< Object running @mapsql */
+  dbref thing;       /**< Object holding the attribute to queue */
+  dbref triggerer;   /**< Enactor for the queued attribute */
+  char *attrname;    /**< Attribute to queue for each row */
+  int queue_type;    /**< Queue type of the queued attributes */
+  bool dofieldnames; /**< Queue a row 0 with the column names? */
+  bool donotify;     /**< Queue @notify me when done? */
+  PE_REGS *qregs;    /**< Q-registers to pass to each queued row */
+};
+
+static void mapsql_queue_rows(struct mapsql_target *target, void *qres);
+
+#ifdef HAVE_POSTGRESQL
+/** A @mapsql/async query waiting on the postgresql connection.
+ * Queries are sent one at a time, in order, with PQsendQuery(), and
+ * the socket is watched by check_sockets() so the game keeps running
+ * while the server works on it. */
+struct sql_async_query {
+  char *query;                  /**< The query text */
+  bool sent;                    /**< Has it been sent to the server? */
+  struct mapsql_target target;  /**< Where the results go */
+  struct sql_async_query *next; /**< Next query in line */
+};
+
+static struct sql_async_query *async_head = NULL, *async_tail = NULL;
+
+static void free_async_query(struct sql_async_query *q);
+static void sql_async_pump(void);
+static void sql_async_complete(bool block);
+static void sql_async_lost(void);
+static void sql_async_reconnect(void);
+static void sql_async_abort(const char *why);
+#endif
+
 #define SANITIZE(s, n) ((s && *s) ? mush_strdup(sql_sanitize(s), n) : NULL)
 
 static char *
@@ -334,6 +371,31 @@ sql_query(const char *query_str __attribute__((__unused__)),
   }
 }
 
+/** The socket to watch for @mapsql/async results.
+ * \return a socket descriptor, or -1 if no query is in flight.
+ */
+int
+sql_async_fd(void)
+{
+#ifdef HAVE_POSTGRESQL
+  if (async_head && async_head->sent && postgres_connp) {
+    return PQsocket(postgres_connp);
+  }
+#endif
+  return -1;
+}
+
+/** Called by check_sockets() when the sql_async_fd() socket is
+ * readable. Queues the results of a finished @mapsql/async query.
+ */
+void
+sql_async_ready(void)
+{
+#ifdef HAVE_POSTGRESQL
+  sql_async_complete(0);
+#endif
+}
+
 FUNCTION(fun_sql_escape)
 {
   char bigbuff[BUFFER_LEN * 2 + 1];
@@ -417,28 +479,13 @@ FUNCTION(fun_sql_escape)
 
 COMMAND(cmd_mapsql)
 {
-#ifdef HAVE_MYSQL
-  MYSQL_FIELD *fields = NULL;
-#endif
   void *qres;
   int affected_rows = -1;
-  int rownum;
-  int numfields;
-  int numrows;
-  int useable_fields = 0;
-  PE_REGS *pe_regs = NULL;
-  char *names[MAX_STACK_ARGS];
-  char *cells[MAX_STACK_ARGS];
   char tbuf[BUFFER_LEN];
-  char strrownum[20];
   char *s;
-  int i, a;
   dbref thing;
-  int dofieldnames = SW_ISSET(sw, SWITCH_COLNAMES);
-  int donotify = SW_ISSET(sw, SWITCH_NOTIFY);
-  dbref triggerer = executor;
+  struct mapsql_target target;
   int spoof = SW_ISSET(sw, SWITCH_SPOOF);
-  int queue_type = QUEUE_DEFAULT | (queue_entry->queue_type & QUEUE_EVENT);
 
   if (!arg_right || !*arg_right) {
     notify(executor, T("What do you want to query?"));
@@ -469,18 +516,43 @@ COMMAND(cmd_mapsql)
     }
   }
 
-  if (spoof)
-    triggerer = enactor;
-
   if (God(thing) && !God(executor)) {
     notify(executor, T("You can't trigger God!"));
     return;
   }
 
-  for (a = 0; a < MAX_STACK_ARGS; a++) {
-    cells[a] = NULL;
-    names[a] = NULL;
+  target.executor = executor;
+  target.thing = thing;
+  target.triggerer = spoof ? enactor : executor;
+  target.attrname = s;
+  target.queue_type = QUEUE_DEFAULT | (queue_entry->queue_type & QUEUE_EVENT);
+  target.dofieldnames = SW_ISSET(sw, SWITCH_COLNAMES);
+  target.donotify = SW_ISSET(sw, SWITCH_NOTIFY);
+  target.qregs = queue_entry->pe_info->regvals;
+
+#ifdef HAVE_POSTGRESQL
+  if (SW_ISSET(sw, SWITCH_ASYNC) &&
+      sql_platform() == SQL_PLATFORM_POSTGRESQL) {
+    struct sql_async_query *q;
+
+    q = mush_malloc(sizeof *q, "sql.async");
+    q->query = mush_strdup(arg_right, "sql.async.query");
+    q->sent = 0;
+    q->target = target;
+    q->target.attrname = mush_strdup(s, "sql.async.attrname");
+    q->target.qregs = pe_regs_create(PE_REGS_Q, "sql.async.qregs");
+    pe_regs_qcopy(q->target.qregs, queue_entry->pe_info->regvals);
+    q->next = NULL;
+    if (async_tail) {
+      async_tail->next = q;
+    } else {
+      async_head = q;
+    }
+    async_tail = q;
+    sql_async_pump();
+    return;
   }
+#endif
 
   /* Do the query. */
   qres = sql_query(arg_right, &affected_rows);
@@ -496,11 +568,39 @@ COMMAND(cmd_mapsql)
     return;
   }
 
+  mapsql_queue_rows(&target, qres);
+}
+
+/** Queue an attribute for each row of a query result, for @mapsql.
+ * \param target where to queue the rows.
+ * \param qres the query result. It is freed.
+ */
+static void
+mapsql_queue_rows(struct mapsql_target *target, void *qres)
+{
+#ifdef HAVE_MYSQL
+  MYSQL_FIELD *fields = NULL;
+#endif
+  int rownum;
+  int numfields;
+  int numrows;
+  int useable_fields = 0;
+  PE_REGS *pe_regs = NULL;
+  char *names[MAX_STACK_ARGS];
+  char *cells[MAX_STACK_ARGS];
+  char strrownum[20];
+  int i, a;
+  dbref executor = target->executor;
+
+  for (a = 0; a < MAX_STACK_ARGS; a++) {
+    cells[a] = NULL;
+    names[a] = NULL;
+  }
+
   /* Get results. A silent query (INSERT, UPDATE, etc.) will return NULL */
   switch (sql_platform()) {
 #ifdef HAVE_MYSQL
   case SQL_PLATFORM_MYSQL:
-    affected_rows = mysql_affected_rows(mysql_connp);
     numfields = mysql_num_fields(qres);
     numrows = INT_MAX; /* Using mysql_use_result() doesn't know the number
                           of rows ahead of time. */
@@ -574,16 +674,17 @@ COMMAND(cmd_mapsql)
         }
       }
 
-      if ((rownum == 0) && dofieldnames) {
+      if ((rownum == 0) && target->dofieldnames) {
         /* Queue 0: <names> */
         snprintf(strrownum, 20, "%d", 0);
         names[0] = strrownum;
         for (i = 0; i < useable_fields + 1; i++) {
           pe_regs_setenv(pe_regs, i, names[i]);
         }
-        pe_regs_qcopy(pe_regs, queue_entry->pe_info->regvals);
-        queue_attribute_base_priv(thing, s, triggerer, 0, pe_regs, queue_type,
-                                  executor, NULL, NULL);
+        pe_regs_qcopy(pe_regs, target->qregs);
+        queue_attribute_base_priv(target->thing, target->attrname,
+                                  target->triggerer, 0, pe_regs,
+                                  target->queue_type, executor, NULL, NULL);
       }
 
       /* Queue the rest. */
@@ -595,9 +696,10 @@ COMMAND(cmd_mapsql)
         if (i && !is_strict_integer(names[i]))
           pe_regs_set(pe_regs, PE_REGS_ARG, names[i], cells[i]);
       }
-      pe_regs_qcopy(pe_regs, queue_entry->pe_info->regvals);
-      queue_attribute_base_priv(thing, s, triggerer, 0, pe_regs, queue_type,
-                                executor, NULL, NULL);
+      pe_regs_qcopy(pe_regs, target->qregs);
+      queue_attribute_base_priv(target->thing, target->attrname,
+                                target->triggerer, 0, pe_regs,
+                                target->queue_type, executor, NULL, NULL);
       for (i = 0; i < useable_fields; i++) {
         if (cells[i + 1])
           mush_free(cells[i + 1], "sql_row");
@@ -609,7 +711,7 @@ COMMAND(cmd_mapsql)
       /* notify_format(executor, T("Row %d: NULL"), rownum + 1); */
     }
   }
-  if (donotify) {
+  if (target->donotify) {
     parse_que(executor, executor, "@notify me", NULL);
   }
 
@@ -1282,6 +1384,9 @@ penn_pg_sql_shutdown(void)
 {
   if (!penn_pg_sql_connected())
     return;
+  if (async_head) {
+    sql_async_abort(T("Connection closed"));
+  }
   PQfinish(postgres_connp);
   postgres_connp = NULL;
 }
@@ -1385,6 +1490,12 @@ penn_pg_sql_query(const char *q_string, int *affected_rows)
     }
   }
 
+  /* A connection can only run one query at a time, so finish any
+   * @mapsql/async queries that are waiting first. */
+  while (async_head && async_head->sent) {
+    sql_async_complete(1);
+  }
+
   /* Send the query. If it returns non-zero, we have an error. */
   qres = PQexec(postgres_connp, q_string);
   if (!qres || (PQresultStatus(qres) != PGRES_COMMAND_OK &&
@@ -1416,6 +1527,163 @@ penn_pg_free_sql_query(PGresult *qres)
 {
   PQclear(qres);
 }
+
+static void
+free_async_query(struct sql_async_query *q)
+{
+  mush_free(q->query, "sql.async.query");
+  mush_free(q->target.attrname, "sql.async.attrname");
+  pe_regs_free(q->target.qregs);
+  mush_free(q, "sql.async");
+}
+
+/* Send the first waiting async query to the server, if there's one
+ * and nothing else is in flight. */
+static void
+sql_async_pump(void)
+{
+  while (async_head && !async_head->sent) {
+    struct sql_async_query *q = async_head;
+
+    if (!penn_pg_sql_connected()) {
+      penn_pg_sql_init();
+    }
+    if (penn_pg_sql_connected() && PQsendQuery(postgres_connp, q->query)) {
+      q->sent = 1;
+      return;
+    }
+
+    if (!penn_pg_sql_connected()) {
+      notify(q->target.executor, T("No SQL database connection."));
+    } else {
+      notify_format(q->target.executor, T("SQL: Error: %s"),
+                    PQerrorMessage(postgres_connp));
+    }
+    async_head = q->next;
+    if (!async_head) {
+      async_tail = NULL;
+    }
+    free_async_query(q);
+  }
+}
+
+/* Collect the results of the in-flight async query and queue them.
+ * If block is false, only do so if they've all arrived. */
+static void
+sql_async_complete(bool block)
+{
+  struct sql_async_query *q = async_head;
+  PGresult *qres, *last = NULL;
+
+  if (!q || !q->sent) {
+    return;
+  }
+
+  if (!block) {
+    if (!PQconsumeInput(postgres_connp)) {
+      sql_async_lost();
+      return;
+    }
+    if (PQisBusy(postgres_connp)) {
+      return;
+    }
+  }
+
+  async_head = q->next;
+  if (!async_head) {
+    async_tail = NULL;
+  }
+
+  /* Use the last result of a multi-statement query, like PQexec()
+   * does, unless one failed. The rest have to be read anyway. */
+  while ((qres = PQgetResult(postgres_connp))) {
+    if (last && PQresultStatus(last) != PGRES_COMMAND_OK &&
+        PQresultStatus(last) != PGRES_TUPLES_OK) {
+      PQclear(qres);
+      continue;
+    }
+    PQclear(last);
+    last = qres;
+  }
+
+  if (last) {
+    switch (PQresultStatus(last)) {
+    case PGRES_TUPLES_OK:
+      mapsql_queue_rows(&q->target, last);
+      break;
+    case PGRES_COMMAND_OK:
+      notify_format(q->target.executor, T("SQL: %d rows affected."),
+                    atoi(PQcmdTuples(last)));
+      PQclear(last);
+      break;
+    default:
+      notify_format(q->target.executor, T("SQL: Error: %s"),
+                    PQresultErrorMessage(last));
+      PQclear(last);
+      break;
+    }
+  }
+
+  free_async_query(q);
+  if (PQstatus(postgres_connp) == CONNECTION_BAD) {
+    queue_event(SYSEVENT, "SQL`DISCONNECT", "%s,%s", "postgresql",
+                PQerrorMessage(postgres_connp));
+    sql_async_reconnect();
+  }
+  sql_async_pump();
+}
+
+/* The connection failed while the in-flight async query was waiting
+ * on it. Tell its executor, and reconnect for the ones behind it. */
+static void
+sql_async_lost(void)
+{
+  struct sql_async_query *q = async_head;
+
+  queue_event(SYSEVENT, "SQL`DISCONNECT", "%s,%s", "postgresql",
+              PQerrorMessage(postgres_connp));
+  notify_format(q->target.executor, T("SQL: Error: %s"),
+                PQerrorMessage(postgres_connp));
+  async_head = q->next;
+  if (!async_head) {
+    async_tail = NULL;
+  }
+  free_async_query(q);
+  sql_async_reconnect();
+  sql_async_pump();
+}
+
+/* Replace a broken connection. Queries that haven't been sent yet are
+ * kept, instead of penn_pg_sql_shutdown() throwing them away. */
+static void
+sql_async_reconnect(void)
+{
+  struct sql_async_query *head = async_head, *tail = async_tail;
+
+  async_head = async_tail = NULL;
+  penn_pg_sql_init();
+  if (penn_pg_sql_connected() &&
+      PQstatus(postgres_connp) == CONNECTION_BAD) {
+    /* Too soon to retry; the next query will. */
+    penn_pg_sql_shutdown();
+  }
+  async_head = head;
+  async_tail = tail;
+}
+
+/* Throw away all pending async queries, telling their executors why. */
+static void
+sql_async_abort(const char *why)
+{
+  struct sql_async_query *q, *next;
+
+  for (q = async_head; q; q = next) {
+    next = q->next;
+    notify_format(q->target.executor, T("SQL: Error: %s"), why);
+    free_async_query(q);
+  }
+  async_head = async_tail = NULL;
+}
 #endif /* HAVE_POSTGRESQL */
 
 void sql_regexp_fun(sqlite3_context *, int, sqlite3_value **);
@@ -1,6 +1,6 @@
 /* AUTOGENERATED FILE. DO NOT EDIT! */
-static const int max_switch = 193;
-SWITCH_VALUE switch_list[194] = {
+static const int max_switch = 194;
+SWITCH_VALUE switch_list[195] = {
   {"ACCESS", SWITCH_ACCESS, 0},
   {"ADD", SWITCH_ADD, 0},
   {"AFTER", SWITCH_AFTER, 0},
@@ -8,6 +8,7 @@ SWITCH_VALUE switch_list[194] = {
   {"ALL", SWITCH_ALL, 0},
   {"ALLOCATIONS", SWITCH_ALLOCATIONS, 0},
   {"ANY", SWITCH_ANY, 0},
+  {"ASYNC", SWITCH_ASYNC, 0},
   {"ATTRIBS", SWITCH_ATTRIBS, 0},
   {"BAN", SWITCH_BAN, 0},
   {"BEFORE", SWITCH_BEFORE, 0},
@@ -14,6 +14,7 @@
 #include <string.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #ifdef TIME_WITH_SYS_TIME
@@ -46,6 +47,7 @@
 #include "parse.h"
 #include "sig.h"
 #include "strutil.h"
+#include "tests.h"
 
 bool inactivity_check(void);
 static void migrate_stuff(int amount);
@@ -385,9 +387,86 @@ reset_cpu_timer(void)
 }
 
 /** System queue stuff. Timed events like dbcks and purges are handled
- *  through this system. */
+ *  through this system. Pending events are kept in a binary min-heap
+ *  ordered by run time, so registering and cancelling are O(log n) and
+ *  finding the next event is O(1). */
+
+static struct squeue **sq_heap = NULL; /**< The heap array */
+static int sq_count = 0;               /**< Number of pending events */
+static int sq_size = 0;                /**< Allocated size of sq_heap */
+static uint64_t sq_seq = 0;            /**< Registration counter */
+
+/* Statistics for @uptime */
+static uint64_t sq_ran = 0;       /**< Number of events run */
+static uint64_t sq_lag_total = 0; /**< Total msecs events ran late */
+static uint64_t sq_lag_max = 0;   /**< Most msecs an event ran late */
+
+/* Does a need to run before b? */
+static inline bool
+sq_before(const struct squeue *a, const struct squeue *b)
+{
+  return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static inline void
+sq_place(struct squeue *sq, int slot)
+{
+  sq_heap[slot] = sq;
+  sq->slot = slot;
+}
+
+/* Move the event in a slot up towards the root until it's in order. */
+static void
+sq_sift_up(int slot)
+{
+  struct squeue *sq = sq_heap[slot];
+
+  while (slot > 0) {
+    int parent = (slot - 1) / 2;
+    if (!sq_before(sq, sq_heap[parent]))
+      break;
+    sq_place(sq_heap[parent], slot);
+    slot = parent;
+  }
+  sq_place(sq, slot);
+}
+
+/* Move the event in a slot down towards the leaves until it's in order. */
+static void
+sq_sift_down(int slot)
+{
+  struct squeue *sq = sq_heap[slot];
+
+  for (;;) {
+    int child = slot * 2 + 1;
+    if (child >= sq_count)
+      break;
+    if (child + 1 < sq_count && sq_before(sq_heap[child + 1], sq_heap[child]))
+      child += 1;
+    if (!sq_before(sq_heap[child], sq))
+      break;
+    sq_place(sq_heap[child], slot);
+    slot = child;
+  }
+  sq_place(sq, slot);
+}
 
-struct squeue *sq_head = NULL;
+/* Take an event out of the heap. */
+static void
+sq_remove(struct squeue *sq)
+{
+  int slot = sq->slot;
+
+  sq_count -= 1;
+  if (slot != sq_count) {
+    sq_place(sq_heap[sq_count], slot);
+    if (slot > 0 && sq_before(sq_heap[slot], sq_heap[(slot - 1) / 2]))
+      sq_sift_up(slot);
+    else
+      sq_sift_down(slot);
+  }
+  sq->slot = -1;
+}
 
 /** Register a callback function to be executed at a certain time.
  * \param w when to run the event
@@ -404,30 +483,20 @@ sq_register(uint64_t w, sq_func f, void *d, const char *ev)
   sq = mush_malloc(sizeof *sq, "squeue.node");
 
   sq->when = w;
+  sq->seq = sq_seq++;
   sq->fun = f;
   sq->data = d;
   if (ev)
     sq->event = strupper_a(ev, "squeue.event");
   else
     sq->event = NULL;
-  sq->next = NULL;
 
-  if (!sq_head)
-    sq_head = sq;
-  else if (sq_head->when > sq->when) {
-    sq->next = sq_head;
-    sq_head = sq;
-  } else {
-    struct squeue *c, *prev = NULL;
-    for (prev = sq_head, c = sq_head->next; c; prev = c, c = c->next) {
-      if (c->when > sq->when) {
-        sq->next = c;
-        prev->next = sq;
-        return sq;
-      }
-    }
-    prev->next = sq;
+  if (sq_count == sq_size) {
+    sq_size = sq_size ? sq_size * 2 : 32;
+    sq_heap = mush_realloc(sq_heap, sizeof *sq_heap * sq_size, "squeue.heap");
   }
+  sq_place(sq, sq_count++);
+  sq_sift_up(sq->slot);
 
   return sq;
 }
@@ -438,25 +507,53 @@ sq_register(uint64_t w, sq_func f, void *d, const char *ev)
 void
 sq_cancel(struct squeue *sq)
 {
-  struct squeue *tmp, *prev = NULL;
-
-  if (!sq)
+  if (!sq || sq->slot < 0 || sq->slot >= sq_count || sq_heap[sq->slot] != sq)
     return;
 
-  /* Remove from list */
-  for (tmp = sq_head; tmp; tmp = tmp->next) {
-    if (tmp == sq) {
-      if (prev)
-        prev->next = tmp->next;
-      else
-        sq_head = tmp->next;
-      if (sq->event)
-        mush_free(sq->event, "squeue.event");
-      mush_free(sq, "squeue.node");
-      return;
-    }
-    prev = tmp;
+  sq_remove(sq);
+  if (sq->event)
+    mush_free(sq->event, "squeue.event");
+  mush_free(sq, "squeue.node");
+}
+
+static bool
+sq_test_fun(void *data __attribute__((__unused__)))
+{
+  return false;
+}
+
+TEST_GROUP(sq_register)
+{
+  struct squeue *sq[5];
+  uint64_t base = now_msecs() + SECS_TO_MSECS(86400 * 365);
+  int before = sq_count, n;
+
+  sq[0] = sq_register(base + 50, sq_test_fun, NULL, NULL);
+  sq[1] = sq_register(base + 10, sq_test_fun, NULL, NULL);
+  sq[2] = sq_register(base + 40, sq_test_fun, NULL, NULL);
+  sq[3] = sq_register(base + 10, sq_test_fun, NULL, NULL);
+  sq[4] = sq_register(base + 30, sq_test_fun, NULL, NULL);
+  TEST("sq_register.1", sq_count == before + 5);
+  if (before == 0) {
+    TEST("sq_register.2", sq_heap[0] == sq[1]);
+    sq_cancel(sq[1]);
+    TEST("sq_register.3", sq_heap[0] == sq[3]);
+    sq_cancel(sq[3]);
+    TEST("sq_register.4", sq_heap[0] == sq[4]);
+  } else {
+    sq_cancel(sq[1]);
+    sq_cancel(sq[3]);
   }
+  sq_cancel(sq[2]);
+  TEST("sq_register.5", sq_count == before + 2);
+  for (n = 0; n < sq_count; n++) {
+    TEST("sq_register.6",
+         n == 0 || !sq_before(sq_heap[n], sq_heap[(n - 1) / 2]));
+    TEST("sq_register.7", sq_heap[n]->slot == n);
+  }
+  sq_cancel(sq[0]);
+  sq_cancel(sq[4]);
+  TEST("sq_register.8", sq_count == before);
 }
 
 /** Register a callback function to be executed in N miliseconds.
@@ -525,10 +622,16 @@ sq_run_one(void)
   struct squeue *torun;
   bool r;
 
-  if (sq_head) {
-    if (sq_head->when <= now) {
-      torun = sq_head;
-      sq_head = torun->next;
+  if (sq_count > 0) {
+    torun = sq_heap[0];
+    if (torun->when <= now) {
+      uint64_t lag = now - torun->when;
+
+      sq_remove(torun);
+      sq_ran += 1;
+      sq_lag_total += lag;
+      if (lag > sq_lag_max)
+        sq_lag_max = lag;
 
       r = torun->fun(torun->data);
       if (torun->event) {
@@ -559,12 +662,36 @@ sq_run_all(void)
   return any;
 }
 
+/** How long until the next system queue event is due.
+ * \return milliseconds until the next event, 0 if one is overdue.
+ */
 uint64_t
 sq_msecs_till_next(void)
 {
   uint64_t now = now_msecs();
-  if (sq_head) {
-    return sq_head->when - now;
+  if (sq_count > 0) {
+    if (sq_heap[0]->when <= now)
+      return 0;
+    return sq_heap[0]->when - now;
   }
   return 500;
 }
+
+/** Report on the system queue, for @uptime.
+ * \param player the enactor.
+ */
+void
+sq_stats(dbref player)
+{
+  uint64_t now = now_msecs();
+
+  notify_format(player, T("%29s: %d pending, next in %" PRIu64 " ms."),
+                T("System timer events"), sq_count,
+                sq_count > 0 && sq_heap[0]->when > now ? sq_heap[0]->when - now
+                                                       : 0);
+  notify_format(player,
+                T("%29s: %" PRIu64 " run, %" PRIu64 " ms average lag, %" PRIu64
+                  " ms max lag."),
+                T("System timer history"), sq_ran,
+                sq_ran ? sq_lag_total / sq_ran : 0, sq_lag_max);
+}
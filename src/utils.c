@@ -95,6 +95,23 @@ now_msecs()
   return (1000ULL * tv.tv_sec) + (tv.tv_usec / 1000UL);
 }
 
+/* Returns microseconds from a monotonic clock, for timing things. */
+uint64_t
+mono_usecs(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (1000000ULL * ts.tv_sec) + (ts.tv_nsec / 1000UL);
+#endif
+  {
+    struct timeval tv;
+    penn_gettimeofday(&tv);
+    return (1000000ULL * tv.tv_sec) + tv.tv_usec;
+  }
+}
+
 /** Parse object/attribute strings into components.
  * This function takes a string which is of the format obj/attr or attr,
  * and returns the dbref of the object, and a pointer to the attribute.
@@ -8,6 +8,7 @@
 #include "copyrite.h"
 
 #include "config.h"
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <openssl/sha.h>
@@ -21,6 +22,7 @@
 #include "notify.h"
 #include "mymalloc.h"
 #include "connlog.h"
+#include "dbio.h"
 #include "websock.h"
 
 /* Length of 16 bytes, Base64 encoded (with padding). */
@@ -49,6 +51,328 @@ enum WebSocketOp {
   /* 0xB - 0xF reserved for control frames */
 };
 
+/* WebSocket frame header bits. */
+#define WS_FIN 0x80  /* last frame of a message */
+#define WS_RSV1 0x40 /* message is compressed (permessage-deflate) */
+
+/* permessage-deflate (RFC 7692) parameters agreed with a client. */
+#define WS_DEFLATE_SERVER_NO_TAKEOVER 0x1 /* we reset after each message */
+#define WS_DEFLATE_CLIENT_NO_TAKEOVER 0x2 /* the client does */
+#define WS_DEFLATE_SERVER_BITS 0x4 /* client limited our window size */
+
+/* Length of the permessage-deflate window. */
+#define WS_DEFLATE_WINDOW (1 << 15)
+
+#ifdef HAVE_LIBZ
+/* Messages shorter than this are sent uncompressed. */
+#define WS_DEFLATE_MIN_LEN 16
+
+/* Decompressed input buffer growth. */
+#define WS_INFLATE_CHUNK 4096
+
+/* Most decompressed input one read may produce. More than this closes
+ * the connection, so a small deflate bomb can't take all our memory. */
+#define WS_INFLATE_MAX (BUFFER_LEN * 64)
+
+/* permessage-deflate state of a websocket connection. Each compressed
+ * message is deflated data ending in an empty stored block, with that
+ * block's 00 00 ff ff left off. With context takeover, one stream
+ * carries all the messages in a direction, so later ones can refer
+ * back to earlier ones. Outgoing messages are compressed as they are
+ * queued, and incoming ones as their frames arrive. */
+struct ws_deflate {
+  int params;      /**< WS_DEFLATE_* flags agreed with the client */
+  int window_bits; /**< Window size of our stream */
+  int in_message;  /**< Partway through an incoming message? */
+  z_stream out;    /**< Compresses outgoing messages */
+  z_stream in;     /**< Decompresses incoming messages */
+  char *inbuf;     /**< Decompressed input */
+  size_t inbuf_size;     /**< Size of inbuf */
+  unsigned long raw_out; /**< Bytes of messages compressed */
+  unsigned long zip_out; /**< Bytes they were compressed to */
+  unsigned long raw_in;  /**< Bytes of messages decompressed */
+  unsigned long zip_in;  /**< Bytes they were decompressed from */
+};
+
+/* Set up compression for a descriptor. Returns NULL if zlib can't. */
+static struct ws_deflate *
+new_websocket_deflate(DESC *d, int params, int window_bits)
+{
+  struct ws_deflate *z;
+
+  z = mush_malloc(sizeof(struct ws_deflate), "ws_deflate");
+  if (!z)
+    mush_panic("Out of memory.");
+  memset(z, 0, sizeof(struct ws_deflate));
+  z->params = params;
+  z->window_bits = window_bits;
+  if (deflateInit2(&z->out, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -window_bits,
+                   8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    do_rawlog_lvl(LT_CONN, MLOG_ERR,
+                  "[%d/%s/%s] Unable to start permessage-deflate: %s",
+                  d->descriptor, d->addr, d->ip,
+                  z->out.msg ? z->out.msg : "out of memory");
+    mush_free(z, "ws_deflate");
+    return NULL;
+  }
+  if (inflateInit2(&z->in, -MAX_WBITS) != Z_OK) {
+    do_rawlog_lvl(LT_CONN, MLOG_ERR,
+                  "[%d/%s/%s] Unable to start permessage-deflate: %s",
+                  d->descriptor, d->addr, d->ip,
+                  z->in.msg ? z->in.msg : "out of memory");
+    deflateEnd(&z->out);
+    mush_free(z, "ws_deflate");
+    return NULL;
+  }
+  return z;
+}
+
+/* Parse a window size parameter, which may be a quoted string. */
+static int
+parse_window_bits(char *value)
+{
+  size_t len;
+
+  if (!value)
+    return -1;
+  value = trim_space_sep(value, ' ');
+  len = strlen(value);
+  if (len > 2 && *value == '"' && value[len - 1] == '"') {
+    value[len - 1] = '\0';
+    value++;
+    len -= 2;
+  }
+  if (len < 1 || len > 2 || !isdigit((unsigned char) value[0]) ||
+      (len == 2 && !isdigit((unsigned char) value[1])))
+    return -1;
+  len = atoi(value);
+  return (len >= 8 && len <= 15) ? (int) len : -1;
+}
+
+/* Accept the first acceptable permessage-deflate offer in a
+ * Sec-WebSocket-Extensions header. An offer is the extension name and
+ * its parameters separated by semicolons, and offers are separated by
+ * commas. */
+static void
+negotiate_deflate(DESC *d, const char *header)
+{
+  char buf[BUFFER_LEN];
+  char *offer, *next;
+
+  if (d->ws_deflate || !options.ws_deflate)
+    return;
+  mush_strncpy(buf, header, sizeof buf);
+
+  for (offer = buf; offer; offer = next) {
+    char *param, *pnext;
+    int params = 0, bits = MAX_WBITS, seen = 0, ok = 1;
+
+    if ((next = strchr(offer, ',')))
+      *next++ = '\0';
+    if ((pnext = strchr(offer, ';')))
+      *pnext++ = '\0';
+    if (strcasecmp(trim_space_sep(offer, ' '), "permessage-deflate"))
+      continue;
+
+    for (param = pnext; ok && param; param = pnext) {
+      char *value;
+      int flag;
+
+      if ((pnext = strchr(param, ';')))
+        *pnext++ = '\0';
+      if ((value = strchr(param, '=')))
+        *value++ = '\0';
+      param = trim_space_sep(param, ' ');
+
+      if (!strcasecmp(param, "server_no_context_takeover")) {
+        flag = 0x1;
+        ok = !value;
+        params |= WS_DEFLATE_SERVER_NO_TAKEOVER;
+      } else if (!strcasecmp(param, "client_no_context_takeover")) {
+        flag = 0x2;
+        ok = !value;
+        params |= WS_DEFLATE_CLIENT_NO_TAKEOVER;
+      } else if (!strcasecmp(param, "server_max_window_bits")) {
+        /* zlib can't make raw deflate data with a 256-byte window. */
+        flag = 0x4;
+        bits = parse_window_bits(value);
+        ok = bits > 8;
+        params |= WS_DEFLATE_SERVER_BITS;
+      } else if (!strcasecmp(param, "client_max_window_bits")) {
+        /* We always accept the largest window, so no reply is needed. */
+        flag = 0x8;
+        ok = !value || parse_window_bits(value) > 0;
+      } else {
+        flag = 0;
+        ok = 0;
+      }
+      if (seen & flag)
+        ok = 0;
+      seen |= flag;
+    }
+    if (!ok)
+      continue;
+
+    if (!options.ws_deflate_takeover)
+      params |=
+        WS_DEFLATE_SERVER_NO_TAKEOVER | WS_DEFLATE_CLIENT_NO_TAKEOVER;
+    d->ws_deflate = new_websocket_deflate(d, params, bits);
+    return;
+  }
+}
+
+/* Write the Sec-WebSocket-Extensions header accepting permessage-deflate. */
+static char *
+write_deflate_response(struct ws_deflate *z, char *bp, char *const bend)
+{
+  bp += snprintf(bp, bend - bp,
+                 "Sec-WebSocket-Extensions: permessage-deflate%s%s",
+                 (z->params & WS_DEFLATE_SERVER_NO_TAKEOVER)
+                   ? "; server_no_context_takeover"
+                   : "",
+                 (z->params & WS_DEFLATE_CLIENT_NO_TAKEOVER)
+                   ? "; client_no_context_takeover"
+                   : "");
+  if (z->params & WS_DEFLATE_SERVER_BITS) {
+    bp += snprintf(bp, bend - bp, "; server_max_window_bits=%d",
+                   z->window_bits);
+  }
+  memcpy(bp, "\r\n", 2);
+  return bp + 2;
+}
+
+/* Compress a message's payload, the channel byte and then the text,
+ * into dst. Returns the compressed length, or 0 if there wasn't room. */
+static size_t
+deflate_message(struct ws_deflate *z, char *dst, size_t room, char channel,
+                const char *src, size_t srclen)
+{
+  size_t len;
+
+  /* An empty stored block, 5 bytes or fewer, ends the message. */
+  if (deflateBound(&z->out, 1 + srclen) + 6 > room)
+    return 0;
+
+  z->out.next_out = (Bytef *) dst;
+  z->out.avail_out = room;
+  z->out.next_in = (Bytef *) &channel;
+  z->out.avail_in = 1;
+  deflate(&z->out, Z_NO_FLUSH);
+  z->out.next_in = (Bytef *) src;
+  z->out.avail_in = srclen;
+  deflate(&z->out, Z_SYNC_FLUSH);
+
+  /* Leave off the 00 00 ff ff. */
+  len = room - z->out.avail_out - 4;
+  if (z->params & WS_DEFLATE_SERVER_NO_TAKEOVER)
+    deflateReset(&z->out);
+  z->raw_out += 1 + srclen;
+  z->zip_out += len;
+  return len;
+}
+
+/* Make room for at least n more bytes of decompressed input after wp,
+ * which points into (or at the start of) inbuf. Returns where wp is now,
+ * or NULL if that would make inbuf bigger than WS_INFLATE_MAX. */
+static char *
+inbuf_reserve(struct ws_deflate *z, char *wp, size_t n)
+{
+  size_t used = wp - z->inbuf;
+
+  if (used + n > WS_INFLATE_MAX)
+    return NULL;
+  if (used + n > z->inbuf_size) {
+    size_t size = z->inbuf_size ? z->inbuf_size : WS_INFLATE_CHUNK;
+    char *inbuf;
+
+    while (size < used + n)
+      size *= 2;
+    if (size > WS_INFLATE_MAX)
+      size = WS_INFLATE_MAX;
+    inbuf = mush_realloc(z->inbuf, size, "ws_inflate_buf");
+    if (!inbuf)
+      mush_panic("Out of memory.");
+    z->inbuf = inbuf;
+    z->inbuf_size = size;
+  }
+  return z->inbuf + used;
+}
+
+/* Decompress len bytes of a compressed message's payload onto the
+ * input at wp, finishing the message if fin is set, and leave room for
+ * reserve more bytes after it. first is the frame parser's channel
+ * state, as for uncompressed payload. Returns the new end of the input,
+ * or NULL if the data is bad or decompresses to too much. */
+static char *
+inflate_payload(DESC *d, char *wp, char *src, size_t len, int fin,
+                unsigned char *first, size_t reserve)
+{
+  static char flush_point[4] = {0, 0, '\xff', '\xff'};
+  struct ws_deflate *z = d->ws_deflate;
+  size_t start = wp - z->inbuf;
+  char *p;
+  int pass, r;
+
+  z->zip_in += len;
+  z->in.next_in = (Bytef *) src;
+  z->in.avail_in = len;
+  for (pass = 0; pass < 2; pass++) {
+    if (pass) {
+      if (!fin)
+        break;
+      /* Put back the end of the message's last block. */
+      z->in.next_in = (Bytef *) flush_point;
+      z->in.avail_in = sizeof flush_point;
+    }
+    do {
+      size_t room;
+
+      wp = inbuf_reserve(z, wp, WS_INFLATE_CHUNK);
+      if (!wp)
+        goto too_long;
+      room = z->inbuf_size - (wp - z->inbuf);
+      z->in.next_out = (Bytef *) wp;
+      z->in.avail_out = room;
+      r = inflate(&z->in, Z_SYNC_FLUSH);
+      wp += room - z->in.avail_out;
+      if (r == Z_STREAM_END) {
+        /* A final block ends the stream; there's nothing after it. */
+        inflateReset(&z->in);
+        z->in.avail_in = 0;
+      } else if (r != Z_OK && r != Z_BUF_ERROR) {
+        do_rawlog_lvl(LT_CONN, MLOG_ERR,
+                      "[%d/%s/%s] Bad permessage-deflate input: %s",
+                      d->descriptor, d->addr, d->ip,
+                      z->in.msg ? z->in.msg : "unknown error");
+        return NULL;
+      }
+    } while (z->in.avail_in > 0 || z->in.avail_out == 0);
+  }
+  z->in_message = !fin;
+
+  /* The first byte of a message is its channel. */
+  p = z->inbuf + start;
+  z->raw_in += wp - p;
+  if (*first == 1 && wp > p) {
+    *first = (*p == WEBSOCKET_CHANNEL_TEXT) ? 0 : 2;
+    memmove(p, p + 1, wp - p - 1);
+    wp--;
+  }
+  if (*first == 2)
+    wp = p;
+
+  wp = inbuf_reserve(z, wp, reserve);
+  if (wp)
+    return wp;
+
+too_long:
+  do_rawlog_lvl(LT_CONN, MLOG_ERR,
+                "[%d/%s/%s] permessage-deflate input too long.", d->descriptor,
+                d->addr, d->ip);
+  return NULL;
+}
+#endif /* HAVE_LIBZ */
+
 /* Base64 encoder. PennMUSH's version uses the heavyweight OpenSSL API. */
 static void
 encode64(char *dst, const char *src, size_t srclen)
@@ -148,8 +472,17 @@ complete_handshake(DESC *d)
   compute_websocket_accept(bp, d->checksum);
   bp += WEBSOCKET_ACCEPT_LEN;
 
-  memcpy(bp, "\r\n\r\n", 4);
-  bp += 4;
+  memcpy(bp, "\r\n", 2);
+  bp += 2;
+
+#ifdef HAVE_LIBZ
+  if (d->ws_deflate) {
+    bp = write_deflate_response(d->ws_deflate, bp, buf + sizeof buf);
+  }
+#endif
+
+  memcpy(bp, "\r\n", 2);
+  bp += 2;
 
   queue_newwrite(d, buf, bp - buf);
 
@@ -172,8 +505,8 @@ complete_handshake(DESC *d)
 
   connlog_set_websocket(d->connlog_id);
 
-  do_rawlog(LT_CONN, "[%d/%s/%s] Switching to Websocket mode.", d->descriptor,
-            d->addr, d->ip);
+  do_rawlog(LT_CONN, "[%d/%s/%s] Switching to Websocket mode%s.", d->descriptor,
+            d->addr, d->ip, d->ws_deflate ? " with permessage-deflate" : "");
 }
 
 int
@@ -196,11 +529,14 @@ int
 process_websocket_request(DESC *d, const char *command)
 {
   static const char *const KEY_HEADER = "Sec-WebSocket-Key:";
+  static const char *const EXTENSIONS_HEADER = "Sec-WebSocket-Extensions:";
 
   static size_t KEY_HEADER_LEN = 0;
+  static size_t EXTENSIONS_HEADER_LEN = 0;
 
   if (!KEY_HEADER_LEN) {
     KEY_HEADER_LEN = strlen(KEY_HEADER);
+    EXTENSIONS_HEADER_LEN = strlen(EXTENSIONS_HEADER);
   }
 
   /* TODO: Full implementation should verify entire request. */
@@ -222,20 +558,40 @@ process_websocket_request(DESC *d, const char *command)
     }
   }
 
+#ifdef HAVE_LIBZ
+  if (strncasecmp(command, EXTENSIONS_HEADER, EXTENSIONS_HEADER_LEN) == 0) {
+    negotiate_deflate(d, command + EXTENSIONS_HEADER_LEN);
+  }
+#endif
+
   return 1;
 }
 
+/* Unmask and unframe websocket input in *bufp. Text is left in place,
+ * unless the connection uses permessage-deflate, when *bufp is pointed
+ * at the decompressed text instead. Returns the length of the text, or
+ * -1 if the connection must be closed. */
 int
-process_websocket_frame(DESC *d, char *tbuf1, int got)
+process_websocket_frame(DESC *d, char **bufp, int got)
 {
   char mask[1 + 4 + 1 + 1];
   unsigned char state, type, first, channel;
   uint64_t len;
+  char *tbuf1 = *bufp;
   char *wp;
   const char *cp, *end;
   enum WebSocketOp op;
-
-  wp = tbuf1;
+  char *zp = tbuf1; /* Compressed payload unmasked so far */
+#ifdef HAVE_LIBZ
+  struct ws_deflate *z = d->ws_deflate;
+
+  if (z) {
+    wp = inbuf_reserve(z, z->inbuf, got);
+    if (!wp)
+      return -1;
+  } else
+#endif
+    wp = tbuf1;
 
   /* Restore state. */
   memcpy(mask, d->checksum, sizeof(mask));
@@ -246,7 +602,7 @@ process_websocket_frame(DESC *d, char *tbuf1, int got)
 
   /* Process buffer bytes. */
   for (cp = tbuf1, end = tbuf1 + got; cp != end; ++cp) {
-    const unsigned char ch = *cp;
+    unsigned char ch = *cp;
 
     switch (state++) {
     case 4:
@@ -259,6 +615,8 @@ process_websocket_frame(DESC *d, char *tbuf1, int got)
         /* TODO: Error handling (only data frames can be continued). */
         first = 0;
         op = type & 0x0F;
+        /* Only the first frame says whether a message is compressed. */
+        ch = (ch & ~WS_RSV1) | (type & WS_RSV1);
         break;
 
       case WS_OP_TEXT:
@@ -272,6 +630,11 @@ process_websocket_frame(DESC *d, char *tbuf1, int got)
         break;
       }
 
+      if (!d->ws_deflate || op >= WS_OP_CLOSE) {
+        /* Only data messages on a deflate connection are compressed. */
+        ch &= ~WS_RSV1;
+      }
+
       type = (ch & 0xF0) | op;
       break;
 
@@ -339,32 +702,45 @@ process_websocket_frame(DESC *d, char *tbuf1, int got)
         /* Empty payload. */
         state = 4;
 
+#ifdef HAVE_LIBZ
+        if (type & WS_RSV1) {
+          wp = inflate_payload(d, wp, tbuf1, 0, type & WS_FIN, &first,
+                               end - cp);
+          if (!wp)
+            return -1;
+        }
+#endif
         /* TODO: Handle end of frame. */
       }
       break;
 
     default:
       /* Payload data; handle according to opcode. */
-      switch (first) {
-      case 0:
-        /* Continue frame. */
-        *wp++ = ch ^ mask[state];
-        break;
-
-      case 1:
-        /* Channel byte. */
-        first = 0;
-        channel = ch ^ mask[state];
+      if (type & WS_RSV1) {
+        /* Compressed; unmask in place and inflate at the end of the frame. */
+        *zp++ = ch ^ mask[state];
+      } else {
+        switch (first) {
+        case 0:
+          /* Continue frame. */
+          *wp++ = ch ^ mask[state];
+          break;
+
+        case 1:
+          /* Channel byte. */
+          first = 0;
+          channel = ch ^ mask[state];
+
+          if (channel != WEBSOCKET_CHANNEL_TEXT) {
+            /* TODO: Support other channel types later. */
+            first = 2;
+          }
+          break;
 
-        if (channel != WEBSOCKET_CHANNEL_TEXT) {
-          /* TODO: Support other channel types later. */
-          first = 2;
+        case 2:
+          /* Ignore channel. */
+          break;
         }
-        break;
-
-      case 2:
-        /* Ignore channel. */
-        break;
       }
 
       if (--len) {
@@ -374,12 +750,30 @@ process_websocket_frame(DESC *d, char *tbuf1, int got)
         /* Last payload byte. */
         state = 4;
 
+#ifdef HAVE_LIBZ
+        if (type & WS_RSV1) {
+          wp = inflate_payload(d, wp, tbuf1, zp - tbuf1, type & WS_FIN, &first,
+                               end - cp);
+          if (!wp)
+            return -1;
+          zp = tbuf1;
+        }
+#endif
         /* TODO: Handle end of frame. */
       }
       break;
     }
   }
 
+#ifdef HAVE_LIBZ
+  if (zp != tbuf1) {
+    /* The rest of this frame's payload hasn't arrived yet. */
+    wp = inflate_payload(d, wp, tbuf1, zp - tbuf1, 0, &first, 0);
+    if (!wp)
+      return -1;
+  }
+#endif
+
   /* Preserve state. */
   mask[0] = state;
   mask[5] = type;
@@ -387,16 +781,159 @@ process_websocket_frame(DESC *d, char *tbuf1, int got)
   memcpy(d->checksum, mask, sizeof(mask));
   d->ws_frame_len = len;
 
+#ifdef HAVE_LIBZ
+  if (z) {
+    *bufp = z->inbuf;
+    return wp - z->inbuf;
+  }
+#endif
   return wp - tbuf1;
 }
 
+/* Called once the text from process_websocket_frame() has been
+ * handled. Frees a decompressed input buffer that grew past its usual
+ * size, so a connection doesn't hold on to memory for one big message. */
+void
+websocket_input_done(DESC *d)
+{
+#ifdef HAVE_LIBZ
+  struct ws_deflate *z = d->ws_deflate;
+
+  if (z && z->inbuf_size > WS_INFLATE_CHUNK) {
+    mush_free(z->inbuf, "ws_inflate_buf");
+    z->inbuf = NULL;
+    z->inbuf_size = 0;
+  }
+#endif
+}
+
+/* Bytes saved so far by permessage-deflate on a descriptor. */
+long
+websocket_deflate_saved(DESC *d)
+{
+#ifdef HAVE_LIBZ
+  struct ws_deflate *z = d->ws_deflate;
+
+  if (z) {
+    return (long) (z->raw_out - z->zip_out) + (long) (z->raw_in - z->zip_in);
+  }
+#endif
+  return 0;
+}
+
+/* Log how much permessage-deflate saved on a descriptor, and free its
+ * state. */
+void
+free_websocket_deflate(DESC *d)
+{
+#ifdef HAVE_LIBZ
+  struct ws_deflate *z = d->ws_deflate;
+
+  if (!z) {
+    return;
+  }
+
+  do_rawlog_lvl(LT_CONN, MLOG_INFO,
+                "[%d/%s/%s] permessage-deflate sent %lu bytes as %lu, "
+                "received %lu as %lu.",
+                d->descriptor, d->addr, d->ip, z->raw_out, z->zip_out,
+                z->raw_in, z->zip_in);
+  deflateEnd(&z->out);
+  inflateEnd(&z->in);
+  if (z->inbuf) {
+    mush_free(z->inbuf, "ws_inflate_buf");
+  }
+  mush_free(z, "ws_deflate");
+  d->ws_deflate = NULL;
+#endif
+}
+
+/* A reboot keeps permessage-deflate going by saving the parameters
+ * agreed with the client and the last 32K of decompressed input. Our
+ * own stream starts again afterwards; the client can read messages
+ * that don't refer back to anything. The client's stream can only be
+ * picked up between messages, where it needs nothing but that window.
+ */
+void
+save_websocket_deflate(PENNFILE *f, DESC *d)
+{
+#ifdef HAVE_LIBZ
+  struct ws_deflate *z = d->ws_deflate;
+
+  if (!z) {
+    putref(f, 0);
+    return;
+  }
+
+  putref(f, z->window_bits);
+  putref(f, z->params);
+  if (z->in_message) {
+    putref(f, -1);
+  } else if (z->params & WS_DEFLATE_CLIENT_NO_TAKEOVER) {
+    putref(f, 0);
+  } else {
+#if ZLIB_VERNUM >= 0x1280
+    unsigned char window[WS_DEFLATE_WINDOW];
+    uInt len = 0;
+
+    if (inflateGetDictionary(&z->in, window, &len) == Z_OK) {
+      putref(f, len);
+      penn_fwrite(window, len, f);
+      return;
+    }
+#endif
+    putref(f, -1);
+  }
+#else
+  putref(f, 0);
+#endif
+}
+
+/* Load a descriptor's permessage-deflate state from the reboot db.
+ * Returns 0 if the client's messages can't be decompressed any more. */
+int
+load_websocket_deflate(PENNFILE *f, DESC *d)
+{
+  unsigned char window[WS_DEFLATE_WINDOW];
+  int window_bits, params, len;
+
+  d->ws_deflate = NULL;
+  window_bits = getref(f);
+  if (!window_bits) {
+    return 1;
+  }
+  params = getref(f);
+  len = getref(f);
+  if (len > WS_DEFLATE_WINDOW ||
+      (len > 0 && penn_fread(window, len, f) != (size_t) len)) {
+    longjmp(db_err, 1);
+  }
+  if (len < 0) {
+    return 0;
+  }
+
+#ifdef HAVE_LIBZ
+  d->ws_deflate = new_websocket_deflate(d, params, window_bits);
+  if (d->ws_deflate && len > 0 &&
+      inflateSetDictionary(&d->ws_deflate->in, window, len) != Z_OK) {
+    free_websocket_deflate(d);
+  }
+  return d->ws_deflate != NULL;
+#else
+  (void) params;
+  return 0;
+#endif
+}
+
 static char *
-write_message(char *dst, char *const dstend, const char *src,
+write_message(DESC *d, char *dst, char *const dstend, const char *src,
               const char *const srcend, char channel)
 {
   size_t dstlen = dstend - dst;
   size_t srclen = srcend - src;
   enum WebSocketOp op;
+  unsigned char head;
+  char *payload = NULL;
 
   /* Check bounds. */
   dstlen = dstend - dst;
@@ -416,10 +953,26 @@ write_message(char *dst, char *const dstend, const char *src,
     srclen = dstlen;
   }
 
-  /* Write frame header. */
   op = WS_OP_TEXT;
   dstlen = 1 + srclen;
-  *dst++ = 0x80 | op;
+  head = WS_FIN | op;
+
+#ifdef HAVE_LIBZ
+  if (d->ws_deflate && dstlen >= WS_DEFLATE_MIN_LEN) {
+    /* Compress after room for the largest header, and move it back once
+     * the header's size is known. Too big a message goes uncompressed. */
+    size_t ziplen = deflate_message(d->ws_deflate, dst + 10, dstend - dst - 10,
+                                    channel, src, srclen);
+    if (ziplen) {
+      payload = dst + 10;
+      dstlen = ziplen;
+      head |= WS_RSV1;
+    }
+  }
+#endif
+
+  /* Write frame header. */
+  *dst++ = head;
 
   if (dstlen < 126) {
     *dst++ = dstlen;
@@ -440,6 +993,11 @@ write_message(char *dst, char *const dstend, const char *src,
   }
 
   /* Write frame payload. Note server doesn't mask. */
+  if (payload) {
+    memmove(dst, payload, dstlen);
+    return dst + dstlen;
+  }
+
   if (op == WS_OP_TEXT) {
     *dst++ = channel;
   }
@@ -451,7 +1009,7 @@ write_message(char *dst, char *const dstend, const char *src,
 }
 
 void
-to_websocket_frame(const char **bp, int *np, char channel)
+to_websocket_frame(DESC *d, const char **bp, int *np, char channel)
 {
   /* TODO: Not sure what the largest possible buffer is yet. */
   static char buf[4 * BUFFER_LEN];
@@ -478,7 +1036,8 @@ to_websocket_frame(const char **bp, int *np, char channel)
         }
 
         if (!suppress && start != end) {
-          dst = write_message(dst, dstend, start, end, WEBSOCKET_CHANNEL_TEXT);
+          dst = write_message(d, dst, dstend, start, end,
+                              WEBSOCKET_CHANNEL_TEXT);
         }
 
         tag = end + 1;
@@ -516,7 +1075,7 @@ to_websocket_frame(const char **bp, int *np, char channel)
 
           default:
             /* Unencoded tag. */
-            dst = write_message(dst, dstend, tag, end, channel);
+            dst = write_message(d, dst, dstend, tag, end, channel);
             break;
           }
 
@@ -530,11 +1089,11 @@ to_websocket_frame(const char **bp, int *np, char channel)
 
     /* Send tail. */
     if (!suppress && start != end && !tag) {
-      dst = write_message(dst, dstend, start, end, WEBSOCKET_CHANNEL_TEXT);
+      dst = write_message(d, dst, dstend, start, end, WEBSOCKET_CHANNEL_TEXT);
     }
   } else {
     /* Send entire buffer on specified channel. */
-    dst = write_message(dst, dstend, *bp, *bp + *np, channel);
+    dst = write_message(d, dst, dstend, *bp, *bp + *np, channel);
   }
 
   /* Replace old arguments. */
@@ -26,6 +26,7 @@
 #include "copyrite.h"
 
 #include <ctype.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -33,11 +34,14 @@
 #include "case.h"
 #include "conf.h"
 #include "externs.h"
+#include "htab.h"
 #include "memcheck.h"
 #include "mymalloc.h"
 #include "mypcre.h"
+#include "notify.h"
 #include "parse.h"
 #include "strutil.h"
+#include "tests.h"
 
 /** Force a char to be lowercase */
 #define FIXCASE(a) (DOWNCASE(a))
@@ -52,6 +56,41 @@ pcre2_convert_context *glob_convert_ctx = NULL;
 uint32_t re_compile_flags = 0;
 uint32_t re_match_flags = 0;
 
+/** A compiled regexp in the regexp cache.
+ * Entries are kept in a hash table keyed on the compile flags and the
+ * pattern, and on a list ordered from most to least recently used.
+ * Entries that are lent out are never evicted.
+ */
+struct re_cache_entry {
+  pcre2_code *re;              /**< The compiled (and JITed) regexp */
+  pcre2_match_data *md;        /**< Match data, lent to one user at a time */
+  bool md_lent;                /**< Is md currently in use? */
+  bool cached;                 /**< Is this entry in the cache? */
+  int refs;                    /**< Number of users of this entry */
+  size_t size;                 /**< Approximate memory used */
+  struct re_cache_entry *prev; /**< More recently used entry */
+  struct re_cache_entry *next; /**< Less recently used entry */
+  char key[];                  /**< Hash table key */
+};
+
+static HASHTAB htab_regexps;
+static bool re_cache_initialized = 0;
+static struct re_cache_entry *re_lru_head = NULL, *re_lru_tail = NULL;
+static size_t re_cache_bytes = 0;
+static struct {
+  uint64_t hits;       /**< Lookups that found a cached regexp */
+  uint64_t misses;     /**< Lookups that had to compile */
+  uint64_t evictions;  /**< Entries dropped to make room */
+  uint64_t comp_usecs; /**< Time spent compiling on misses */
+} re_cache_stat;
+
+static void re_cache_unlink(struct re_cache_entry *e);
+static void re_cache_push(struct re_cache_entry *e);
+static void re_cache_free_entry(void *e);
+static void re_cache_trim(void);
+static bool re_cache_lookup(struct re_cache_ref *ref, char type,
+                            const char *pattern, uint32_t flags, int *errcode);
+
 /** Do a wildcard match, without remembering the wild data.
  *
  * This routine will cause crashes if fed NULLs instead of strings.
@@ -446,13 +485,12 @@ regexp_match_case_r(const char *restrict s, const char *restrict val, bool cs,
                     char **matches, size_t nmatches, char *data, ssize_t len,
                     PE_REGS *pe_regs, int pe_reg_flags)
 {
+  struct re_cache_ref rx;
   pcre2_code *re;
   size_t i;
-  int errcode;
   ansi_string *as = NULL;
   const char *d;
   size_t delenn;
-  PCRE2_SIZE erroffset;
   pcre2_match_data *md;
   int subpatterns;
   int totallen = 0;
@@ -461,9 +499,8 @@ regexp_match_case_r(const char *restrict s, const char *restrict val, bool cs,
     matches[i] = NULL;
   }
 
-  if ((re = pcre2_compile((const PCRE2_UCHAR *) s, PCRE2_ZERO_TERMINATED,
-                          (cs ? 0 : PCRE2_CASELESS) | re_compile_flags,
-                          &errcode, &erroffset, re_compile_ctx)) == NULL) {
+  if (!re_cache_get(&rx, s, (cs ? 0 : PCRE2_CASELESS) | re_compile_flags,
+                    NULL)) {
     /*
      * This is a matching error. We have an error message in
      * errptr that we can ignore, since we're doing
@@ -471,7 +508,8 @@ regexp_match_case_r(const char *restrict s, const char *restrict val, bool cs,
      */
     return 0;
   }
-  ADD_CHECK("pcre");
+  re = rx.re;
+  md = rx.md;
 
   /* The ansi string */
   if (has_markup(val)) {
@@ -487,15 +525,12 @@ regexp_match_case_r(const char *restrict s, const char *restrict val, bool cs,
    * Now we try to match the pattern. The relevant fields will
    * automatically be filled in by this.
    */
-  md = pcre2_match_data_create_from_pattern(re, NULL);
   if ((subpatterns = pcre2_match(re, (const PCRE2_UCHAR *) d, delenn, 0,
                                  re_match_flags, md, re_match_ctx)) < 0) {
     if (as) {
       free_ansi_string(as);
     }
-    pcre2_code_free(re);
-    pcre2_match_data_free(md);
-    DEL_CHECK("pcre");
+    re_cache_release(&rx);
     return 0;
   }
 
@@ -543,9 +578,7 @@ regexp_match_case_r(const char *restrict s, const char *restrict val, bool cs,
   if (as) {
     free_ansi_string(as);
   }
-  pcre2_code_free(re);
-  pcre2_match_data_free(md);
-  DEL_CHECK("pcre");
+  re_cache_release(&rx);
   return 1;
 }
 
@@ -564,12 +597,10 @@ bool
 quick_regexp_match(const char *restrict s, const char *restrict d, bool cs,
                    const char **report_err)
 {
-  pcre2_code *re;
+  struct re_cache_ref rx;
   const char *sptr;
   size_t slen;
   int errcode;
-  PCRE2_SIZE erroffset;
-  pcre2_match_data *md;
   int r;
   int flags =
     re_compile_flags; /* There's a PCRE_NO_AUTO_CAPTURE flag to turn all raw
@@ -585,8 +616,7 @@ quick_regexp_match(const char *restrict s, const char *restrict d, bool cs,
     *report_err = NULL;
   }
 
-  if ((re = pcre2_compile((const PCRE2_UCHAR *) s, PCRE2_ZERO_TERMINATED, flags,
-                          &errcode, &erroffset, re_compile_ctx)) == NULL) {
+  if (!re_cache_get(&rx, s, flags, &errcode)) {
     /*
      * This is a matching error. We have an error message in
      * errptr that we can ignore, since we're doing
@@ -599,19 +629,15 @@ quick_regexp_match(const char *restrict s, const char *restrict d, bool cs,
     }
     return 0;
   }
-  ADD_CHECK("pcre");
   sptr = remove_markup(d, &slen);
 
   /*
    * Now we try to match the pattern. The relevant fields will
    * automatically be filled in by this.
    */
-  md = pcre2_match_data_create_from_pattern(re, NULL);
-  r = pcre2_match(re, (const PCRE2_UCHAR *) sptr, slen - 1, 0, re_match_flags,
-                  md, re_match_ctx);
-  pcre2_code_free(re);
-  pcre2_match_data_free(md);
-  DEL_CHECK("pcre");
+  r = pcre2_match(rx.re, (const PCRE2_UCHAR *) sptr, slen - 1, 0,
+                  re_match_flags, rx.md, re_match_ctx);
+  re_cache_release(&rx);
 
   return r >= 0;
 }
@@ -637,6 +663,293 @@ qcomp_regexp_match(const pcre2_code *re, pcre2_match_data *md, const char *subj,
   return r >= 0;
 }
 
+static void
+re_cache_unlink(struct re_cache_entry *e)
+{
+  if (e->prev) {
+    e->prev->next = e->next;
+  } else {
+    re_lru_head = e->next;
+  }
+  if (e->next) {
+    e->next->prev = e->prev;
+  } else {
+    re_lru_tail = e->prev;
+  }
+  e->prev = e->next = NULL;
+}
+
+static void
+re_cache_push(struct re_cache_entry *e)
+{
+  e->prev = NULL;
+  e->next = re_lru_head;
+  if (re_lru_head) {
+    re_lru_head->prev = e;
+  } else {
+    re_lru_tail = e;
+  }
+  re_lru_head = e;
+}
+
+static void
+re_cache_free_entry(void *data)
+{
+  struct re_cache_entry *e = data;
+
+  pcre2_match_data_free(e->md);
+  pcre2_code_free(e->re);
+  DEL_CHECK("pcre");
+  mush_free(e, "regexp.cache");
+}
+
+/* Evict least recently used entries until the cache fits in
+ * regexp_cache_memory. */
+static void
+re_cache_trim(void)
+{
+  struct re_cache_entry *e, *prev;
+
+  for (e = re_lru_tail;
+       e && re_cache_bytes > (size_t) options.regexp_cache_memory; e = prev) {
+    prev = e->prev;
+    if (e->refs > 0) {
+      continue;
+    }
+    re_cache_unlink(e);
+    re_cache_bytes -= e->size;
+    re_cache_stat.evictions++;
+    hashdelete(e->key, &htab_regexps); /* Frees e */
+  }
+}
+
+/* Find or compile a regexp ('r') or glob ('g') pattern, and lend it
+ * out. */
+static bool
+re_cache_lookup(struct re_cache_ref *ref, char type, const char *pattern,
+                uint32_t flags, int *errcode)
+{
+  char key[BUFFER_LEN + 16];
+  int klen;
+  struct re_cache_entry *e = NULL;
+
+  ref->re = NULL;
+  ref->md = NULL;
+  ref->entry = NULL;
+
+  if (!re_cache_initialized) {
+    hash_init(&htab_regexps, 256, re_cache_free_entry);
+    re_cache_initialized = 1;
+  }
+
+  klen = snprintf(key, sizeof key, "%c%08" PRIx32 ":%s", type, flags, pattern);
+  if (klen >= (int) sizeof key) {
+    /* Too long to be worth caching; compile it for this use only. */
+    klen = 0;
+    key[0] = '\0';
+  } else {
+    e = hashfind(key, &htab_regexps);
+  }
+
+  if (e) {
+    re_cache_stat.hits++;
+    re_cache_unlink(e);
+    re_cache_push(e);
+  } else {
+    pcre2_code *re = NULL;
+    PCRE2_SIZE erroffset, csize = 0, jsize = 0;
+    uint64_t start = mono_usecs();
+    int err = 0;
+
+    if (type == 'g') {
+      PCRE2_UCHAR *as_re = NULL;
+      PCRE2_SIZE rlen;
+
+      err = pcre2_pattern_convert((const PCRE2_UCHAR *) pattern,
+                                  PCRE2_ZERO_TERMINATED, PCRE2_CONVERT_GLOB,
+                                  &as_re, &rlen, glob_convert_ctx);
+      if (err == 0) {
+        re = pcre2_compile(as_re, rlen, flags, &err, &erroffset,
+                           re_compile_ctx);
+        pcre2_converted_pattern_free(as_re);
+      }
+    } else {
+      re = pcre2_compile((const PCRE2_UCHAR *) pattern, PCRE2_ZERO_TERMINATED,
+                         flags, &err, &erroffset, re_compile_ctx);
+    }
+    if (re && !(re_match_flags & PCRE2_NO_JIT)) {
+      pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
+    }
+    re_cache_stat.misses++;
+    re_cache_stat.comp_usecs += mono_usecs() - start;
+
+    if (!re) {
+      if (errcode) {
+        *errcode = err;
+      }
+      return false;
+    }
+    ADD_CHECK("pcre");
+
+    e = mush_malloc(sizeof *e + klen + 1, "regexp.cache");
+    if (!e) {
+      mush_panic("Unable to allocate memory in re_cache_lookup()");
+    }
+    e->re = re;
+    e->md = pcre2_match_data_create_from_pattern(re, NULL);
+    e->md_lent = 0;
+    e->cached = 0;
+    e->refs = 0;
+    e->prev = e->next = NULL;
+    memcpy(e->key, key, klen + 1);
+    pcre2_pattern_info(re, PCRE2_INFO_SIZE, &csize);
+    pcre2_pattern_info(re, PCRE2_INFO_JITSIZE, &jsize);
+    e->size = sizeof *e + klen + 1 + csize + jsize +
+              pcre2_get_match_data_size(e->md);
+
+    if (klen && e->size <= (size_t) options.regexp_cache_memory) {
+      hashadd(e->key, e, &htab_regexps);
+      re_cache_push(e);
+      re_cache_bytes += e->size;
+      e->cached = 1;
+    }
+  }
+
+  e->refs++;
+  ref->entry = e;
+  ref->re = e->re;
+  if (e->md_lent) {
+    /* Nested use of the same pattern, like a regedit() inside the
+     * replacement of another regedit(). */
+    ref->md = pcre2_match_data_create_from_pattern(e->re, NULL);
+  } else {
+    e->md_lent = 1;
+    ref->md = e->md;
+  }
+
+  if (e->cached) {
+    re_cache_trim();
+  }
+  return true;
+}
+
+/** Borrow a compiled regexp from the regexp cache, compiling it if needed.
+ * The regexp is JIT-compiled unless JIT is disabled. Every successful
+ * call must be paired with re_cache_release().
+ * \param ref where to store the regexp and its match data.
+ * \param pattern the regexp.
+ * \param flags pcre2 compile flags, including re_compile_flags.
+ * \param errcode if not NULL, set to the pcre2 error code on failure.
+ * \retval true the regexp is in ref.
+ * \retval false the pattern did not compile.
+ */
+bool
+re_cache_get(struct re_cache_ref *ref, const char *pattern, uint32_t flags,
+             int *errcode)
+{
+  return re_cache_lookup(ref, 'r', pattern, flags, errcode);
+}
+
+/** Borrow a wildcard pattern converted to a compiled regexp from the
+ * regexp cache. See re_cache_get().
+ * \param ref where to store the regexp and its match data.
+ * \param glob the wildcard pattern.
+ * \param flags pcre2 compile flags, including re_compile_flags.
+ * \param errcode if not NULL, set to the pcre2 error code on failure.
+ * \retval true the regexp is in ref.
+ * \retval false the pattern could not be converted or compiled.
+ */
+bool
+re_cache_get_glob(struct re_cache_ref *ref, const char *glob, uint32_t flags,
+                  int *errcode)
+{
+  return re_cache_lookup(ref, 'g', glob, flags, errcode);
+}
+
+/** Give a regexp back to the regexp cache.
+ * \param ref the regexp from re_cache_get() or re_cache_get_glob().
+ */
+void
+re_cache_release(struct re_cache_ref *ref)
+{
+  struct re_cache_entry *e = ref->entry;
+
+  if (!e) {
+    return;
+  }
+  if (ref->md == e->md) {
+    e->md_lent = 0;
+  } else {
+    pcre2_match_data_free(ref->md);
+  }
+  e->refs--;
+  if (!e->cached) {
+    if (e->refs == 0) {
+      re_cache_free_entry(e);
+    }
+  } else if (e->refs == 0 &&
+             re_cache_bytes > (size_t) options.regexp_cache_memory) {
+    re_cache_trim();
+  }
+  ref->entry = NULL;
+  ref->re = NULL;
+  ref->md = NULL;
+}
+
+/** Report regexp cache statistics for \@stats/tables.
+ * \param player the player to notify.
+ */
+void
+re_cache_stats(dbref player)
+{
+  uint64_t lookups = re_cache_stat.hits + re_cache_stat.misses;
+
+  notify(player, "Regexp Cache:");
+  notify_format(player,
+                " %d regexps using %zu of %d bytes, %" PRIu64
+                " evicted.",
+                re_cache_initialized ? htab_regexps.entries : 0,
+                re_cache_bytes, options.regexp_cache_memory,
+                re_cache_stat.evictions);
+  notify_format(player,
+                " %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate), "
+                "%.1f usecs average compile.",
+                re_cache_stat.hits, re_cache_stat.misses,
+                lookups ? 100.0 * re_cache_stat.hits / lookups : 0.0,
+                re_cache_stat.misses ? (double) re_cache_stat.comp_usecs /
+                                         re_cache_stat.misses
+                                     : 0.0);
+}
+
+TEST_GROUP(re_cache)
+{
+  struct re_cache_ref a, b;
+  uint64_t hits;
+  int errcode = 0;
+
+  TEST("re_cache.1", re_cache_get(&a, "^re_cache(\\d+)$", re_compile_flags,
+                                  &errcode));
+  TEST("re_cache.2", qcomp_regexp_match(a.re, a.md, "re_cache42",
+                                        PCRE2_ZERO_TERMINATED));
+  hits = re_cache_stat.hits;
+  TEST("re_cache.3", re_cache_get(&b, "^re_cache(\\d+)$", re_compile_flags,
+                                  NULL));
+  TEST("re_cache.4", !a.entry->cached || (b.re == a.re && b.md != a.md &&
+                                            re_cache_stat.hits == hits + 1));
+  re_cache_release(&b);
+  re_cache_release(&a);
+  TEST("re_cache.5", !re_cache_get(&a, "re_cache(", re_compile_flags,
+                                   &errcode) &&
+                       errcode != 0 && a.re == NULL);
+  TEST("re_cache.6", re_cache_get_glob(&a, "RE_CACHE*FOO", PCRE2_CASELESS,
+                                       NULL));
+  TEST("re_cache.7", qcomp_regexp_match(a.re, a.md, "re_cache_x_foo",
+                                        PCRE2_ZERO_TERMINATED) &&
+                       !qcomp_regexp_match(a.re, a.md, "re_cache_x_bar",
+                                           PCRE2_ZERO_TERMINATED));
+  re_cache_release(&a);
+}
+
 /** Either an order comparison or a wildcard match with optional
  *  pe_regs memory.
  *
@@ -0,0 +1,141 @@
+package FakePostgres;
+
+# Just enough of a PostgreSQL server, speaking the v3 wire protocol,
+# for the tests of the game's postgresql support to run without a
+# real one. It accepts any login, and answers simple queries:
+#
+#   SELECT 'text', ...                 one row of the given values
+#   SELECT pg_sleep(N)                 one empty row, after N seconds
+#   SELECT pg_terminate_backend(...)   drops the connection
+#   UPDATE/INSERT/DELETE ...           reports 2 rows affected
+#
+# Anything else is a syntax error. Statements are split on ';', and
+# an error skips the rest, like the real thing.
+
+use strict;
+use warnings;
+use IO::Socket::IP;
+use POSIX qw/_exit/;
+
+sub new {
+  my $proto = shift;
+  my $class = ref($proto) || $proto;
+  my $self = {};
+  $self->{LISTEN} = IO::Socket::IP->new(LocalHost => "127.0.0.1",
+                                        LocalPort => 0,
+                                        Listen => 5,
+                                        ReuseAddr => 1)
+    or die "Unable to open fake postgresql port: $!\n";
+  $self->{PORT} = $self->{LISTEN}->sockport;
+  bless($self, $class);
+  my $child = fork();
+  die "Could not spawn fake postgresql server: $!\n" unless defined $child;
+  if ($child == 0) {
+    while (my $conn = $self->{LISTEN}->accept) {
+      serve($conn);
+      close $conn;
+    }
+    _exit(0);
+  }
+  $self->{PID} = $child;
+  close $self->{LISTEN};
+  return $self;
+}
+
+sub port {
+  my $self = shift;
+  return $self->{PORT};
+}
+
+sub DESTROY {
+  my $self = shift;
+  if ($self->{PID}) {
+    kill("TERM", $self->{PID});
+    waitpid($self->{PID}, 0);
+  }
+}
+
+sub readn {
+  my ($conn, $n) = @_;
+  my $buf = "";
+  while (length($buf) < $n) {
+    my $got = sysread($conn, $buf, $n - length($buf), length($buf));
+    return undef unless $got;
+  }
+  return $buf;
+}
+
+sub message {
+  my ($conn, $type, $body) = @_;
+  syswrite($conn, $type . pack("N", length($body) + 4) . $body);
+}
+
+sub serve {
+  my $conn = shift;
+
+  # SSL and GSSAPI encryption requests get turned down, then comes the
+  # startup packet.
+  while (1) {
+    my $len = readn($conn, 4) // return;
+    my $body = readn($conn, unpack("N", $len) - 4) // return;
+    my $code = unpack("N", $body);
+    if ($code == 80877103 || $code == 80877104) {
+      syswrite($conn, "N");
+      next;
+    }
+    last;
+  }
+  message($conn, "R", pack("N", 0));
+  message($conn, "S", "server_version\0" . "13.0\0");
+  message($conn, "S", "client_encoding\0" . "UTF8\0");
+  message($conn, "S", "standard_conforming_strings\0" . "on\0");
+  message($conn, "K", pack("NN", $$, 0));
+  message($conn, "Z", "I");
+
+  while (1) {
+    my $type = readn($conn, 1) // return;
+    my $len = readn($conn, 4) // return;
+    my $body = readn($conn, unpack("N", $len) - 4) // return;
+    return if $type eq "X";
+    next unless $type eq "Q";
+    $body =~ s/\0$//;
+    foreach my $stmt (split /;/, $body) {
+      $stmt =~ s/^\s+|\s+$//g;
+      next if $stmt eq "";
+      if ($stmt =~ /^SELECT\s+pg_terminate_backend/i) {
+        return;
+      } elsif ($stmt =~ /^SELECT\s+pg_sleep\((\d+)\)$/i) {
+        sleep $1;
+        rows($conn, ["pg_sleep"], [""]);
+      } elsif ($stmt =~ /^SELECT\s+('[^']*'(?:\s*,\s*'[^']*')*)$/i) {
+        my @values = map { s/^'|'$//gr } split /\s*,\s*/, $1;
+        rows($conn, [map { "?column?" } @values], \@values);
+      } elsif ($stmt =~ /^(UPDATE|INSERT|DELETE)\b/i) {
+        my $tag = uc($1) eq "INSERT" ? "INSERT 0 2" : uc($1) . " 2";
+        message($conn, "C", "$tag\0");
+      } else {
+        message($conn, "E", "SERROR\0VERROR\0C42601\0"
+                . "Msyntax error at or near \"$stmt\"\0\0");
+        last;
+      }
+    }
+    message($conn, "Z", "I");
+  }
+}
+
+sub rows {
+  my ($conn, $names, $values) = @_;
+  my $desc = pack("n", scalar @$names);
+  foreach my $name (@$names) {
+    $desc .= "$name\0" . pack("NnNnNn", 0, 0, 25, 0xffff, 0xffffffff, 0);
+  }
+  message($conn, "T", $desc);
+  my $row = pack("n", scalar @$values);
+  foreach my $value (@$values) {
+    $row .= pack("N", length $value) . $value;
+  }
+  message($conn, "D", $row);
+  message($conn, "C", "SELECT 1\0");
+}
+
+1;
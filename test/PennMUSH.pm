@@ -72,6 +72,7 @@ sub start {
     $target =~ s-../game-testgame-o;
     copy($file, $target);
   }
+  copy("../game/txt/colors.json", "testgame/txt/colors.json");
   symlink("../../src/netmud", "testgame/netmush");
   symlink("../../src/info_slave", "testgame/info_slave");
   my $child = fork();
@@ -0,0 +1,98 @@
+#!/usr/bin/perl
+
+# Times a channel broadcast to many listeners while many other
+# connections are open. Not part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ ulimit -n 4096
+#    $ perl benchbroadcast.pl [--listeners 500] [--connections 2000]
+#                             [--runs 200] [--length 0]
+#
+# Each listener is its own player with one connection, on channel
+# Bench. The rest of the connections are all logged in as one player
+# who is not on the channel. The result is the benchmark() output for
+# cemit() to the channel, in microseconds per broadcast.
+#
+# The message is "ping", or --length dashes. Nothing reads from the
+# connections, and they ask for small receive buffers, so long enough
+# messages fill the socket buffers and the rest waits in the game's
+# output queues. On Linux, the game's resident memory before and after
+# is shown too.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use IO::Socket::IP;
+use Socket qw(SOL_SOCKET SO_RCVBUF);
+use PennMUSH;
+
+my ($listeners, $connections, $runs, $length) = (500, 2000, 200, 0);
+my ($host, $port) = ("localhost", 0);
+GetOptions "listeners=i" => \$listeners,
+    "connections=i" => \$connections,
+    "runs=i" => \$runs,
+    "length=i" => \$length,
+    "host=s" => \$host,
+    "port=i" => \$port;
+die "--connections must be at least --listeners\n"
+  if $connections < $listeners;
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "max_logins" => $connections + 10,
+                         "use_dns" => "no");
+my $god = $mush->loginGod;
+
+$god->command('@channel/add Bench=player');
+# Keep the broadcasts themselves from coming back to God.
+$god->command('@channel/on Bench=me');
+$god->command('@channel/gag Bench=yes');
+$god->command('@pcreate BenchFiller=bench');
+foreach my $n (1..$listeners) {
+  $god->command("\@pcreate Bench$n=bench");
+  $god->command("\@channel/on Bench=*Bench$n");
+}
+
+my @socks;
+foreach my $n (1..$connections) {
+  my $who = $n <= $listeners ? "Bench$n" : "BenchFiller";
+  my $sock = IO::Socket::IP->new(PeerHost => "127.0.0.1",
+                                 PeerPort => $mush->{PORT},
+                                 Proto => "tcp",
+                                 Sockopts => [[SOL_SOCKET, SO_RCVBUF, 4096]])
+    or die "Unable to open connection $n: $!\n";
+  $sock->autoflush(1);
+  # The game listens with a tiny backlog, so wait for the connect
+  # screen before opening the next connection.
+  $sock->sysread(my $screen, 8192);
+  $sock->print("connect $who bench\r\n");
+  push @socks, $sock;
+}
+
+# Wait for every connection to be logged in. lwho() has one entry
+# per connection, and One is connected too.
+foreach my $try (1..60) {
+  my $have = $god->command("think words(lwho())");
+  last if $have =~ /(\d+)/ && $1 > $connections;
+  die "Only $have connected after 60 seconds\n" if $try == 60;
+  sleep 1;
+}
+
+# Resident memory of the game, in kB.
+sub rss {
+  open my $STATUS, "<", "/proc/$mush->{PID}/status" or return "?";
+  while (my $line = <$STATUS>) {
+    return $1 if $line =~ /^VmRSS:\s+(\d+)/;
+  }
+  return "?";
+}
+
+my $msg = $length ? "repeat(-,$length)" : "ping";
+my $before = rss();
+my $result = $god->command("think benchmark(cemit(Bench,$msg,1),$runs)");
+$result =~ s/[\r\n]+$//;
+print "$listeners listeners, $connections connections: $result\n";
+printf "Resident memory: %s kB before, %s kB after\n", $before, rss();
+
+$_->close foreach @socks;
@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+
+# Times command matching against objects with many $-commands, with
+# and without the attribute value cache. Not part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchcommands.pl [--attributes 2000] [--objects 1] [--master]
+#                            [--commands 500] [--batch 50]
+#                            [--compression huffman]
+#
+# God gets --objects objects, each carrying --attributes $-commands
+# with longish action lists, or with --master they go in the master
+# room as globals. God then runs --commands commands with
+# @dolist/inplace, each checked against all of them and matching none,
+# once with attribute_cache_memory at its configured value and once
+# with it set to 0. The results are wall-clock milliseconds per
+# command, including a round trip per --batch commands.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use Time::HiRes qw(time);
+use PennMUSH;
+
+my ($attributes, $objects, $master, $commands, $batch, $compression) =
+  (2000, 1, 0, 500, 50, "huffman");
+my ($host, $port) = ("localhost", 0);
+GetOptions "attributes=i" => \$attributes,
+    "objects=i" => \$objects,
+    "master" => \$master,
+    "commands=i" => \$commands,
+    "batch=i" => \$batch,
+    "compression=s" => \$compression,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "attr_compression" => $compression);
+my $god = $mush->loginGod;
+
+my $body = join(";", map { "think [add($_,1)] ... benchmark filler" } 1..6);
+foreach my $obj (1..$objects) {
+  $god->command("\@create Bench Commands $obj");
+  $god->command("\@set Bench Commands $obj=!no_command");
+  foreach my $n (1..$attributes) {
+    $god->command("&CMD$n Bench Commands $obj=\$benchcmd$obj.$n *:$body");
+  }
+  $god->command("\@tel Bench Commands $obj=#2") if $master;
+}
+
+# Batches are kept small by default so that no queue entry runs into
+# queue_entry_cpu_time.
+sub run {
+  my $start = time;
+  for (my $left = $commands; $left > 0; $left -= $batch) {
+    my $n = $left < $batch ? $left : $batch;
+    $god->command("\@dolist/inplace lnum($n)=benchnomatch x");
+  }
+  return (time - $start) * 1000 / $commands;
+}
+
+my $size = $god->command('think config(attribute_cache_memory)');
+$size =~ s/[\r\n]+$//;
+run();    # Warm up
+my $cached = run();
+$god->command('@config/set attribute_cache_memory=0');
+my $uncached = run();
+$god->command("\@config/set attribute_cache_memory=$size");
+
+printf "%d objects with %d \$-commands: %.3f ms/command cached, "
+  . "%.3f ms/command uncached\n", $objects, $attributes, $cached, $uncached;
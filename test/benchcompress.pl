@@ -0,0 +1,64 @@
+#!/usr/bin/perl
+
+# Times reading huffman-compressed attributes. Not part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchcompress.pl [--runs 20] [--compression huffman]
+#
+# Every entry of the help files in game/txt/hlp is stored in an
+# attribute, then all of them are read back with get() --runs times,
+# with attribute_cache_memory set to 0 so that every read has to
+# uncompress. The result is the uncompressed megabytes read per
+# second, including the softcode overhead of iter() and get().
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use PennMUSH;
+
+my ($runs, $compression) = (20, "huffman");
+my ($host, $port) = ("localhost", 0);
+GetOptions "runs=i" => \$runs,
+    "compression=s" => \$compression,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "attr_compression" => $compression,
+                         "attribute_cache_memory" => 0,
+                         "function_invocation_limit" => 10000000,
+                         "queue_entry_cpu_time" => 100000);
+my $god = $mush->loginGod;
+
+my @entries;
+foreach my $file (glob "../game/txt/hlp/*.hlp") {
+  open my $HLP, "<", $file or die "Could not open $file: $!\n";
+  my $text = "";
+  while (my $line = <$HLP>) {
+    if ($line =~ /^&/) {
+      push @entries, $text if $text =~ /\S/;
+      $text = "";
+      next;
+    }
+    $line =~ s/[\r\n]+$//;
+    $text .= " $line";
+  }
+  push @entries, $text if $text =~ /\S/;
+  close $HLP;
+}
+
+$god->command('@create Corpus');
+my $bytes = 0;
+foreach my $n (0..$#entries) {
+  my $text = substr($entries[$n], 0, 8000);
+  $bytes += length $text;
+  $god->command("&HLP$n Corpus=$text");
+}
+
+my $result = $god->command("think benchmark(strlen(iter(lattr(Corpus),"
+                           . "strlen(get(Corpus/##)))),$runs)");
+$result =~ /Average: ([\d.]+)/ or die "Unexpected benchmark result: $result\n";
+printf "%d attributes, %d bytes: %.1f MB/s\n", scalar @entries, $bytes,
+  $bytes / $1;
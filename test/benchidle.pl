@@ -0,0 +1,71 @@
+#!/usr/bin/perl
+
+# Measures how much idle connections slow down the main loop. Not part
+# of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchidle.pl [--idle 1000,3000] [--passes 5000]
+#
+# God runs an action list that @triggers itself --passes times. With
+# queue_chunk at 1, each run is one pass through the main loop,
+# including a check of the sockets. That's timed with no other
+# connections, and then again after opening each number of --idle
+# connections that sit at the login screen and send nothing. The
+# result is the best of three runs for each, in microseconds per pass.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use IO::Socket::IP;
+use Time::HiRes qw(time);
+use PennMUSH;
+
+my ($idle, $passes) = ("1000,3000", 5000);
+my ($host, $port) = ("localhost", 0);
+GetOptions "idle=s" => \$idle,
+    "passes=i" => \$passes,
+    "host=s" => \$host,
+    "port=i" => \$port;
+my @counts = split /,/, $idle;
+my $most = (sort { $b <=> $a } @counts)[0];
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "queue_chunk" => 1,
+                         "max_logins" => $most + 10,
+                         "use_dns" => "no");
+my $god = $mush->loginGod;
+
+$god->command('&PASS me=@switch [setr(0,dec(v(LEFT)))][set(me,LEFT:%q0)]='
+              . '0,@pemit me=Done.,@trigger me/PASS');
+
+sub pass_time {
+  my $best;
+  foreach my $run (1..3) {
+    $god->command("&LEFT me=$passes");
+    my $start = time;
+    my $result = $god->command('@trigger me/PASS');
+    $result = $god->noise . $result;
+    $god->read_to_pattern('Done\.') unless $result =~ /Done\./;
+    my $elapsed = time - $start;
+    $best = $elapsed if !defined $best || $elapsed < $best;
+  }
+  return $best * 1e6 / $passes;
+}
+
+printf "%5d idle connections: %6.1f us per pass\n", 0, pass_time();
+my @sockets;
+foreach my $count (sort { $a <=> $b } @counts) {
+  while (@sockets < $count) {
+    my $sock = IO::Socket::IP->new(PeerHost => "127.0.0.1",
+                                   PeerPort => $mush->{PORT},
+                                   Proto => "tcp")
+      or die "Unable to open connection " . (@sockets + 1) . ": $!\n";
+    push @sockets, $sock;
+  }
+  # Let the new connections get their welcome screens.
+  $god->command('think Settled.');
+  sleep 2;
+  printf "%5d idle connections: %6.1f us per pass\n", $count, pass_time();
+}
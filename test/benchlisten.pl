@@ -0,0 +1,52 @@
+#!/usr/bin/perl
+
+# Times matching speech against ^-listens on the objects in a room.
+# Not part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchlisten.pl [--objects 200] [--attributes 20] [--runs 200]
+#
+# God's location gets --objects MONITOR objects, each with two ^-listen
+# patterns that don't match and --attributes other attributes. Half of
+# them are LISTEN_PARENT children of a parent with listens of its own.
+# The result is the benchmark() output for remit() to the room, in
+# microseconds per line spoken.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use PennMUSH;
+
+my ($objects, $attributes, $runs) = (200, 20, 200);
+my ($host, $port) = ("localhost", 0);
+GetOptions "objects=i" => \$objects,
+    "attributes=i" => \$attributes,
+    "runs=i" => \$runs,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "function_invocation_limit" => 10000000,
+                         "queue_entry_cpu_time" => 100000);
+my $god = $mush->loginGod;
+
+$god->command('think set(me,LPARENT:[create(Lparent)])');
+$god->command('@set [v(LPARENT)]=monitor');
+$god->command('&PHEAR [v(LPARENT)]=^*zzparent*:@pemit me=heard');
+for (my $made = 0; $made < $objects; $made += 100) {
+  my $n = $objects - $made < 100 ? $objects - $made : 100;
+  $god->command("think iter(lnum($n),[setq(0,create(Listener##))]"
+                . "[set(%q0,monitor)]"
+                . "[iter(lnum(1,$attributes),set(%q0,DATA%i0:text %i0))]"
+                . '[set(%q0,HEAR1:^*zzone*:@pemit me=one)]'
+                . '[set(%q0,HEAR2:^zztwo *:@pemit me=two)]'
+                . "[if(mod(##,2),[parent(%q0,v(LPARENT))]"
+                . "[set(%q0,listen_parent)])][tel(%q0,here)])");
+}
+
+my $result = $god->command("think benchmark(remit(here,hello there),$runs)");
+$result =~ /Average: ([\d.]+)/ or die "Unexpected benchmark result: $result\n";
+printf "%d objects, %d attributes: %.1f us per line\n", $objects,
+  $attributes, $1;
@@ -0,0 +1,95 @@
+#!/usr/bin/perl
+
+# Times loading a text database against loading a binary snapshot of
+# the same database. Not part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchload.pl [--objects 20000] [--attributes 10] [--runs 3]
+#
+# A database of --objects things, each with --attributes attributes,
+# is saved once as text and once with binary_dump on. The game is then
+# started --runs times from each. The results are the best wall-clock
+# times from starting the server until the log says the database has
+# been read, including the attribute compression analysis pass, and
+# from the log saying it has started reading the database until then.
+
+use lib '.';
+use strict;
+use warnings;
+use File::Copy;
+use Getopt::Long;
+use Time::HiRes qw(time sleep);
+use PennMUSH;
+
+my ($objects, $attributes, $runs) = (20000, 10, 3);
+my ($host, $port) = ("localhost", 0);
+GetOptions "objects=i" => \$objects,
+    "attributes=i" => \$attributes,
+    "runs=i" => \$runs,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "forking_dump" => "no",
+                         "function_invocation_limit" => 10000000,
+                         "queue_entry_cpu_time" => 100000);
+my $god = $mush->loginGod;
+
+my $sets = join("", map { "[set(%q0,A$_:$_ benchmark [add($_,##)] text)]" }
+                1..$attributes);
+for (my $made = 0; $made < $objects; $made += 500) {
+  my $n = $objects - $made < 500 ? $objects - $made : 500;
+  $god->command("think iter(lnum($n),[setq(0,create(Bench##))]$sets)");
+}
+
+$god->command('@dump');
+copy("testgame/data/outdb", "testgame/data/bench.text") or die "copy: $!\n";
+$god->command('@config/set binary_dump=yes');
+$god->command('@dump');
+copy("testgame/data/outdb", "testgame/data/bench.snapshot")
+  or die "copy: $!\n";
+kill "KILL", $mush->{PID};
+sleep 1;
+
+# Start the server on a database and wait for it to finish reading it.
+sub load {
+  my $db = shift;
+  copy("testgame/data/$db", "testgame/data/indb") or die "copy: $!\n";
+  unlink "testgame/log/netmush.log";
+  my $start = time;
+  my $child = fork();
+  die "fork: $!\n" unless defined $child;
+  if ($child == 0) {
+    chdir("testgame");
+    exec "./netmush", "--no-session", "test.cnf";
+    die "exec: $!\n";
+  }
+  my ($loading, $elapsed);
+  while (!defined $elapsed) {
+    sleep 0.01;
+    next unless open my $LOG, "<", "testgame/log/netmush.log";
+    while (my $line = <$LOG>) {
+      die "Unable to load $db\n" if $line =~ /ERROR LOADING/;
+      $loading //= time if $line =~ /LOADING: /;
+      $elapsed = time - $start if $line =~ /READING: done/;
+    }
+    close $LOG;
+  }
+  my $reading = time - ($loading // $start);
+  kill "KILL", $child;
+  waitpid $child, 0;
+  return ($elapsed, $reading);
+}
+
+foreach my $db ("bench.text", "bench.snapshot") {
+  my ($best, $best_reading);
+  foreach (1..$runs) {
+    my ($t, $reading) = load($db);
+    $best = $t if !defined $best || $t < $best;
+    $best_reading = $reading
+      if !defined $best_reading || $reading < $best_reading;
+  }
+  printf "%s: %d bytes, %.3f s to start, %.3f s reading\n", $db,
+    -s "testgame/data/$db", $best, $best_reading;
+}
@@ -0,0 +1,181 @@
+#!/usr/bin/perl
+
+# Measures how much MCCP compression saves on everyday output. Not
+# part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchmccp.pl [--players 100] [--runs 20] [--mccp3]
+#
+# God's location gets a long description full of color, and --players
+# other players are connected, so WHO is long. Then two connections as
+# God, both using xterm256 colors, each look and WHO --runs times. One
+# turns telnet on but refuses compression, and the other accepts MCCP2.
+# The result is the bytes each received for that output and the text
+# they came to. With --mccp3, the compressed connection also compresses
+# what it sends.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use IO::Socket::IP;
+use Compress::Raw::Zlib;
+use PennMUSH;
+
+my ($players, $runs, $mccp3) = (100, 20, 0);
+my ($host, $port) = ("localhost", 0);
+GetOptions "players=i" => \$players,
+    "runs=i" => \$runs,
+    "mccp3" => \$mccp3,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+my ($IAC, $WONT, $DO, $DONT, $WILL, $SB, $SE) =
+  ("\xff", "\xfc", "\xfd", "\xfe", "\xfb", "\xfa", "\xf0");
+my ($MCCP2, $MCCP3, $LINEMODE) = ("\x56", "\x57", "\x22");
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "max_logins" => $players + 10,
+                         "use_dns" => "no");
+my $god = $mush->loginGod;
+
+$god->command('@desc here=[iter(lnum(30),[ansi(hc,Lanterns)] '
+              . '[ansi(y,sway over)] [ansi(+orange,the crowded)] '
+              . '[ansi(g,market)] [ansi(hb,stalls)] [ansi(r,and the)] '
+              . '[ansi(m,smell of)] [ansi(+gold,spice)] fills row ##.,,%r)]');
+$god->command('@pcreate BenchFiller=bench');
+my @fillers;
+foreach my $n (1..$players) {
+  my $sock = IO::Socket::IP->new(PeerHost => "127.0.0.1",
+                                 PeerPort => $mush->{PORT},
+                                 Proto => "tcp")
+    or die "Unable to open connection $n: $!\n";
+  $sock->sysread(my $screen, 8192);
+  $sock->print("connect BenchFiller bench\r\n");
+  push @fillers, $sock;
+}
+
+# One measured connection. It answers telnet option offers, accepting
+# MCCP2 (and MCCP3) only if asked to, and keeps count of the bytes it
+# reads off the socket and the text they decompress to.
+sub open_conn {
+  my $compress = shift;
+  my $c = {wire => 0, text => "", compressed => 0, sent => 0, plain => 0};
+  $c->{sock} = IO::Socket::IP->new(PeerHost => "127.0.0.1",
+                                   PeerPort => $mush->{PORT},
+                                   Proto => "tcp")
+    or die "Unable to connect: $!\n";
+  $c->{mccp} = $compress;
+  # Any telnet command makes the game send its option offers.
+  syswrite $c->{sock}, "$IAC$WONT$LINEMODE";
+  return $c;
+}
+
+# Send bytes, compressed once MCCP3 has started.
+sub send_bytes {
+  my ($c, $bytes) = @_;
+  $c->{plain} += length $bytes;
+  if ($c->{deflate}) {
+    my $out = "";
+    $c->{deflate}->deflate($bytes, $out);
+    $c->{deflate}->flush($out, Z_SYNC_FLUSH);
+    $bytes = $out;
+  }
+  $c->{sent} += length $bytes;
+  syswrite $c->{sock}, $bytes;
+}
+
+sub send_line {
+  my ($c, $line) = @_;
+  send_bytes($c, "$line\r\n");
+}
+
+sub handle_plain {
+  my ($c, $data) = @_;
+  while ($data =~ /\G(.*?)$IAC(.)(.)/gcs) {
+    my ($cmd, $opt) = ($2, $3);
+    $c->{text} .= $1;
+    if ($cmd eq $WILL) {
+      my $yes = $c->{mccp} && ($opt eq $MCCP2 || ($mccp3 && $opt eq $MCCP3));
+      send_bytes($c, $IAC . ($yes ? $DO : $DONT) . $opt);
+      if ($yes && $opt eq $MCCP3) {
+        send_bytes($c, "$IAC$SB$MCCP3$IAC$SE");
+        $c->{deflate} = Compress::Raw::Zlib::Deflate->new(-AppendOutput => 1);
+      }
+    } elsif ($cmd eq $SB && $opt eq $MCCP2) {
+      $data =~ /\G$IAC$SE/gc or die "Bad MCCP2 start\n";
+      $c->{compressed} = 1;
+      $c->{inflate} = Compress::Raw::Zlib::Inflate->new(-AppendOutput => 1);
+      my $rest = substr($data, pos($data));
+      handle_compressed($c, $rest);
+      return;
+    } elsif ($cmd eq $SB) {
+      $data =~ /\G.*?$IAC$SE/gcs;
+    }
+  }
+  $c->{text} .= substr($data, pos($data) // 0);
+}
+
+sub handle_compressed {
+  my ($c, $data) = @_;
+  my $out = "";
+  my $status = $c->{inflate}->inflate($data, $out);
+  die "Inflate failed: $status\n" if $status != Z_OK && $status != Z_STREAM_END;
+  # Telnet commands inside the stream are ignored here.
+  $out =~ s/$IAC[\xfb-\xfe].|$IAC$SB.*?$IAC$SE//gs;
+  $c->{text} .= $out;
+  if ($status == Z_STREAM_END) {
+    $c->{compressed} = 0;
+    handle_plain($c, $data);
+  }
+}
+
+sub read_until {
+  my ($c, $pattern) = @_;
+  while ($c->{text} !~ /$pattern/) {
+    my $got = sysread $c->{sock}, my $data, 65536;
+    die "Connection closed\n" unless $got;
+    $c->{wire} += $got;
+    if ($c->{compressed}) {
+      handle_compressed($c, $data);
+    } else {
+      handle_plain($c, $data);
+    }
+  }
+  $c->{text} = "";
+}
+
+foreach my $compress (0, 1) {
+  my $c = open_conn($compress);
+  read_until($c, qr/connect/i);
+  send_line($c, "SOCKSET colorstyle=xterm256");
+  send_line($c, "connect One one");
+  send_line($c, "think Ready.");
+  read_until($c, qr/Ready\./);
+  die "MCCP2 was not negotiated\n" if $compress && !$c->{inflate};
+  @$c{qw(wire plain sent)} = (0, 0, 0);
+  my $text = 0;
+  foreach my $n (1..$runs) {
+    send_line($c, "look");
+    send_line($c, "WHO");
+    send_line($c, "think Done $n.");
+    while ($c->{text} !~ /Done $n\./) {
+      my $got = sysread $c->{sock}, my $data, 65536;
+      die "Connection closed\n" unless $got;
+      $c->{wire} += $got;
+      my $before = length $c->{text};
+      if ($c->{compressed}) {
+        handle_compressed($c, $data);
+      } else {
+        handle_plain($c, $data);
+      }
+      $text += length($c->{text}) - $before;
+    }
+    $c->{text} = "";
+  }
+  my $name = $compress ? ($mccp3 ? "MCCP2+MCCP3" : "MCCP2") : "Uncompressed";
+  printf "%-13s received %9d bytes for %9d of text, sent %6d for %6d\n",
+    $name, $c->{wire}, $text, $c->{sent}, $c->{plain};
+  close $c->{sock};
+}
@@ -0,0 +1,47 @@
+#!/usr/bin/perl
+
+# Times looking up per-object data, which mail uses to find where each
+# player's messages start. Not part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchobjdata.pl [--players 500] [--runs 200]
+#
+# --players players are made and each is sent a message. The result is
+# the benchmark() output for counting every player's mail with mail(),
+# in microseconds per player. Each count looks up the player's starting
+# point with get_objdata() and stores it again with set_objdata(), so
+# running this against a build from before objdata moved out of sqlite
+# and one from after compares the two.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use PennMUSH;
+
+my ($players, $runs) = (500, 200);
+my ($host, $port) = ("localhost", 0);
+GetOptions "players=i" => \$players,
+    "runs=i" => \$runs,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "function_invocation_limit" => 10000000,
+                         "queue_entry_cpu_time" => 100000);
+my $god = $mush->loginGod;
+
+for (my $made = 0; $made < $players; $made += 100) {
+  my $n = $players - $made < 100 ? $players - $made : 100;
+  $god->command("think iter(lnum($n),[setq(0,pcreate(Bench[add($made,##)],"
+                . 'bench))][mailsend(%q0,Hello/Just checking.)])');
+}
+
+$god->command('think set(me,PLAYERS:[lsearch(all,type,player)])');
+my $mail = $god->command('think lmath(add,iter(v(PLAYERS),mail(##)))');
+die "Expected $players messages, not $mail" unless $mail == $players;
+
+my $result = $god->command("think benchmark(iter(v(PLAYERS),mail(##)),$runs)");
+$result =~ /Average: ([\d.]+)/ or die "Unexpected benchmark result: $result\n";
+printf "%d players: %.3f us per mail count\n", $players, $1 / ($players + 1);
@@ -0,0 +1,71 @@
+#!/usr/bin/perl
+
+# Times queueing commands, with queue counts kept only in memory and
+# with queue_sql_mirror copying them into the internal sqlite objects
+# table as well, which is what every queued command used to cost. Not
+# part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchqueue.pl [--entries 20000] [--runs 5]
+#
+# God triggers an action list that queues --entries empty commands
+# with @dolist and then queues one more that says it's done. The
+# wall-clock time from sending @trigger until that arrives is measured,
+# less the time for an action list that queues only the last one. The
+# result is the best of --runs for each setting, in nanoseconds per
+# entry queued and run.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use Time::HiRes qw(time);
+use PennMUSH;
+
+my ($entries, $runs) = (20000, 5);
+my ($host, $port) = ("localhost", 0);
+GetOptions "entries=i" => \$entries,
+    "runs=i" => \$runs,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+# A big queue_chunk so the time is spent on queue entries rather
+# than on trips around the main loop, and no allocation tracking.
+# There can't be more than 32768 queue entries at once.
+my $mush = PennMUSH->new($host, $port, 0,
+                         "player_queue_limit" => 100000,
+                         "queue_chunk" => 1000,
+                         "mem_check" => "no");
+my $god = $mush->loginGod;
+
+# lnum() can only make about a thousand numbers at a time.
+my $batches = int(($entries + 999) / 1000);
+$entries = $batches * 1000;
+$god->command('&QUEUE me=' . ('@dolist lnum(1000)=@@;' x $batches)
+              . '@force me=@pemit me=Queued.');
+$god->command('&EMPTY me=@force me=@pemit me=Queued.');
+
+# Best wall-clock time for an action list to run.
+sub best {
+  my $attr = shift;
+  my $best;
+  foreach my $run (1..$runs) {
+    my $start = time;
+    my $result = $god->command("\@trigger me/$attr");
+    $result = $god->noise . $result;
+    $god->read_to_pattern('Queued\.') unless $result =~ /Queued\./;
+    my $elapsed = time - $start;
+    $best = $elapsed if !defined $best || $elapsed < $best;
+  }
+  return $best;
+}
+
+foreach my $mirror ("no", "yes") {
+  $god->command("\@config/set queue_sql_mirror=$mirror");
+  my $set = $god->command("think config(queue_sql_mirror)");
+  die "Unable to set queue_sql_mirror\n" unless $set =~ /^$mirror\s*$/mi;
+  my $elapsed = best("QUEUE") - best("EMPTY");
+  printf "queue_sql_mirror=%-3s %7.0f ns per entry\n", $mirror,
+    $elapsed * 1e9 / $entries;
+}
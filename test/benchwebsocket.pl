@@ -0,0 +1,197 @@
+#!/usr/bin/perl
+
+# Measures how much permessage-deflate saves a websocket client. Not
+# part of alltests.sh.
+#
+# From the test subdirectory, after building:
+#
+#    $ perl benchwebsocket.pl [--players 50] [--runs 20]
+#
+# God's location gets a long description full of color, and --players
+# other players are connected, so WHO is long. Then God connects over
+# a websocket three times: without compression, with permessage-deflate,
+# and with permessage-deflate but no context takeover. Each time, God
+# looks, uses WHO, and is sent some JSON and HTML, --runs times. The
+# result is the bytes each connection received for that and the
+# payload they came to, and the same for what it sent.
+
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use IO::Socket::IP;
+use Compress::Raw::Zlib;
+use PennMUSH;
+
+my ($players, $runs) = (50, 20);
+my ($host, $port) = ("localhost", 0);
+GetOptions "players=i" => \$players,
+    "runs=i" => \$runs,
+    "host=s" => \$host,
+    "port=i" => \$port;
+
+my $mush = PennMUSH->new($host, $port, 0,
+                         "max_logins" => $players + 10,
+                         "use_dns" => "no");
+my $god = $mush->loginGod;
+
+$god->command('@desc here=[iter(lnum(30),[ansi(hc,Lanterns)] '
+              . '[ansi(y,sway over)] [ansi(+orange,the crowded)] '
+              . '[ansi(g,market)] [ansi(hb,stalls)] [ansi(r,and the)] '
+              . '[ansi(m,smell of)] [ansi(+gold,spice)] fills row ##.,,%r)]');
+$god->command('@pcreate BenchFiller=bench');
+my @fillers;
+foreach my $n (1..$players) {
+  my $sock = IO::Socket::IP->new(PeerHost => "127.0.0.1",
+                                 PeerPort => $mush->{PORT},
+                                 Proto => "tcp")
+    or die "Unable to open connection $n: $!\n";
+  $sock->sysread(my $screen, 8192);
+  $sock->print("connect BenchFiller bench\r\n");
+  push @fillers, $sock;
+}
+
+# One websocket connection, offering the given Sec-WebSocket-Extensions
+# value if any. It keeps count of the bytes it reads off the socket and
+# the payload they decompress to, and the same for what it sends.
+sub open_ws {
+  my $offer = shift;
+  my $c = {wire => 0, text => "", sent => 0, plain => 0, buf => ""};
+  $c->{sock} = IO::Socket::IP->new(PeerHost => "127.0.0.1",
+                                   PeerPort => $mush->{PORT},
+                                   Proto => "tcp")
+    or die "Unable to connect: $!\n";
+  my $request = "GET /wsclient HTTP/1.1\r\n"
+    . "Host: localhost\r\n"
+    . "Upgrade: websocket\r\n"
+    . "Connection: Upgrade\r\n"
+    . "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    . "Sec-WebSocket-Version: 13\r\n";
+  $request .= "Sec-WebSocket-Extensions: $offer\r\n" if $offer;
+  syswrite $c->{sock}, "$request\r\n";
+
+  my $response = "";
+  while ($response !~ /\r\n\r\n/) {
+    sysread $c->{sock}, my $data, 65536 or die "Connection closed\n";
+    $response .= $data;
+  }
+  $response =~ s/^.*?(HTTP\/1\.1 101)/$1/s
+    or die "Websocket handshake failed:\n$response\n";
+  ($response, $c->{buf}) = split /\r\n\r\n/, $response, 2;
+  if ($response =~ /^Sec-WebSocket-Extensions: *permessage-deflate(.*?)\r?$/mi) {
+    my $params = $1;
+    $c->{inflate} =
+      Compress::Raw::Zlib::Inflate->new(-WindowBits => -MAX_WBITS,
+                                        -AppendOutput => 1);
+    $c->{deflate} =
+      Compress::Raw::Zlib::Deflate->new(-WindowBits => -MAX_WBITS,
+                                        -AppendOutput => 1);
+    $c->{reset} = $params =~ /client_no_context_takeover/;
+  }
+  return $c;
+}
+
+# Send a line of input as a masked text frame on the text channel.
+sub send_line {
+  my ($c, $line) = @_;
+  my $payload = "t$line\n";
+  my $head = 0x81;
+  $c->{plain} += length $payload;
+  if ($c->{deflate}) {
+    my $out = "";
+    $c->{deflate}->deflate($payload, $out);
+    $c->{deflate}->flush($out, Z_SYNC_FLUSH);
+    $c->{deflate}->deflateReset() if $c->{reset};
+    substr($out, -4) = "";
+    $payload = $out;
+    $head |= 0x40;
+  }
+  my $len = length $payload;
+  my $frame = chr($head);
+  if ($len < 126) {
+    $frame .= chr(0x80 | $len);
+  } else {
+    $frame .= chr(0x80 | 126) . pack("n", $len);
+  }
+  my $mask = pack("N", int(rand(2**32)));
+  $frame .= $mask . ($payload ^ (substr($mask x (int($len / 4) + 1), 0, $len)));
+  $c->{sent} += length $frame;
+  syswrite $c->{sock}, $frame;
+}
+
+# Take any whole frames off the read buffer, decompressing them as
+# needed, and add their payload (minus channel bytes) to the text.
+sub take_frames {
+  my $c = shift;
+  while (length($c->{buf}) >= 2) {
+    my ($head, $len) = unpack("CC", $c->{buf});
+    my $at = 2;
+    if ($len == 126) {
+      return if length($c->{buf}) < 4;
+      $len = unpack("n", substr($c->{buf}, 2, 2));
+      $at = 4;
+    } elsif ($len == 127) {
+      return if length($c->{buf}) < 10;
+      $len = unpack("Q>", substr($c->{buf}, 2, 8));
+      $at = 10;
+    }
+    return if length($c->{buf}) < $at + $len;
+    my $payload = substr($c->{buf}, $at, $len);
+    substr($c->{buf}, 0, $at + $len) = "";
+    if ($head & 0x40) {
+      my $out = "";
+      my $in = $payload . "\x00\x00\xff\xff";
+      my $status = $c->{inflate}->inflate($in, $out);
+      die "Inflate failed: $status\n" if $status != Z_OK;
+      $payload = $out;
+    }
+    $c->{text} .= substr($payload, 1);
+  }
+}
+
+sub read_until {
+  my ($c, $pattern) = @_;
+  my $text = 0;
+  take_frames($c);
+  while ($c->{text} !~ /$pattern/) {
+    my $got = sysread $c->{sock}, my $data, 65536;
+    die "Connection closed\n" unless $got;
+    $c->{wire} += $got;
+    $c->{buf} .= $data;
+    my $before = length $c->{text};
+    take_frames($c);
+    $text += length($c->{text}) - $before;
+  }
+  $c->{text} = "";
+  return $text;
+}
+
+foreach my $mode (["Uncompressed", ""],
+                  ["Deflate", "permessage-deflate; client_max_window_bits"],
+                  ["No takeover", "permessage-deflate; "
+                   . "server_no_context_takeover; client_no_context_takeover"])
+{
+  my ($name, $offer) = @$mode;
+  my $c = open_ws($offer);
+  die "permessage-deflate was not negotiated\n" if $offer && !$c->{inflate};
+  send_line($c, "connect One one");
+  send_line($c, "think Ready.");
+  read_until($c, qr/Ready\./);
+  @$c{qw(wire plain sent)} = (0, 0, 0);
+  my $text = 0;
+  foreach my $n (1..$runs) {
+    send_line($c, "look");
+    send_line($c, "WHO");
+    send_line($c, "think websocket_json(json(object,hp,json(number,$n),"
+              . "room,json(string,Market),exits,json(array,"
+              . "json(string,North),json(string,South))))");
+    send_line($c, "think websocket_html(<div class=\"status\">"
+              . "<span class=\"hp\">$n</span><span class=\"room\">"
+              . "Market</span></div>)");
+    send_line($c, "think Done $n.");
+    $text += read_until($c, qr/Done $n\./);
+  }
+  printf "%-12s received %9d bytes for %9d of payload, sent %6d for %6d\n",
+    $name, $c->{wire}, $text, $c->{sent}, $c->{plain};
+  close $c->{sock};
+}
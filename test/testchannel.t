@@ -0,0 +1,20 @@
+# Channel name matching: exact, partial, ambiguous, and after renames
+# and deletes.
+
+run tests:
+test('channel.1', $god, '@channel/add Alpha', "Channel <Alpha> created");
+test('channel.2', $god, '@channel/add AlphaBeta', "Channel <AlphaBeta> created");
+test('channel.3', $god, '@channel/add Gamma', "Channel <Gamma> created");
+test('channel.4', $god, 'think cowner(alpha)', '^#1');
+test('channel.5', $god, 'think cowner(alph)', '^#-2 AMBIGUOUS CHANNEL NAME');
+test('channel.6', $god, 'think cowner(gam)', '^#1');
+test('channel.7', $god, 'think cowner(<Gamma>)', '^#1');
+test('channel.8', $god, 'think cowner(delta)', '^#-1 NO SUCH CHANNEL');
+test('channel.9', $god, '@channel/rename Gamma=Delta', "Channel renamed");
+test('channel.10', $god, 'think cowner(gam)', '^#-1 NO SUCH CHANNEL');
+test('channel.11', $god, 'think cowner(del)', '^#1');
+test('channel.12', $god, '@channel/add delta', "needs a more unique name");
+test('channel.13', $god, '@channel/delete Delta', "Channel removed");
+test('channel.14', $god, 'think cowner(del)', '^#-1 NO SUCH CHANNEL');
+test('channel.15', $god, '@channel/off alphab', "not on channel <AlphaBeta>");
+test('channel.16', $god, 'think channels()', '^Alpha AlphaBeta');
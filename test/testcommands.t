@@ -0,0 +1,34 @@
+run tests:
+# $-commands are found through an index of literal prefixes, which has
+# to notice every change to them.
+test('commands.1', $god, '@create Cmdobj', 'Created');
+test('commands.2', $god, '@set Cmdobj=!no_command', 'reset');
+test('commands.3', $god, '&CMD Cmdobj=$xyzzy *:@pemit %#=plugh %0', 'Set');
+test('commands.4', $god, 'xyzzy one', '^plugh one');
+test('commands.5', $god, 'XYZZY two', '^plugh two');
+test('commands.6', $god, 'xyzz three', 'Huh\?');
+test('commands.7', $god, '&CMD Cmdobj=$frotz *:@pemit %#=plover %0', 'Set');
+test('commands.8', $god, 'xyzzy four', 'Huh\?');
+test('commands.9', $god, 'frotz five', '^plover five');
+test('commands.10', $god, '&CMD Cmdobj', 'Cleared');
+test('commands.11', $god, 'frotz six', 'Huh\?');
+test('commands.12', $god, '&CMD Cmdobj=$^fr(o+)tz$:@pemit %#=regexp %1', 'Set');
+test('commands.13', $god, '@set Cmdobj/CMD=regexp', 'set');
+test('commands.14', $god, 'froootz', '^regexp ooo');
+test('commands.15', $god, '@set Cmdobj/CMD=!regexp', 'reset');
+test('commands.16', $god, 'froootz', 'Huh\?');
+test('commands.17', $god, '&CMD Cmdobj=$a\*b *:@pemit %#=star %0', 'Set');
+test('commands.18', $god, 'a*b seven', '^star seven');
+test('commands.19', $god, 'axb eight', 'Huh\?');
+# Commands on parents and in the master room
+test('commands.20', $god, 'think set(me,CMDPARENT:[create(Cmdparent)])', 'Created');
+test('commands.21', $god, '@set [v(CMDPARENT)]=!no_command', 'reset');
+test('commands.22', $god, '&PCMD [v(CMDPARENT)]=$wibble:@pemit %#=parent', 'Set');
+test('commands.23', $god, '@tel [v(CMDPARENT)]=[dig(Cmdroom)]', 'created');
+test('commands.24', $god, 'wibble', 'Huh\?');
+test('commands.25', $god, '@parent Cmdobj=[v(CMDPARENT)]', 'Parent changed');
+test('commands.26', $god, 'wibble', '^parent');
+test('commands.27', $god, '@parent Cmdobj', 'Parent changed');
+test('commands.28', $god, 'wibble', 'Huh\?');
+test('commands.29', $god, '@tel [v(CMDPARENT)]=#2', 'Teleported');
+test('commands.30', $god, 'wibble', '^parent');
@@ -0,0 +1,22 @@
+# @function, and which function a name calls after adds, overrides,
+# deletes and restores.
+
+run tests:
+test('function.1', $god, '@create FunObj', "Created");
+test('function.2', $god, '&FN_ONE FunObj=one:%0', "Set");
+test('function.3', $god, '@function mytestfn=FunObj, FN_ONE', "Function added");
+test('function.4', $god, 'think [mytestfn(a)] [MyTestFn(b)]', '^one:a one:b');
+test('function.5', $god, '@function/delete mytestfn', "Function deleted");
+test('function.6', $god, 'think [mytestfn(a)]', 'FUNCTION \(MYTESTFN\) NOT FOUND');
+test('function.7', $god, '&FN_LEN FunObj=mylen:%0', "Set");
+test('function.8', $god, 'think strlen(abc)', '^3');
+test('function.9', $god, '@function/delete strlen', "Function deleted");
+test('function.10', $god, 'think [strlen(abc)]', 'FUNCTION \(STRLEN\) NOT FOUND');
+test('function.11', $god, '@function strlen=FunObj, FN_LEN', "Function added");
+test('function.12', $god, 'think strlen(abc)', '^mylen:abc');
+test('function.13', $god, '@function/restore strlen', "Restored");
+test('function.14', $god, 'think strlen(abc)', '^3');
+test('function.15', $god, '@function/alias strlen=mystrlen', "Alias added");
+test('function.16', $god, 'think mystrlen(abcd)', '^4');
+test('function.17', $god, '@function/delete mystrlen', "Function alias deleted");
+test('function.18', $god, 'think [mystrlen(abcd)]', 'FUNCTION \(MYSTRLEN\) NOT FOUND');
@@ -0,0 +1,12 @@
+# Per-owner run queues, and what happens to them when a dbref is recycled.
+
+run tests:
+test('ownerqueue.1', $god, '@pcreate Qown=qownpass', "New player 'Qown'");
+test('ownerqueue.2', $god, 'think set(me,QOWN:[pmatch(Qown)])', 'Set\.');
+test('ownerqueue.3', $god, '@force *Qown=think queued', '');
+test('ownerqueue.4', $god, '@ps/all', 'Qown\(#\d+[^)]*\): 1 run');
+test('ownerqueue.5', $god, '@nuke *Qown', 'scheduled to be destroyed');
+test('ownerqueue.6', $god, '@nuke *Qown', 'Destroyed\.');
+test('ownerqueue.7', $god, '@pcreate Qnew=qnewpass', "New player 'Qnew'");
+test('ownerqueue.8', $god, 'think strmatch(pmatch(Qnew),v(QOWN))', '^1$');
+test('ownerqueue.9', $god, '@ps/all', '!Qnew\(#\d+[^)]*\): \d+ run');
@@ -0,0 +1,16 @@
+# Player name lookups: names, aliases and renames.
+
+run tests:
+test('playerlist.1', $god, '@pcreate Plyr=plyrpass', "New player 'Plyr'");
+test('playerlist.2', $god, 'think pmatch(plyr)', '^#\d+');
+test('playerlist.3', $god, 'think pmatch(PLYR)', '^#\d+');
+test('playerlist.4', $god, '@alias *Plyr=PlyrAlias;PlyrOther', 'Alias set');
+test('playerlist.5', $god, 'think [pmatch(plyralias)] [pmatch(plyrother)]', '^#\d+ #\d+');
+test('playerlist.6', $god, '@name *Plyr=Rylp', 'Name set');
+test('playerlist.7', $god, 'think pmatch(plyr)', 'No match\.\s+#-1');
+test('playerlist.8', $god, 'think [pmatch(rylp)] [pmatch(plyralias)]', '^#\d+ #\d+');
+test('playerlist.9', $god, '@alias *Rylp', 'Alias removed');
+test('playerlist.10', $god, 'think pmatch(plyralias)', 'No match\.\s+#-1');
+test('playerlist.11', $god, '@pcreate PlyrAlias=plyrpass', "New player 'PlyrAlias'");
+test('playerlist.12', $god, '@name *Rylp=Plyr', 'Name set');
+test('playerlist.13', $god, 'think [pmatch(plyr)] [pmatch(rylp)]', 'No match\.\s+#\d+ #-1');
@@ -0,0 +1,58 @@
+# @mapsql/async against a stand-in postgresql server. See FakePostgres.pm
+# for the queries it understands.
+
+run tests:
+require FakePostgres;
+my $pg = FakePostgres->new;
+$god->command('@config/set sql_platform=postgresql');
+$god->command('@config/set sql_host=127.0.0.1:' . $pg->port);
+$god->command('@config/set sql_database=mush');
+$god->command('@config/set sql_username=mush');
+$god->command('@config/set sql_password=mush');
+$god->command('&ROW me=&GOT me=[v(GOT)]%0:%1.');
+
+# Only games built with postgresql support can run these.
+if ($god->command("think sql(SELECT 'probe')") !~ /^probe/) {
+  $god->command('@config/set sql_platform=disabled');
+  return;
+}
+
+# Both ways of running a query use the last result of several.
+test('sqlasync.1', $god, "think sql(UPDATE t SET x = 1; SELECT 'sync')",
+     '^sync$');
+$god->command("\@mapsql/async me/ROW=UPDATE t SET x = 1; SELECT 'async'");
+sleep 1;
+test('sqlasync.2', $god, 'think v(GOT)', '^1:async\.$');
+test('sqlasync.3', $god, "\@mapsql me/ROW=SELECT 'x'; UPDATE t SET x = 1",
+     'SQL: 2 rows affected\.');
+$god->command("\@mapsql/async me/ROW=SELECT 'x'; UPDATE t SET x = 1");
+sleep 1;
+test('sqlasync.4', $god, undef, 'SQL: 2 rows affected\.');
+
+# An error in any of them is reported.
+test('sqlasync.5', $god, "\@mapsql me/ROW=SELECT 'x'; bogus", 'SQL: Error: ');
+$god->command("\@mapsql/async me/ROW=SELECT 'x'; bogus");
+sleep 1;
+test('sqlasync.6', $god, undef, 'SQL: Error: .*syntax error at or near "bogus"');
+
+# The game doesn't wait on a slow query.
+$god->command('&GOT me');
+my $start = time;
+$god->command('@mapsql/async me/ROW=SELECT pg_sleep(3)');
+$god->command('think not waiting');
+test('sqlasync.7', $god, 'think ' . (time - $start < 2 ? 'quick' : 'blocked'),
+     '^quick$');
+test('sqlasync.8', $god, 'think v(GOT)', '^$');
+sleep 4;
+test('sqlasync.9', $god, 'think v(GOT)', '^1:\.$');
+
+# Losing the connection under a query fails only that query.
+$god->command('&GOT me');
+$god->command('@mapsql/async me/ROW=SELECT pg_terminate_backend(1)');
+sleep 1;
+test('sqlasync.10', $god, undef, 'SQL: Error: ');
+$god->command("\@mapsql/async me/ROW=SELECT 'again'");
+sleep 1;
+test('sqlasync.11', $god, 'think v(GOT)', '^1:again\.$');
+
+$god->command('@config/set sql_platform=disabled');